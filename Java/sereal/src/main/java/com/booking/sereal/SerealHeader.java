@@ -49,13 +49,14 @@ public interface SerealHeader {
   byte SRL_HDR_REGEXP            = (byte)  49; /*  49 0x31 0b00110001 <PATTERN-STR-TAG> <MODIFIERS-STR-TAG> */
   byte SRL_HDR_OBJECT_FREEZE     = (byte)  50; /*  50 0x32 0b00110010 <STR-TAG> <ITEM-TAG> - class, object-item. Need to call "THAW" method on class after decoding */
   byte SRL_HDR_OBJECTV_FREEZE    = (byte)  51; /*  51 0x33 0b00110011 <OFFSET-VARINT> <ITEM-TAG> - (OBJECTV_FREEZE is to OBJECT_FREEZE as OBJECTV is to OBJECT) */
-  byte SRL_HDR_RESERVED          = (byte)  52; /*  52 0x34 0b00110100 reserved */
-  byte SRL_HDR_RESERVED_LOW      = (byte)  52; /*  52 0x34 0b00110100 reserved */
+  byte SRL_HDR_RECORDS           = (byte)  52; /*  52 0x34 0b00110100 <COUNT-VARINT> <NKEYS-VARINT> [<KEY-TAG> ...] [<ITEM-TAG> ...] - array of count hashes with the same keys, values stored column by column */
+  byte SRL_HDR_RESERVED          = (byte)  53; /*  53 0x35 0b00110101 reserved */
+  byte SRL_HDR_RESERVED_LOW      = (byte)  53; /*  53 0x35 0b00110101 reserved */
   byte SRL_HDR_RESERVED_HIGH     = (byte)  56; /*  56 0x38 0b00111000 reserved */
   byte SRL_HDR_CANONICAL_UNDEF   = (byte)  57; /*  57 0x39 0b00111001 undef (PL_sv_undef) - "the" Perl undef (see notes) */
   byte SRL_HDR_FALSE             = (byte)  58; /*  58 0x3a 0b00111010 false (PL_sv_no) */
   byte SRL_HDR_TRUE              = (byte)  59; /*  59 0x3b 0b00111011 true  (PL_sv_yes) */
-  byte SRL_HDR_MANY              = (byte)  60; /*  60 0x3c 0b00111100 <LEN-VARINT> <TYPE-BYTE> <TAG-DATA> - repeated tag (not done yet, will be implemented in version 3) */
+  byte SRL_HDR_MANY              = (byte)  60; /*  60 0x3c 0b00111100 <COUNT-VARINT> <TYPE-TAG> [<ITEM-DATA> ...] - packed array of count numbers of the same type, stored without their tags */
   byte SRL_HDR_PACKET_START      = (byte)  61; /*  61 0x3d 0b00111101 (first byte of magic string in header) */
   byte SRL_HDR_EXTEND            = (byte)  62; /*  62 0x3e 0b00111110 <BYTE> - for additional tags */
   byte SRL_HDR_PAD               = (byte)  63; /*  63 0x3f 0b00111111 (ignored tag, skip to next byte) */
@@ -343,6 +343,12 @@ BOOT:
         SRL_INIT_OPTION( SRL_DEC_OPT_IDX_USE_UNDEF,                  SRL_DEC_OPT_STR_USE_UNDEF                  );
         SRL_INIT_OPTION( SRL_DEC_OPT_IDX_VALIDATE_UTF8,              SRL_DEC_OPT_STR_VALIDATE_UTF8              );
         SRL_INIT_OPTION( SRL_DEC_OPT_IDX_REFUSE_ZSTD,                SRL_DEC_OPT_STR_REFUSE_ZSTD                );
+        SRL_INIT_OPTION( SRL_DEC_OPT_IDX_DECOMPRESS_BUFFER_HIGH_WATER, SRL_DEC_OPT_STR_DECOMPRESS_BUFFER_HIGH_WATER );
+        SRL_INIT_OPTION( SRL_DEC_OPT_IDX_ZSTD_DICTIONARIES,          SRL_DEC_OPT_STR_ZSTD_DICTIONARIES          );
+        SRL_INIT_OPTION( SRL_DEC_OPT_IDX_ZERO_COPY_STRINGS_OVER,     SRL_DEC_OPT_STR_ZERO_COPY_STRINGS_OVER     );
+        SRL_INIT_OPTION( SRL_DEC_OPT_IDX_REGEXP_CACHE_SIZE,          SRL_DEC_OPT_STR_REGEXP_CACHE_SIZE          );
+        SRL_INIT_OPTION( SRL_DEC_OPT_IDX_SELECT_PATHS,               SRL_DEC_OPT_STR_SELECT_PATHS               );
+        SRL_INIT_OPTION( SRL_DEC_OPT_IDX_STATS,                      SRL_DEC_OPT_STR_STATS                      );
     }
 #if USE_CUSTOM_OPS
     {
@@ -521,6 +527,41 @@ decode_sereal_with_header_data(src, opt = NULL, body_into = NULL, header_into =
     av_store(RETVAL, 1, SvREFCNT_inc(body_into));
   OUTPUT: RETVAL
 
+UV
+validate_sereal(src, opt = NULL)
+    SV *src;
+    SV *opt;
+  PREINIT:
+    dMY_CXT;
+    srl_decoder_t *dec= NULL;
+  CODE:
+    if (SvROK(src))
+        croak("We can't decode a reference as Sereal!");
+    /* Support no opt at all, undef, hashref */
+    if (opt != NULL) {
+        SvGETMAGIC(opt);
+        if (!SvOK(opt))
+            opt = NULL;
+        else if (SvROK(opt) && SvTYPE(SvRV(opt)) == SVt_PVHV)
+            opt = (SV *)SvRV(opt);
+        else
+            croak("Options are neither undef nor hash reference");
+    }
+    dec = srl_build_decoder_struct(aTHX_ (HV *)opt, MY_CXT.options);
+    RETVAL = srl_validate_document(aTHX_ dec, src, 0);
+  OUTPUT: RETVAL
+
+UV
+validate(dec, src, offset = 0)
+    srl_decoder_t *dec;
+    SV *src;
+    UV offset;
+  CODE:
+    if (SvROK(src))
+        croak("We can't decode a reference as Sereal!");
+    RETVAL = srl_validate_document(aTHX_ dec, src, offset);
+  OUTPUT: RETVAL
+
 UV
 bytes_consumed(dec)
     srl_decoder_t *dec;
@@ -528,6 +569,42 @@ bytes_consumed(dec)
     RETVAL = dec->bytes_consumed;
   OUTPUT: RETVAL
 
+HV *
+regexp_cache_stats(dec)
+    srl_decoder_t *dec;
+  PREINIT:
+    srl_regexp_cache_t *cache;
+  CODE:
+    cache = dec->regexp_cache;
+    RETVAL = newHV();
+    sv_2mortal((SV *)RETVAL);
+    hv_stores(RETVAL, "max_entries", newSVuv(dec->regexp_cache_size));
+    hv_stores(RETVAL, "entries",     newSVuv(cache ? cache->entries   : 0));
+    hv_stores(RETVAL, "hits",        newSVuv(cache ? cache->hits      : 0));
+    hv_stores(RETVAL, "misses",      newSVuv(cache ? cache->misses    : 0));
+    hv_stores(RETVAL, "evictions",   newSVuv(cache ? cache->evictions : 0));
+  OUTPUT: RETVAL
+
+SV *
+stats(dec)
+    srl_decoder_t *dec;
+  PREINIT:
+    HV *hv;
+  CODE:
+    if (dec->stats == NULL)
+      XSRETURN_UNDEF;
+    hv = newHV();
+    RETVAL = newRV_noinc((SV *)hv);
+    srl_decoder_stats(aTHX_ dec, hv);
+  OUTPUT: RETVAL
+
+void
+reset_stats(dec)
+    srl_decoder_t *dec;
+  CODE:
+    if (dec->stats != NULL)
+      srl_decoder_reset_stats(aTHX_ dec);
+
 U32
 flags(dec)
     srl_decoder_t *dec;
@@ -540,3 +617,39 @@ regexp_internals_type()
   CODE:
     RETVAL = newSVpvs(REGEXP_TYPE);
   OUTPUT: RETVAL
+
+MODULE = Sereal::Decoder        PACKAGE = Sereal::Decoder::Reader
+
+srl_decoder_reader_t *
+new(CLASS, dec, fh, read_size = 0)
+    char *CLASS;
+    srl_decoder_t *dec;
+    SV *fh;
+    UV read_size;
+  CODE:
+    RETVAL = srl_build_decoder_reader(aTHX_ dec, fh, (STRLEN)read_size);
+  OUTPUT: RETVAL
+
+void
+DESTROY(rdr)
+    srl_decoder_reader_t *rdr;
+  CODE:
+    srl_destroy_decoder_reader(aTHX_ rdr);
+
+void
+next(rdr, into = NULL)
+    srl_decoder_reader_t *rdr;
+    SV *into;
+  PPCODE:
+    into = srl_decoder_reader_next(aTHX_ rdr, into);
+    if (into == NULL)
+        XSRETURN_EMPTY;
+    ST(0) = into;
+    XSRETURN(1);
+
+UV
+offset(rdr)
+    srl_decoder_reader_t *rdr;
+  CODE:
+    RETVAL = rdr->offset;
+  OUTPUT: RETVAL
@@ -25,6 +25,7 @@ our @EXPORT_OK= qw(
     sereal_decode_only_header_with_offset_with_object
     sereal_decode_with_header_and_offset_with_object
     sereal_decode_with_offset_with_object
+    validate_sereal
 );
 our %EXPORT_TAGS= ( all => \@EXPORT_OK );
 
@@ -127,19 +128,31 @@ use constant #begin generated
 sub decode_from_file {
     my ( $self, $file, )= @_;    # pos 3 is "target var" if one is provided
     $self= $self->new() unless ref $self;
-    open my $fh, "<", $file
-        or die "Failed to open '$file' for read: $!";
-    my $buf= do { local $/; <$fh> };
-    close $fh
-        or die "Failed to close '$file': $!";
+    my $reader= $self->reader($file);
+    my @ret;
     if ( wantarray && ( $self->flags & SRL_F_DECODER_DESTRUCTIVE_INCREMENTAL ) ) {
-        my @ret;
-        while ( length $buf ) {
-            push @ret, $self->decode($buf);
+        while ( my ($doc)= $reader->next ) {
+            push @ret, $doc;
         }
         return @ret;
     }
-    return $self->decode( $buf, @_ > 2 ? $_[2] : () );
+    @ret= $reader->next( @_ > 2 ? $_[2] : () )
+        or die "Failed to decode '$file': it contains no Sereal document";
+    return $ret[0];
+}
+
+sub reader {
+    my ( $self, $file, $read_size )= @_;
+    $self= $self->new() unless ref $self;
+    my $fh;
+    if ( ref $file || ref \$file eq "GLOB" ) {
+        $fh= $file;
+    }
+    else {
+        open $fh, "<:raw", $file
+            or die "Failed to open '$file' for read: $!";
+    }
+    return Sereal::Decoder::Reader->new( $self, $fh, $read_size || 0 );
 }
 
 my $flags= sub {
@@ -254,11 +267,13 @@ with any data that has been encoded by an external source (e.g. http cookies).
 
 =head3 max_recursion_depth
 
-C<Sereal::Decoder> is recursive. If you pass it a Sereal document that is deeply
-nested, it will eventually exhaust the C stack. Therefore, there is a limit on
-the depth of recursion that is accepted. It defaults to 10000 nested calls. You
-may choose to override this value with the C<max_recursion_depth> option.
-Beware that setting it too high can cause hard crashes.
+C<Sereal::Decoder> keeps track of the structures it is in the middle of
+reading on the heap rather than on the C stack, so deeply nested documents
+cannot crash it. Still, to limit the time and memory spent on a hostile
+document, there is a limit on the depth of nesting that is accepted. It
+defaults to 10000 nested structures. You may choose to override this value with
+the C<max_recursion_depth> option. Raising it is safe: each level costs a few
+dozen bytes.
 
 Do note that the setting is somewhat approximate. Setting it to 10000 may break at
 somewhere between 9997 and 10003 nested structures depending on their types.
@@ -334,6 +349,102 @@ If set to a true value then the output will be completely readonly (deeply).
 If set to a true value then scalars in the output will be readonly (deeply).
 References won't be readonly.
 
+=head3 decompress_buffer_high_water
+
+A decoder object keeps the buffer it decompresses documents into around
+between calls and only grows it when needed. If, after decoding a document,
+that buffer is larger than this many bytes (default: 16MiB), it is released
+again so that a single unusually large document does not pin its memory for
+the lifetime of the decoder. Setting it to 0 releases the buffer after every
+document.
+
+=head3 regexp_cache_size
+
+If set to a positive integer, the decoder keeps up to this many compiled
+regular expressions, keyed by their pattern and modifiers, and reuses them
+for the same patterns in later documents instead of compiling them again.
+Once the cache is full, the least recently used pattern is dropped. The
+decoded regexps share the compiled program with the cached one the same way
+the regexps from evaluating one C<qr//> repeatedly do, so they behave exactly
+like freshly compiled ones. See C<regexp_cache_stats> for how well it does.
+Default: 0, compile every regexp.
+
+The cache needs Perl 5.28 or later; the option is ignored on older perls.
+
+=head3 zero_copy_strings_over
+
+If set to a positive integer, strings at least this many bytes long are not
+copied out of the document but point into the buffer they were decoded from,
+which is kept alive for as long as any of them is. For an uncompressed
+document that is the input string itself, shared copy-on-write so that
+modifying or freeing the input afterwards doesn't affect the decoded strings;
+for a compressed one it is the buffer the document was decompressed into,
+which the decoder then doesn't reuse for the next document. This saves
+copying large strings like images or HTML fragments, and the memory for
+the copies. Default: 0, copy all strings.
+
+These strings are read-only, as modifying them in place would modify the
+shared buffer, and, like the strings of L<File::Map>, they are not followed
+by a NUL byte in memory, which matters only to XS code that treats them as C
+strings. Assigning one to another variable makes a normal copy. Note that a
+single small string that is kept around keeps the whole buffer it points
+into alive.
+
+Copy-on-write needs Perl 5.20 or later, and an input string that is neither
+read-only nor magical and whose buffer is not mostly unused. Otherwise the
+strings of uncompressed documents are copied as usual.
+
+=head3 zstd_dictionaries
+
+A zstd dictionary, or a reference to an array of them, which documents may
+have been compressed with (see the C<zstd_dictionary> option of
+L<Sereal::Encoder>). Dictionaries produced by zstd's dictionary builder carry
+an ID which is recorded in every document compressed with them, and the
+decoder picks the right one based on that. A raw content dictionary (any
+string not in zstd's dictionary format) has no ID and is used for all
+zstd-compressed documents without a dictionary ID, so pass at most one of
+those.
+
+Decoding a document compressed with a dictionary which was not given to the
+decoder is an error.
+
+=head3 select_paths
+
+A path, or a reference to an array of up to 32 paths, into the documents to
+decode. Only the parts of a document the paths go into are decoded, the rest
+is skipped over without creating any Perl values, which is a lot faster when
+only a few values of a large document are wanted:
+
+  my $decoder = Sereal::Decoder->new({
+      select_paths => [ '$.user.name', '$.items[*].id' ],
+  });
+  # { user => { name => ... }, items => [ { id => ... }, ... ] }
+  my $partial = $decoder->decode($document);
+
+The paths use the syntax of L<Sereal::Path>: C<$> is the whole document,
+C<.name> or C<[name]> a hash key (quote it as in C<['a.b']> if it contains
+any of C<.[],'">), C<[2]> an array item, with negative indexes counting
+from the end, C<[*]> or C<.*> everything, C<[a,b]> either of them, and
+C<[start:stop:step]> a slice of an array. Recursive descent (C<..>) is not
+supported.
+
+The result has the same shape as the document. A hash only has the keys that
+paths go into, and an array only the items that they go into, at their index,
+with undef for the items that are skipped before them. References and
+objects are gone through, and what a path ends at is decoded whole. A path
+that goes on into a string or number, or into something that does not exist,
+selects nothing. Values that are referred to from the selected parts, and the
+classes of objects, are decoded even if they are in the skipped parts.
+Weak references whose referent is not selected are undef. An empty array of
+paths selects nothing, and the result is undef.
+
+=head3 stats
+
+If set, the decoder keeps counters of what it read, see the C<stats>
+method. Like the C<stats> option of L<Sereal::Encoder>, this is meant for
+tuning, as the body of every document is scanned once more to count its
+tags. Disabled by default.
+
 =head1 INSTANCE METHODS
 
 =head2 decode
@@ -414,6 +525,27 @@ pass an integer offset into the input string, at which the decoding is
 to start. The optional "pass-in" style scalars (see C<decode_with_header> above)
 are relegated to being the third and fourth parameters.
 
+=head2 validate
+
+  my $length= $decoder->validate($sereal_string);
+  my $length= $decoder->validate($sereal_string, $offset);
+
+Checks that the Sereal document in the input string, starting at the
+optional offset, is well formed without decoding it, and returns its length,
+which C<bytes_consumed> returns afterwards, too. If it isn't, this dies with
+the error decoding it would die with.
+
+All of the document is checked: the lengths of strings and containers, the
+varints, the offsets of C<COPY>, C<REFP>, C<ALIAS> and C<OBJECTV> tags, and
+the options C<validate_utf8>, C<max_recursion_depth>,
+C<max_num_hash_entries> and C<refuse_objects> apply. Compressed documents
+are decompressed first, and header user data is skipped. As no values are
+created, this is several times faster than decoding, which makes it useful
+to reject malformed input before storing or queueing it. Only what takes
+decoding the values to tell is not checked: whether hashes have duplicate
+keys, whether regular expressions compile and whether C<THAW> succeeds for
+objects serialized with C<FREEZE>.
+
 =head2 bytes_consumed
 
 After using the various C<decode> methods documented previously,
@@ -452,6 +584,39 @@ following example is correct, as only the header is deserialized:
   my $count = $decoder->bytes_consumed;
   # $count is 0
 
+=head2 regexp_cache_stats
+
+    my $stats= $decoder->regexp_cache_stats;
+
+Returns a hash reference with the counters of the regexp cache (see the
+C<regexp_cache_size> option): C<hits> and C<misses> of lookups,
+C<evictions> of least recently used patterns, the number of C<entries> in
+the cache and its C<max_entries>.
+
+=head2 stats
+
+    my $stats= $decoder->stats;
+
+With the C<stats> option, returns a hash reference with the counters the
+decoder kept since it was created or since C<reset_stats> was last called,
+and undef without it. The documents decoded, validated or partly decoded
+with C<select_paths> are counted, but not those of a C<reader> (or
+C<decode_from_file>), nor those decoded by THAW methods with the same
+decoder.
+
+The counters have the same names and meaning as those of the C<stats>
+method of L<Sereal::Encoder>, so that the two can be compared:
+C<documents>, C<tags>, C<tracked>, C<copy>, C<refp>, C<alias>, C<bytes>,
+C<body_bytes>, C<compressed_documents> and C<compressed_bytes>. The time
+spent decompressing is in C<decompress_time>. C<tables> has the size and
+number of C<grows> of the tables the decoder looks things up in:
+C<tracked_items>, C<thawed_objects>, C<stashes>, C<objects> and
+C<hash_keys>.
+
+=head2 reset_stats
+
+Sets the counters of the C<stats> option back to zero.
+
 =head2 decode_from_file
 
     Sereal::Decoder->decode_from_file($file);
@@ -463,6 +628,51 @@ contained in the file and returns a list, otherwise decodes
 the first (or only) packet in the file. Accepts an optinal
 "target" variable as a second argument.
 
+The file is read with a C<reader> (see below), so it is not slurped
+into memory first.
+
+=head2 reader
+
+    my $reader= $decoder->reader($file);
+    my $reader= $decoder->reader($fh);
+    while ( my ($data)= $reader->next ) {
+        ...
+    }
+
+Returns a C<Sereal::Decoder::Reader> object which decodes the concatenated
+Sereal documents in the named file, or read from the given file handle,
+one at a time. Memory use is bounded by the size of the largest document
+(plus what it decodes to), no matter how large the file is: the input is
+read in windows of at least 64kB, and only the documents that weren't
+decoded yet are kept in memory. An optional second argument sets the
+window size in bytes.
+
+The reader uses a copy of the decoder's options, with the exception that it
+is never in destructive incremental mode. The reader's methods are:
+
+=over 4
+
+=item next
+
+Decodes the next document and returns the result. If a variable is passed
+in, decodes into that like C<decode> does. At the end of the input, returns
+the empty list (so that C<while ( my ($data)= $reader-E<gt>next )> works
+with documents that decode to false values). Dies if the input ends in
+the middle of a document. If a document fails to decode, the reader moves
+on to the next document regardless, so calling C<next> again after
+catching the exception skips the bad document.
+
+=item offset
+
+Returns the offset in the input of the next document C<next> will decode.
+
+=back
+
+To find where a document ends, the reader uses the compressed length in
+the header of compressed documents, and scans the body of uncompressed
+ones. The latter is not possible for the non-incremental Snappy
+compression of protocol version 1, so the reader refuses such documents.
+
 =head2 looks_like_sereal
 
 Performs some rudimentary check to determine if the argument
@@ -609,6 +819,12 @@ to write to. See the documentation for C<decode_with_header> above for details.
 This functional interface is significantly slower than the OO interface since
 it cannot reuse the decoder object.
 
+=head2 validate_sereal
+
+The functional interface that is equivalent to using C<new> and C<validate>.
+Expects a byte string to check as first argument, optionally followed by a
+hash reference of options (see documentation for C<new()>).
+
 =head2 scalar_looks_like_sereal
 
 The functional interface that is equivalent to using C<looks_like_sereal>.
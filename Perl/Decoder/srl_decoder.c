@@ -56,13 +56,16 @@ extern "C" {
 
 #include "srl_common.h"
 #include "ptable.h"
+#include "srl_method_cache.h"
 #include "srl_reader.h"
 #include "srl_reader_error.h"
 #include "srl_reader_varint.h"
 #include "srl_reader_misc.h"
 #include "srl_reader_decompress.h"
+#include "srl_reader_utf8.h"
 #include "srl_protocol.h"
 #include "srl_taginfo.h"
+#include "srl_stats.h"
 
 /* 5.8.8 and earlier have a nasty bug in their handling of overloading:
  * The overload-flag is set on the referer of the blessed object instead of
@@ -90,6 +93,106 @@ extern "C" {
 #  define USE_588_WORKAROUND 1
 #endif
 
+#ifndef HV_FETCH_LVALUE
+#   define OLDHASH
+#   define IS_LVALUE 1
+#   define KEYLENTYPE IV
+#else
+#   define KEYLENTYPE STRLEN
+#endif
+
+#ifndef HvRITER_set
+#   define HvRITER_set(sv,v) HvRITER(sv) = v
+#endif
+
+/* The keys of a record batch (RECORDS), see srl_read_records() */
+typedef struct {
+    const U8 *from;
+    KEYLENTYPE key_len;
+    U32 flags;
+    U32 hash;
+} srl_record_key_t;
+
+/* Nested arrays and hashes are read with a stack of frames on the heap rather
+ * than by recursing in C, see srl_read_single_value(). A frame is either a
+ * container whose items are being read, or a reference whose referent is
+ * being read, and knows what is left to do once that is complete. */
+typedef struct srl_decoder_frame {
+    union {
+        struct { SV **ptr; SV **end; } av;          /* the items left to read */
+        struct { HV *hv; UV left; } hv;             /* the number of values left to read */
+        struct {
+            AV *values;                             /* mortal, owns the values until the hashes are built */
+            SV **ptr;                               /* the next value of the column being read */
+            srl_record_key_t *keys;
+            UV nkeys;
+            UV column;
+        } records;
+        struct { HV *stash; } obj;                  /* the class of the object */
+        struct { UV left; } check;                  /* the items left to check, see srl_validate_value() */
+    } u;
+    SV *into;                                       /* what the readonly options apply to once complete */
+    U8 kind;                                        /* one of the SRL_DEC_FRAME_* below */
+    U8 is_ref;                                      /* into is a reference */
+    U32 nested;                                     /* the levels of dec->recursion_depth to restore once complete */
+} srl_decoder_frame_t;
+
+#define SRL_DEC_FRAME_ARRAY     0   /* the items of an ARRAY(REF) */
+#define SRL_DEC_FRAME_HASH      1   /* the values of a HASH(REF) */
+#define SRL_DEC_FRAME_RECORDS   2   /* the values of a RECORDS, column by column */
+#define SRL_DEC_FRAME_REFN      3   /* the referent of a REFN, or only the depth to restore, see srl_read_single_value_begin() */
+#define SRL_DEC_FRAME_WEAKEN    4   /* the reference to weaken */
+#define SRL_DEC_FRAME_OBJECT    5   /* the value of an OBJECT(V), if anything is to be done once it is read */
+#define SRL_DEC_FRAME_CHECK_ITEMS   6   /* the items of an ARRAY(REF), the values of a RECORDS or a referent, validated */
+#define SRL_DEC_FRAME_CHECK_HASH    7   /* the keys and values of a HASH(REF), validated */
+#define SRL_DEC_FRAME_CHECK_REGEXP  8   /* the pattern of a REGEXP, validated */
+
+#define srl_stack_type_t srl_decoder_frame_t
+#include "srl_stack.h"
+
+/* Initial number of frames, the stack grows as needed */
+#define SRL_DEC_FRAMES_PREALLOCATE 64
+
+/* The compiled select_paths option, see srl_read_selected(). A path is a
+ * list of steps from the top of the document down, in the syntax of
+ * Sereal::Path, and a step is one or more alternatives: a hash key or array
+ * index, a slice of an array, or anything. */
+typedef struct {
+    SV *key;                            /* the alternative as written, in UTF-8 */
+    SV *key_bytes;                      /* the same in Latin-1 for keys that aren't UTF-8, NULL if it has wide characters */
+    IV index;                           /* the array index, if is_index */
+    IV start, stop, step;               /* the slice, for SRL_SELECT_SLICE */
+    U8 type;                            /* one of the SRL_SELECT_* below */
+    U8 is_index;                        /* key is a number, which also selects that array item */
+} srl_select_alt_t;
+
+#define SRL_SELECT_ANY      0           /* * */
+#define SRL_SELECT_KEY      1           /* name or 42 */
+#define SRL_SELECT_SLICE    2           /* start:stop:step, a key like any other for hashes */
+
+typedef struct {
+    U32 first_alt;                      /* index into alts */
+    U32 nalts;
+} srl_select_step_t;
+
+typedef struct srl_select {
+    U32 refcnt;                         /* shared by the clones of a decoder */
+    U32 npaths;
+    U32 *first_step;                    /* the steps of path i are first_step[i] .. first_step[i+1]-1 */
+    srl_select_step_t *steps;
+    srl_select_alt_t *alts;
+    U32 nsteps, steps_size;
+    U32 nalts, alts_size;
+} srl_select_t;
+
+/* The paths that go on into a value are a bit mask */
+#define SRL_SELECT_MAX_PATHS 32
+
+/* How srl_select_kind() says to read a value */
+#define SRL_SELECT_SKIP     0           /* not at all */
+#define SRL_SELECT_WHOLE    1           /* completely, a path ends there */
+#define SRL_SELECT_PART     2           /* only the parts that paths go on into */
+
 /* predeclare all our subs so we have one definitive authority for their signatures */
 SRL_STATIC_INLINE SV *srl_fetch_item(pTHX_ srl_decoder_t *dec, UV item, const char * const tag_name);
 
@@ -102,20 +205,26 @@ void srl_decoder_destructor_hook(pTHX_ void *p);                    /* destructo
 /* srl_begin_decoding: set up the decoder to handle a given var */
 SRL_STATIC_INLINE srl_decoder_t *srl_begin_decoding(pTHX_ srl_decoder_t *dec, SV *src, UV start_offset);
 SRL_STATIC_INLINE void srl_read_header(pTHX_ srl_decoder_t *dec, SV *header_user_data); /* read/validate header */
-SRL_STATIC_INLINE void srl_read_single_value(pTHX_ srl_decoder_t *dec, SV* into, SV** container); /* main recursive dump routine */
+SRL_STATIC_INLINE void srl_begin_body(pTHX_ srl_decoder_t *dec, srl_decoder_t *origdec);
+static void srl_read_single_value(pTHX_ srl_decoder_t *dec, SV* into, SV** container); /* main dump routine */
 SRL_STATIC_INLINE void srl_finalize_structure(pTHX_ srl_decoder_t *dec);             /* optional finalize structure logic */
 SRL_STATIC_INLINE void srl_clear_decoder(pTHX_ srl_decoder_t *dec);                 /* clean up decoder after a dump */
 
 /* the internal routines to handle each kind of object we have to deserialize */
 SRL_STATIC_INLINE void srl_read_copy(pTHX_ srl_decoder_t *dec, SV* into);
 
-SRL_STATIC_INLINE void srl_read_hash(pTHX_ srl_decoder_t *dec, SV* into, U8 tag);
-SRL_STATIC_INLINE void srl_read_array(pTHX_ srl_decoder_t *dec, SV* into, U8 tag);
+SRL_STATIC_INLINE SV **srl_read_hash(pTHX_ srl_decoder_t *dec, SV* into, U8 tag, U32 *nested);
+static void srl_read_single_value_begin(pTHX_ srl_decoder_t *dec, SV* into, SV** container, U32 nested);
+SRL_STATIC_INLINE SV **srl_read_array(pTHX_ srl_decoder_t *dec, SV* into, U8 tag, U32 *nested);
+SRL_STATIC_INLINE void srl_set_readonly(pTHX_ srl_decoder_t *dec, SV *into, int is_ref);
+SRL_STATIC_INLINE void srl_read_many(pTHX_ srl_decoder_t *dec, SV* into);
+SRL_STATIC_INLINE SV **srl_read_records(pTHX_ srl_decoder_t *dec, SV* into);
 SRL_STATIC_INLINE void srl_read_regexp(pTHX_ srl_decoder_t *dec, SV* into);
+SRL_STATIC_INLINE void srl_regexp_cache_free(pTHX_ srl_regexp_cache_t *cache);
 
 SRL_STATIC_INLINE void srl_read_refp(pTHX_ srl_decoder_t *dec, SV* into);
-SRL_STATIC_INLINE void srl_read_refn(pTHX_ srl_decoder_t *dec, SV* into);
-SRL_STATIC_INLINE void srl_read_weaken(pTHX_ srl_decoder_t *dec, SV* into);
+SRL_STATIC_INLINE SV *srl_read_refn(pTHX_ srl_decoder_t *dec, SV* into);
+SRL_STATIC_INLINE void srl_finish_weaken(pTHX_ srl_decoder_t *dec, SV* into);
 SRL_STATIC_INLINE void srl_read_long_double(pTHX_ srl_decoder_t *dec, SV* into);
 SRL_STATIC_INLINE void srl_read_double(pTHX_ srl_decoder_t *dec, SV* into);
 SRL_STATIC_INLINE void srl_read_float(pTHX_ srl_decoder_t *dec, SV* into);
@@ -123,14 +232,19 @@ SRL_STATIC_INLINE void srl_read_string(pTHX_ srl_decoder_t *dec, int is_utf8, SV
 SRL_STATIC_INLINE void srl_read_varint_into(pTHX_ srl_decoder_t *dec, SV* into, SV** container, const U8 *track_it);
 SRL_STATIC_INLINE void srl_read_zigzag_into(pTHX_ srl_decoder_t *dec, SV* into, SV** container, const U8 *track_it);
 SRL_STATIC_INLINE void srl_read_reserved(pTHX_ srl_decoder_t *dec, U8 tag, SV* into);
-SRL_STATIC_INLINE void srl_read_object(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag, int read_class_name_only);
-SRL_STATIC_INLINE void srl_read_objectv(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag);
+SRL_STATIC_INLINE int srl_read_object(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag, int read_class_name_only);
+SRL_STATIC_INLINE int srl_read_objectv(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag);
 
 SRL_STATIC_INLINE void srl_track_sv(pTHX_ srl_decoder_t *dec, const U8 *track_pos, SV *sv);
 SRL_STATIC_INLINE void srl_read_frozen_object(pTHX_ srl_decoder_t *dec, HV *class_stash, SV *into);
 SRL_STATIC_INLINE SV * srl_follow_refp_alias_reference(pTHX_ srl_decoder_t *dec, UV offset);
 SRL_STATIC_INLINE AV * srl_follow_objectv_reference(pTHX_ srl_decoder_t *dec, UV offset);
 
+SRL_STATIC_INLINE srl_select_t *srl_select_compile(pTHX_ SV *paths);
+SRL_STATIC_INLINE void srl_select_free(pTHX_ srl_select_t *sel);
+SRL_STATIC_INLINE void srl_read_selected_body(pTHX_ srl_decoder_t *dec, SV *into);
+static void srl_read_selected(pTHX_ srl_decoder_t *dec, SV *into, SV **container, U32 mask, U32 depth);
+
 /* FIXME unimplemented!!! */
 SRL_STATIC_INLINE SV *srl_read_extend(pTHX_ srl_decoder_t *dec, SV* into);
 
@@ -205,6 +319,19 @@ S_read_varint_uv_length_char_ptr(pTHX_ const unsigned char **from, const unsigne
 
 /* PUBLIC ROUTINES */
 
+/* Allocates the stack of frames srl_read_single_value() reads with */
+SRL_STATIC_INLINE srl_stack_t *
+srl_new_frame_stack(pTHX)
+{
+    srl_stack_t *frames;
+    Newx(frames, 1, srl_stack_t);
+    if (srl_stack_init(aTHX_ frames, SRL_DEC_FRAMES_PREALLOCATE) != 0) {
+        Safefree(frames);
+        croak("Out of memory");
+    }
+    return frames;
+}
+
 /* Builds the C-level configuration and state struct.
  * Automatically freed at scope boundary. */
 srl_decoder_t *
@@ -217,8 +344,10 @@ srl_build_decoder_struct(pTHX_ HV *opt, sv_with_hash *options)
     Newxz(dec, 1, srl_decoder_t);
 
     dec->ref_seenhash = PTABLE_new();
+    dec->frames = srl_new_frame_stack(aTHX);
     dec->max_recursion_depth = DEFAULT_MAX_RECUR_DEPTH;
     dec->max_num_hash_entries = 0; /* 0 == any number */
+    dec->decompress_buffer_high_water = SRL_DEFAULT_DECOMPRESS_BUFFER_HIGH_WATER;
 
     SRL_RDR_CLEAR(&dec->buf);
     dec->pbuf = &dec->buf;
@@ -257,6 +386,49 @@ srl_build_decoder_struct(pTHX_ HV *opt, sv_with_hash *options)
         if ( val && SvTRUE(val) )
             dec->max_num_hash_entries = SvUV(val);
 
+        /* zstd dictionaries, either a single one or an array of them */
+        my_hv_fetchs(he,val,opt, SRL_DEC_OPT_IDX_ZSTD_DICTIONARIES);
+        if ( val && SvOK(val) ) {
+            AV *dicts = newAV();
+            dec->zstd_dicts.dicts = dicts;
+            if (SvROK(val) && SvTYPE(SvRV(val)) == SVt_PVAV) {
+                AV *av = (AV *) SvRV(val);
+                SSize_t i, top = av_len(av);
+                for (i = 0; i <= top; i++) {
+                    SV **svp = av_fetch(av, i, 0);
+                    if (svp == NULL || !SvOK(*svp) || SvROK(*svp))
+                        croak("The 'zstd_dictionaries' option expects a string or an array of strings");
+                    av_push(dicts, newSVsv(*svp));
+                }
+            }
+            else if (!SvROK(val)) {
+                av_push(dicts, newSVsv(val));
+            }
+            else {
+                croak("The 'zstd_dictionaries' option expects a string or an array of strings");
+            }
+        }
+
+        my_hv_fetchs(he,val,opt, SRL_DEC_OPT_IDX_DECOMPRESS_BUFFER_HIGH_WATER);
+        if ( val && SvOK(val) )
+            dec->decompress_buffer_high_water = (STRLEN) SvUV(val);
+
+        my_hv_fetchs(he,val,opt, SRL_DEC_OPT_IDX_ZERO_COPY_STRINGS_OVER);
+        if ( val && SvTRUE(val) )
+            dec->zero_copy_strings_over = (STRLEN) SvUV(val);
+
+        my_hv_fetchs(he,val,opt, SRL_DEC_OPT_IDX_REGEXP_CACHE_SIZE);
+        if ( val && SvTRUE(val) )
+            dec->regexp_cache_size = SvUV(val);
+
+        my_hv_fetchs(he,val,opt, SRL_DEC_OPT_IDX_SELECT_PATHS);
+        if ( val && SvOK(val) )
+            dec->select = srl_select_compile(aTHX_ val);
+
+        my_hv_fetchs(he,val,opt, SRL_DEC_OPT_IDX_STATS);
+        if ( val && SvTRUE(val) )
+            Newxz(dec->stats, 1, srl_stats_t);
+
         my_hv_fetchs(he,val,opt, SRL_DEC_OPT_IDX_DESTRUCTIVE_INCREMENTAL);
         if ( val && SvTRUE(val) )
             SRL_DEC_SET_OPTION(dec,SRL_F_DECODER_DESTRUCTIVE_INCREMENTAL);
@@ -336,14 +508,31 @@ srl_build_decoder_struct_alike(pTHX_ srl_decoder_t *proto)
     Newxz(dec, 1, srl_decoder_t);
 
     dec->ref_seenhash = PTABLE_new();
+    dec->frames = srl_new_frame_stack(aTHX);
     dec->max_recursion_depth = proto->max_recursion_depth;
     dec->max_num_hash_entries = proto->max_num_hash_entries;
+    dec->decompress_buffer_high_water = proto->decompress_buffer_high_water;
+    dec->zero_copy_strings_over = proto->zero_copy_strings_over;
+    dec->regexp_cache_size = proto->regexp_cache_size;
 
+    dec->alias_varint_under = proto->alias_varint_under;
+    dec->flags_readonly = proto->flags_readonly;
     if (proto->alias_cache) {
         dec->alias_cache = proto->alias_cache;
         SvREFCNT_inc(dec->alias_cache);
     }
 
+    if (proto->select) {
+        dec->select = proto->select;
+        dec->select->refcnt++;
+    }
+
+    /* share the raw dictionaries, the clone digests them on its own */
+    if (proto->zstd_dicts.dicts) {
+        dec->zstd_dicts.dicts = proto->zstd_dicts.dicts;
+        SvREFCNT_inc(dec->zstd_dicts.dicts);
+    }
+
     SRL_RDR_CLEAR(&dec->buf);
     dec->pbuf = &dec->buf;
     dec->flags = proto->flags;
@@ -357,6 +546,8 @@ void
 srl_destroy_decoder(pTHX_ srl_decoder_t *dec)
 {
     PTABLE_free(dec->ref_seenhash);
+    srl_stack_deinit(aTHX_ dec->frames);
+    Safefree(dec->frames);
     if (dec->ref_stashes) {
         PTABLE_free(dec->ref_stashes);
         PTABLE_free(dec->ref_bless_av);
@@ -367,11 +558,71 @@ srl_destroy_decoder(pTHX_ srl_decoder_t *dec)
     }
     if (dec->ref_thawhash)
         PTABLE_free(dec->ref_thawhash);
+    if (dec->ref_keyhash)
+        PTABLE_free(dec->ref_keyhash);
     if (dec->alias_cache)
         SvREFCNT_dec(dec->alias_cache);
+    srl_destroy_zstd_dctx(aTHX_ dec->zstd_dctx);
+    srl_zstd_dicts_destroy(aTHX_ &dec->zstd_dicts);
+    if (dec->string_owner)
+        SvREFCNT_dec(dec->string_owner);
+    if (dec->decompress_buf)
+        SvREFCNT_dec(dec->decompress_buf);
+    if (dec->regexp_cache)
+        srl_regexp_cache_free(aTHX_ dec->regexp_cache);
+    if (dec->thaw_cv_cache)
+        srl_method_cache_free(aTHX_ dec->thaw_cv_cache);
+    if (dec->select)
+        srl_select_free(aTHX_ dec->select);
+    Safefree(dec->stats);
     Safefree(dec);
 }
 
+void
+srl_decoder_stats(pTHX_ srl_decoder_t *dec, HV *hv)
+{
+    HV *tables = newHV();
+
+    srl_stats_fill_hv(aTHX_ dec->stats, hv, "decompress_time");
+
+    /* the tables are created when first needed and kept from then on */
+    srl_stats_table(aTHX_ tables, "tracked_items", dec->ref_seenhash->tbl_max + 1, dec->ref_seenhash->tbl_grows);
+    if (dec->ref_thawhash)
+        srl_stats_table(aTHX_ tables, "thawed_objects", dec->ref_thawhash->tbl_max + 1, dec->ref_thawhash->tbl_grows);
+    if (dec->ref_stashes) {
+        srl_stats_table(aTHX_ tables, "stashes", dec->ref_stashes->tbl_max + 1, dec->ref_stashes->tbl_grows);
+        srl_stats_table(aTHX_ tables, "objects", dec->ref_bless_av->tbl_max + 1, dec->ref_bless_av->tbl_grows);
+    }
+    if (dec->ref_keyhash)
+        srl_stats_table(aTHX_ tables, "hash_keys", dec->ref_keyhash->tbl_max + 1, dec->ref_keyhash->tbl_grows);
+    hv_stores(hv, "tables", newRV_noinc((SV *)tables));
+}
+
+void
+srl_decoder_reset_stats(pTHX_ srl_decoder_t *dec)
+{
+    Zero(dec->stats, 1, srl_stats_t);
+    dec->ref_seenhash->tbl_grows = 0;
+    if (dec->ref_thawhash)
+        dec->ref_thawhash->tbl_grows = 0;
+    if (dec->ref_stashes) {
+        dec->ref_stashes->tbl_grows = 0;
+        dec->ref_bless_av->tbl_grows = 0;
+    }
+    if (dec->ref_keyhash)
+        dec->ref_keyhash->tbl_grows = 0;
+}
+
+/* For the stats option: count the tags of the body that was just read,
+ * which started at body_start, see srl_stats_scan() */
+SRL_STATIC_INLINE void
+srl_stats_count_body(srl_decoder_t *dec, const U8 *body_start)
+{
+    UV packed = 0;
+    (void)srl_stats_scan(dec->stats, body_start, dec->buf.pos, &packed);
+    dec->stats->documents++;
+}
+
 /* This is fired when we exit the Perl pseudo-block.
  * It frees our decoder and all. Put decoder-level cleanup
  * logic here so that we can simply use croak/longjmp for
@@ -397,29 +648,24 @@ SRL_STATIC_INLINE void
 srl_decode_into_internal(pTHX_ srl_decoder_t *origdec, SV *src, SV *header_into, SV *body_into, UV start_offset)
 {
     srl_decoder_t *dec;
+    const U8 *body_start;
 
     assert(origdec != NULL);
     dec = srl_begin_decoding(aTHX_ origdec, src, start_offset);
     srl_read_header(aTHX_ dec, header_into);
-    if (expect_false( SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_DECOMPRESS_SNAPPY) )) {
-        dec->bytes_consumed = srl_decompress_body_snappy(aTHX_ dec->pbuf, dec->encoding_flags, NULL);
-        origdec->bytes_consumed = dec->bytes_consumed;
-    } else if (expect_false( SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_DECOMPRESS_ZLIB) )) {
-        dec->bytes_consumed = srl_decompress_body_zlib(aTHX_ dec->pbuf, NULL);
-        origdec->bytes_consumed = dec->bytes_consumed;
-    } else if (expect_false( SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_DECOMPRESS_ZSTD) )) {
-        dec->bytes_consumed = srl_decompress_body_zstd(aTHX_ dec->pbuf, NULL);
-        origdec->bytes_consumed = dec->bytes_consumed;
-    }
-
-    /* this function *MUST* be called right after srl_decompress* functions */
-    SRL_RDR_UPDATE_BODY_POS(dec->pbuf, dec->proto_version);
+    srl_begin_body(aTHX_ dec, origdec);
+    body_start = dec->buf.pos;
 
     /* The actual document body deserialization: */
-    srl_read_single_value(aTHX_ dec, body_into, NULL);
+    if (expect_false( dec->select != NULL ))
+        srl_read_selected_body(aTHX_ dec, body_into);
+    else
+        srl_read_single_value(aTHX_ dec, body_into, NULL);
     if (expect_false(SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_NEEDS_FINALIZE))) {
         srl_finalize_structure(aTHX_ dec);
     }
+    if (expect_false( dec->stats != NULL ))
+        srl_stats_count_body(dec, body_start);
 
     /* If we aren't reading from a decompressed buffer we have to remember the number
      * of bytes used for the user to query. */
@@ -438,6 +684,45 @@ srl_decode_into_internal(pTHX_ srl_decoder_t *origdec, SV *src, SV *header_into,
     srl_clear_decoder(aTHX_ dec);
 }
 
+/* Decompresses the body of the document whose header was just read, if
+ * need be, and sets up reading it. */
+SRL_STATIC_INLINE void
+srl_begin_body(pTHX_ srl_decoder_t *dec, srl_decoder_t *origdec)
+{
+    const STRLEN header_len = dec->buf.pos - dec->buf.start;
+    NV start_time = 0;
+
+    if (expect_false( dec->stats != NULL ))
+        start_time = srl_stats_now();
+
+    if (expect_false( SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_DECOMPRESS_SNAPPY) )) {
+        dec->bytes_consumed = srl_decompress_body_snappy(aTHX_ dec->pbuf, dec->encoding_flags, &dec->decompress_buf);
+        origdec->bytes_consumed = dec->bytes_consumed;
+    } else if (expect_false( SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_DECOMPRESS_ZLIB) )) {
+        dec->bytes_consumed = srl_decompress_body_zlib(aTHX_ dec->pbuf, &dec->decompress_buf);
+        origdec->bytes_consumed = dec->bytes_consumed;
+    } else if (expect_false( SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_DECOMPRESS_ZSTD) )) {
+        dec->bytes_consumed = srl_decompress_body_zstd(aTHX_ dec->pbuf, &dec->zstd_dctx, &dec->zstd_dicts, &dec->decompress_buf);
+        origdec->bytes_consumed = dec->bytes_consumed;
+    }
+
+    if (expect_false( dec->stats != NULL && dec->bytes_consumed )) {
+        dec->stats->compress_time += srl_stats_now() - start_time;
+        dec->stats->compressed_documents++;
+        dec->stats->compressed_bytes += dec->bytes_consumed - header_len;
+    }
+
+    /* strings in the header point into the input, those in a compressed
+     * body into the decompression buffer */
+    if (expect_false( dec->string_owner && dec->bytes_consumed )) {
+        SvREFCNT_dec(dec->string_owner);
+        dec->string_owner = NULL;
+    }
+
+    /* this function *MUST* be called right after srl_decompress* functions */
+    SRL_RDR_UPDATE_BODY_POS(dec->pbuf, dec->proto_version);
+}
+
 /* This is the main routine to deserialize just the header of a document. */
 SV *
 srl_decode_header_into(pTHX_ srl_decoder_t *origdec, SV *src, SV* header_into, UV start_offset)
@@ -489,6 +774,13 @@ srl_clear_decoder(pTHX_ srl_decoder_t *dec)
         return;
 
     srl_clear_decoder_body_state(aTHX_ dec);
+    if (dec->string_owner) {
+        SvREFCNT_dec(dec->string_owner);
+        dec->string_owner = NULL;
+    }
+    dec->string_src = NULL;
+    if (dec->decompress_buf)
+        srl_release_decompress_buffer(aTHX_ &dec->decompress_buf, dec->decompress_buffer_high_water);
     SRL_DEC_RESET_VOLATILE_FLAGS(dec);
     dec->buf.body_pos = dec->buf.start = dec->buf.end = dec->buf.pos = dec->save_pos = NULL;
 }
@@ -506,8 +798,11 @@ srl_clear_decoder_body_state(pTHX_ srl_decoder_t *dec)
         PTABLE_clear(dec->ref_stashes);
         PTABLE_clear(dec->ref_bless_av);
     }
+    if (dec->ref_keyhash)
+        PTABLE_clear(dec->ref_keyhash);
 
     dec->recursion_depth = 0;
+    srl_stack_clear(dec->frames); /* not empty if we croaked */
 }
 
 SRL_STATIC_INLINE srl_decoder_t *
@@ -549,6 +844,17 @@ srl_begin_decoding(pTHX_ srl_decoder_t *dec, SV *src, UV start_offset)
         sv_utf8_downgrade(src, 0);
     }
 
+    if (dec->zero_copy_strings_over) {
+        /* Strings may point into a copy-on-write copy of the input, which
+         * needs a spare byte at the end of the buffer for its refcount. */
+        if (SvPOK(src) && !SvTHINKFIRST(src) && SvLEN(src) && SvLEN(src) < SvCUR(src) + 2
+            && SvCUR(src) >= dec->zero_copy_strings_over)
+        {
+            SvGROW(src, SvCUR(src) + 2);
+        }
+        dec->string_src = src;
+    }
+
     tmp = (unsigned char*)SvPV(src, len);
     if (expect_false( start_offset > len )) {
         SRL_RDR_ERROR(dec->pbuf, "Start offset is beyond input string length");
@@ -757,16 +1063,24 @@ srl_track_sv(pTHX_ srl_decoder_t *dec, const U8 *track_pos, SV *sv)
 }
 
 
+/* The items that REFP, ALIAS and OBJECTV tags refer to may not have been
+ * read: Sereal::Path::Iterator decodes only parts of a document, and so does
+ * the select_paths option. Then those items are read when they are referred
+ * to, and this returns NULL for them rather than croaking. */
+#ifdef FOLLOW_REFERENCES_IF_NOT_STASHED
+#   define SRL_DEC_FOLLOW_REFERENCES(dec) 1
+#else
+#   define SRL_DEC_FOLLOW_REFERENCES(dec) ((dec)->select != NULL)
+#endif
+
 SRL_STATIC_INLINE SV *
 srl_fetch_item(pTHX_ srl_decoder_t *dec, UV item, const char * const tag_name)
 {
     SV *sv= (SV *)PTABLE_fetch(dec->ref_seenhash, (void *)item);
-#ifndef FOLLOW_REFERENCES_IF_NOT_STASHED
-    if (expect_false( !sv )) {
+    if (expect_false( !sv && !SRL_DEC_FOLLOW_REFERENCES(dec) )) {
         /*srl_ptable_debug_dump(aTHX_ dec->ref_seenhash);*/
         SRL_RDR_ERRORf2(dec->pbuf, "%s(%"UVuf") references an unknown item", tag_name, item);
     }
-#endif
     return sv;
 }
 
@@ -803,7 +1117,7 @@ srl_alias_iv(pTHX_ srl_decoder_t *dec, SV **container, const U8 *track_it, IV iv
 
 
 
-SRL_STATIC_INLINE void
+SRL_STATIC_ALWAYS_INLINE void
 srl_setiv(pTHX_ srl_decoder_t *dec, SV *into, SV **container, const U8 *track_it, IV iv)
 {
     if ( expect_false( container && IS_IV_ALIAS(dec,iv) )) {
@@ -835,7 +1149,7 @@ srl_setiv(pTHX_ srl_decoder_t *dec, SV *into, SV **container, const U8 *track_it
     }
 }
 
-SRL_STATIC_INLINE void
+SRL_STATIC_ALWAYS_INLINE void
 srl_read_varint_into(pTHX_ srl_decoder_t *dec, SV* into, SV **container, const U8 *track_it)
 {
     UV uv= srl_read_varint_uv(aTHX_ dec->pbuf);
@@ -858,23 +1172,114 @@ srl_read_zigzag_iv(pTHX_ srl_decoder_t *dec)
     return i;
 }
 
-SRL_STATIC_INLINE void
+SRL_STATIC_ALWAYS_INLINE void
 srl_read_zigzag_into(pTHX_ srl_decoder_t *dec, SV* into, SV **container, const U8 *track_it)
 {
     srl_setiv(aTHX_ dec, into, container, track_it, srl_read_zigzag_iv(aTHX_ dec));
 }
 
 
+/* Strings decoded with zero_copy_strings_over point into the buffer they
+ * were decoded from. The buffer belongs to an SV, either a copy-on-write
+ * copy of the input or the decompression buffer, which the magic keeps
+ * alive. The strings are readonly, as writing to them in place would
+ * change the buffer, and they are not NUL terminated. */
+#ifdef USE_ITHREADS
+STATIC int
+srl_zero_copy_string_dup(pTHX_ MAGIC *mg, CLONE_PARAMS *param);
+#endif
+
+STATIC MGVTBL srl_zero_copy_string_vtbl = {
+    NULL, NULL, NULL, NULL, NULL, NULL,
+#ifdef USE_ITHREADS
+    srl_zero_copy_string_dup,
+#else
+    NULL,
+#endif
+    NULL
+};
+
+#ifdef USE_ITHREADS
+/* The clone of the owner in a new thread has a copy of the buffer, make the
+ * clone of the string point into that. mg_ptr is the original string. */
+STATIC int
+srl_zero_copy_string_dup(pTHX_ MAGIC *mg, CLONE_PARAMS *param)
+{
+    SV * const old_sv = (SV *)mg->mg_ptr;
+    SV * const new_sv = (SV *)ptr_table_fetch(PL_ptr_table, old_sv);
+    const MAGIC * const old_mg = mg_findext(old_sv, PERL_MAGIC_ext, &srl_zero_copy_string_vtbl);
+    PERL_UNUSED_ARG(param);
+
+    if (new_sv && old_mg)
+        SvPV_set(new_sv, SvPVX(mg->mg_obj) + (SvPVX(old_sv) - SvPVX(old_mg->mg_obj)));
+    mg->mg_ptr = (char *)new_sv;
+    return 0;
+}
+#endif
+
+/* Makes into, a fresh SV, point at the len bytes at the current position.
+ * Returns false if the buffer can't be shared, the string has to be copied
+ * then. */
+SRL_STATIC_INLINE int
+srl_read_zero_copy_string(pTHX_ srl_decoder_t *dec, SV *into, STRLEN len)
+{
+    SV *owner = dec->string_owner;
+    MAGIC *mg;
+
+    if (owner == NULL) {
+        SV * const decompress_buf = dec->decompress_buf;
+        if (decompress_buf && (srl_reader_char_ptr)SvPVX(decompress_buf) == dec->buf.start) {
+            owner = SvREFCNT_inc_simple_NN(decompress_buf);
+        }
+        else {
+            /* If the input is modified later on, it gets a buffer of its own */
+            owner = newSV(0);
+            sv_setsv_flags(owner, dec->string_src, SV_NOSTEAL|SV_COW_SHARED_HASH_KEYS|SV_COW_OTHER_PVS);
+            if (!SvPOK(owner) || SvPVX(owner) != SvPVX(dec->string_src)) {
+                /* copied instead, so copy the strings instead */
+                SvREFCNT_dec(owner);
+                owner = &PL_sv_undef;
+            }
+        }
+        dec->string_owner = owner;
+    }
+    if (owner == &PL_sv_undef)
+        return 0;
+
+    sv_upgrade(into, SVt_PVMG);
+    SvPV_set(into, (char *)dec->buf.pos);
+    SvCUR_set(into, len);
+    SvLEN_set(into, 0);
+    SvPOK_only(into);
+    mg = sv_magicext(into, owner, PERL_MAGIC_ext, &srl_zero_copy_string_vtbl, (const char *)into, 0);
+#ifdef USE_ITHREADS
+    mg->mg_flags |= MGf_DUP;
+#else
+    PERL_UNUSED_VAR(mg);
+#endif
+    SvREADONLY_on(into);
+    return 1;
+}
+
 SRL_STATIC_INLINE void
 srl_read_string(pTHX_ srl_decoder_t *dec, int is_utf8, SV* into)
 {
     UV len= srl_read_varint_uv_length(aTHX_ dec->pbuf, " while reading string");
     if (expect_false(is_utf8 && SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_VALIDATE_UTF8))) {
         /* checks for invalid byte sequences. */
-        if (expect_false( !is_utf8_string((U8*)dec->buf.pos, len) )) {
+        if (expect_false( !srl_is_utf8_string(dec->buf.pos, len) )) {
             SRL_RDR_ERROR(dec->pbuf, "Invalid UTF8 byte sequence");
         }
     }
+    if (expect_false( dec->zero_copy_strings_over && len >= dec->zero_copy_strings_over
+                      && SvTYPE(into) == SVt_NULL )
+        && srl_read_zero_copy_string(aTHX_ dec, into, len))
+    {
+        if (is_utf8)
+            SvUTF8_on(into);
+        dec->buf.pos+= len;
+        return;
+    }
     sv_setpvn(into,(char *)dec->buf.pos,len);
     if (is_utf8) {
         SvUTF8_on(into);
@@ -897,7 +1302,7 @@ union myfloat {
  * floating point alignment.  So maybe this logic should be the other
  * way: default to strict, and do sloppy only if x86? */
 
-SRL_STATIC_INLINE void
+SRL_STATIC_ALWAYS_INLINE void
 srl_read_float(pTHX_ srl_decoder_t *dec, SV* into)
 {
     union myfloat val;
@@ -912,7 +1317,7 @@ srl_read_float(pTHX_ srl_decoder_t *dec, SV* into)
 }
 
 
-SRL_STATIC_INLINE void
+SRL_STATIC_ALWAYS_INLINE void
 srl_read_double(pTHX_ srl_decoder_t *dec, SV* into)
 {
     union myfloat val;
@@ -942,176 +1347,546 @@ srl_read_long_double(pTHX_ srl_decoder_t *dec, SV* into)
 }
 
 
-SRL_STATIC_INLINE void
-srl_read_array(pTHX_ srl_decoder_t *dec, SV *into, U8 tag) {
+/* Reads a value that contains no others, a number, string, boolean or
+ * undef, given its tag, which was just read. Returns 0 without reading
+ * anything else if the tag is not one of those. srl_read_single_value_begin()
+ * tries this before anything else, and the loops over the items of
+ * containers read items with srl_read_next_leaf() until the first that
+ * contains others, so a container of scalars never pushes a frame. */
+SRL_STATIC_ALWAYS_INLINE int
+srl_read_leaf(pTHX_ srl_decoder_t *dec, U8 tag, SV *into, SV **container, const U8 *track_it)
+{
+    STRLEN len;
+
+    switch (tag) {
+        CASE_SRL_HDR_POS:
+            srl_setiv(aTHX_ dec, into, container, track_it, (IV)tag);
+            break;
+        CASE_SRL_HDR_NEG:
+            srl_setiv(aTHX_ dec, into, container, track_it, (IV)(tag - 32));
+            break;
+        CASE_SRL_HDR_SHORT_BINARY:
+            len= (STRLEN)SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(tag);
+            SRL_RDR_ASSERT_SPACE(dec->pbuf, len, " while reading ascii string");
+            sv_setpvn(into,(char*)dec->buf.pos,len);
+            dec->buf.pos += len;
+            break;
+        case SRL_HDR_VARINT:        srl_read_varint_into(aTHX_ dec, into, container, track_it); break;
+        case SRL_HDR_ZIGZAG:        srl_read_zigzag_into(aTHX_ dec, into, container, track_it); break;
+
+        case SRL_HDR_FLOAT:         srl_read_float(aTHX_ dec, into);                  break;
+        case SRL_HDR_DOUBLE:        srl_read_double(aTHX_ dec, into);                 break;
+        case SRL_HDR_LONG_DOUBLE:   srl_read_long_double(aTHX_ dec, into);            break;
+
+        case SRL_HDR_TRUE:          sv_setsv(into, &PL_sv_yes);                       break;
+        case SRL_HDR_FALSE:         sv_setsv(into, &PL_sv_no);                        break;
+
+        case SRL_HDR_CANONICAL_UNDEF: /* fallthrough (XXX: is this right?)*/
+        case SRL_HDR_UNDEF:
+        {
+            if (container && SRL_DEC_HAVE_OPTION(dec,SRL_F_DECODER_USE_UNDEF)){
+                SvREFCNT_dec(into);
+                *container= &PL_sv_undef;
+                if ( track_it )
+                    srl_track_sv(aTHX_ dec, track_it, *container);
+                return 1;
+            } else {
+                sv_setsv(into, &PL_sv_undef);
+            }
+        }
+        break;
+
+        case SRL_HDR_BINARY:        srl_read_string(aTHX_ dec, 0, into);              break;
+        case SRL_HDR_STR_UTF8:      srl_read_string(aTHX_ dec, 1, into);              break;
+
+        default:
+            return 0;
+    }
+
+    if ( expect_false(dec->flags_readonly) )
+        srl_set_readonly(aTHX_ dec, into, 0);
+    return 1;
+}
+
+/* Reads the next item of a container into its slot if it contains no other
+ * values, see srl_read_leaf(), and otherwise leaves it to be read by
+ * srl_read_single_value_begin(). Returns whether it read it. */
+SRL_STATIC_ALWAYS_INLINE int
+srl_read_next_leaf(pTHX_ srl_decoder_t *dec, SV **slot)
+{
+    if (expect_false( SRL_RDR_DONE(dec->pbuf) ))
+        return 0;
+    if (expect_true( srl_read_leaf(aTHX_ dec, *dec->buf.pos++, *slot, slot, NULL) ))
+        return 1;
+    dec->buf.pos--;
+    return 0;
+}
+
+/* Objects are queued for blessing before what is blessed is read, so they
+ * only need a frame for the readonly options or blessing right away */
+#define SRL_DEC_OBJECT_NEEDS_FRAME(dec) (USE_588_WORKAROUND || (dec)->flags_readonly)
+
+/* Arrays, hashes and REFNs whose last value is all that is left to read only
+ * need a frame for the readonly options, otherwise the value restores their
+ * depth once it is read, see srl_read_single_value_begin() */
+#define SRL_DEC_TAIL_NEEDS_FRAME(dec) ((dec)->flags_readonly)
+
+/* Push the frame that restores the depth handed on to a value, for values
+ * that push frames of their own, which must come after it */
+#define SRL_DEC_PUSH_NESTED(dec, into, nested) STMT_START {                 \
+    if (expect_false( (nested) != 0 )) {                                    \
+        srl_push_frame(aTHX_ (dec), (into), SRL_DEC_FRAME_REFN, 0, (nested)); \
+        (nested)= 0;                                                        \
+    }                                                                       \
+} STMT_END
+
+/* Push a frame for the rest of the value being read into "into", see
+ * srl_read_single_value(). The caller fills in the details of the kind. */
+SRL_STATIC_ALWAYS_INLINE srl_decoder_frame_t *
+srl_push_frame(pTHX_ srl_decoder_t *dec, SV *into, U8 kind, U8 is_ref, U32 nested)
+{
+    srl_decoder_frame_t *frame;
+    srl_stack_push_ptr(dec->frames, frame);
+    frame->into= into;
+    frame->kind= kind;
+    frame->is_ref= is_ref;
+    frame->nested= nested;
+    return frame;
+}
+
+/* Sets up the array and reads its leading scalars. The rest of the items are
+ * read from a frame by srl_read_single_value(): then this pushes the frame
+ * and returns the slot of the first of them, which is to be read next.
+ * "*nested" is the depth to restore once the array is read, see
+ * srl_read_single_value_begin(), and is left to the item returned if that
+ * is the last, which then needs no frame. */
+SRL_STATIC_ALWAYS_INLINE SV **
+srl_read_array(pTHX_ srl_decoder_t *dec, SV *into, U8 tag, U32 *nested) {
     UV len;
+    SV *av= into;
     if (tag) {
-        SV *referent= (SV *)newAV();
+        av= (SV *)newAV();
         len= tag & 15;
-        SRL_sv_set_rv_to(into, referent);
-        into= referent;
+        SRL_sv_set_rv_to(into, av);
         DEPTH_INCREMENT(dec);
+        ++*nested;
     } else {
         len= srl_read_varint_uv_count(aTHX_ dec->pbuf, " while reading ARRAY");
         (void)SvUPGRADE(into, SVt_PVAV);
     }
 
     if (len) {
-        SV **av_array;
-        SV **av_end;
+        srl_decoder_frame_t *frame;
+        SV **ptr;
+        SV **end;
 
         SRL_RDR_ASSERT_SPACE(dec->pbuf,len," while reading array contents, insufficient remaining tags for specified array size");
 
         /* make sure the array has room */
-        av_extend((AV*)into, len-1);
+        av_extend((AV*)av, len-1);
         /* set the size */
-        AvFILLp(into)= len - 1;
+        AvFILLp(av)= len - 1;
+
+        ptr= AvARRAY((AV*)av);
+        end= ptr + len;
+        for (;;) {
+            *ptr= FRESH_SV();
+            if (expect_false( !srl_read_next_leaf(aTHX_ dec, ptr) )) {
+                if (ptr + 1 < end || SRL_DEC_TAIL_NEEDS_FRAME(dec)) {
+                    frame= srl_push_frame(aTHX_ dec, into, SRL_DEC_FRAME_ARRAY, tag != 0, *nested);
+                    frame->u.av.ptr= ptr + 1;
+                    frame->u.av.end= end;
+                    *nested= 0;
+                }
+                return ptr;
+            }
+            if (++ptr == end)
+                break;
+        }
+    }
+    dec->recursion_depth -= *nested;
+    *nested= 0;
+    return NULL;
+}
+
+/* A packed array (MANY) of numbers that all have the same type, without
+ * tags of their own, so the whole array can be filled in one loop. */
+SRL_STATIC_INLINE void
+srl_read_many(pTHX_ srl_decoder_t *dec, SV *into)
+{
+    U8 type;
+    UV len= srl_read_many_header(aTHX_ dec->pbuf, &type);
+    SV **av_array;
+    SV **av_end;
+
+    (void)SvUPGRADE(into, SVt_PVAV);
+    if (!len)
+        return;
 
-        av_array= AvARRAY((AV*)into);
-        av_end= av_array + len;
+    av_extend((AV*)into, len-1);
+    AvFILLp(into)= len - 1;
 
+    av_array= AvARRAY((AV*)into);
+    av_end= av_array + len;
+
+    /* the header checked that there is room for len items, but varints
+     * vary in length, so those are still read with bounds checks */
+    switch (type) {
+    case SRL_HDR_VARINT:
         for ( ; av_array < av_end ; av_array++) {
             *av_array = FRESH_SV();
-            srl_read_single_value(aTHX_ dec, *av_array, av_array);
+            srl_read_varint_into(aTHX_ dec, *av_array, av_array, NULL);
         }
-    }
-    if (tag)
-        DEPTH_DECREMENT(dec);
-}
-
-#ifndef HV_FETCH_LVALUE
-#   define OLDHASH
-#   define IS_LVALUE 1
-#   define KEYLENTYPE IV
+        break;
+    case SRL_HDR_ZIGZAG:
+        for ( ; av_array < av_end ; av_array++) {
+            *av_array = FRESH_SV();
+            srl_read_zigzag_into(aTHX_ dec, *av_array, av_array, NULL);
+        }
+        break;
+    case SRL_HDR_FLOAT:
+        for ( ; av_array < av_end ; av_array++) {
+            union myfloat val;
+#if SRL_USE_ALIGNED_LOADS_AND_STORES
+            Copy(dec->buf.pos,val.c,sizeof(float),U8);
 #else
-#   define KEYLENTYPE STRLEN
+            val.f= *((float *)dec->buf.pos);
 #endif
-
-#ifndef HvRITER_set
-#   define HvRITER_set(sv,v) HvRITER(sv) = v
+            dec->buf.pos+= sizeof(float);
+            *av_array = newSVnv((NV)val.f);
+        }
+        break;
+    default: /* SRL_HDR_DOUBLE */
+        for ( ; av_array < av_end ; av_array++) {
+            union myfloat val;
+#if SRL_USE_ALIGNED_LOADS_AND_STORES
+            Copy(dec->buf.pos,val.c,sizeof(double),U8);
+#else
+            val.d= *((double *)dec->buf.pos);
 #endif
-
-SRL_STATIC_INLINE void
-srl_read_hash(pTHX_ srl_decoder_t *dec, SV* into, U8 tag) {
-    UV num_keys;
-    if (tag) {
-        SV *referent= (SV *)newHV();
-        num_keys= tag & 15;
-        SRL_sv_set_rv_to(into, referent);
-        into= referent;
-        DEPTH_INCREMENT(dec);
-    } else {
-        num_keys= srl_read_varint_uv_count(aTHX_ dec->pbuf, " while reading HASH");
-        (void)SvUPGRADE(into, SVt_PVHV);
+            dec->buf.pos+= sizeof(double);
+            *av_array = newSVnv((NV)val.d);
+        }
+        break;
     }
-    /* in some versions of Perl HvRITER() is not properly set on an upgrade SV
-     * so we explicitly set it ourselves */
-#ifdef FIXUP_RITER
-    HvRITER_set(into,-1);
-#endif
 
-    /* Limit the maximum number of hash keys that we accept to whetever was configured */
-    if (expect_false( dec->max_num_hash_entries != 0 && num_keys > dec->max_num_hash_entries )) {
-        SRL_RDR_ERRORf2(dec->pbuf, "Got input hash with %u entries, but the configured maximum is just %u",
-                (int)num_keys, (int)dec->max_num_hash_entries);
+    /* the items are scalars, which set_readonly_scalars applies to, too */
+    if (expect_false( dec->flags_readonly )) {
+        for (av_array= AvARRAY((AV*)into) ; av_array < av_end ; av_array++) {
+            if (!SvREADONLY(*av_array))
+                SvREADONLY_on(*av_array);
+        }
     }
+}
 
-    SRL_RDR_ASSERT_SPACE(dec->pbuf,num_keys*2," while reading hash contents, insufficient remaining tags for number of keys specified");
-
-    HvSHAREKEYS_on(into); /* apparently required on older perls */
-
-    hv_ksplit((HV *)into, num_keys); /* make sure we have enough room */
-    /* NOTE: contents of hash are stored VALUE/KEY, reverse from normal perl
-     * storage, this is because it simplifies the hash storage logic somewhat */
-    for (; num_keys > 0 ; num_keys--) {
-        const U8 *from;
-        U8 tag;
-        SV **fetched_sv;
-#ifndef OLDHASH
-        U32 flags= 0;
-#endif
-        KEYLENTYPE key_len;
+/* Read the tag of a hash key, a string or a COPY of one, and leave a pointer
+ * to the key in *from_out and its length in *key_len_out. For hv_common()
+ * the key's flags are stored in *flags_out, and for COPY tags its hash in
+ * *hash_out, which is left alone otherwise. */
+SRL_STATIC_ALWAYS_INLINE void
+srl_read_hash_key(pTHX_ srl_decoder_t *dec, const U8 **from_out, KEYLENTYPE *key_len_out,
+                  U32 *flags_out, U32 *hash_out)
+{
+    const U8 *from;
+    U8 tag;
+    KEYLENTYPE key_len;
 
-        SRL_RDR_ASSERT_SPACE(dec->pbuf,1," while reading key tag byte for HASH");
-        tag= (*dec->buf.pos++)&127;
-        if (IS_SRL_HDR_SHORT_BINARY(tag)) {
-            key_len= (KEYLENTYPE)SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(tag);
-            SRL_RDR_ASSERT_SPACE(dec->pbuf,key_len," while reading string/SHORT_BINARY key");
-            from= dec->buf.pos;
-            dec->buf.pos += key_len;
-        } else if (tag == SRL_HDR_BINARY) {
-            key_len= (KEYLENTYPE)srl_read_varint_uv_length(aTHX_ dec->pbuf, " while reading string/BINARY key");
-            SRL_RDR_ASSERT_SPACE(dec->pbuf,key_len," while reading binary key");
-            from= dec->buf.pos;
-            dec->buf.pos += key_len;
-        } else if (tag == SRL_HDR_STR_UTF8) {
-            key_len= (KEYLENTYPE)srl_read_varint_uv_length(aTHX_ dec->pbuf, " while reading UTF8 key");
-            SRL_RDR_ASSERT_SPACE(dec->pbuf,key_len," while reading string key");
-            from= dec->buf.pos;
-            dec->buf.pos += key_len;
+    SRL_RDR_ASSERT_SPACE(dec->pbuf,1," while reading key tag byte for HASH");
+    tag= (*dec->buf.pos++)&127;
+    if (IS_SRL_HDR_SHORT_BINARY(tag)) {
+        key_len= (KEYLENTYPE)SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(tag);
+        SRL_RDR_ASSERT_SPACE(dec->pbuf,key_len," while reading string/SHORT_BINARY key");
+        from= dec->buf.pos;
+        dec->buf.pos += key_len;
+    } else if (tag == SRL_HDR_BINARY) {
+        key_len= (KEYLENTYPE)srl_read_varint_uv_length(aTHX_ dec->pbuf, " while reading string/BINARY key");
+        SRL_RDR_ASSERT_SPACE(dec->pbuf,key_len," while reading binary key");
+        from= dec->buf.pos;
+        dec->buf.pos += key_len;
+    } else if (tag == SRL_HDR_STR_UTF8) {
+        key_len= (KEYLENTYPE)srl_read_varint_uv_length(aTHX_ dec->pbuf, " while reading UTF8 key");
+        SRL_RDR_ASSERT_SPACE(dec->pbuf,key_len," while reading string key");
+        from= dec->buf.pos;
+        dec->buf.pos += key_len;
 #ifdef OLDHASH
-            key_len= -key_len;
+        key_len= -key_len;
 #else
-            flags= HVhek_UTF8;
+        *flags_out= HVhek_UTF8;
 #endif
-        } else if (tag == SRL_HDR_COPY) {
-            UV ofs= srl_read_varint_uv_offset(aTHX_ dec->pbuf, " while reading COPY tag");
-            from= dec->buf.body_pos + ofs;
-            tag= *from++;
-            /* note we do NOT validate these items, as we have alread read them
-             * and if they were a problem we would not be here to process them! */
-            if (IS_SRL_HDR_SHORT_BINARY(tag)) {
-                key_len= (KEYLENTYPE)SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(tag);
-            }
-            else
-            if (tag == SRL_HDR_BINARY) {
-                key_len = (KEYLENTYPE)S_read_varint_uv_length_char_ptr(
-                    aTHX_ &from, dec->buf.end,
-                    " while reading (byte) string length (via COPY)"
-                );
-            }
-            else
-            if (tag == SRL_HDR_STR_UTF8) {
-                key_len = (KEYLENTYPE)S_read_varint_uv_length_char_ptr(
-                    aTHX_ &from, dec->buf.end,
-                    " while reading UTF8-encoded string length (via COPY)"
-                );
+    } else if (tag == SRL_HDR_COPY) {
+        UV ofs= srl_read_varint_uv_offset(aTHX_ dec->pbuf, " while reading COPY tag");
+        const U8 *copied_tag;
+#ifndef OLDHASH
+        U32 hash;
+#endif
+        from= copied_tag= dec->buf.body_pos + ofs;
+        tag= *from++;
+        /* note we do NOT validate these items, as we have alread read them
+         * and if they were a problem we would not be here to process them! */
+        if (IS_SRL_HDR_SHORT_BINARY(tag)) {
+            key_len= (KEYLENTYPE)SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(tag);
+        }
+        else
+        if (tag == SRL_HDR_BINARY) {
+            key_len = (KEYLENTYPE)S_read_varint_uv_length_char_ptr(
+                aTHX_ &from, dec->buf.end,
+                " while reading (byte) string length (via COPY)"
+            );
+        }
+        else
+        if (tag == SRL_HDR_STR_UTF8) {
+            key_len = (KEYLENTYPE)S_read_varint_uv_length_char_ptr(
+                aTHX_ &from, dec->buf.end,
+                " while reading UTF8-encoded string length (via COPY)"
+            );
 #ifdef OLDHASH
-                key_len= -key_len;
+            key_len= -key_len;
 #else
-                flags= HVhek_UTF8;
+            *flags_out= HVhek_UTF8;
 #endif
-            }
-            else {
-                SRL_RDR_ERROR_BAD_COPY(dec->pbuf, SRL_HDR_HASH);
-            }
-        } else {
-            SRL_RDR_ERROR_UNEXPECTED(dec->pbuf, tag, "a stringish type");
         }
-        if (SvREADONLY(into)) {
-            SvREADONLY_off(into);
+        else {
+            SRL_RDR_ERROR_BAD_COPY(dec->pbuf, SRL_HDR_HASH);
+        }
+#ifndef OLDHASH
+        /* Records sharing their keys repeat the same few COPY tags over
+         * and over, so hash each copied key only once per document.
+         * A key that hashes to 0 is simply hashed again every time. */
+        if (expect_false( dec->ref_keyhash == NULL ))
+            dec->ref_keyhash= PTABLE_new_size(4);
+        hash= (U32)PTR2UV(PTABLE_fetch(dec->ref_keyhash, copied_tag));
+        if (expect_false( hash == 0 )) {
+            PERL_HASH(hash, (const char *)from, key_len);
+            PTABLE_store(dec->ref_keyhash, (void *)copied_tag, INT2PTR(void *, (UV)hash));
         }
+        *hash_out= hash;
+#endif
+    } else {
+        SRL_RDR_ERROR_UNEXPECTED(dec->pbuf, tag, "a stringish type");
+    }
+
+    *from_out= from;
+    *key_len_out= key_len;
+}
+
+/* Fetch the lvalue slot for a key read by srl_read_hash_key() from a hash,
+ * and make sure it is new. */
+SRL_STATIC_INLINE SV **
+srl_fetch_hash_slot(pTHX_ srl_decoder_t *dec, HV *hv, const U8 *from, KEYLENTYPE key_len,
+                    U32 flags, U32 hash)
+{
+    SV **fetched_sv;
 #ifdef OLDHASH
-        fetched_sv= hv_fetch((HV *)into, (char *)from, key_len, IS_LVALUE);
+    PERL_UNUSED_ARG(flags);
+    PERL_UNUSED_ARG(hash);
+    fetched_sv= hv_fetch(hv, (char *)from, key_len, IS_LVALUE);
 #else
-        fetched_sv= (SV **) hv_common((HV *)into, NULL, (char *)from, key_len, flags, HV_FETCH_LVALUE|HV_FETCH_JUST_SV, NULL, 0);
+    fetched_sv= (SV **) hv_common(hv, NULL, (char *)from, key_len, flags, HV_FETCH_LVALUE|HV_FETCH_JUST_SV, NULL, hash);
 #endif
-        if (expect_false( !fetched_sv )) {
-            SRL_RDR_ERROR_PANIC(dec->pbuf, "failed to hv_store");
-        }
-        else
-        if ( expect_false( SvTYPE(*fetched_sv) != SVt_NULL ) ) {
-            /* sv_dump(*fetched_sv); */
-            SRL_RDR_ERRORf2(dec->pbuf, "duplicate key '%.*s' in hash", (int) key_len, (char *)from);
+    if (expect_false( !fetched_sv )) {
+        SRL_RDR_ERROR_PANIC(dec->pbuf, "failed to hv_store");
+    }
+    else
+    if ( expect_false( SvTYPE(*fetched_sv) != SVt_NULL ) ) {
+        /* sv_dump(*fetched_sv); */
+        SRL_RDR_ERRORf2(dec->pbuf, "duplicate key '%.*s' in hash", (int) key_len, (char *)from);
+    }
+    return fetched_sv;
+}
+
+/* Read the next key of a hash and return the slot its value is to be read
+ * into. */
+SRL_STATIC_ALWAYS_INLINE SV **
+srl_read_hash_entry(pTHX_ srl_decoder_t *dec, HV *hv)
+{
+    const U8 *from;
+    U32 flags= 0;
+    U32 hash= 0;
+    KEYLENTYPE key_len;
+
+    srl_read_hash_key(aTHX_ dec, &from, &key_len, &flags, &hash);
+    if (SvREADONLY(hv)) {
+        SvREADONLY_off(hv);
+    }
+    return srl_fetch_hash_slot(aTHX_ dec, hv, from, key_len, flags, hash);
+}
+
+/* Sets up the hash and reads its leading entries with scalar values. The rest
+ * are read from a frame by srl_read_single_value(): then this pushes the frame
+ * and returns the slot of the first of them, whose value is to be read next.
+ * "*nested" is as for srl_read_array(). */
+SRL_STATIC_ALWAYS_INLINE SV **
+srl_read_hash(pTHX_ srl_decoder_t *dec, SV* into, U8 tag, U32 *nested) {
+    UV num_keys;
+    SV *hv= into;
+    if (tag) {
+        hv= (SV *)newHV();
+        num_keys= tag & 15;
+        SRL_sv_set_rv_to(into, hv);
+        DEPTH_INCREMENT(dec);
+        ++*nested;
+    } else {
+        num_keys= srl_read_varint_uv_count(aTHX_ dec->pbuf, " while reading HASH");
+        (void)SvUPGRADE(into, SVt_PVHV);
+    }
+    /* in some versions of Perl HvRITER() is not properly set on an upgrade SV
+     * so we explicitly set it ourselves */
+#ifdef FIXUP_RITER
+    HvRITER_set(hv,-1);
+#endif
+
+    /* Limit the maximum number of hash keys that we accept to whetever was configured */
+    if (expect_false( dec->max_num_hash_entries != 0 && num_keys > dec->max_num_hash_entries )) {
+        SRL_RDR_ERRORf2(dec->pbuf, "Got input hash with %u entries, but the configured maximum is just %u",
+                (int)num_keys, (int)dec->max_num_hash_entries);
+    }
+
+    SRL_RDR_ASSERT_SPACE(dec->pbuf,num_keys*2," while reading hash contents, insufficient remaining tags for number of keys specified");
+
+    HvSHAREKEYS_on(hv); /* apparently required on older perls */
+
+    hv_ksplit((HV *)hv, num_keys); /* make sure we have enough room */
+    while (num_keys) {
+        SV **slot= srl_read_hash_entry(aTHX_ dec, (HV *)hv);
+        num_keys--;
+        if (expect_false( !srl_read_next_leaf(aTHX_ dec, slot) )) {
+            if (num_keys || SRL_DEC_TAIL_NEEDS_FRAME(dec)) {
+                srl_decoder_frame_t *frame= srl_push_frame(aTHX_ dec, into, SRL_DEC_FRAME_HASH, tag != 0, *nested);
+                frame->u.hv.hv= (HV *)hv;
+                frame->u.hv.left= num_keys;
+                *nested= 0;
+            }
+            return slot;
         }
-        srl_read_single_value(aTHX_ dec, *fetched_sv, fetched_sv );
     }
-    if (tag)
-        DEPTH_DECREMENT(dec);
+    dec->recursion_depth -= *nested;
+    *nested= 0;
+    return NULL;
+}
+
+/* Read the keys of a record batch, and hash them once for all the records */
+SRL_STATIC_INLINE srl_record_key_t *
+srl_read_records_keys(pTHX_ srl_decoder_t *dec, UV nkeys)
+{
+    srl_record_key_t *keys;
+    UV i;
+
+    /* Limit the maximum number of hash keys that we accept to whetever was configured */
+    if (expect_false( dec->max_num_hash_entries != 0 && nkeys > dec->max_num_hash_entries )) {
+        SRL_RDR_ERRORf2(dec->pbuf, "Got input hash with %u entries, but the configured maximum is just %u",
+                (int)nkeys, (int)dec->max_num_hash_entries);
+    }
+
+    /* the keys point into the document, which outlives the batch */
+    Newx(keys, nkeys, srl_record_key_t);
+    SAVEFREEPV(keys);
+    for (i= 0; i < nkeys; i++) {
+        srl_record_key_t *key= keys + i;
+        key->flags= 0;
+        key->hash= 0;
+        srl_read_hash_key(aTHX_ dec, &key->from, &key->key_len, &key->flags, &key->hash);
+#ifndef OLDHASH
+        if (key->hash == 0)
+            PERL_HASH(key->hash, (const char *)key->from, key->key_len);
+#endif
+    }
+    return keys;
 }
 
+/* A record batch (RECORDS): an array of references to hashes that all have
+ * the same keys, stored as the keys followed by the values one column at a
+ * time. The keys are read and hashed once for all the records. This sets up
+ * the batch, its values are read from a frame by srl_read_single_value() and
+ * the hashes built by srl_build_records() once they all are. Unless the batch
+ * is empty, this pushes the frame and returns the slot of the first value,
+ * which is to be read next. */
+SRL_STATIC_INLINE SV **
+srl_read_records(pTHX_ srl_decoder_t *dec, SV *into)
+{
+    UV nkeys;
+    const UV count= srl_read_records_header(aTHX_ dec->pbuf, &nkeys);
+    srl_record_key_t *keys;
+    srl_decoder_frame_t *frame;
+    AV *values;
+
+    (void)SvUPGRADE(into, SVt_PVAV);
+    keys= srl_read_records_keys(aTHX_ dec, nkeys);
+    if (!count)
+        return NULL;
+
+    /* The values are read in their order, column by column, into a
+     * temporary array laid out record by record, and the hashes are built
+     * one record at a time. Filling thousands of hashes a column at a time
+     * is a lot less cache friendly. The array owns the values until they are
+     * stored, so none leak if the document turns out to be bad. The header
+     * check guarantees that count * nkeys doesn't overflow. */
+    values= (AV *)sv_2mortal((SV *)newAV());
+    av_extend(values, count * nkeys - 1);
+    Zero(AvARRAY(values), count * nkeys, SV *);
+    AvFILLp(values)= count * nkeys - 1;
+
+    DEPTH_INCREMENT(dec);
+    frame= srl_push_frame(aTHX_ dec, into, SRL_DEC_FRAME_RECORDS, 0, 1);
+    frame->u.records.values= values;
+    frame->u.records.ptr= AvARRAY(values) + nkeys;
+    frame->u.records.keys= keys;
+    frame->u.records.nkeys= nkeys;
+    frame->u.records.column= 0;
+    *AvARRAY(values)= newSV(0);
+    return AvARRAY(values);
+}
 
+/* Build the hashes of a record batch from the values read for its frame */
 SRL_STATIC_INLINE void
+srl_build_records(pTHX_ srl_decoder_t *dec, srl_decoder_frame_t *frame)
+{
+    AV *into= (AV *)frame->into;
+    const srl_record_key_t *keys= frame->u.records.keys;
+    const UV nkeys= frame->u.records.nkeys;
+    const UV count= (AvFILLp(frame->u.records.values) + 1) / nkeys;
+    SV **value= AvARRAY(frame->u.records.values);
+    SV **av_array;
+    SV **av_end;
+    UV i;
+
+    av_extend(into, count-1);
+    AvFILLp(into)= count - 1;
+    av_array= AvARRAY(into);
+    av_end= av_array + count;
+    for ( ; av_array < av_end ; av_array++) {
+        HV *hv= newHV();
+        HvSHAREKEYS_on(hv); /* apparently required on older perls */
+        hv_ksplit(hv, nkeys);
+        *av_array= newRV_noinc((SV *)hv);
+        for (i= 0; i < nkeys; i++, value++) {
+            const srl_record_key_t *key= keys + i;
+#ifdef OLDHASH
+            if (expect_false( !hv_store(hv, (char *)key->from, key->key_len, *value, 0) ))
+#else
+            if (expect_false( !hv_common(hv, NULL, (char *)key->from, key->key_len, key->flags,
+                                         HV_FETCH_ISSTORE|HV_FETCH_JUST_SV, *value, key->hash) ))
+#endif
+                SRL_RDR_ERROR_PANIC(dec->pbuf, "failed to hv_store");
+            *value= NULL; /* the hash owns it now */
+        }
+        /* every record has the same keys, so checking the first is enough */
+        if (expect_false( av_array == AvARRAY(into) && HvUSEDKEYS(hv) != nkeys ))
+            SRL_RDR_ERROR(dec->pbuf, "duplicate key in record batch");
+    }
+
+    /* the records are references like any other, which set_readonly applies to */
+    if (expect_false( dec->flags_readonly == 1 )) {
+        for (av_array= AvARRAY(into) ; av_array < av_end ; av_array++) {
+            SvREADONLY_on(SvRV(*av_array));
+            SvREADONLY_on(*av_array);
+        }
+    }
+}
+
+/* Returns the referent still to be read, see srl_read_single_value(), or
+ * NULL for references to the special values. The caller sees to it that the
+ * depth is restored once the referent is read, usually with a frame. */
+SRL_STATIC_INLINE SV *
 srl_read_refn(pTHX_ srl_decoder_t *dec, SV* into)
 {
     SV *referent;
@@ -1149,11 +1924,10 @@ srl_read_refn(pTHX_ srl_decoder_t *dec, SV* into)
         tag = 0;
     }
     SRL_sv_set_rv_to(into, referent);
-    if (!tag) {
-        DEPTH_INCREMENT(dec);
-        srl_read_single_value(aTHX_ dec, referent, NULL);
-        DEPTH_DECREMENT(dec);
-    }
+    if (tag)
+        return NULL;
+    DEPTH_INCREMENT(dec);
+    return referent;
 }
 
 SRL_STATIC_INLINE SV *
@@ -1167,9 +1941,12 @@ srl_follow_refp_alias_reference(pTHX_ srl_decoder_t *dec, UV offset)
         SRL_RDR_ERROR(dec->pbuf, "Corrupted packed. Reference offset points forward!");
     }
 
+    /* what it refers to may refer to something not read either */
+    DEPTH_INCREMENT(dec);
     dec->buf.pos = new_pos;
     srl_read_single_value(aTHX_ dec, into, NULL);
     dec->buf.pos = orig_pos;
+    DEPTH_DECREMENT(dec);
     return into;
 }
 
@@ -1207,11 +1984,8 @@ srl_read_refp(pTHX_ srl_decoder_t *dec, SV* into)
         return;
     }
     referent= srl_fetch_item(aTHX_ dec, item, "REFP");
-
-#ifdef FOLLOW_REFERENCES_IF_NOT_STASHED
-    if (referent == NULL)
+    if (expect_false( referent == NULL ))
         referent = srl_follow_refp_alias_reference(aTHX_ dec, item);
-#endif
 
     (void)SvREFCNT_inc(referent);
 
@@ -1228,13 +2002,14 @@ srl_read_refp(pTHX_ srl_decoder_t *dec, SV* into)
 }
 
 
+/* Weaken the reference read into "into" for a WEAKEN tag, once it is
+ * complete. */
 SRL_STATIC_INLINE void
-srl_read_weaken(pTHX_ srl_decoder_t *dec, SV* into)
+srl_finish_weaken(pTHX_ srl_decoder_t *dec, SV* into)
 {
     SV* referent;
     /* TODO This really just wants a subset of the states that srl_read_single_value covers, right?
      *      Optimization opportunity? Or robustness against invalid packets issue? */
-    srl_read_single_value(aTHX_ dec, into, NULL);
     if (expect_false( !SvROK(into) ))
         SRL_RDR_ERROR(dec->pbuf, "WEAKEN op");
     referent= SvRV(into);
@@ -1264,7 +2039,9 @@ srl_read_weaken(pTHX_ srl_decoder_t *dec, SV* into)
     }
 }
 
-SRL_STATIC_INLINE void
+/* Returns true if the value to bless is still to be read into "into", see
+ * srl_read_single_value(), false if it was a frozen object. */
+SRL_STATIC_INLINE int
 srl_read_objectv(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag)
 {
     AV *av= NULL;
@@ -1276,20 +2053,17 @@ srl_read_objectv(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag)
     ofs= srl_read_varint_uv_offset(aTHX_ dec->pbuf, " while reading OBJECTV(_FREEZE) classname");
 
     if (expect_false( !dec->ref_bless_av )) {
-#ifdef FOLLOW_REFERENCES_IF_NOT_STASHED
+        if (!SRL_DEC_FOLLOW_REFERENCES(dec))
+            SRL_RDR_ERROR(dec->pbuf, "Corrupted packet. OBJECTV(_FREEZE) used without "
+                          "preceding OBJECT(_FREEZE) to define classname");
         SRL_ASSERT_REF_PTR_TABLES(dec); /* init dec->ref_stashes and dec->ref_bless_av */
-#else
-        SRL_RDR_ERROR(dec->pbuf, "Corrupted packet. OBJECTV(_FREEZE) used without "
-                      "preceding OBJECT(_FREEZE) to define classname");
-#endif
     }
 
     av= (AV *)PTABLE_fetch(dec->ref_bless_av, (void *)ofs);
     if (expect_false( NULL == av )) {
-#ifdef FOLLOW_REFERENCES_IF_NOT_STASHED
-        av = srl_follow_objectv_reference(aTHX_ dec, (UV) ofs);
+        if (SRL_DEC_FOLLOW_REFERENCES(dec))
+            av = srl_follow_objectv_reference(aTHX_ dec, (UV) ofs);
         if (expect_false( NULL == av ))
-#endif
             SRL_RDR_ERRORf1(dec->pbuf, "Corrupted packet. OBJECTV(_FREEZE) references unknown classname offset: %"UVuf, (UV)ofs);
     }
 
@@ -1300,29 +2074,35 @@ srl_read_objectv(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag)
             SRL_RDR_ERROR(dec->pbuf, "Corrupted packet. OBJECTV(_FREEZE) used without "
                       "preceding OBJECT(_FREEZE) to define classname");
         srl_read_frozen_object(aTHX_ dec, class_stash, into);
+        return 0;
     }  else {
         /* SRL_HDR_OBJECTV, not SRL_HDR_OBJECTV_FREEZE */
-        /* now deparse the thing we are going to bless */
-        srl_read_single_value(aTHX_ dec, into, NULL);
-
-        /* and also stuff it into the av - we dont have to do any more book-keeping */
+        /* stuff the thing we are going to bless into the av - we dont have to
+         * do any more book-keeping - and deparse it next */
         av_push(av, SvREFCNT_inc(into));
 
+        if (SRL_DEC_OBJECT_NEEDS_FRAME(dec)) {
+            srl_decoder_frame_t *frame= srl_push_frame(aTHX_ dec, into, SRL_DEC_FRAME_OBJECT, 1, 0);
+            frame->u.obj.stash= NULL;
 #if USE_588_WORKAROUND
-        {
-            /* See 'define USE_588_WORKAROUND' above for a discussion of what this does. */
-            HV *class_stash= PTABLE_fetch(dec->ref_stashes, (void *)ofs);
-            if (expect_false( class_stash == NULL ))
-                SRL_RDR_ERROR(dec->pbuf, "Corrupted packet. OBJECTV(_FREEZE) used without "
-                              "preceding OBJECT(_FREEZE) to define classname");
-            if (!SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_NO_BLESS_OBJECTS))
-                sv_bless(into, class_stash);
-        }
+            {
+                /* See 'define USE_588_WORKAROUND' above for a discussion of what this does. */
+                HV *class_stash= PTABLE_fetch(dec->ref_stashes, (void *)ofs);
+                if (expect_false( class_stash == NULL ))
+                    SRL_RDR_ERROR(dec->pbuf, "Corrupted packet. OBJECTV(_FREEZE) used without "
+                                  "preceding OBJECT(_FREEZE) to define classname");
+                frame->u.obj.stash= class_stash;
+            }
 #endif
+        }
+        return 1;
     }
 }
 
-SRL_STATIC_INLINE void
+/* Returns true if the value to bless is still to be read into "into", see
+ * srl_read_single_value(), false if it was a frozen object or only the
+ * class name was wanted. */
+SRL_STATIC_INLINE int
 srl_read_object(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag, int read_class_name_only)
 {
     HV *class_stash= NULL;
@@ -1405,7 +2185,7 @@ srl_read_object(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag, int read_class_n
                     " while reading UTF8 string length for class name (via COPY)"
                 );
                 flags = flags | SVf_UTF8;
-                if (!is_utf8_string(from, key_len)) {
+                if (!srl_is_utf8_string(from, key_len)) {
                     SRL_RDR_ERROR_PANIC(dec->pbuf, "utf8 flagged classname is not actually utf8");
                 }
             }
@@ -1437,18 +2217,16 @@ srl_read_object(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag, int read_class_n
             SRL_RDR_ERRORf1(dec->pbuf, "Panic, no ref_bless_av for %"UVuf, (UV)storepos);
     }
 
-#ifdef FOLLOW_REFERENCES_IF_NOT_STASHED
     /* at this point we have class name read and have coressponding records in
      * dec->dec->ref_stashes and dec->ref_bless_av. So, we can simply fetch
      * from hashes outside this function. The code */
-    if (read_class_name_only) return;
-#else
+    if (read_class_name_only) return 0;
     assert(into != NULL);
     assert(obj_tag != 0);
-#endif
 
     if (expect_false( obj_tag == SRL_HDR_OBJECT_FREEZE )) {
         srl_read_frozen_object(aTHX_ dec, class_stash, into);
+        return 0;
     }  else {
         /* We now have a stash so we /could/ bless... except that
          * we don't actually want to do so right now. We want to defer blessing
@@ -1458,15 +2236,12 @@ srl_read_object(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag, int read_class_n
         SRL_DEC_SET_OPTION(dec, SRL_F_DECODER_NEEDS_FINALIZE);
         av_push(av, SvREFCNT_inc(into));
 
-        /* now deparse the thing we are going to bless */
-        srl_read_single_value(aTHX_ dec, into, NULL);
-
-#if USE_588_WORKAROUND
-        /* See 'define USE_588_WORKAROUND' above for a discussion of what this does. */
-        if (!SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_NO_BLESS_OBJECTS))
-            sv_bless(into, class_stash);
-#endif
-
+        /* the thing we are going to bless is read next */
+        if (SRL_DEC_OBJECT_NEEDS_FRAME(dec)) {
+            srl_decoder_frame_t *frame= srl_push_frame(aTHX_ dec, into, SRL_DEC_FRAME_OBJECT, 1, 0);
+            frame->u.obj.stash= class_stash;
+        }
+        return 1;
     }
 }
 
@@ -1477,7 +2252,7 @@ srl_read_object(pTHX_ srl_decoder_t *dec, SV* into, U8 obj_tag, int read_class_n
 SRL_STATIC_INLINE void
 srl_read_frozen_object(pTHX_ srl_decoder_t *dec, HV *class_stash, SV *into)
 {
-    GV *method = gv_fetchmethod_autoload(class_stash, "THAW", 0);
+    CV *method;
     char *classname = HvNAME(class_stash);
     SV* referent;
     SV *replacement;
@@ -1491,6 +2266,9 @@ srl_read_frozen_object(pTHX_ srl_decoder_t *dec, HV *class_stash, SV *into)
 
     const unsigned char *fixup_pos= dec->buf.pos + 1; /* get the tag for the WHATEVER */
 
+    if (expect_false( dec->thaw_cv_cache == NULL ))
+        dec->thaw_cv_cache = PTABLE_new_size(3);
+    method = srl_method_cache_fetch(aTHX_ dec->thaw_cv_cache, class_stash, "THAW");
     if (expect_false( method == NULL ))
         SRL_RDR_ERRORf1(dec->pbuf, "No THAW method defined for class '%s'", HvNAME(class_stash));
 
@@ -1524,8 +2302,7 @@ srl_read_frozen_object(pTHX_ srl_decoder_t *dec, HV *class_stash, SV *into)
         }
 
         PUTBACK;
-        count = call_sv((SV *)GvCV(method), G_SCALAR);
-        /* TODO explore method lookup caching */
+        count = call_sv((SV *)method, G_SCALAR);
         SPAGAIN;
 
         if (expect_true( count == 1 )) {
@@ -1574,6 +2351,125 @@ srl_read_reserved(pTHX_ srl_decoder_t *dec, U8 tag, SV* into)
 }
 
 
+/* The regexp cache maps the modifier flags, UTF8-ness and bytes of a
+ * pattern to the REGEXP it compiles to. Documents produced from the same
+ * data tend to carry the same few patterns over and over, and compiling
+ * them is far more expensive than decoding anything else. Hits are
+ * handed out with reg_temp_copy(), which shares the compiled program
+ * just like every execution of a qr// does. */
+SRL_STATIC_INLINE srl_regexp_cache_t *
+srl_regexp_cache_new(pTHX_ UV max_entries)
+{
+    srl_regexp_cache_t *cache;
+    Newxz(cache, 1, srl_regexp_cache_t);
+    cache->index = newHV();
+    cache->keybuf = newSV(64);
+    cache->max_entries = max_entries;
+    return cache;
+}
+
+SRL_STATIC_INLINE void
+srl_regexp_cache_free(pTHX_ srl_regexp_cache_t *cache)
+{
+    srl_regexp_cache_entry_t *entry = cache->head;
+    while (entry) {
+        srl_regexp_cache_entry_t *next = entry->next;
+        SvREFCNT_dec(entry->key);
+        SvREFCNT_dec(entry->rx);
+        Safefree(entry);
+        entry = next;
+    }
+    SvREFCNT_dec(cache->index);
+    SvREFCNT_dec(cache->keybuf);
+    Safefree(cache);
+}
+
+SRL_STATIC_INLINE void
+srl_regexp_cache_unlink(srl_regexp_cache_t *cache, srl_regexp_cache_entry_t *entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        cache->head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        cache->tail = entry->prev;
+}
+
+SRL_STATIC_INLINE void
+srl_regexp_cache_push(srl_regexp_cache_t *cache, srl_regexp_cache_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head)
+        cache->head->prev = entry;
+    else
+        cache->tail = entry;
+    cache->head = entry;
+}
+
+/* builds the key for a pattern in cache->keybuf */
+SRL_STATIC_INLINE SV *
+srl_regexp_cache_key(pTHX_ srl_regexp_cache_t *cache, SV *sv_pat, U32 flags)
+{
+    STRLEN pat_len;
+    const char *pat = SvPV(sv_pat, pat_len);
+    char prefix[5];
+    SV *key = cache->keybuf;
+
+    Copy(&flags, prefix, 4, char);
+    prefix[4] = SvUTF8(sv_pat) ? 1 : 0;
+    sv_setpvn(key, prefix, sizeof(prefix));
+    sv_catpvn(key, pat, pat_len);
+    return key;
+}
+
+/* returns the cached REGEXP for the key, or NULL on a miss */
+SRL_STATIC_INLINE SV *
+srl_regexp_cache_fetch(pTHX_ srl_regexp_cache_t *cache, SV *key)
+{
+    HE *he = hv_fetch_ent(cache->index, key, 0, 0);
+    srl_regexp_cache_entry_t *entry;
+
+    if (!he) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    entry = INT2PTR(srl_regexp_cache_entry_t *, SvIV(HeVAL(he)));
+    if (entry != cache->head) {
+        srl_regexp_cache_unlink(cache, entry);
+        srl_regexp_cache_push(cache, entry);
+    }
+    return entry->rx;
+}
+
+/* takes ownership of rx, evicting the least recently used entry when full */
+SRL_STATIC_INLINE void
+srl_regexp_cache_store(pTHX_ srl_regexp_cache_t *cache, SV *key, SV *rx)
+{
+    srl_regexp_cache_entry_t *entry;
+
+    if (cache->entries >= cache->max_entries) {
+        entry = cache->tail;
+        srl_regexp_cache_unlink(cache, entry);
+        (void)hv_delete_ent(cache->index, entry->key, G_DISCARD, 0);
+        SvREFCNT_dec(entry->key);
+        SvREFCNT_dec(entry->rx);
+        cache->entries--;
+        cache->evictions++;
+    }
+    else {
+        Newx(entry, 1, srl_regexp_cache_entry_t);
+    }
+    entry->key = newSVsv(key);
+    entry->rx = rx;
+    srl_regexp_cache_push(cache, entry);
+    (void)hv_store_ent(cache->index, entry->key, newSViv(PTR2IV(entry)), 0);
+    cache->entries++;
+}
+
 SRL_STATIC_INLINE void
 srl_read_regexp(pTHX_ srl_decoder_t *dec, SV* into)
 {
@@ -1614,6 +2510,27 @@ srl_read_regexp(pTHX_ srl_decoder_t *dec, SV* into)
         }
 #ifdef MODERN_REGEXP
         {
+            SV *referent;
+            SV tmp;
+#ifdef HAVE_REGEXP_CACHE
+            SV *cache_key = NULL;
+
+            if (dec->regexp_cache_size) {
+                SV *cached;
+                if (!dec->regexp_cache)
+                    dec->regexp_cache = srl_regexp_cache_new(aTHX_ dec->regexp_cache_size);
+                cache_key = srl_regexp_cache_key(aTHX_ dec->regexp_cache, sv_pat, flags);
+                cached = srl_regexp_cache_fetch(aTHX_ dec->regexp_cache, cache_key);
+                if (cached) {
+                    assert( SvTYPE(into) == SVt_NULL );
+                    sv_upgrade(into, SVt_REGEXP);
+                    (void)Perl_reg_temp_copy(aTHX_ (REGEXP *)into, (REGEXP *)cached);
+                    SvREFCNT_dec(sv_pat);
+                    return;
+                }
+            }
+#endif
+
             /* This is ugly. We have to swap out the insides of our SV
              * with the one we get back from CALLREGCOMP, as there is no
              * way to get it to fill our SV.
@@ -1624,8 +2541,7 @@ srl_read_regexp(pTHX_ srl_decoder_t *dec, SV* into)
              */
 
             /* compile the regex */
-            SV *referent= (SV*)CALLREGCOMP(sv_pat, flags);
-            SV tmp;
+            referent= (SV*)CALLREGCOMP(sv_pat, flags);
 
             /* make sure the SV came from us (it should) and
              * is bodyless */
@@ -1646,6 +2562,13 @@ srl_read_regexp(pTHX_ srl_decoder_t *dec, SV* into)
             SvREFCNT_dec(sv_pat); /* I think we need this or we leak */
             /* and now throw away the head we got from the regexp engine. */
             SvREFCNT_dec(referent);
+
+#ifdef HAVE_REGEXP_CACHE
+            /* cache a copy, "into" is the user's to bless or modify */
+            if (cache_key)
+                srl_regexp_cache_store(aTHX_ dec->regexp_cache, cache_key,
+                                       (SV *)Perl_reg_temp_copy(aTHX_ NULL, (REGEXP *)into));
+#endif
         }
 #elif defined( TRANSITION_REGEXP )
         {
@@ -1714,13 +2637,96 @@ srl_decode_single_value(pTHX_ srl_decoder_t *dec, SV* into, SV** container)
     srl_read_single_value(aTHX_ dec, into, container);
 }
 
+void
+srl_decode_many_item(pTHX_ srl_decoder_t *dec, U8 type, SV* into)
+{
+    switch (type) {
+    case SRL_HDR_VARINT: srl_read_varint_into(aTHX_ dec, into, NULL, NULL); break;
+    case SRL_HDR_ZIGZAG: srl_read_zigzag_into(aTHX_ dec, into, NULL, NULL); break;
+    case SRL_HDR_FLOAT:  srl_read_float(aTHX_ dec, into);                   break;
+    default:             srl_read_double(aTHX_ dec, into);                  break;
+    }
+}
+
+void
+srl_decode_record(pTHX_ srl_decoder_t *dec, const UV *keys, const UV *values, UV nkeys, SV* into)
+{
+    HV *hv= newHV();
+    UV i;
+
+    SRL_sv_set_rv_to(into, (SV *)hv);
+    for (i= 0; i < nkeys; i++) {
+        SV **slot;
+        dec->buf.pos= dec->buf.body_pos + keys[i];
+        slot= srl_read_hash_entry(aTHX_ dec, hv);
+        dec->buf.pos= dec->buf.body_pos + values[i];
+        srl_read_single_value(aTHX_ dec, *slot, slot);
+    }
+}
+
+/* they want us to set all SVs readonly, or only the non-ref */
+#define SUPPORT_READONLY 1
 SRL_STATIC_INLINE void
-srl_read_single_value(pTHX_ srl_decoder_t *dec, SV* into, SV** container)
+srl_set_readonly(pTHX_ srl_decoder_t *dec, SV *into, int is_ref)
+{
+#if SUPPORT_READONLY
+    if (
+         dec->flags_readonly == 1 || !is_ref
+    ) {
+        if (is_ref && !SvREADONLY(SvRV(into)) ) {
+            SvREADONLY_on(SvRV(into));
+        }
+        if (!SvREADONLY(into)) {
+            SvREADONLY_on(into);
+        }
+    }
+#endif
+}
+
+/* Whatever is left to do once the value of a frame is read completely */
+SRL_STATIC_INLINE void
+srl_finish_frame(pTHX_ srl_decoder_t *dec, srl_decoder_frame_t *frame)
+{
+    switch (frame->kind) {
+    case SRL_DEC_FRAME_RECORDS:
+        srl_build_records(aTHX_ dec, frame);
+        break;
+    case SRL_DEC_FRAME_WEAKEN:
+        srl_finish_weaken(aTHX_ dec, frame->into);
+        break;
+    case SRL_DEC_FRAME_OBJECT:
+#if USE_588_WORKAROUND
+        /* See 'define USE_588_WORKAROUND' above for a discussion of what this does. */
+        if (!SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_NO_BLESS_OBJECTS))
+            sv_bless(frame->into, frame->u.obj.stash);
+#endif
+        break;
+    default:
+        break;
+    }
+    dec->recursion_depth -= frame->nested;
+    if ( expect_false(dec->flags_readonly) )
+        srl_set_readonly(aTHX_ dec, frame->into, frame->is_ref);
+}
+
+/* Reads a value into "into", except that arrays, hashes and the referents of
+ * references are set up and left to srl_read_single_value() on dec->frames,
+ * see there. "container" is the slot of an array or hash the value goes into,
+ * if any, for the aliasing options.
+ *
+ * "nested" is the depth to restore once the value is read. Arrays, hashes
+ * and REFNs whose last value is all that is left to read don't push a frame
+ * just to do that, unless the readonly options need it: their depth is
+ * handed on to that value instead, down to the first that needs a frame
+ * anyway or is read completely. */
+static void
+srl_read_single_value_begin(pTHX_ srl_decoder_t *dec, SV* into, SV** container, U32 nested)
 {
-    STRLEN len;
     U8 tag;
     int is_ref = 0;
     const U8 *track_it = NULL;
+    SV *referent;
+    SV **item;
 
   read_again:
     if (expect_false( SRL_RDR_DONE(dec->pbuf) ))
@@ -1730,58 +2736,64 @@ srl_read_single_value(pTHX_ srl_decoder_t *dec, SV* into, SV** container)
 
   read_tag:
     switch (tag) {
-        CASE_SRL_HDR_POS:
-            srl_setiv(aTHX_ dec, into, container, track_it, (IV)tag);
+        CASE_SRL_HDR_HASHREF:
+            if ((item= srl_read_hash(aTHX_ dec, into, tag, &nested)) != NULL)
+                goto read_item;
+            is_ref = 1;
             break;
-        CASE_SRL_HDR_NEG:
-            srl_setiv(aTHX_ dec, into, container, track_it, (IV)(tag - 32));
-            break;
-        CASE_SRL_HDR_SHORT_BINARY:
-            len= (STRLEN)SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(tag);
-            SRL_RDR_ASSERT_SPACE(dec->pbuf, len, " while reading ascii string");
-            sv_setpvn(into,(char*)dec->buf.pos,len);
-            dec->buf.pos += len;
+        CASE_SRL_HDR_ARRAYREF:
+            if ((item= srl_read_array(aTHX_ dec, into, tag, &nested)) != NULL)
+                goto read_item;
+            is_ref = 1;
             break;
-        CASE_SRL_HDR_HASHREF:       srl_read_hash(aTHX_ dec, into, tag);  is_ref = 1; break;
-        CASE_SRL_HDR_ARRAYREF:      srl_read_array(aTHX_ dec, into, tag); is_ref = 1; break;
-        case SRL_HDR_VARINT:        srl_read_varint_into(aTHX_ dec, into, container, track_it); break;
-        case SRL_HDR_ZIGZAG:        srl_read_zigzag_into(aTHX_ dec, into, container, track_it); break;
-
-        case SRL_HDR_FLOAT:         srl_read_float(aTHX_ dec, into);                  break;
-        case SRL_HDR_DOUBLE:        srl_read_double(aTHX_ dec, into);                 break;
-        case SRL_HDR_LONG_DOUBLE:   srl_read_long_double(aTHX_ dec, into);            break;
-
-        case SRL_HDR_TRUE:          sv_setsv(into, &PL_sv_yes);                       break;
-        case SRL_HDR_FALSE:         sv_setsv(into, &PL_sv_no);                        break;
 
-        case SRL_HDR_CANONICAL_UNDEF: /* fallthrough (XXX: is this right?)*/
-        case SRL_HDR_UNDEF:
-        {
-            if (container && SRL_DEC_HAVE_OPTION(dec,SRL_F_DECODER_USE_UNDEF)){
-                SvREFCNT_dec(into);
-                *container= &PL_sv_undef;
-                if ( track_it )
-                    srl_track_sv(aTHX_ dec, track_it, *container);
-            } else {
-                sv_setsv(into, &PL_sv_undef);
+        case SRL_HDR_WEAKEN:
+            SRL_DEC_PUSH_NESTED(dec, into, nested);
+            srl_push_frame(aTHX_ dec, into, SRL_DEC_FRAME_WEAKEN, 1, 0);
+            goto read_referent;
+        case SRL_HDR_REFN:
+            referent= srl_read_refn(aTHX_ dec, into);
+            if (referent) {
+                if (SRL_DEC_TAIL_NEEDS_FRAME(dec))
+                    srl_push_frame(aTHX_ dec, into, SRL_DEC_FRAME_REFN, 1, 1);
+                else
+                    nested++;
+                into= referent;
+                goto read_referent;
             }
-        }
-        break;
-
-        case SRL_HDR_BINARY:        srl_read_string(aTHX_ dec, 0, into);              break;
-        case SRL_HDR_STR_UTF8:      srl_read_string(aTHX_ dec, 1, into);              break;
-
-        case SRL_HDR_WEAKEN:        srl_read_weaken(aTHX_ dec, into);       is_ref=1; break;
-        case SRL_HDR_REFN:          srl_read_refn(aTHX_ dec, into);         is_ref=1; break;
+            is_ref=1;
+            break;
         case SRL_HDR_REFP:          srl_read_refp(aTHX_ dec, into);         is_ref=1; break;
         case SRL_HDR_OBJECT_FREEZE:
-        case SRL_HDR_OBJECT:        srl_read_object(aTHX_ dec, into, tag, 0); is_ref=1; break;
+        case SRL_HDR_OBJECT:
+            SRL_DEC_PUSH_NESTED(dec, into, nested);
+            if (srl_read_object(aTHX_ dec, into, tag, 0))
+                goto read_referent;
+            is_ref=1;
+            break;
         case SRL_HDR_OBJECTV_FREEZE:
-        case SRL_HDR_OBJECTV:       srl_read_objectv(aTHX_ dec, into, tag); is_ref=1; break;
+        case SRL_HDR_OBJECTV:
+            SRL_DEC_PUSH_NESTED(dec, into, nested);
+            if (srl_read_objectv(aTHX_ dec, into, tag))
+                goto read_referent;
+            is_ref=1;
+            break;
         case SRL_HDR_COPY:          srl_read_copy(aTHX_ dec, into);                   break;
         case SRL_HDR_EXTEND:        srl_read_extend(aTHX_ dec, into);                 break;
-        case SRL_HDR_HASH:          srl_read_hash(aTHX_ dec, into, 0);                break;
-        case SRL_HDR_ARRAY:         srl_read_array(aTHX_ dec, into, 0);               break;
+        case SRL_HDR_HASH:
+            if ((item= srl_read_hash(aTHX_ dec, into, 0, &nested)) != NULL)
+                goto read_item;
+            break;
+        case SRL_HDR_ARRAY:
+            if ((item= srl_read_array(aTHX_ dec, into, 0, &nested)) != NULL)
+                goto read_item;
+            break;
+        case SRL_HDR_MANY:          srl_read_many(aTHX_ dec, into);                   break;
+        case SRL_HDR_RECORDS:
+            SRL_DEC_PUSH_NESTED(dec, into, nested);
+            if ((item= srl_read_records(aTHX_ dec, into)) != NULL)
+                goto read_item;
+            break;
         case SRL_HDR_REGEXP:        srl_read_regexp(aTHX_ dec, into);                 break;
         case SRL_HDR_ALIAS:
         {
@@ -1791,14 +2803,14 @@ srl_read_single_value(pTHX_ srl_decoder_t *dec, SV* into, SV** container)
                 SRL_RDR_ERROR(dec->pbuf, "ALIAS tag not inside container, corrupt packet?");
             offset= srl_read_varint_uv_offset(aTHX_ dec->pbuf," while reading ALIAS tag");
             alias= srl_fetch_item(aTHX_ dec, offset, "ALIAS");
-#ifdef FOLLOW_REFERENCES_IF_NOT_STASHED
-            if (!alias) alias= srl_follow_refp_alias_reference(aTHX_ dec, offset);
-#endif
+            if (expect_false( !alias ))
+                alias= srl_follow_refp_alias_reference(aTHX_ dec, offset);
             SvREFCNT_inc(alias);
             SvREFCNT_dec(into);
             *container= alias;
             if (track_it)
                 srl_track_sv(aTHX_ dec, track_it, alias);
+            dec->recursion_depth -= nested;
             return;
         }
         break;
@@ -1813,30 +2825,1561 @@ srl_read_single_value(pTHX_ srl_decoder_t *dec, SV* into, SV** container)
                 track_it = dec->buf.pos-1;
                 srl_track_sv(aTHX_ dec, track_it, into);
                 goto read_tag;
-            } else { 
+            } else if (srl_read_leaf(aTHX_ dec, tag, into, container, track_it)) {
+                dec->recursion_depth -= nested;
+                return;
+            } else {
                 SRL_RDR_ERROR_UNEXPECTED(dec->pbuf, tag, " single value");
             }
         break;
     }
 
-    /* they want us to set all SVs readonly, or only the non-ref */
-#define SUPPORT_READONLY 1
-#if SUPPORT_READONLY
     if ( expect_false(dec->flags_readonly) )
-    {
-        if (
-             dec->flags_readonly == 1 || !is_ref
-        ) {
-            if (is_ref && !SvREADONLY(SvRV(into)) ) {
-                SvREADONLY_on(SvRV(into));
+        srl_set_readonly(aTHX_ dec, into, is_ref);
+    dec->recursion_depth -= nested;
+
+    return;
+
+    /* What is to be read next is read right away rather than from a frame:
+     * the referent of a reference (or what is to be blessed or weakened), or
+     * the first item of a container that isn't a number or string. Whatever
+     * is left to do once it is read is on the frame its reader pushed, if
+     * any (objects only push one when they must be blessed afterwards). */
+  read_referent:
+    container= NULL;
+    track_it= NULL;
+    goto read_again;
+  read_item:
+    into= *item;
+    container= item;
+    track_it= NULL;
+    goto read_again;
+}
+
+/* Reads a value into "into", with everything it contains. Rather than
+ * recursing in C for nested arrays and hashes, the values that contain
+ * others push a frame onto dec->frames, and this loop reads what each frame
+ * on top of the stack still needs until it is back at the frames there were
+ * on entry. So the depth of the data is only limited by max_recursion_depth
+ * and the memory for the frames, not by the C stack.
+ *
+ * The items of arrays, hashes and record batches are read in tight loops
+ * here: leaves are read in place, and only other items go through
+ * srl_read_single_value_begin(), after the state of the frame is saved, as a
+ * push may move the stack. A loop moves on to the next frame when reading an
+ * item pushed one. */
+static void
+srl_read_single_value(pTHX_ srl_decoder_t *dec, SV* into, SV** container)
+{
+    srl_stack_t *frames= dec->frames;
+    const IV base_depth= SRL_STACK_DEPTH(frames);
+    IV depth;
+    SV **tail;
+    U32 nested;
+
+    srl_read_single_value_begin(aTHX_ dec, into, container, 0);
+
+    while ((depth= SRL_STACK_DEPTH(frames)) > base_depth) {
+        srl_decoder_frame_t *frame= srl_stack_ptr(frames);
+
+        switch (frame->kind) {
+        case SRL_DEC_FRAME_ARRAY:
+        {
+            SV **ptr= frame->u.av.ptr;
+            SV **end= frame->u.av.end;
+            while (ptr < end) {
+                SV **item= ptr++;
+                *item= FRESH_SV();
+                if (expect_true( srl_read_next_leaf(aTHX_ dec, item) ))
+                    continue;
+                if (ptr == end && !SRL_DEC_TAIL_NEEDS_FRAME(dec)) {
+                    tail= item;
+                    goto read_tail;
+                }
+                frame->u.av.ptr= ptr;
+                srl_read_single_value_begin(aTHX_ dec, *item, item, 0);
+                if (expect_false( SRL_STACK_DEPTH(frames) != depth ))
+                    goto next_frame;
+            }
+            goto finish_container;
+        }
+        case SRL_DEC_FRAME_HASH:
+        {
+            HV *hv= frame->u.hv.hv;
+            UV left= frame->u.hv.left;
+            while (left) {
+                SV **slot= srl_read_hash_entry(aTHX_ dec, hv);
+                left--;
+                if (expect_true( srl_read_next_leaf(aTHX_ dec, slot) ))
+                    continue;
+                if (left == 0 && !SRL_DEC_TAIL_NEEDS_FRAME(dec)) {
+                    tail= slot;
+                    goto read_tail;
+                }
+                frame->u.hv.left= left;
+                srl_read_single_value_begin(aTHX_ dec, *slot, slot, 0);
+                if (expect_false( SRL_STACK_DEPTH(frames) != depth ))
+                    goto next_frame;
+            }
+            goto finish_container;
+        }
+        case SRL_DEC_FRAME_RECORDS:
+        {
+            const UV nkeys= frame->u.records.nkeys;
+            SV **ptr= frame->u.records.ptr;
+            SV **end= AvARRAY(frame->u.records.values) + AvFILLp(frame->u.records.values) + 1;
+            for (;;) {
+                while (ptr < end) {
+                    SV **value= ptr;
+                    ptr += nkeys;
+                    *value= newSV(0);
+                    if (expect_true( srl_read_next_leaf(aTHX_ dec, value) ))
+                        continue;
+                    frame->u.records.ptr= ptr;
+                    srl_read_single_value_begin(aTHX_ dec, *value, value, 0);
+                    if (expect_false( SRL_STACK_DEPTH(frames) != depth ))
+                        goto next_frame;
+                }
+                if (++frame->u.records.column == nkeys)
+                    break;
+                ptr= frame->u.records.ptr= AvARRAY(frame->u.records.values) + frame->u.records.column;
+            }
+            break;
+        }
+        default:
+            /* a reference, its referent was read when it was pushed */
+            break;
+        }
+
+        srl_finish_frame(aTHX_ dec, frame);
+        srl_stack_pop_nocheck(frames);
+        continue;
+
+      finish_container:
+        dec->recursion_depth -= frame->nested;
+        if ( expect_false(dec->flags_readonly) )
+            srl_set_readonly(aTHX_ dec, frame->into, frame->is_ref);
+        srl_stack_pop_nocheck(frames);
+        continue;
+
+        /* the last item of an array or hash is read after its frame is
+         * popped, and restores its depth, see srl_read_single_value_begin() */
+      read_tail:
+        nested= frame->nested;
+        srl_stack_pop_nocheck(frames);
+        srl_read_single_value_begin(aTHX_ dec, *tail, tail, nested);
+      next_frame: ;
+    }
+}
+
+/****************************************************************************
+ * SELECT_PATHS - DECODING ONLY THE PARTS OF A DOCUMENT PATHS GO INTO       *
+ ****************************************************************************/
+
+#define SRL_SELECT_BAD_PATH(path) \
+    croak("Bad path '%" SVf "' in the 'select_paths' option", SVfARG(path))
+
+/* Parses an array index, an optional minus sign and up to 18 digits */
+SRL_STATIC_INLINE int
+srl_select_parse_index(const char *str, STRLEN len, IV *out)
+{
+    IV iv= 0;
+    int neg= 0;
+    STRLEN i;
+
+    if (len && *str == '-') {
+        neg= 1;
+        str++;
+        len--;
+    }
+    if (len == 0 || len > 18)
+        return 0;
+    for (i= 0; i < len; i++) {
+        if (str[i] < '0' || str[i] > '9')
+            return 0;
+        iv= iv * 10 + (str[i] - '0');
+    }
+    *out= neg ? -iv : iv;
+    return 1;
+}
+
+/* Parses start:stop or start:stop:step, each of them optional */
+SRL_STATIC_INLINE int
+srl_select_parse_slice(pTHX_ SV *path, srl_select_alt_t *alt, const char *str, STRLEN len)
+{
+    const char *end= str + len;
+    IV parts[3];
+    int nparts= 0;
+
+    parts[0]= 0;
+    parts[1]= IV_MAX;
+    parts[2]= 1;
+    for (;;) {
+        const char *part= str;
+        while (str < end && *str != ':')
+            str++;
+        if (nparts == 3 || (str > part && !srl_select_parse_index(part, str - part, parts + nparts)))
+            return 0;
+        nparts++;
+        if (str++ == end)
+            break;
+    }
+    if (nparts < 2)
+        return 0;
+    if (parts[2] < 0)
+        croak("Negative step in slice of path '%" SVf "' in the 'select_paths' option is not supported",
+              SVfARG(path));
+    alt->start= parts[0];
+    alt->stop= parts[1];
+    alt->step= parts[2] ? parts[2] : 1;
+    return 1;
+}
+
+/* Adds a step to the path being compiled, its alternatives follow */
+SRL_STATIC_INLINE void
+srl_select_add_step(pTHX_ srl_select_t *sel)
+{
+    srl_select_step_t *step;
+    if (sel->nsteps == sel->steps_size) {
+        sel->steps_size= sel->steps_size ? 2 * sel->steps_size : 8;
+        Renew(sel->steps, sel->steps_size, srl_select_step_t);
+    }
+    step= sel->steps + sel->nsteps++;
+    step->first_alt= sel->nalts;
+    step->nalts= 0;
+}
+
+/* Adds an alternative to the last step. A quoted one is always a hash key. */
+SRL_STATIC_INLINE void
+srl_select_add_alt(pTHX_ srl_select_t *sel, SV *path, const char *str, STRLEN len, int quoted)
+{
+    srl_select_alt_t *alt;
+    if (sel->nalts == sel->alts_size) {
+        sel->alts_size= sel->alts_size ? 2 * sel->alts_size : 8;
+        Renew(sel->alts, sel->alts_size, srl_select_alt_t);
+    }
+    alt= sel->alts + sel->nalts++;
+    Zero(alt, 1, srl_select_alt_t);
+    sel->steps[sel->nsteps - 1].nalts++;
+
+    /* keys are compared as bytes, in UTF-8 with keys that are in UTF-8 in
+     * the document, and in Latin-1 with the others */
+    alt->key= newSVpvn_flags(str, len, SvUTF8(path));
+    alt->key_bytes= newSVsv(alt->key);
+    if (!sv_utf8_downgrade(alt->key_bytes, 1)) {
+        SvREFCNT_dec(alt->key_bytes);
+        alt->key_bytes= NULL;
+    }
+    sv_utf8_upgrade(alt->key);
+
+    if (quoted)
+        alt->type= SRL_SELECT_KEY;
+    else if (len == 1 && *str == '*')
+        alt->type= SRL_SELECT_ANY;
+    else if (srl_select_parse_index(str, len, &alt->index)) {
+        alt->type= SRL_SELECT_KEY;
+        alt->is_index= 1;
+    }
+    else if (memchr(str, ':', len) && srl_select_parse_slice(aTHX_ path, alt, str, len))
+        alt->type= SRL_SELECT_SLICE;
+    else
+        alt->type= SRL_SELECT_KEY;
+}
+
+/* Compiles a path like "$.users[0,-1]['e-mail']" into steps */
+SRL_STATIC_INLINE void
+srl_select_parse_path(pTHX_ srl_select_t *sel, SV *path)
+{
+    STRLEN len;
+    const char *p= SvPV(path, len);
+    const char *end= p + len;
+
+    if (p == end || *p++ != '$')
+        SRL_SELECT_BAD_PATH(path);
+
+    while (p < end) {
+        srl_select_add_step(aTHX_ sel);
+        if (*p == '.') {
+            const char *name= ++p;
+            if (p < end && *p == '.')
+                croak("Recursive descent (..) in path '%" SVf "' in the 'select_paths' option is not supported",
+                      SVfARG(path));
+            while (p < end && *p != '.' && *p != '[')
+                p++;
+            if (p == name)
+                SRL_SELECT_BAD_PATH(path);
+            srl_select_add_alt(aTHX_ sel, path, name, p - name, 0);
+        }
+        else if (*p == '[') {
+            p++;
+            for (;;) {
+                const char *item= p;
+                if (p < end && (*p == '\'' || *p == '"')) {
+                    const char quote= *p++;
+                    item= p;
+                    while (p < end && *p != quote)
+                        p++;
+                    if (p == end)
+                        SRL_SELECT_BAD_PATH(path);
+                    srl_select_add_alt(aTHX_ sel, path, item, p - item, 1);
+                    p++;
+                }
+                else {
+                    while (p < end && *p != ',' && *p != ']')
+                        p++;
+                    if (p > item)
+                        srl_select_add_alt(aTHX_ sel, path, item, p - item, 0);
+                }
+                if (p == end)
+                    SRL_SELECT_BAD_PATH(path);
+                if (*p == ']')
+                    break;
+                if (*p++ != ',')
+                    SRL_SELECT_BAD_PATH(path);
             }
-            if (!SvREADONLY(into)) {
-                SvREADONLY_on(into);
+            p++;
+            if (sel->steps[sel->nsteps - 1].nalts == 0)
+                SRL_SELECT_BAD_PATH(path);
+        }
+        else {
+            SRL_SELECT_BAD_PATH(path);
+        }
+    }
+}
+
+/* Compiles the select_paths option, a path or an array of them */
+SRL_STATIC_INLINE srl_select_t *
+srl_select_compile(pTHX_ SV *paths)
+{
+    srl_select_t *sel;
+    AV *av= NULL;
+    SSize_t npaths= 1;
+    U32 i;
+
+    if (SvROK(paths)) {
+        if (SvTYPE(SvRV(paths)) != SVt_PVAV || SvOBJECT(SvRV(paths)))
+            croak("The 'select_paths' option expects a path or an array of paths");
+        av= (AV *)SvRV(paths);
+        npaths= av_len(av) + 1;
+    }
+    if (npaths > SRL_SELECT_MAX_PATHS)
+        croak("The 'select_paths' option takes at most %d paths, got %d",
+              SRL_SELECT_MAX_PATHS, (int)npaths);
+
+    Newxz(sel, 1, srl_select_t);
+    sel->refcnt= 1;
+    sel->npaths= (U32)npaths;
+    Newx(sel->first_step, npaths + 1, U32);
+    for (i= 0; i < sel->npaths; i++) {
+        SV *path= paths;
+        if (av) {
+            SV **svp= av_fetch(av, i, 0);
+            if (svp == NULL || !SvOK(*svp) || SvROK(*svp))
+                croak("The 'select_paths' option expects a path or an array of paths");
+            path= *svp;
+        }
+        sel->first_step[i]= sel->nsteps;
+        srl_select_parse_path(aTHX_ sel, path);
+    }
+    sel->first_step[sel->npaths]= sel->nsteps;
+    return sel;
+}
+
+SRL_STATIC_INLINE void
+srl_select_free(pTHX_ srl_select_t *sel)
+{
+    U32 i;
+    if (--sel->refcnt)
+        return;
+    for (i= 0; i < sel->nalts; i++) {
+        SvREFCNT_dec(sel->alts[i].key);
+        if (sel->alts[i].key_bytes)
+            SvREFCNT_dec(sel->alts[i].key_bytes);
+    }
+    Safefree(sel->alts);
+    Safefree(sel->steps);
+    Safefree(sel->first_step);
+    Safefree(sel);
+}
+
+/* Whether an alternative selects a hash key, or if key is NULL the index-th
+ * of the len items of an array */
+SRL_STATIC_INLINE int
+srl_select_matches(const srl_select_alt_t *alt, const char *key, STRLEN key_len, int is_utf8,
+                   UV index, UV len)
+{
+    IV start, stop;
+
+    if (alt->type == SRL_SELECT_ANY)
+        return 1;
+    if (key) {
+        const SV *sv= is_utf8 ? alt->key : alt->key_bytes;
+        return sv && SvCUR(sv) == key_len && memEQ(SvPVX_const(sv), key, key_len);
+    }
+    if (alt->type == SRL_SELECT_KEY) {
+        if (!alt->is_index)
+            return 0;
+        start= alt->index < 0 ? alt->index + (IV)len : alt->index;
+        return start == (IV)index;
+    }
+    /* a slice, negative ends count from the end like in Sereal::Path */
+    start= alt->start < 0 ? alt->start + (IV)len : alt->start;
+    stop= alt->stop < 0 ? alt->stop + (IV)len : alt->stop;
+    return (IV)index >= start && (IV)index < stop && ((IV)index - start) % alt->step == 0;
+}
+
+/* The paths in mask that go on into a hash value or array item at depth */
+SRL_STATIC_INLINE U32
+srl_select_child(const srl_select_t *sel, U32 mask, U32 depth, const char *key, STRLEN key_len,
+                 int is_utf8, UV index, UV len)
+{
+    U32 child= 0;
+    U32 i;
+
+    for (i= 0; mask; i++, mask >>= 1) {
+        const srl_select_step_t *step;
+        U32 a;
+        if (!(mask & 1) || sel->first_step[i] + depth >= sel->first_step[i + 1])
+            continue;
+        step= sel->steps + sel->first_step[i] + depth;
+        for (a= 0; a < step->nalts; a++) {
+            if (srl_select_matches(sel->alts + step->first_alt + a, key, key_len, is_utf8, index, len)) {
+                child |= (U32)1 << i;
+                break;
             }
         }
     }
+    return child;
+}
+
+/* The paths in mask that go on into the value of a hash key read by
+ * srl_read_hash_key() */
+SRL_STATIC_INLINE U32
+srl_select_key(const srl_select_t *sel, U32 mask, U32 depth, const U8 *from, KEYLENTYPE key_len, U32 flags)
+{
+#ifdef OLDHASH
+    PERL_UNUSED_ARG(flags);
+    if (key_len < 0)
+        return srl_select_child(sel, mask, depth, (const char *)from, (STRLEN)-key_len, 1, 0, 0);
+    return srl_select_child(sel, mask, depth, (const char *)from, (STRLEN)key_len, 0, 0, 0);
+#else
+    return srl_select_child(sel, mask, depth, (const char *)from, (STRLEN)key_len, flags & HVhek_UTF8, 0, 0);
 #endif
+}
 
+#define srl_select_item(sel, mask, depth, index, len) \
+    srl_select_child((sel), (mask), (depth), NULL, 0, 0, (index), (len))
 
-    return;
+/* Whether one of the paths in mask ends at depth */
+SRL_STATIC_INLINE int
+srl_select_ends(const srl_select_t *sel, U32 mask, U32 depth)
+{
+    U32 i;
+    for (i= 0; mask; i++, mask >>= 1) {
+        if ((mask & 1) && sel->first_step[i] + depth == sel->first_step[i + 1])
+            return 1;
+    }
+    return 0;
+}
+
+/* How to read the value next in the buffer, at depth, which the paths in
+ * mask go into: not at all, whole, or only its parts the paths go on into.
+ * The paths go through references and objects like Sereal::Path does, and
+ * scalars where they go on have nothing to select, so they are skipped. */
+SRL_STATIC_INLINE int
+srl_select_kind(pTHX_ srl_decoder_t *dec, U32 mask, U32 depth)
+{
+    const U8 *pos= dec->buf.pos;
+    U8 tag;
+
+    if (!mask)
+        return SRL_SELECT_SKIP;
+    if (srl_select_ends(dec->select, mask, depth))
+        return SRL_SELECT_WHOLE;
+
+    while (pos < dec->buf.end && *pos == SRL_HDR_PAD)
+        pos++;
+    if (pos >= dec->buf.end)
+        return SRL_SELECT_WHOLE; /* reading it reports the error */
+    tag= *pos & ~SRL_HDR_TRACK_FLAG;
+
+    if ((tag & 0xE0) == 0x40) /* ARRAYREF_0 .. HASHREF_15 */
+        return SRL_SELECT_PART;
+    switch (tag) {
+    case SRL_HDR_HASH:
+    case SRL_HDR_ARRAY:
+    case SRL_HDR_RECORDS:
+    case SRL_HDR_REFN:
+    case SRL_HDR_WEAKEN:
+    case SRL_HDR_OBJECT:
+    case SRL_HDR_OBJECT_FREEZE:
+    case SRL_HDR_OBJECTV:
+    case SRL_HDR_OBJECTV_FREEZE:
+        return SRL_SELECT_PART;
+    case SRL_HDR_REFP:
+    case SRL_HDR_ALIAS:
+    case SRL_HDR_MANY:
+        /* what is referred to, and packed arrays, are read whole */
+        return SRL_SELECT_WHOLE;
+    default:
+        return SRL_SELECT_SKIP;
+    }
+}
+
+/* Read the value next in the buffer into the slot of a container, as
+ * srl_select_kind() said, unless that was to skip it */
+SRL_STATIC_INLINE void
+srl_read_selected_item(pTHX_ srl_decoder_t *dec, SV **slot, int kind, U32 mask, U32 depth)
+{
+    if (kind == SRL_SELECT_WHOLE)
+        srl_read_single_value(aTHX_ dec, *slot, slot);
+    else
+        srl_read_selected(aTHX_ dec, *slot, slot, mask, depth);
+}
+
+/* A hash with only the keys that paths go on into */
+SRL_STATIC_INLINE void
+srl_read_selected_hash(pTHX_ srl_decoder_t *dec, SV *into, U8 tag, U32 mask, U32 depth)
+{
+    UV num_keys;
+    SV *hv= into;
+    if (tag) {
+        hv= (SV *)newHV();
+        num_keys= tag & 15;
+        SRL_sv_set_rv_to(into, hv);
+        DEPTH_INCREMENT(dec);
+    } else {
+        num_keys= srl_read_varint_uv_count(aTHX_ dec->pbuf, " while reading HASH");
+        (void)SvUPGRADE(into, SVt_PVHV);
+    }
+#ifdef FIXUP_RITER
+    HvRITER_set(hv,-1);
+#endif
+
+    if (expect_false( dec->max_num_hash_entries != 0 && num_keys > dec->max_num_hash_entries )) {
+        SRL_RDR_ERRORf2(dec->pbuf, "Got input hash with %u entries, but the configured maximum is just %u",
+                (int)num_keys, (int)dec->max_num_hash_entries);
+    }
+
+    SRL_RDR_ASSERT_SPACE(dec->pbuf,num_keys*2," while reading hash contents, insufficient remaining tags for number of keys specified");
+
+    HvSHAREKEYS_on(hv); /* apparently required on older perls */
+
+    while (num_keys--) {
+        const U8 *from;
+        U32 flags= 0;
+        U32 hash= 0;
+        KEYLENTYPE key_len;
+        U32 child;
+        int kind;
+        SV **slot;
+
+        srl_read_hash_key(aTHX_ dec, &from, &key_len, &flags, &hash);
+        child= srl_select_key(dec->select, mask, depth, from, key_len, flags);
+        kind= srl_select_kind(aTHX_ dec, child, depth + 1);
+        if (kind == SRL_SELECT_SKIP) {
+            srl_skip_value(aTHX_ dec->pbuf);
+            continue;
+        }
+        if (SvREADONLY(hv)) {
+            SvREADONLY_off(hv);
+        }
+        slot= srl_fetch_hash_slot(aTHX_ dec, (HV *)hv, from, key_len, flags, hash);
+        srl_read_selected_item(aTHX_ dec, slot, kind, child, depth + 1);
+    }
+    if (tag)
+        DEPTH_DECREMENT(dec);
+}
+
+/* An array with only the items that paths go on into, at their index. The
+ * array ends with the last of them. */
+SRL_STATIC_INLINE void
+srl_read_selected_array(pTHX_ srl_decoder_t *dec, SV *into, U8 tag, U32 mask, U32 depth)
+{
+    UV len;
+    UV i;
+    SV *av= into;
+    if (tag) {
+        av= (SV *)newAV();
+        len= tag & 15;
+        SRL_sv_set_rv_to(into, av);
+        DEPTH_INCREMENT(dec);
+    } else {
+        len= srl_read_varint_uv_count(aTHX_ dec->pbuf, " while reading ARRAY");
+        (void)SvUPGRADE(into, SVt_PVAV);
+    }
+
+    SRL_RDR_ASSERT_SPACE(dec->pbuf,len," while reading array contents, insufficient remaining tags for specified array size");
+
+    for (i= 0; i < len; i++) {
+        const U32 child= srl_select_item(dec->select, mask, depth, i, len);
+        const int kind= srl_select_kind(aTHX_ dec, child, depth + 1);
+        if (kind == SRL_SELECT_SKIP) {
+            srl_skip_value(aTHX_ dec->pbuf);
+            continue;
+        }
+        srl_read_selected_item(aTHX_ dec, av_store((AV *)av, (SSize_t)i, FRESH_SV()), kind, child, depth + 1);
+    }
+    if (tag)
+        DEPTH_DECREMENT(dec);
+}
+
+/* A record batch, with only the records that paths go on into, and only the
+ * keys of them that they go on into, see srl_read_records(). */
+SRL_STATIC_INLINE void
+srl_read_selected_records(pTHX_ srl_decoder_t *dec, SV *into, U32 mask, U32 depth)
+{
+    const srl_select_t *sel= dec->select;
+    UV nkeys;
+    const UV count= srl_read_records_header(aTHX_ dec->pbuf, &nkeys);
+    srl_record_key_t *keys;
+    U32 *masks;
+    U8 *kinds;
+    AV *values;
+    UV i, k;
+
+    (void)SvUPGRADE(into, SVt_PVAV);
+    keys= srl_read_records_keys(aTHX_ dec, nkeys);
+    if (!count)
+        return;
+
+    /* the paths that go on into each record, and how to read it */
+    Newx(masks, count, U32);
+    SAVEFREEPV(masks);
+    Newx(kinds, count, U8);
+    SAVEFREEPV(kinds);
+    for (i= 0; i < count; i++) {
+        masks[i]= srl_select_item(sel, mask, depth, i, count);
+        kinds[i]= !masks[i] ? SRL_SELECT_SKIP
+                : srl_select_ends(sel, masks[i], depth + 1) ? SRL_SELECT_WHOLE
+                : SRL_SELECT_PART;
+    }
+
+    /* the values are read column by column into a temporary array laid out
+     * record by record, which owns them until they are stored */
+    values= (AV *)sv_2mortal((SV *)newAV());
+    av_extend(values, count * nkeys - 1);
+    Zero(AvARRAY(values), count * nkeys, SV *);
+    AvFILLp(values)= count * nkeys - 1;
+
+    DEPTH_INCREMENT(dec);
+    for (k= 0; k < nkeys; k++) {
+        const srl_record_key_t *key= keys + k;
+        for (i= 0; i < count; i++) {
+            SV **slot= AvARRAY(values) + i * nkeys + k;
+            U32 child= masks[i];
+            int kind= kinds[i];
+            if (kind == SRL_SELECT_PART) {
+                child= srl_select_key(sel, child, depth + 1, key->from, key->key_len, key->flags);
+                kind= srl_select_kind(aTHX_ dec, child, depth + 2);
+            }
+            if (kind == SRL_SELECT_SKIP) {
+                srl_skip_value(aTHX_ dec->pbuf);
+                continue;
+            }
+            *slot= newSV(0);
+            srl_read_selected_item(aTHX_ dec, slot, kind, child, depth + 2);
+        }
+    }
+
+    for (i= 0; i < count; i++) {
+        SV **value= AvARRAY(values) + i * nkeys;
+        HV *hv;
+        SV *rv;
+        if (kinds[i] == SRL_SELECT_SKIP)
+            continue;
+        hv= newHV();
+        HvSHAREKEYS_on(hv); /* apparently required on older perls */
+        rv= newRV_noinc((SV *)hv);
+        av_store((AV *)into, (SSize_t)i, rv);
+        for (k= 0; k < nkeys; k++, value++) {
+            const srl_record_key_t *key= keys + k;
+            if (!*value)
+                continue;
+#ifdef OLDHASH
+            if (expect_false( !hv_store(hv, (char *)key->from, key->key_len, *value, 0) ))
+#else
+            if (expect_false( !hv_common(hv, NULL, (char *)key->from, key->key_len, key->flags,
+                                         HV_FETCH_ISSTORE|HV_FETCH_JUST_SV, *value, key->hash) ))
+#endif
+                SRL_RDR_ERROR_PANIC(dec->pbuf, "failed to hv_store");
+            *value= NULL; /* the hash owns it now */
+        }
+        if (expect_false( dec->flags_readonly == 1 )) {
+            SvREADONLY_on(hv);
+            SvREADONLY_on(rv);
+        }
+    }
+    DEPTH_DECREMENT(dec);
+}
+
+/* Reads the parts of the value next in the buffer that the paths in mask go
+ * on into, at depth, into "into". This recurses in C for the containers on
+ * the paths, so only as deep as the longest path, and reads what they
+ * select with srl_read_single_value(). References and objects along the way
+ * are read like srl_read_single_value_begin() does, with the frames they
+ * push finished here. */
+static void
+srl_read_selected(pTHX_ srl_decoder_t *dec, SV *into, SV **container, U32 mask, U32 depth)
+{
+    srl_stack_t *frames= dec->frames;
+    const IV base_depth= SRL_STACK_DEPTH(frames);
+    const U8 *tag_pos;
+    SV *referent;
+    int is_ref= 0;
+    U8 tag;
+
+  read_again:
+    if (expect_false( SRL_RDR_DONE(dec->pbuf) ))
+        SRL_RDR_ERROR(dec->pbuf, "unexpected end of input stream while expecting a single value");
+
+    tag_pos= dec->buf.pos;
+    tag= *dec->buf.pos++;
+    if (tag & SRL_HDR_TRACK_FLAG) {
+        tag= tag & ~SRL_HDR_TRACK_FLAG;
+        srl_track_sv(aTHX_ dec, tag_pos, into);
+    }
+
+    switch (tag) {
+        CASE_SRL_HDR_HASHREF:
+            srl_read_selected_hash(aTHX_ dec, into, tag, mask, depth);
+            is_ref= 1;
+            break;
+        CASE_SRL_HDR_ARRAYREF:
+            srl_read_selected_array(aTHX_ dec, into, tag, mask, depth);
+            is_ref= 1;
+            break;
+        case SRL_HDR_HASH:
+            srl_read_selected_hash(aTHX_ dec, into, 0, mask, depth);
+            break;
+        case SRL_HDR_ARRAY:
+            srl_read_selected_array(aTHX_ dec, into, 0, mask, depth);
+            break;
+        case SRL_HDR_RECORDS:
+            srl_read_selected_records(aTHX_ dec, into, mask, depth);
+            break;
+        case SRL_HDR_PAD:
+            goto read_again;
+        case SRL_HDR_WEAKEN:
+            srl_push_frame(aTHX_ dec, into, SRL_DEC_FRAME_WEAKEN, 1, 0);
+            container= NULL;
+            goto read_again;
+        case SRL_HDR_REFN:
+            referent= srl_read_refn(aTHX_ dec, into);
+            if (referent) {
+                srl_push_frame(aTHX_ dec, into, SRL_DEC_FRAME_REFN, 1, 1);
+                into= referent;
+                container= NULL;
+                goto read_again;
+            }
+            is_ref= 1;
+            break;
+        case SRL_HDR_OBJECT_FREEZE:
+        case SRL_HDR_OBJECT:
+            if (srl_read_object(aTHX_ dec, into, tag, 0)) {
+                container= NULL;
+                goto read_again;
+            }
+            is_ref= 1;
+            break;
+        case SRL_HDR_OBJECTV_FREEZE:
+        case SRL_HDR_OBJECTV:
+            if (srl_read_objectv(aTHX_ dec, into, tag)) {
+                container= NULL;
+                goto read_again;
+            }
+            is_ref= 1;
+            break;
+        default:
+            /* nothing to select in it, so read it whole */
+            dec->buf.pos= tag_pos;
+            srl_read_single_value(aTHX_ dec, into, container);
+            goto finish;
+    }
+
+    if ( expect_false(dec->flags_readonly) )
+        srl_set_readonly(aTHX_ dec, into, is_ref);
+
+  finish:
+    while (SRL_STACK_DEPTH(frames) > base_depth) {
+        srl_finish_frame(aTHX_ dec, srl_stack_ptr(frames));
+        srl_stack_pop_nocheck(frames);
+    }
+}
+
+/* The document body with the select_paths option */
+SRL_STATIC_INLINE void
+srl_read_selected_body(pTHX_ srl_decoder_t *dec, SV *into)
+{
+    const U32 npaths= dec->select->npaths;
+    const U32 mask= npaths == SRL_SELECT_MAX_PATHS ? 0xFFFFFFFF : ((U32)1 << npaths) - 1;
+
+    switch (srl_select_kind(aTHX_ dec, mask, 0)) {
+    case SRL_SELECT_SKIP:
+        srl_skip_value(aTHX_ dec->pbuf);
+        break;
+    case SRL_SELECT_WHOLE:
+        srl_read_single_value(aTHX_ dec, into, NULL);
+        break;
+    default:
+        srl_read_selected(aTHX_ dec, into, NULL, mask, 0);
+        break;
+    }
+}
+
+/****************************************************************************
+ * VALIDATE - CHECKING DOCUMENTS WITHOUT DECODING THEM                      *
+ ****************************************************************************/
+
+/* The value stored for the offsets of tracked items in dec->ref_seenhash and
+ * of class names in dec->ref_stashes while validating, where there is no SV
+ * or stash to store */
+#define SRL_VALIDATE_SEEN ((void *)&PL_sv_undef)
+
+#define SRL_VALIDATE_UTF8(dec, from, len) STMT_START {                          \
+    if (expect_false( SRL_DEC_HAVE_OPTION((dec), SRL_F_DECODER_VALIDATE_UTF8)   \
+                      && !srl_is_utf8_string((from), (len)) ))                  \
+        SRL_RDR_ERROR((dec)->pbuf, "Invalid UTF8 byte sequence");               \
+} STMT_END
+
+/* Check the string whose tag was just read, or a COPY of an earlier one for
+ * hash keys and class names. "context" is the tag of what the string is part
+ * of, for errors. Like the decoder this checks UTF-8 only in values. Returns
+ * the offset of the tag of the string, or of the copied one for a COPY. */
+SRL_STATIC_INLINE UV
+srl_validate_string(pTHX_ srl_decoder_t *dec, U8 tag, U8 context)
+{
+    const int is_value= context == tag;
+    UV ofs= SRL_RDR_BODY_POS_OFS(dec->pbuf) - 1;
+    UV len;
+
+    if (IS_SRL_HDR_SHORT_BINARY(tag)) {
+        len= SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(tag);
+        SRL_RDR_ASSERT_SPACE(dec->pbuf, len, " while reading ascii string");
+        dec->buf.pos += len;
+    }
+    else
+    if (tag == SRL_HDR_BINARY || tag == SRL_HDR_STR_UTF8) {
+        len= srl_read_varint_uv_length(aTHX_ dec->pbuf, " while reading string");
+        if (tag == SRL_HDR_STR_UTF8 && is_value)
+            SRL_VALIDATE_UTF8(dec, dec->buf.pos, len);
+        dec->buf.pos += len;
+    }
+    else
+    if (tag == SRL_HDR_COPY) {
+        const U8 *from;
+        ofs= srl_read_varint_uv_offset(aTHX_ dec->pbuf, " while reading COPY tag");
+        from= dec->buf.body_pos + ofs;
+        tag= *from++;
+        if (IS_SRL_HDR_SHORT_BINARY(tag)) {
+            len= SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(tag);
+        }
+        else
+        if (tag == SRL_HDR_BINARY || tag == SRL_HDR_STR_UTF8) {
+            len= S_read_varint_uv_length_char_ptr(aTHX_ &from, dec->buf.end,
+                                                  " while reading string length (via COPY)");
+        }
+        else {
+            SRL_RDR_ERROR_BAD_COPY(dec->pbuf, context);
+        }
+        if (expect_false( len > (UV)(dec->buf.end - from) ))
+            SRL_RDR_ERRORf1(dec->pbuf, "COPY(%"UVuf") points out of packet", ofs);
+    }
+    else {
+        SRL_RDR_ERROR_UNEXPECTED(dec->pbuf, tag, context == SRL_HDR_OBJECT || context == SRL_HDR_OBJECT_FREEZE
+                                                 ? "a class name" : "a stringish type");
+    }
+    return ofs;
+}
+
+/* Check the next key of a hash or record batch */
+SRL_STATIC_INLINE void
+srl_validate_key(pTHX_ srl_decoder_t *dec, U8 context)
+{
+    SRL_RDR_ASSERT_SPACE(dec->pbuf, 1, " while reading key tag byte for HASH");
+    (void)srl_validate_string(aTHX_ dec, (*dec->buf.pos++) & 127, context);
+}
+
+/* Check that an offset of a REFP or ALIAS tag is that of a tracked item */
+SRL_STATIC_INLINE void
+srl_validate_item(pTHX_ srl_decoder_t *dec, UV item, const char * const tag_name)
+{
+    if (expect_false( PTABLE_fetch(dec->ref_seenhash, (void *)item) == NULL ))
+        SRL_RDR_ERRORf2(dec->pbuf, "%s(%"UVuf") references an unknown item", tag_name, item);
+}
+
+/* Check the modifiers of a regexp, which are a SHORT_BINARY */
+SRL_STATIC_INLINE void
+srl_validate_regexp_modifiers(pTHX_ srl_decoder_t *dec)
+{
+    U8 mod_len;
+
+    SRL_RDR_ASSERT_SPACE(dec->pbuf, 1, " while reading regexp modifer tag");
+    if (expect_false( !IS_SRL_HDR_SHORT_BINARY(*dec->buf.pos) ))
+        SRL_RDR_ERROR(dec->pbuf, "Expecting SRL_HDR_SHORT_BINARY for modifiers of regexp");
+    mod_len= SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(*dec->buf.pos++);
+    SRL_RDR_ASSERT_SPACE(dec->pbuf, mod_len, " while reading regexp modifiers");
+    while (mod_len > 0) {
+        mod_len--;
+        switch (*dec->buf.pos++) {
+            case 'm':
+            case 's':
+            case 'i':
+            case 'x':
+#ifdef REGEXP_HAS_P_MODIFIER
+            case 'p':
+#endif
+                break;
+            default:
+                SRL_RDR_ERROR(dec->pbuf, "bad modifier");
+                break;
+        }
+    }
+}
+
+/* Whether the tag of a value, its TRACK flag aside, makes a reference. Only
+ * references can be weakened or blessed. A COPY could only be of another
+ * reference, which no encoder writes, so it isn't accepted. */
+#define SRL_VALIDATE_REF_TAG(tag) (                                             \
+       ((tag) >= SRL_HDR_ARRAYREF_LOW && (tag) <= SRL_HDR_HASHREF_HIGH)          \
+    || (tag) == SRL_HDR_REFN || (tag) == SRL_HDR_REFP || (tag) == SRL_HDR_WEAKEN \
+    || (tag) == SRL_HDR_OBJECT || (tag) == SRL_HDR_OBJECT_FREEZE                \
+    || (tag) == SRL_HDR_OBJECTV || (tag) == SRL_HDR_OBJECTV_FREEZE )
+
+/* Check that the value to be read next, PADs aside, is a reference to
+ * weaken or bless */
+SRL_STATIC_INLINE void
+srl_validate_next_is_ref(pTHX_ srl_decoder_t *dec, const char * const errstr)
+{
+    const U8 *next= dec->buf.pos;
+    while (next < dec->buf.end && *next == SRL_HDR_PAD)
+        next++;
+    if (expect_false( next < dec->buf.end && !SRL_VALIDATE_REF_TAG(*next & ~SRL_HDR_TRACK_FLAG) ))
+        SRL_RDR_ERROR(dec->pbuf, errstr);
+}
+
+/* Checks the value whose tag is next in the document, with everything it
+ * contains, the way srl_read_single_value() would read it but without
+ * creating any SVs. Containers and references push a frame that only counts
+ * the items left to check, so like there the depth of the data is only
+ * limited by max_recursion_depth. The offsets of tracked items and class
+ * names are kept in dec->ref_seenhash and dec->ref_stashes for the checks of
+ * REFP, ALIAS and OBJECTV tags.
+ *
+ * Not checked is what only decoding the values can tell: duplicate keys,
+ * and whether regexps compile and FREEZE data thaws. */
+static void
+srl_validate_value(pTHX_ srl_decoder_t *dec)
+{
+    srl_stack_t *frames= dec->frames;
+    const IV base_depth= SRL_STACK_DEPTH(frames);
+    srl_decoder_frame_t *frame;
+    int in_container= 0;
+    U8 nested;
+    UV len;
+    U8 tag;
+
+  read_again:
+    if (expect_false( SRL_RDR_DONE(dec->pbuf) ))
+        SRL_RDR_ERROR(dec->pbuf, "unexpected end of input stream while expecting a single value");
+
+    tag= *dec->buf.pos++;
+    if (tag & SRL_HDR_TRACK_FLAG) {
+        PTABLE_store(dec->ref_seenhash, (void *)(SRL_RDR_BODY_POS_OFS(dec->pbuf) - 1), SRL_VALIDATE_SEEN);
+        tag &= ~SRL_HDR_TRACK_FLAG;
+    }
+
+    switch (tag) {
+        CASE_SRL_HDR_POS:
+        CASE_SRL_HDR_NEG:
+        case SRL_HDR_TRUE:
+        case SRL_HDR_FALSE:
+        case SRL_HDR_UNDEF:
+        case SRL_HDR_CANONICAL_UNDEF:
+            break;
+        CASE_SRL_HDR_SHORT_BINARY:
+        case SRL_HDR_BINARY:
+        case SRL_HDR_STR_UTF8:
+            (void)srl_validate_string(aTHX_ dec, tag, tag);
+            break;
+        case SRL_HDR_VARINT:
+        case SRL_HDR_ZIGZAG:
+            (void)srl_read_varint_uv(aTHX_ dec->pbuf);
+            break;
+        case SRL_HDR_FLOAT:
+            SRL_RDR_ASSERT_SPACE(dec->pbuf, sizeof(float), " while reading FLOAT");
+            dec->buf.pos += sizeof(float);
+            break;
+        case SRL_HDR_DOUBLE:
+            SRL_RDR_ASSERT_SPACE(dec->pbuf, sizeof(double), " while reading DOUBLE");
+            dec->buf.pos += sizeof(double);
+            break;
+        case SRL_HDR_LONG_DOUBLE:
+            SRL_RDR_ASSERT_SPACE(dec->pbuf, sizeof(long double), " while reading LONG_DOUBLE");
+            dec->buf.pos += sizeof(long double);
+            break;
+
+        CASE_SRL_HDR_HASHREF:
+            DEPTH_INCREMENT(dec);
+            nested= 1;
+            len= tag & 15;
+            goto check_hash;
+        case SRL_HDR_HASH:
+            nested= 0;
+            len= srl_read_varint_uv_count(aTHX_ dec->pbuf, " while reading HASH");
+          check_hash:
+            if (expect_false( dec->max_num_hash_entries != 0 && len > dec->max_num_hash_entries )) {
+                SRL_RDR_ERRORf2(dec->pbuf, "Got input hash with %u entries, but the configured maximum is just %u",
+                        (int)len, (int)dec->max_num_hash_entries);
+            }
+            SRL_RDR_ASSERT_SPACE(dec->pbuf, len * 2, " while reading hash contents, insufficient remaining tags for number of keys specified");
+            if (len) {
+                frame= srl_push_frame(aTHX_ dec, NULL, SRL_DEC_FRAME_CHECK_HASH, 0, nested);
+                frame->u.check.left= len;
+                srl_validate_key(aTHX_ dec, SRL_HDR_HASH);
+                in_container= 1;
+                goto read_again;
+            }
+            if (nested)
+                DEPTH_DECREMENT(dec);
+            break;
+
+        CASE_SRL_HDR_ARRAYREF:
+            DEPTH_INCREMENT(dec);
+            nested= 1;
+            len= tag & 15;
+            goto check_items;
+        case SRL_HDR_ARRAY:
+            nested= 0;
+            len= srl_read_varint_uv_count(aTHX_ dec->pbuf, " while reading ARRAY");
+            SRL_RDR_ASSERT_SPACE(dec->pbuf, len, " while reading array contents, insufficient remaining tags for specified array size");
+          check_items:
+            if (len) {
+                frame= srl_push_frame(aTHX_ dec, NULL, SRL_DEC_FRAME_CHECK_ITEMS, 0, nested);
+                frame->u.check.left= len;
+                in_container= 1;
+                goto read_again;
+            }
+            if (nested)
+                DEPTH_DECREMENT(dec);
+            break;
+        case SRL_HDR_RECORDS:
+        {
+            UV nkeys, i;
+            len= srl_read_records_header(aTHX_ dec->pbuf, &nkeys);
+            if (expect_false( dec->max_num_hash_entries != 0 && nkeys > dec->max_num_hash_entries )) {
+                SRL_RDR_ERRORf2(dec->pbuf, "Got input hash with %u entries, but the configured maximum is just %u",
+                        (int)nkeys, (int)dec->max_num_hash_entries);
+            }
+            for (i= 0; i < nkeys; i++)
+                srl_validate_key(aTHX_ dec, SRL_HDR_RECORDS);
+            if (!len)
+                break;
+            /* the header check guarantees that this doesn't overflow */
+            len *= nkeys;
+            DEPTH_INCREMENT(dec);
+            nested= 1;
+            goto check_items;
+        }
+        case SRL_HDR_MANY:
+        {
+            U8 type;
+            len= srl_read_many_header(aTHX_ dec->pbuf, &type);
+            srl_skip_many_items(aTHX_ dec->pbuf, type, len);
+            break;
+        }
+
+        case SRL_HDR_REFN:
+            DEPTH_INCREMENT(dec);
+            frame= srl_push_frame(aTHX_ dec, NULL, SRL_DEC_FRAME_CHECK_ITEMS, 0, 1);
+            frame->u.check.left= 1;
+            in_container= 0;
+            goto read_again;
+        case SRL_HDR_REFP:
+            srl_validate_item(aTHX_ dec, srl_read_varint_uv_offset(aTHX_ dec->pbuf, " while reading REFP tag"), "REFP");
+            break;
+        case SRL_HDR_ALIAS:
+            if (!in_container)
+                SRL_RDR_ERROR(dec->pbuf, "ALIAS tag not inside container, corrupt packet?");
+            srl_validate_item(aTHX_ dec, srl_read_varint_uv_offset(aTHX_ dec->pbuf, " while reading ALIAS tag"), "ALIAS");
+            break;
+        case SRL_HDR_WEAKEN:
+            srl_validate_next_is_ref(aTHX_ dec, "WEAKEN op");
+            in_container= 0;
+            goto read_again;
+
+        case SRL_HDR_OBJECT:
+        case SRL_HDR_OBJECT_FREEZE:
+        {
+            UV ofs;
+            if (expect_false( SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_REFUSE_OBJECTS) ))
+                SRL_RDR_ERROR_REFUSE_OBJECT(dec->pbuf);
+            SRL_RDR_ASSERT_SPACE(dec->pbuf, 1, " while reading classname tag");
+            ofs= srl_validate_string(aTHX_ dec, *dec->buf.pos++, tag);
+            SRL_ASSERT_REF_PTR_TABLES(dec);
+            PTABLE_store(dec->ref_stashes, (void *)ofs, SRL_VALIDATE_SEEN);
+            if (tag == SRL_HDR_OBJECT)
+                srl_validate_next_is_ref(aTHX_ dec, "Can't bless non-reference value");
+            in_container= 0;
+            goto read_again;
+        }
+        case SRL_HDR_OBJECTV:
+        case SRL_HDR_OBJECTV_FREEZE:
+        {
+            UV ofs;
+            if (expect_false( SRL_DEC_HAVE_OPTION(dec, SRL_F_DECODER_REFUSE_OBJECTS) ))
+                SRL_RDR_ERROR_REFUSE_OBJECT(dec->pbuf);
+            ofs= srl_read_varint_uv_offset(aTHX_ dec->pbuf, " while reading OBJECTV(_FREEZE) classname");
+            if (expect_false( !dec->ref_stashes ))
+                SRL_RDR_ERROR(dec->pbuf, "Corrupted packet. OBJECTV(_FREEZE) used without "
+                              "preceding OBJECT(_FREEZE) to define classname");
+            if (expect_false( !PTABLE_fetch(dec->ref_stashes, (void *)ofs) ))
+                SRL_RDR_ERRORf1(dec->pbuf, "Corrupted packet. OBJECTV(_FREEZE) references unknown classname offset: %"UVuf, ofs);
+            if (tag == SRL_HDR_OBJECTV)
+                srl_validate_next_is_ref(aTHX_ dec, "Can't bless non-reference value");
+            in_container= 0;
+            goto read_again;
+        }
+
+        case SRL_HDR_COPY:
+        {
+            /* what is copied is checked again, it may not be a value that
+             * was checked before, and a COPY in it is an error */
+            UV item= srl_read_varint_uv_offset(aTHX_ dec->pbuf, " while reading COPY tag");
+            if (expect_false( dec->save_pos ))
+                SRL_RDR_ERRORf1(dec->pbuf, "COPY(%d) called during parse", (int)item);
+            dec->save_pos= dec->buf.pos;
+            dec->buf.pos= dec->buf.body_pos + item;
+            srl_validate_value(aTHX_ dec);
+            dec->buf.pos= dec->save_pos;
+            dec->save_pos= NULL;
+            break;
+        }
+        case SRL_HDR_REGEXP:
+            /* the modifiers are checked once the pattern is */
+            frame= srl_push_frame(aTHX_ dec, NULL, SRL_DEC_FRAME_CHECK_REGEXP, 0, 0);
+            frame->u.check.left= 1;
+            in_container= 0;
+            goto read_again;
+        case SRL_HDR_EXTEND:
+            SRL_RDR_ERROR_UNIMPLEMENTED(dec->pbuf, SRL_HDR_EXTEND, "EXTEND");
+            break;
+        case SRL_HDR_PAD:
+            goto read_again;
+        default:
+            SRL_RDR_ERROR_UNEXPECTED(dec->pbuf, tag, " single value");
+            break;
+    }
+
+    /* The value is complete, move on to the next item of the innermost
+     * container that has any left, completing those that have none. */
+    while (SRL_STACK_DEPTH(frames) > base_depth) {
+        frame= srl_stack_ptr(frames);
+        if (--frame->u.check.left) {
+            if (frame->kind == SRL_DEC_FRAME_CHECK_HASH)
+                srl_validate_key(aTHX_ dec, SRL_HDR_HASH);
+            in_container= 1;
+            goto read_again;
+        }
+        if (frame->kind == SRL_DEC_FRAME_CHECK_REGEXP)
+            srl_validate_regexp_modifiers(aTHX_ dec);
+        if (frame->nested)
+            DEPTH_DECREMENT(dec);
+        srl_stack_pop_nocheck(frames);
+    }
+}
+
+/* Checks that the document in src is well formed, see srl_validate_value(),
+ * and returns its length. Croaks with the error decoding it would croak with
+ * otherwise. Like when only the body is decoded the header user data is
+ * skipped. */
+UV
+srl_validate_document(pTHX_ srl_decoder_t *origdec, SV *src, UV start_offset)
+{
+    srl_decoder_t *dec;
+    const U8 *body_start;
+    UV len;
+
+    assert(origdec != NULL);
+    dec= srl_begin_decoding(aTHX_ origdec, src, start_offset);
+    srl_read_header(aTHX_ dec, NULL);
+    srl_begin_body(aTHX_ dec, origdec);
+    body_start= dec->buf.pos;
+    srl_validate_value(aTHX_ dec);
+    if (expect_false( dec->stats != NULL ))
+        srl_stats_count_body(dec, body_start);
+
+    if (dec->bytes_consumed == 0) {
+        dec->bytes_consumed= dec->buf.pos - dec->buf.start;
+        origdec->bytes_consumed= dec->bytes_consumed;
+    }
+    len= dec->bytes_consumed;
+
+    srl_clear_decoder(aTHX_ dec);
+    return len;
+}
+
+/****************************************************************************
+ * READER - DECODING DOCUMENTS FROM A FILE HANDLE ONE AT A TIME             *
+ ****************************************************************************/
+
+/* Errors about input that is not decoded yet, ofs is relative to the start
+ * of the document at rdr->offset. */
+#define SRL_DEC_READER_ERROR(rdr, ofs, msg) \
+    croak(SRL_RDR_BASE_ERROR_FORMAT("%s"), (msg), (UV)(1 + (rdr)->offset + (ofs)), __FILE__, __LINE__)
+#define SRL_DEC_READER_ERRORf1(rdr, ofs, fmt, var) \
+    croak(SRL_RDR_BASE_ERROR_FORMAT(fmt), (var), (UV)(1 + (rdr)->offset + (ofs)), __FILE__, __LINE__)
+
+/* Default for the minimum number of bytes to read from the handle at a time */
+#define SRL_DEC_READER_READ_SIZE (64 * 1024)
+
+srl_decoder_reader_t *
+srl_build_decoder_reader(pTHX_ srl_decoder_t *proto, SV *fh, STRLEN read_size)
+{
+    srl_decoder_reader_t *rdr;
+
+    if (IoIFP(sv_2io(fh)) == NULL)
+        croak("Filehandle is not open for reading");
+
+    Newxz(rdr, 1, srl_decoder_reader_t);
+
+    /* Own clone of the decoder, so the documents are never chopped off the
+     * window by destructive incremental mode and the decoder the reader was
+     * created from can be used while reading. */
+    rdr->dec = srl_build_decoder_struct_alike(aTHX_ proto);
+    SRL_DEC_SET_OPTION(rdr->dec, SRL_F_DECODER_REUSE);
+    SRL_DEC_UNSET_OPTION(rdr->dec, SRL_F_DECODER_DESTRUCTIVE_INCREMENTAL);
+
+    rdr->fh = SvREFCNT_inc(fh);
+    rdr->window = newSV(0);
+    sv_setpvs(rdr->window, "");
+    rdr->read_size = read_size ? read_size : SRL_DEC_READER_READ_SIZE;
+
+    return rdr;
+}
+
+void
+srl_destroy_decoder_reader(pTHX_ srl_decoder_reader_t *rdr)
+{
+    /* If a document was just decoded, the decoder is freed by its
+     * destructor hook on scope exit instead. */
+    if (SRL_DEC_HAVE_OPTION(rdr->dec, SRL_F_DECODER_DIRTY))
+        SRL_DEC_UNSET_OPTION(rdr->dec, SRL_F_DECODER_REUSE);
+    else
+        srl_destroy_decoder(aTHX_ rdr->dec);
+    SvREFCNT_dec(rdr->fh);
+    SvREFCNT_dec(rdr->window);
+    Safefree(rdr);
+}
+
+/* Like srl_read_varint_uv(), but returns false instead of croaking if the
+ * varint isn't complete before end. */
+SRL_STATIC_INLINE int
+srl_decoder_reader_varint(pTHX_ srl_decoder_reader_t *rdr, const U8 *doc, const U8 **p, const U8 *end, UV *uv)
+{
+    const U8 *ptr = *p;
+    unsigned int lshift = 0;
+    UV value = 0;
+
+    while (ptr < end) {
+        const U8 c = *ptr++;
+        if (expect_false( lshift >= sizeof(UV) * 8 ))
+            SRL_DEC_READER_ERROR(rdr, *p - doc, "varint too big");
+        value |= ((UV)(c & 0x7F)) << lshift;
+        lshift += 7;
+        if (!(c & 0x80)) {
+            *p = ptr;
+            *uv = value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#define SRL_DEC_READER_VARINT(uv) STMT_START {                            \
+    if (!srl_decoder_reader_varint(aTHX_ rdr, doc, &p, end, &(uv)))       \
+        return 0;                                                         \
+} STMT_END
+
+#define SRL_DEC_READER_SKIP(n) STMT_START {                               \
+    if ((UV)(end - p) < (UV)(n))                                          \
+        return 0;                                                         \
+    p += (n);                                                             \
+} STMT_END
+
+#define SRL_DEC_READER_ADD_ITEMS(n) STMT_START {                          \
+    if (expect_false( (UV)(n) > UV_MAX - items ))                         \
+        SRL_DEC_READER_ERROR(rdr, tag_pos - doc, "item count too large"); \
+    items += (n);                                                         \
+} STMT_END
+
+/* Find the end of the document at the start of the len bytes at doc without
+ * decoding it. Returns the length of the document, or 0 if the document
+ * doesn't end within len bytes. Compressed documents carry the length of
+ * their body in the header. For uncompressed ones, the body is scanned for
+ * the items it consists of; that scan picks up where it stopped the last
+ * time the same document was incomplete. */
+SRL_STATIC_INLINE STRLEN
+srl_decoder_reader_scan(pTHX_ srl_decoder_reader_t *rdr, const U8 *doc, STRLEN len)
+{
+    const U8 * const end = doc + len;
+    const U8 *p = doc + SRL_MAGIC_STRLEN + 1;
+    IV version_encoding;
+    UV header_len, body_len;
+    UV items, packed;
+
+    if (len < SRL_MAGIC_STRLEN + 3)
+        return 0;
+    version_encoding = srl_validate_header_version(aTHX_ doc, len);
+    if (expect_false( version_encoding < 1 )) {
+        if (version_encoding == 0)
+            SRL_DEC_READER_ERROR(rdr, 0, "Bad Sereal header: It seems your document was accidentally UTF-8 encoded");
+        else
+            SRL_DEC_READER_ERROR(rdr, 0, "Bad Sereal header: Not a valid Sereal document.");
+    }
+
+    SRL_DEC_READER_VARINT(header_len);
+    SRL_DEC_READER_SKIP(header_len);
+
+    switch (version_encoding & SRL_PROTOCOL_ENCODING_MASK) {
+    case SRL_PROTOCOL_ENCODING_RAW:
+        break;
+    case SRL_PROTOCOL_ENCODING_ZLIB:
+        SRL_DEC_READER_VARINT(body_len); /* uncompressed length */
+        /* FALLTHROUGH */
+    case SRL_PROTOCOL_ENCODING_SNAPPY_INCREMENTAL:
+    case SRL_PROTOCOL_ENCODING_ZSTD:
+        SRL_DEC_READER_VARINT(body_len);
+        SRL_DEC_READER_SKIP(body_len);
+        return p - doc;
+    case SRL_PROTOCOL_ENCODING_SNAPPY:
+        SRL_DEC_READER_ERROR(rdr, SRL_MAGIC_STRLEN,
+                             "Can't find the end of a non-incremental Snappy compressed document "
+                             "in a stream of documents");
+    default:
+        SRL_DEC_READER_ERRORf1(rdr, SRL_MAGIC_STRLEN, "Sereal document encoded in an unknown format '%d'",
+                               (int)((version_encoding & SRL_PROTOCOL_ENCODING_MASK) >> SRL_PROTOCOL_VERSION_BITS));
+    }
+
+    if (rdr->scan_items == 0 && rdr->scan_packed == 0) {
+        /* start of the body, which is a single item */
+        rdr->scan_pos = p - doc;
+        rdr->scan_items = 1;
+    }
+    p = doc + rdr->scan_pos;
+    items = rdr->scan_items;
+    packed = rdr->scan_packed;
+
+    while (items || packed) {
+        const U8 * const tag_pos = p;
+        U8 tag;
+        UV n;
+
+        if (packed) {
+            /* the varints of a packed array, each ends with a byte without
+             * the high bit. Remember how far we got, these can be many. */
+            const U8 *q = p;
+            while (packed && q < end) {
+                if (!(*q++ & 0x80)) {
+                    packed--;
+                    p = q;
+                }
+            }
+            rdr->scan_pos = p - doc;
+            rdr->scan_packed = packed;
+            if (packed)
+                return 0;
+            continue;
+        }
+        if (p >= end)
+            return 0;
+        tag = *p++ & ~SRL_HDR_TRACK_FLAG;
+        --items;
+
+        if (tag <= SRL_HDR_NEG_HIGH) {
+            /* no payload */
+        }
+        else if (tag >= SRL_HDR_SHORT_BINARY_LOW) {
+            SRL_DEC_READER_SKIP(SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(tag));
+        }
+        else if (tag >= SRL_HDR_HASHREF_LOW) {
+            SRL_DEC_READER_ADD_ITEMS(2 * SRL_HDR_HASHREF_LEN_FROM_TAG(tag));
+        }
+        else if (tag >= SRL_HDR_ARRAYREF_LOW) {
+            SRL_DEC_READER_ADD_ITEMS(SRL_HDR_ARRAYREF_LEN_FROM_TAG(tag));
+        }
+        else {
+            switch (tag) {
+            case SRL_HDR_UNDEF:
+            case SRL_HDR_CANONICAL_UNDEF:
+            case SRL_HDR_FALSE:
+            case SRL_HDR_TRUE:
+                break;
+            case SRL_HDR_PAD:
+                ++items; /* not an item */
+                break;
+            case SRL_HDR_VARINT:
+            case SRL_HDR_ZIGZAG:
+            case SRL_HDR_REFP:
+            case SRL_HDR_ALIAS:
+            case SRL_HDR_COPY:
+                SRL_DEC_READER_VARINT(n);
+                break;
+            case SRL_HDR_FLOAT:       SRL_DEC_READER_SKIP(4);  break;
+            case SRL_HDR_DOUBLE:      SRL_DEC_READER_SKIP(8);  break;
+            case SRL_HDR_LONG_DOUBLE: SRL_DEC_READER_SKIP(16); break;
+            case SRL_HDR_BINARY:
+            case SRL_HDR_STR_UTF8:
+                SRL_DEC_READER_VARINT(n);
+                SRL_DEC_READER_SKIP(n);
+                break;
+            case SRL_HDR_REFN:
+            case SRL_HDR_WEAKEN:
+                SRL_DEC_READER_ADD_ITEMS(1);
+                break;
+            case SRL_HDR_HASH:
+                SRL_DEC_READER_VARINT(n);
+                if (expect_false( n > UV_MAX / 2 ))
+                    SRL_DEC_READER_ERROR(rdr, tag_pos - doc, "item count too large");
+                SRL_DEC_READER_ADD_ITEMS(2 * n);
+                break;
+            case SRL_HDR_ARRAY:
+                SRL_DEC_READER_VARINT(n);
+                SRL_DEC_READER_ADD_ITEMS(n);
+                break;
+            case SRL_HDR_MANY: {
+                U8 type;
+                SRL_DEC_READER_VARINT(n);
+                SRL_DEC_READER_SKIP(1);
+                type = p[-1];
+                if (type == SRL_HDR_FLOAT || type == SRL_HDR_DOUBLE) {
+                    const UV size = type == SRL_HDR_FLOAT ? 4 : 8;
+                    if (n > (UV)(end - p) / size)
+                        return 0;
+                    p += n * size;
+                }
+                else if (type == SRL_HDR_VARINT || type == SRL_HDR_ZIGZAG) {
+                    packed = n; /* skipped below, possibly over several calls */
+                }
+                else {
+                    SRL_DEC_READER_ERRORf1(rdr, tag_pos - doc, "Unsupported item type %u in packed array (MANY)",
+                                           (unsigned int)type);
+                }
+                break;
+            }
+            case SRL_HDR_RECORDS: {
+                UV nkeys;
+                SRL_DEC_READER_VARINT(n);
+                SRL_DEC_READER_VARINT(nkeys);
+                if (expect_false( nkeys == 0 || n > UV_MAX / nkeys - 1 ))
+                    SRL_DEC_READER_ERROR(rdr, tag_pos - doc, "item count too large");
+                SRL_DEC_READER_ADD_ITEMS(nkeys + n * nkeys);
+                break;
+            }
+            case SRL_HDR_OBJECT:
+            case SRL_HDR_OBJECT_FREEZE:
+            case SRL_HDR_REGEXP:
+                SRL_DEC_READER_ADD_ITEMS(2); /* class name or pattern, and the item or modifiers */
+                break;
+            case SRL_HDR_OBJECTV:
+            case SRL_HDR_OBJECTV_FREEZE:
+                SRL_DEC_READER_VARINT(n);
+                SRL_DEC_READER_ADD_ITEMS(1);
+                break;
+            default:
+                SRL_DEC_READER_ERRORf1(rdr, tag_pos - doc, "Unexpected tag SRL_HDR_%s in document body",
+                                       SRL_TAG_NAME(tag));
+            }
+        }
+
+        /* the item is complete, don't scan it again */
+        rdr->scan_pos = p - doc;
+        rdr->scan_items = items;
+        rdr->scan_packed = packed;
+    }
+
+    return p - doc;
+}
+
+#undef SRL_DEC_READER_VARINT
+#undef SRL_DEC_READER_SKIP
+#undef SRL_DEC_READER_ADD_ITEMS
+
+/* Read more input, dropping the documents that were decoded already. The
+ * window grows with the document that doesn't fit into it, so documents
+ * that are much larger than read_size take a few reads rather than many,
+ * and are moved to the start of the window only that many times. */
+SRL_STATIC_INLINE void
+srl_decoder_reader_fill(pTHX_ srl_decoder_reader_t *rdr)
+{
+    SV *window = rdr->window;
+    const STRLEN avail = SvCUR(window) - rdr->pos;
+    const STRLEN want = avail > rdr->read_size ? avail : rdr->read_size;
+    PerlIO *in = IoIFP(sv_2io(rdr->fh));
+    SSize_t got;
+
+    if (in == NULL)
+        croak("Filehandle is not open for reading");
+
+    if (SvIsCOW(window)) {
+        /* Strings decoded with zero_copy_strings_over may point into the
+         * buffer, carry on with a new one. */
+        SV * const fresh = newSV(avail + want + 1);
+        Copy(SvPVX(window) + rdr->pos, SvPVX(fresh), avail, char);
+        SvPOK_only(fresh);
+        SvCUR_set(fresh, avail);
+        SvREFCNT_dec(window);
+        rdr->window = window = fresh;
+        rdr->pos = 0;
+    }
+
+    if (rdr->pos) {
+        if (avail)
+            Move(SvPVX(window) + rdr->pos, SvPVX(window), avail, char);
+        SvCUR_set(window, avail);
+        rdr->pos = 0;
+    }
+
+    SvGROW(window, avail + want + 1);
+    got = PerlIO_read(in, SvPVX(window) + avail, want);
+    if (got < 0 || (got == 0 && PerlIO_error(in)))
+        croak("Failed to read Sereal document: %s", Strerror(errno));
+    if (got == 0)
+        rdr->eof = 1;
+    SvCUR_set(window, avail + got);
+}
+
+/* Decode the next document into "into", or a new mortal if that's NULL.
+ * Returns NULL at the end of the input. */
+SV *
+srl_decoder_reader_next(pTHX_ srl_decoder_reader_t *rdr, SV *into)
+{
+    STRLEN doc_len;
+
+    for (;;) {
+        const STRLEN avail = SvCUR(rdr->window) - rdr->pos;
+
+        doc_len = avail
+                ? srl_decoder_reader_scan(aTHX_ rdr, (U8 *)SvPVX(rdr->window) + rdr->pos, avail)
+                : 0;
+        if (doc_len)
+            break;
+        if (rdr->eof) {
+            if (avail == 0)
+                return NULL;
+            SRL_DEC_READER_ERROR(rdr, avail, "Unexpected end of input, the last document is incomplete");
+        }
+        srl_decoder_reader_fill(aTHX_ rdr);
+    }
+
+    /* Move on first, so that a document that fails to decode is skipped
+     * if the caller wants to carry on. */
+    {
+        const STRLEN doc_pos = rdr->pos;
+        rdr->pos += doc_len;
+        rdr->offset += doc_len;
+        rdr->scan_items = 0;
+        rdr->scan_packed = 0;
+        return srl_decode_into(aTHX_ rdr->dec, rdr->window, into, doc_pos);
+    }
 }
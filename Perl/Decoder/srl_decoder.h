@@ -9,6 +9,28 @@
 typedef struct PTABLE * ptable_ptr;
 typedef struct srl_decoder srl_decoder_t;
 
+/* LRU cache of compiled regexps, keyed by modifier flags, UTF8-ness and
+ * pattern. Entries are linked from most to least recently used. */
+typedef struct srl_regexp_cache_entry srl_regexp_cache_entry_t;
+struct srl_regexp_cache_entry {
+    srl_regexp_cache_entry_t *prev;     /* more recently used */
+    srl_regexp_cache_entry_t *next;     /* less recently used */
+    SV *key;
+    SV *rx;                             /* compiled REGEXP, only ever handed out as copies */
+};
+
+typedef struct {
+    HV *index;                          /* key => entry pointer */
+    SV *keybuf;                         /* scratch SV to build lookup keys in */
+    srl_regexp_cache_entry_t *head;     /* most recently used */
+    srl_regexp_cache_entry_t *tail;     /* least recently used, evicted first */
+    UV entries;
+    UV max_entries;
+    UV hits;
+    UV misses;
+    UV evictions;
+} srl_regexp_cache_t;
+
 struct srl_decoder {
     srl_reader_buffer_t buf;
     srl_reader_buffer_ptr pbuf;
@@ -21,13 +43,28 @@ struct srl_decoder {
     ptable_ptr ref_thawhash;          /* ptr table for dealing with non ref thawed items */
     ptable_ptr ref_stashes;             /* ptr table for tracking stashes we will bless into - key: ofs, value: stash */
     ptable_ptr ref_bless_av;            /* ptr table for tracking which objects need to be bless - key: ofs, value: mortal AV (of refs)  */
+    ptable_ptr ref_keyhash;             /* ptr table of precomputed hashes of hash keys referenced by COPY - key: key tag pos, value: hash */
     AV* weakref_av;
 
     AV* alias_cache; /* used to cache integers of different sizes. */
     IV alias_varint_under;
 
+    void *zstd_dctx;                    /* lazily allocated if and only if decoding zstd, reused across calls */
+    srl_zstd_dicts_t zstd_dicts;        /* zstd dictionaries we were configured with */
+    SV *decompress_buf;                 /* grow-only output buffer for decompression, reused across calls */
+    STRLEN decompress_buffer_high_water; /* release decompress_buf after a document if it grew beyond this */
+    STRLEN zero_copy_strings_over;      /* strings this long point into the input rather than being copied, 0 for never */
+    SV *string_src;                     /* the SV being decoded, when zero_copy_strings_over is set */
+    SV *string_owner;                   /* keeps the buffer the strings point into alive, &PL_sv_undef if it can't be shared */
+    UV regexp_cache_size;               /* max number of compiled regexps to keep, 0 for no cache */
+    srl_regexp_cache_t *regexp_cache;   /* lazily allocated on the first regexp if regexp_cache_size is set */
+    ptable_ptr thaw_cv_cache;           /* THAW method by class stash, lazily allocated, see srl_method_cache.h */
+    struct srl_stats *stats;            /* counters of the stats option, see srl_stats.h, NULL if not counting */
+
     UV bytes_consumed;
     UV recursion_depth;                 /* Recursion depth of current decoder */
+    struct srl_stack *frames;           /* containers and references being read, see srl_read_single_value() */
+    struct srl_select *select;          /* compiled select_paths, NULL to decode everything, see srl_read_selected() */
     U8 proto_version;
     U8 encoding_flags;
     U32 flags_readonly;
@@ -38,6 +75,21 @@ typedef struct {
     U32 hash;
 } sv_with_hash;
 
+/* Decodes concatenated documents read from a file handle one at a time,
+ * keeping only the input that was not decoded yet in memory. */
+typedef struct srl_decoder_reader {
+    srl_decoder_t *dec;                 /* private clone of the decoder the reader was created from */
+    SV *fh;                             /* the handle we read from */
+    SV *window;                         /* input read so far, the documents before pos are decoded */
+    STRLEN pos;                         /* offset of the next document in window */
+    STRLEN read_size;                   /* minimum number of bytes to read at a time */
+    UV offset;                          /* offset of the next document in the input */
+    STRLEN scan_pos;                    /* how far into the next document it was scanned for its end */
+    UV scan_items;                      /* items of the next document left to scan after scan_pos */
+    UV scan_packed;                     /* varints of a packed array left to scan before those items */
+    int eof;                            /* no more input after the window */
+} srl_decoder_reader_t;
+
 /* utility routine */
 IV srl_validate_header_version_pv_len(pTHX_ char *strdata, STRLEN len);
 
@@ -51,8 +103,15 @@ SV *srl_decode_into(pTHX_ srl_decoder_t *dec, SV *src, SV *body_into, UV start_o
 SV *srl_decode_header_into(pTHX_ srl_decoder_t *dec, SV *src, SV *header_into, UV start_offset);
 /* decode both header and body - must pass in two SVs to write into */
 void srl_decode_all_into(pTHX_ srl_decoder_t *dec, SV *src, SV *header_into, SV *body_into, UV start_offset);
+/* check that a document is well formed without decoding it, returns its length */
+UV srl_validate_document(pTHX_ srl_decoder_t *dec, SV *src, UV start_offset);
 /* main recursive dump routine, for internal usage only!!! */
 void srl_decode_single_value(pTHX_ srl_decoder_t *dec, SV* into, SV** container);
+/* decode one item of a packed array (MANY) of the given type, for the path iterator */
+void srl_decode_many_item(pTHX_ srl_decoder_t *dec, U8 type, SV* into);
+/* decode one record of a record batch (RECORDS) as a hash reference, from the
+ * body offsets of its keys and values, for the path iterator */
+void srl_decode_record(pTHX_ srl_decoder_t *dec, const UV *keys, const UV *values, UV nkeys, SV* into);
 
 /* Explicit destructor */
 void srl_destroy_decoder(pTHX_ srl_decoder_t *dec);
@@ -63,6 +122,16 @@ void srl_clear_decoder_body_state(pTHX_ srl_decoder_t *dec);
 /* destructor hook - called automagically */
 void srl_decoder_destructor_hook(pTHX_ void *p);
 
+/* Put the counters of the stats option into hv, and start counting from 0 */
+void srl_decoder_stats(pTHX_ srl_decoder_t *dec, HV *hv);
+void srl_decoder_reset_stats(pTHX_ srl_decoder_t *dec);
+
+/* reader constructor and destructor */
+srl_decoder_reader_t *srl_build_decoder_reader(pTHX_ srl_decoder_t *proto, SV *fh, STRLEN read_size);
+void srl_destroy_decoder_reader(pTHX_ srl_decoder_reader_t *rdr);
+/* decode the next document from the reader, returns NULL at the end of the input */
+SV *srl_decoder_reader_next(pTHX_ srl_decoder_reader_t *rdr, SV *into);
+
 /* Macro to assert that the type of an SV is complex enough to
  * be an RV. Differs on old perls since there used to be an RV type.
  */
@@ -196,15 +265,37 @@ void srl_decoder_destructor_hook(pTHX_ void *p);
 #define SRL_DEC_OPT_STR_REFUSE_ZSTD                 "refuse_zstd"
 #define SRL_DEC_OPT_IDX_REFUSE_ZSTD                 13
 
+#define SRL_DEC_OPT_STR_DECOMPRESS_BUFFER_HIGH_WATER "decompress_buffer_high_water"
+#define SRL_DEC_OPT_IDX_DECOMPRESS_BUFFER_HIGH_WATER 14
+
+#define SRL_DEC_OPT_STR_ZSTD_DICTIONARIES           "zstd_dictionaries"
+#define SRL_DEC_OPT_IDX_ZSTD_DICTIONARIES           15
+
+#define SRL_DEC_OPT_STR_ZERO_COPY_STRINGS_OVER      "zero_copy_strings_over"
+#define SRL_DEC_OPT_IDX_ZERO_COPY_STRINGS_OVER      16
+
+#define SRL_DEC_OPT_STR_REGEXP_CACHE_SIZE           "regexp_cache_size"
+#define SRL_DEC_OPT_IDX_REGEXP_CACHE_SIZE           17
+
+#define SRL_DEC_OPT_STR_SELECT_PATHS                "select_paths"
+#define SRL_DEC_OPT_IDX_SELECT_PATHS                18
+
+#define SRL_DEC_OPT_STR_STATS                       "stats"
+#define SRL_DEC_OPT_IDX_STATS                       19
+
 /* NOTE WELL: WHEN YOU ADD AN OPTION YOU **MUST** ADD A
  * CORRESPONDING CALL TO SRL_INIT_OPTION() to Decoder.xs */
 
-#define SRL_DEC_OPT_COUNT                           14
+#define SRL_DEC_OPT_COUNT                           20
 
 #if ((PERL_VERSION > 10) || (PERL_VERSION == 10 && PERL_SUBVERSION > 1 ))
 #   define MODERN_REGEXP
 #   define REGEXP_HAS_P_MODIFIER
 #   define REGEXP_TYPE  "MODERN_REGEXP"
+#   if PERL_VERSION >= 28
+        /* reg_temp_copy() fills in an existing SVt_REGEXP since 5.27.x */
+#       define HAVE_REGEXP_CACHE
+#   endif
 #elif PERL_VERSION == 10
 #   define TRANSITION_REGEXP
 #   define REGEXP_HAS_P_MODIFIER
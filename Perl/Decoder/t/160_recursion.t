@@ -29,6 +29,49 @@ my $no_exception= eval {
 };
 ok( !$no_exception );
 
+# the nesting is tracked on the heap, so very deep documents decode fine when
+# the limit allows them, with what follows a nested structure read correctly
+my $deep= 200_000;
+my %docs= (
+    arrays  => [ chr( SRL_HDR_ARRAYREF + 2 ), integer(1), short_string("s") ],
+    hashes  => [ chr( SRL_HDR_HASHREF + 2 ) . short_string("k"), integer(1), short_string("z") . integer(2) ],
+    refs    => [ chr(SRL_HDR_REFN), integer(1), "" ],
+    objects => [ chr(SRL_HDR_OBJECT) . short_string("Foo") . chr( SRL_HDR_ARRAYREF + 2 ), integer(1), integer(3) ],
+);
+foreach my $name ( sort keys %docs ) {
+    my ( $open, $leaf, $close )= @{ $docs{$name} };
+    my $doc= Header() . ( $open x $deep ) . $leaf . ( $close x $deep );
+    foreach my $readonly ( 0, 1 ) {
+        my $got= eval {
+            decode_sereal( $doc, { max_recursion_depth => 2 * $deep + 10, set_readonly => $readonly } );
+        };
+        ok( defined $got, "$name: $deep levels deep, set_readonly=$readonly" ) or diag $@;
+        my ( $depth, $ok )= ( 0, 1 );
+        while ( ref $got ) {
+            if ( $name eq 'arrays' ) {
+                $ok &&= @$got == 2 && $got->[1] eq "s" && ( !$readonly || Internals::SvREADONLY(@$got) );
+                $got= $got->[0];
+            }
+            elsif ( $name eq 'hashes' ) {
+                $ok &&= keys %$got == 2 && $got->{z} == 2 && ( !$readonly || Internals::SvREADONLY(%$got) );
+                $got= $got->{k};
+            }
+            elsif ( $name eq 'objects' ) {
+                $ok &&= ref $got eq 'Foo' && @$got == 2 && $got->[1] == 3 && ( !$readonly || Internals::SvREADONLY(@$got) );
+                $got= $got->[0];
+            }
+            else {
+                $ok &&= !$readonly || Internals::SvREADONLY($$got);
+                $got= $$got;
+            }
+            $depth++;
+        }
+        ok( $ok && $depth == $deep && $got == 1, "$name: ... decoded correctly" );
+    }
+    ok( !eval { decode_sereal($doc); 1 }, "$name: the default limit refuses it" );
+    like( $@, qr/recursion/i, "$name: ... with a useful message" );
+}
+
 done_testing();
 note("All done folks!");
 
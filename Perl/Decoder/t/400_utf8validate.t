@@ -12,7 +12,7 @@ BEGIN {
     lib->import('lib')
         if !-d 't';
 }
-use Sereal::TestSet;
+use Sereal::TestSet qw(varint);
 
 use Sereal::Decoder qw(decode_sereal);
 no warnings 'utf8';
@@ -41,7 +41,21 @@ my @invalid_utf8= (
     [ continuation => "=srl\x01\x00'\x01\xC0" ],
 );
 
-plan tests => 2 * @valid_utf8 + 2 * @invalid_utf8;
+# Strings are checked many bytes at a time where the CPU allows it, so also
+# check long ones with characters crossing those blocks, and sequences Perl
+# accepts although strict UTF-8 does not
+my @chars= ( "a", "\xC3\xA9", "\xE2\x82\xAC", "\xE4\xB8\xAD", "\xF0\x9F\x98\x80" );
+my @inserted= (
+    [ surrogate     => "\xED\xA0\x80" ],
+    [ above_unicode => "\xF4\x90\x80\x80" ],
+    [ ff            => "\xFF" ],
+    [ overlong      => "\xC0\x80" ],
+    [ continuation  => "\x80" ],
+    [ truncated     => "\xE2\x82" ],
+);
+
+plan tests => 2 * @valid_utf8 + 2 * @invalid_utf8 + 1 + @inserted;
+
 
 for my $test (@valid_utf8) {
     my ( $name, $exp, $expected )= @$test;
@@ -72,3 +86,39 @@ for my $test (@invalid_utf8) {
     $err= $@ || 'Zombie error';
     like( $err, qr/Invalid UTF8 byte sequence/, "$name: die with a UTF8 error" );
 }
+
+# what Perl's own check says about the bytes
+sub is_perl_utf8 {
+    my ($bytes)= @_;
+    Encode::_utf8_on($bytes);
+    return utf8::valid($bytes) ? 1 : 0;
+}
+
+sub decodes_with_validation {
+    my ($bytes)= @_;
+    my $doc= "=srl\x01\x00'" . varint( length $bytes ) . $bytes;
+    return eval { decode_sereal( $doc, { validate_utf8 => 1 } ); 1 } ? 1 : 0;
+}
+
+require Encode;
+my @strings= map {
+    my $len= $_;
+    map { my $first= $_; join "", map { $chars[ ( $first + $_ ) % @chars ] } 1 .. $len } 0 .. $#chars
+} 1 .. 40;
+
+my @wrong= grep { !decodes_with_validation($_) } @strings;
+is( scalar(@wrong), 0, "long valid strings decode with validate_utf8" );
+
+for my $test (@inserted) {
+    my ( $name, $seq )= @$test;
+    my @disagree;
+    for my $string ( @strings[ grep { $_ % 7 == 0 } 0 .. $#strings ] ) {
+        for my $pos ( 0 .. length $string ) {
+            my $bytes= $string;
+            substr( $bytes, $pos, 0, $seq );
+            push @disagree, Data::Dumper::qquote($bytes)
+                if decodes_with_validation($bytes) != is_perl_utf8($bytes);
+        }
+    }
+    is( "@disagree", "", "$name: long strings are checked like Perl does" );
+}
@@ -0,0 +1,66 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Decoder;
+
+# A decoder object reuses the buffer it decompresses documents into.
+# Make sure that documents of varying sizes, buffer release via
+# decompress_buffer_high_water and re-entrant decoding all work.
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of encoder';
+}
+
+my $dec;
+
+package Foo;
+sub FREEZE { Sereal::Encoder->new( { compress => Sereal::Encoder::SRL_ZLIB(), compress_threshold => 0 } )->encode( $_[0]->{a} ) }
+sub THAW   { bless( { a => $dec->decode( $_[2] ) }, $_[0] ) }
+
+package main;
+
+my @sizes= ( 10, 5000, 20, 50000, 100, 50000 );
+my %compress= (
+    snappy => Sereal::Encoder::SRL_SNAPPY(),
+    zlib   => Sereal::Encoder::SRL_ZLIB(),
+    zstd   => Sereal::Encoder::SRL_ZSTD(),
+);
+
+foreach my $name ( sort keys %compress ) {
+    my $enc= Sereal::Encoder->new( { compress => $compress{$name}, compress_threshold => 0 } );
+    my @docs= map { [ ("x" x $_), [ 1 .. ( $_ / 10 ) ] ] } @sizes;
+    my @encoded= map { $enc->encode($_) } @docs;
+
+    foreach my $high_water ( undef, 0, 1000 ) {
+        my $desc= "$name, high water " . ( defined $high_water ? $high_water : "default" );
+        $dec= Sereal::Decoder->new( defined $high_water ? { decompress_buffer_high_water => $high_water } : () );
+        for my $i ( 0 .. $#docs ) {
+            is_deeply( $dec->decode( $encoded[$i] ), $docs[$i], "$desc: document of size $sizes[$i]" );
+        }
+        # decode them again in reverse, the buffer may now be bigger than needed
+        for my $i ( reverse 0 .. $#docs ) {
+            is_deeply( $dec->decode( $encoded[$i] ), $docs[$i], "$desc: document of size $sizes[$i] again" );
+        }
+    }
+
+    # a THAW hook decompressing with the same decoder while the outer document
+    # still lives in the decoder's buffer
+    $dec= Sereal::Decoder->new;
+    my $data= [ map { bless( { a => "y" x $_ }, "Foo" ) } @sizes ];
+    my $frozen= Sereal::Encoder->new( { freeze_callbacks => 1, compress => $compress{$name}, compress_threshold => 0 } )
+        ->encode($data);
+    is_deeply( $dec->decode($frozen), $data, "$name: re-entrant decoding of compressed documents" );
+    is_deeply( $dec->decode($frozen), $data, "$name: re-entrant decoding of compressed documents again" );
+}
+
+done_testing();
@@ -0,0 +1,112 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Decoder;
+
+# Documents compressed with zstd dictionaries, both trained ones (with a
+# dictionary ID, see t/data/zstd_dictionary which was built by
+# author_tools/train_zstd_dictionary.pl with --id 1234567) and raw content
+# dictionaries.
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of encoder';
+}
+
+my $dict_file= File::Spec->catfile(qw(t data zstd_dictionary));
+open my $fh, "<:raw", $dict_file or die "Can't open '$dict_file': $!";
+my $trained= do { local $/; <$fh> };
+close $fh;
+is( ( unpack "VV", $trained )[1], 1234567, "trained dictionary has the expected ID" );
+
+# canonical, so that how much the raw dictionary helps doesn't depend on the
+# order hash keys come out in
+my $raw= join "", map { Sereal::Encoder->new( { canonical => 1 } )->encode( { id => $_, name => "user_$_", active => 1 } ) } 1 .. 10;
+
+my $dec;
+
+package My::Profile;
+sub FREEZE { "$_[0]->{score}" }
+sub THAW   { bless( { score => $_[2], nested => $dec->decode( $main::nested ) }, $_[0] ) }
+
+package main;
+
+my $data= {
+    id      => 7,
+    name    => "user_7",
+    email   => 'user7@example.com',
+    tags    => [ "tag1", "tag2" ],
+    active  => 1,
+    profile => bless( { score => 5, created => 1580000007 }, "My::Profile" ),
+};
+
+sub encoder {
+    my ($dict)= @_;
+    return Sereal::Encoder->new( {
+        compress           => Sereal::Encoder::SRL_ZSTD(),
+        compress_threshold => 0,
+        zstd_dictionary    => $dict,
+        canonical          => 1,
+    } );
+}
+
+foreach my $test ( [ trained => $trained ], [ raw => $raw ] ) {
+    my ( $name, $dict )= @$test;
+    my $encoded= encoder($dict)->encode($data);
+    my $plain= Sereal::Encoder->new( { canonical => 1 } )->encode($data);
+    cmp_ok( length($encoded), '<', length($plain), "$name: dictionary compressed document is smaller" );
+
+    $dec= Sereal::Decoder->new( { zstd_dictionaries => [ $trained, $raw ] } );
+    is_deeply( $dec->decode($encoded), $data, "$name: decoder with all dictionaries" );
+    is_deeply( $dec->decode($encoded), $data, "$name: decoder with all dictionaries, again" );
+    is_deeply( Sereal::Decoder->new( { zstd_dictionaries => $dict } )->decode($encoded),
+        $data, "$name: decoder with a single dictionary" );
+    is_deeply( Sereal::Decoder->new( { zstd_dictionaries => [$dict] } )->decode( encoder(undef)->encode($data) ),
+        $data, "$name: decoder with dictionary decodes documents compressed without one" );
+}
+
+# dictionary ID is checked
+{
+    my $encoded= encoder($trained)->encode($data);
+    my $ok= eval { Sereal::Decoder->new->decode($encoded); 1 };
+    ok( !$ok, "decoding without the dictionary fails" );
+    like( $@, qr/zstd dictionary 1234567 which is not known/, "... with a useful message" );
+
+    $ok= eval { Sereal::Decoder->new( { zstd_dictionaries => [$raw] } )->decode($encoded); 1 };
+    ok( !$ok, "decoding with a different dictionary fails" );
+}
+
+# re-entrant decoding uses the dictionaries as well
+{
+    local $main::nested= encoder($trained)->encode( { id => 8, name => "user_8" } );
+    my $encoded= Sereal::Encoder->new( {
+        compress           => Sereal::Encoder::SRL_ZSTD(),
+        compress_threshold => 0,
+        zstd_dictionary    => $trained,
+        freeze_callbacks   => 1,
+    } )->encode($data);
+    $dec= Sereal::Decoder->new( { zstd_dictionaries => [$trained] } );
+    my $got= $dec->decode($encoded);
+    is_deeply( $got->{profile}{nested}, { id => 8, name => "user_8" }, "THAW hook decoding with the same decoder" );
+}
+
+# bad options
+{
+    my $ok= eval { Sereal::Encoder->new( { zstd_dictionary => $trained } ); 1 };
+    ok( !$ok, "zstd_dictionary requires zstd compression" );
+    $ok= eval { encoder( "\x37\xA4\x30\xEC" . ( "x" x 100 ) ); 1 };
+    ok( !$ok, "corrupt zstd dictionary is refused" );
+    $ok= eval { Sereal::Decoder->new( { zstd_dictionaries => [ {} ] } ); 1 };
+    ok( !$ok, "zstd_dictionaries must be strings" );
+}
+
+done_testing();
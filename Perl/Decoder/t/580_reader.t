@@ -0,0 +1,178 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use File::Temp qw(tempdir);
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Decoder;
+
+# Sereal::Decoder::Reader decodes a stream of concatenated documents one at a
+# time, finding the end of each document before decoding it.
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of encoder';
+}
+
+my @data= (
+    { id => 1, list => [ 1 .. 100 ], str => "x" x 1000 },
+    undef,
+    0,
+    "",
+    [ map { { id => $_, name => "name $_", ratio => $_ / 7 } } 1 .. 500 ],
+    bless( { obj => 1 }, "Some::Class" ),
+    qr/foo(bar)?/i,
+    \"scalar ref",
+    -12345678901,
+    3.25,
+    "\x{263a} unicode",
+    [ map { $_ * 1000 } 1 .. 300 ],
+    [ map { $_ / 4 } -150 .. 150 ],
+);
+{
+    my $shared= [ 1, 2, 3 ];
+    my $cycle= {};
+    $cycle->{self}= $cycle;
+    push @data, { a => $shared, b => $shared, c => $cycle, d => "dedupe me", e => "dedupe me" };
+    push @data, [ map { { id => $_, name => "row $_", tags => [ 1, 2 ] } } 1 .. 20 ];
+}
+
+my @encoders= (
+    Sereal::Encoder->new,
+    Sereal::Encoder->new( { compress => Sereal::Encoder::SRL_SNAPPY(), compress_threshold => 0 } ),
+    Sereal::Encoder->new( { compress => Sereal::Encoder::SRL_ZLIB(), compress_threshold => 0 } ),
+    Sereal::Encoder->new( { compress => Sereal::Encoder::SRL_ZSTD(), compress_threshold => 0 } ),
+    Sereal::Encoder->new( { protocol_version => 1 } ),
+    Sereal::Encoder->new( { dedupe_strings => 1, aliased_dedupe_strings => 1 } ),
+    Sereal::Encoder->new( { pack_numeric_arrays => 1 } ),
+    Sereal::Encoder->new( { record_batches => 1 } ),
+);
+
+my @docs;
+foreach my $i ( 0 .. 3 ) {
+    foreach my $enc (@encoders) {
+        push @docs, map { $enc->encode($_) } @data;
+        push @docs, $enc->encode( $data[0], { header => $i } ) if $enc != $encoders[4];
+    }
+}
+my $stream= join "", @docs;
+my @expect= map { Sereal::Decoder->new->decode($_) } @docs;
+
+my $dir= tempdir( CLEANUP => 1 );
+my $file= File::Spec->catfile( $dir, "stream.srl" );
+write_file( $file, $stream );
+
+sub write_file {
+    my ( $name, $contents )= @_;
+    open my $fh, ">:raw", $name or die "Can't write '$name': $!";
+    print $fh $contents;
+    close $fh or die "Can't close '$name': $!";
+}
+
+sub read_all {
+    my ($reader)= @_;
+    my ( @got, @offsets );
+    while (1) {
+        push @offsets, $reader->offset;
+        my ($doc)= $reader->next
+            or last;
+        push @got, $doc;
+    }
+    pop @offsets;
+    return ( \@got, \@offsets );
+}
+
+my @expect_offsets;
+{
+    my $ofs= 0;
+    foreach my $doc (@docs) {
+        push @expect_offsets, $ofs;
+        $ofs+= length $doc;
+    }
+}
+
+foreach my $read_size ( 1, 7, 100, undef ) {
+    my $what= "read size " . ( $read_size // "default" );
+    my ( $got, $offsets )= read_all( Sereal::Decoder->new->reader( $file, $read_size ) );
+    is( scalar(@$got), scalar(@docs), "$what: all documents" );
+    is_deeply( $got, \@expect, "$what: documents decode correctly" );
+    is_deeply( $offsets, \@expect_offsets, "$what: offsets" );
+}
+
+# reading from a handle, with the functional constructor and into a variable
+{
+    open my $fh, "<", \$stream or die;
+    my $reader= Sereal::Decoder->reader($fh);
+    my $into;
+    my $ret= $reader->next($into);
+    is_deeply( $into, $expect[0], "decoding into a variable" );
+    is_deeply( ( read_all($reader) )[0], [ @expect[ 1 .. $#expect ] ], "reading from an in-memory handle" );
+}
+
+# destructive incremental mode doesn't affect the reader, but
+# decode_from_file returns all documents
+{
+    my $dec= Sereal::Decoder->new( { incremental => 1 } );
+    is_deeply( ( read_all( $dec->reader($file) ) )[0], \@expect, "reader of a decoder in incremental mode" );
+    is_deeply( [ $dec->decode_from_file($file) ], \@expect, "decode_from_file in list context" );
+    is_deeply( scalar $dec->decode_from_file($file), $expect[0], "decode_from_file in scalar context" );
+    my $into;
+    Sereal::Decoder->decode_from_file( $file, $into );
+    is_deeply( $into, $expect[0], "decode_from_file into a variable" );
+}
+
+# end of input
+{
+    my $empty= File::Spec->catfile( $dir, "empty.srl" );
+    write_file( $empty, "" );
+    my @got= Sereal::Decoder->new->reader($empty)->next;
+    is( scalar(@got), 0, "empty file has no documents" );
+    ok( !eval { Sereal::Decoder->decode_from_file($empty); 1 }, "decode_from_file dies on an empty file" );
+
+    my $truncated= File::Spec->catfile( $dir, "truncated.srl" );
+    foreach my $cut ( 1, 5, 20 ) {
+        write_file( $truncated, $docs[0] . substr( $docs[4], 0, length( $docs[4] ) - $cut ) );
+        my $reader= Sereal::Decoder->new->reader( $truncated, 16 );
+        my ($doc)= $reader->next;
+        is_deeply( $doc, $expect[0], "document before a truncated one (cut $cut)" );
+        ok( !eval { $reader->next; 1 }, "truncated document dies (cut $cut)" );
+        like( $@, qr/Unexpected end of input/, "... with a useful message" );
+    }
+}
+
+# bad documents
+{
+    my $bad= File::Spec->catfile( $dir, "bad.srl" );
+    my $zstd= $encoders[3]->encode( $data[4] );
+    substr( $zstd, -20, 10, "\0" x 10 );
+    write_file( $bad, $docs[0] . $zstd . $docs[1] );
+    my $reader= Sereal::Decoder->new->reader($bad);
+    $reader->next;
+    ok( !eval { $reader->next; 1 }, "corrupt compressed document dies" );
+    my @got= $reader->next;
+    is_deeply( \@got, [ $expect[1] ], "... and is skipped" );
+
+    write_file( $bad, $docs[0] . "garbage" x 10 );
+    $reader= Sereal::Decoder->new->reader($bad);
+    $reader->next;
+    ok( !eval { $reader->next; 1 }, "garbage dies" );
+    like( $@, qr/Bad Sereal header/, "... with a useful message" );
+
+    my $snappy_v1= Sereal::Encoder->new( { snappy => 1, use_protocol_v1 => 1, compress_threshold => 0 } )
+        ->encode( $data[4] );
+    write_file( $bad, $snappy_v1 );
+    ok( !eval { Sereal::Decoder->new->reader($bad)->next; 1 }, "non-incremental Snappy is refused" );
+    like( $@, qr/non-incremental Snappy/, "... with a useful message" );
+
+    ok( !eval { Sereal::Decoder->new->reader( File::Spec->catfile( $dir, "nonexistent" ) ); 1 },
+        "reader dies on a file that doesn't exist" );
+}
+
+done_testing();
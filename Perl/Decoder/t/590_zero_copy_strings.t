@@ -0,0 +1,118 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use File::Temp qw(tempdir);
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Decoder;
+
+# zero_copy_strings_over makes long strings point into the document (or the
+# buffer it was decompressed into) instead of copying them out of it
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of encoder';
+}
+
+my $blob= join "", map { chr( 32 + $_ % 90 ) } 1 .. 100_000;
+my $wide= "\x{263a}" x 10_000;
+my $data= {
+    blob  => $blob,
+    small => "small string",
+    list  => [ "$blob!", $wide, 1, "x" x 999, "y" x 1000 ],
+    ref   => \"$blob?",
+};
+
+my @encoders= (
+    [ plain  => Sereal::Encoder->new ],
+    [ snappy => Sereal::Encoder->new( { compress => Sereal::Encoder::SRL_SNAPPY(), compress_threshold => 0 } ) ],
+    [ zlib   => Sereal::Encoder->new( { compress => Sereal::Encoder::SRL_ZLIB(),   compress_threshold => 0 } ) ],
+    [ zstd   => Sereal::Encoder->new( { compress => Sereal::Encoder::SRL_ZSTD(),   compress_threshold => 0 } ) ],
+);
+
+sub readonly_flags {
+    my ($got)= @_;
+    return [ map { Internals::SvREADONLY($_) ? 1 : 0 } $got->{blob}, $got->{small}, @{ $got->{list} }, ${ $got->{ref} } ];
+}
+
+foreach my $case (@encoders) {
+    my ( $name, $enc )= @$case;
+    my $doc= $enc->encode($data);
+    my $dec= Sereal::Decoder->new( { zero_copy_strings_over => 1000 } );
+
+    my $got= $dec->decode($doc);
+    is_deeply( $got, $data, "$name: roundtrip" );
+    is_deeply( readonly_flags($got), [ 1, 0, 1, 1, 0, 0, 1, 1 ], "$name: long strings are zero-copy and readonly" );
+    ok( utf8::is_utf8( $got->{list}[1] ), "$name: UTF8 flag is kept" );
+
+    # the next document must not overwrite the strings of the previous one
+    my $got2= $dec->decode( $enc->encode( { blob => "z" x 100_000 } ) );
+    is( $got2->{blob}, "z" x 100_000, "$name: next document" );
+    is( $got->{blob},  $blob,         "$name: ... leaves the strings of the previous one alone" );
+
+    # nor must modifying or freeing the input
+    substr( $doc, 10, 1000, "#" x 1000 );
+    undef $doc;
+    is_deeply( $got, $data, "$name: input modified and freed" );
+
+    my $copy= $got->{blob};
+    $copy .= "!";
+    is( $copy, "$blob!", "$name: copies can be modified" );
+    ok( !eval { $got->{blob} .= "!"; 1 }, "$name: the strings themselves can't" );
+    is( $got->{blob}, $blob, "$name: ... and are unchanged" );
+}
+
+# header data, decoding into existing variables and copies by the encoder
+{
+    my $doc= Sereal::Encoder->new( { dedupe_strings => 1 } )
+        ->encode( [ $blob, $blob ], { meta => "m" x 5000 } );
+    my $dec= Sereal::Decoder->new( { zero_copy_strings_over => 1000 } );
+    my ( $body, $header );
+    $dec->decode_with_header( $doc, $body, $header );
+    is_deeply( $body,   [ $blob, $blob ],       "COPY tags" );
+    is_deeply( $header, { meta => "m" x 5000 }, "header data" );
+    ok( Internals::SvREADONLY( $header->{meta} ), "... is zero-copy too" );
+
+    my $into= "old value";
+    $dec->decode( Sereal::Encoder->new->encode($blob), $into );
+    is( $into, $blob, "decoding a string into a variable" );
+    ok( !Internals::SvREADONLY($into), "... copies it" );
+}
+
+# a read-only input can't be shared, strings are copied then
+{
+    my $got= Sereal::Decoder->new( { zero_copy_strings_over => 1000 } )
+        ->decode( Sereal::Encoder->new->encode( [$blob] ) );
+    ok( Internals::SvREADONLY( $got->[0] ), "zero-copy string" );
+
+    Internals::SvREADONLY( my $doc= Sereal::Encoder->new->encode( [$blob] ), 1 );
+    $got= Sereal::Decoder->new( { zero_copy_strings_over => 1000 } )->decode($doc);
+    is_deeply( $got, [$blob], "read-only input" );
+}
+
+# the reader reuses its buffer for the next documents
+{
+    my $dir= tempdir( CLEANUP => 1 );
+    my $file= File::Spec->catfile( $dir, "stream.srl" );
+    my @docs= map { { n => $_, blob => $blob . $_ } } 1 .. 20;
+    open my $fh, ">:raw", $file or die "Can't write '$file': $!";
+    print $fh $encoders[ $_ % 2 ][1]->encode( $docs[$_] ) for 0 .. $#docs;
+    close $fh or die "Can't close '$file': $!";
+
+    my $reader= Sereal::Decoder->new( { zero_copy_strings_over => 1000 } )->reader( $file, 50_000 );
+    my @got;
+    while ( my ($doc)= $reader->next ) {
+        push @got, $doc;
+    }
+    is_deeply( \@got, \@docs, "reader" );
+    ok( Internals::SvREADONLY( $got[0]{blob} ), "... with zero-copy strings" );
+}
+
+done_testing();
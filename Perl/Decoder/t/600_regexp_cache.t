@@ -0,0 +1,101 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Decoder;
+
+# regexp_cache_size makes the decoder reuse the compiled regexps of the
+# patterns it has seen before
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of encoder';
+}
+if ( $] < 5.028 ) {
+    plan skip_all => 'The regexp cache needs Perl 5.28';
+}
+
+my $enc= Sereal::Encoder->new;
+my @patterns= ( qr/a(b+)c/, qr/a(b+)c/i, qr/\x{263a}(.)/, qr/ a (b+) c /x, qr/^a(b+)$/m );
+my $doc= $enc->encode( \@patterns );
+
+my $dec= Sereal::Decoder->new( { regexp_cache_size => 10 } );
+is_deeply( $dec->regexp_cache_stats,
+    { hits => 0, misses => 0, evictions => 0, entries => 0, max_entries => 10 },
+    "stats before decoding" );
+
+my $first= $dec->decode($doc);
+my $second= $dec->decode($doc);
+is_deeply( $dec->regexp_cache_stats,
+    { hits => 5, misses => 5, evictions => 0, entries => 5, max_entries => 10 },
+    "the same patterns are compiled once" );
+
+foreach my $got ( $first, $second ) {
+    is( scalar(@$got), scalar(@patterns), "number of regexps" );
+    foreach my $i ( 0 .. $#patterns ) {
+        is( ref( $got->[$i] ), "Regexp", "regexp $i is a Regexp" );
+        is( "$got->[$i]", "$patterns[$i]", "regexp $i stringifies the same" );
+    }
+}
+
+# modifiers and UTF8-ness are part of the key
+ok( "xABBC" =~ $second->[1] && $1 eq "BB", "cached case insensitive regexp matches" );
+ok( "xABBC" !~ $second->[0],               "... and the case sensitive one doesn't" );
+ok( "\x{263a}z" =~ $second->[2] && $1 eq "z", "cached UTF8 regexp matches" );
+ok( "abbbc" =~ $second->[3] && $1 eq "bbb",   "cached /x regexp matches" );
+ok( "x\nabb\n" =~ $second->[4],                "cached /m regexp matches" );
+
+# copies of the same cached regexp keep their own captures
+{
+    "abc" =~ $first->[0];
+    my $one= $1;
+    "abbbbc" =~ $second->[0];
+    is( "$one $1", "b bbbb", "captures of copies are independent" );
+}
+
+# the decoded regexps are the caller's to modify
+bless $first->[0], "My::Regexp";
+my $third= $dec->decode($doc);
+is( ref( $third->[0] ), "Regexp", "blessing a decoded regexp doesn't affect the cache" );
+
+# blessed regexps
+{
+    my $got= $dec->decode( $enc->encode( [ bless( qr/a(b+)c/, "My::Regexp" ) ] ) );
+    is( ref( $got->[0] ), "My::Regexp", "blessed regexp from the cache" );
+    ok( "abc" =~ $got->[0], "... matches" );
+}
+
+# least recently used patterns are evicted first
+{
+    my $dec= Sereal::Decoder->new( { regexp_cache_size => 2 } );
+    $dec->decode( $enc->encode( [ qr/one/, qr/two/ ] ) );
+    $dec->decode( $enc->encode( [qr/one/] ) );
+    $dec->decode( $enc->encode( [qr/three/] ) );
+    is_deeply( $dec->regexp_cache_stats,
+        { hits => 1, misses => 3, evictions => 1, entries => 2, max_entries => 2 },
+        "a full cache evicts" );
+    $dec->decode( $enc->encode( [ qr/one/, qr/two/ ] ) );
+    is_deeply( $dec->regexp_cache_stats,
+        { hits => 2, misses => 4, evictions => 2, entries => 2, max_entries => 2 },
+        "... the least recently used pattern" );
+}
+
+# no cache by default
+{
+    my $dec= Sereal::Decoder->new;
+    my $got= $dec->decode($doc);
+    is( "$got->[1]", "$patterns[1]", "regexp without cache" );
+    is_deeply( $dec->regexp_cache_stats,
+        { hits => 0, misses => 0, evictions => 0, entries => 0, max_entries => 0 },
+        "no cache by default" );
+}
+
+done_testing();
@@ -0,0 +1,59 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Decoder;
+
+# Hash keys referring back to an earlier key with a COPY tag are hashed once
+# per document, make sure they still end up as the right keys
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of encoder';
+}
+
+my @keys= ( "id", "name", "x" x 100, "caf\x{e9}", "\x{263a}smile", "" );
+my @records= map { my $n= $_; +{ map { $_ => $n } @keys } } 1 .. 50;
+
+my $enc= Sereal::Encoder->new;
+my $dec= Sereal::Decoder->new;
+
+my $doc= $enc->encode( \@records );
+
+my $got= $dec->decode($doc);
+is_deeply( $got, \@records, "records with copied keys" );
+
+my $last= $got->[-1];
+ok( exists $last->{"caf\x{e9}"}, "latin1 key via COPY is found" );
+utf8::upgrade( my $upgraded= "caf\x{e9}" );
+ok( exists $last->{$upgraded}, "... also when looked up upgraded to UTF8" );
+ok( exists $last->{"\x{263a}smile"}, "UTF8 key via COPY is found" );
+is( $last->{""}, 50, "empty key via COPY" );
+
+# the same decoder on other documents, where the offsets of the keys differ
+{
+    my @other= map { +{ other => $_, map { $_ => -$_ } @keys[ 1 .. 3 ] } } 1 .. 10;
+    is_deeply( $dec->decode( $enc->encode( [ "padding" x 3, @other ] ) ),
+        [ "padding" x 3, @other ], "next document" );
+    is_deeply( $dec->decode($doc), \@records, "and the first one again" );
+}
+
+# copied keys in the header and the body
+{
+    my $header= [ map { +{ head => $_, shared => 1 } } 1 .. 5 ];
+    my $doc= $enc->encode( \@records, $header );
+    my ( $body, $got_header );
+    $dec->decode_with_header( $doc, $body, $got_header );
+    is_deeply( $got_header, $header,   "header with copied keys" );
+    is_deeply( $body,       \@records, "body with copied keys" );
+}
+
+done_testing();
@@ -0,0 +1,149 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use Scalar::Util qw(blessed isweak refaddr);
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Decoder qw(decode_sereal);
+
+# The select_paths option decodes only the parts of a document that paths
+# go into, and skips the rest
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of encoder';
+}
+
+sub select_paths {
+    my ( $paths, $encoded, %opt )= @_;
+    return Sereal::Decoder->new( { %opt, select_paths => $paths } )->decode($encoded);
+}
+
+my $data= {
+    users => [ map { { id => $_, name => "user $_", tags => [ "a$_", "b$_" ] } } 1 .. 6 ],
+    meta  => { total => 6, "caf\x{e9}" => 1, "\x{263a}" => 2, "a.b" => 3 },
+    title => "users",
+};
+
+# selecting from plain arrays and hashes, and from record batches
+foreach my $batches ( 0, 1 ) {
+    my $encoded= Sereal::Encoder->new( { record_batches => $batches } )->encode($data);
+    my $name= $batches ? "batched" : "plain";
+    my @cases= (
+        [ '$',                     $data ],
+        [ '$.title',               { title => "users" } ],
+        [ '$.meta.total',          { meta => { total => 6 } } ],
+        [ '$["meta"][\'a.b\']',    { meta => { "a.b" => 3 } } ],
+        [ "\$.meta.caf\x{e9}",     { meta => { "caf\x{e9}" => 1 } } ],
+        [ "\$.meta.\x{263a}",      { meta => { "\x{263a}" => 2 } } ],
+        [ '$.meta[total,missing]', { meta => { total => 6 } } ],
+        [ '$.users[0].name',       { users => [ { name => "user 1" } ] } ],
+        [ '$.users[-1].id',        { users => [ (undef) x 5, { id => 6 } ] } ],
+        [ '$.users[1,3].id',       { users => [ undef, { id => 2 }, undef, { id => 4 } ] } ],
+        [ '$.users[1:5:2].id',     { users => [ undef, { id => 2 }, undef, { id => 4 } ] } ],
+        [ '$.users[-2:].id',       { users => [ (undef) x 4, { id => 5 }, { id => 6 } ] } ],
+        [ '$.users[*].tags[1]',    { users => [ map { { tags => [ undef, "b$_" ] } } 1 .. 6 ] } ],
+        [ '$.users[0]',            { users => [ $data->{users}[0] ] } ],
+        [ '$.*.total',             { meta => { total => 6 }, users => [] } ],
+        [ [ '$.title', '$.users[5].name' ], { title => "users", users => [ (undef) x 5, { name => "user 6" } ] } ],
+        [ '$.missing',             {} ],
+        [ '$.title.x',             {} ],
+        [ [],                      undef ],
+    );
+    foreach my $case (@cases) {
+        my ( $paths, $want )= @$case;
+        my $desc= ref $paths ? "[@$paths]" : $paths;
+        $desc =~ s/([^\x00-\x7f])/sprintf "\\x{%x}", ord $1/ge;
+        is_deeply( select_paths( $paths, $encoded ), $want, "$name: $desc" );
+    }
+}
+
+# references to values in parts that are skipped are decoded anyway, what
+# refers to them comes after them
+{
+    my $shared= { big => [ 1 .. 10 ] };
+    my $doc= [ [ $shared, \"x" ], { a => $shared, b => $shared } ];
+    my $got= select_paths( '$[1]', Sereal::Encoder->new->encode($doc) );
+    is_deeply( $got, [ undef, { a => $shared, b => $shared } ], "REFP into a skipped part" );
+    is( refaddr( $got->[1]{a} ), refaddr( $got->[1]{b} ), "... still shares the value" );
+
+    $doc= [ [ "dup" x 10, "other" ], [ "dup" x 10 ] ];
+    foreach my $opt ( { dedupe_strings => 1 }, { aliased_dedupe_strings => 1 } ) {
+        my ($name)= keys %$opt;
+        my $encoded= Sereal::Encoder->new($opt)->encode($doc);
+        is_deeply( select_paths( '$[1]', $encoded ), [ undef, [ "dup" x 10 ] ], "$name into a skipped part" );
+    }
+
+    my $weak= { value => 42 };
+    $doc= [ $weak, $weak ];
+    Scalar::Util::weaken( $doc->[1] );
+    my $encoded= Sereal::Encoder->new->encode($doc);
+    $got= select_paths( '$[*].value', $encoded );
+    is( $got->[1]{value}, 42, "weak reference" );
+    ok( isweak( $got->[1] ), "... is still weak" );
+    is( refaddr( $got->[0] ), refaddr( $got->[1] ), "... to the same hash" );
+    $got= select_paths( '$[1]', $encoded );
+    ok( !defined $got->[1], "weak reference to a value that is not selected is gone" );
+}
+
+# objects are gone through like the references they are
+{
+    my $doc= [ bless( { x => 1 }, "Foo" ), [ bless( { x => 2, y => 3 }, "Foo" ), bless( [ 4, 5 ], "Bar" ) ] ];
+    my $encoded= Sereal::Encoder->new->encode($doc);
+    my $got= select_paths( '$[1][*].x', $encoded );
+    is( blessed( $got->[1][0] ), "Foo", "object whose class was named in a skipped part" );
+    is_deeply( { %{ $got->[1][0] } }, { x => 2 }, "... with the selected keys" );
+    is( blessed( $got->[1][1] ), "Bar", "other object" );
+    is_deeply( [ @{ $got->[1][1] } ], [], "... without keys to select" );
+
+    $got= select_paths( '$[1][1]', $encoded );
+    is_deeply( $got->[1][1], bless( [ 4, 5 ], "Bar" ), "object selected whole" );
+}
+
+# other options still apply
+{
+    my $encoded= Sereal::Encoder->new->encode($data);
+    my $got= select_paths( '$.users[0].tags', $encoded, set_readonly => 1 );
+    ok( Internals::SvREADONLY( %$got ),                  "set_readonly: top hash" );
+    ok( Internals::SvREADONLY( @{ $got->{users} } ),     "... array on the path" );
+    ok( Internals::SvREADONLY( $got->{users}[0]{tags}[0] ), "... selected value" );
+
+    ok( !eval { select_paths( '$.meta.total', $encoded, max_num_hash_entries => 3 ); 1 },
+        "max_num_hash_entries" );
+    like( $@, qr/configured maximum/, "... with a useful message" );
+
+    is_deeply( decode_sereal( $encoded, { select_paths => '$.title' } ), { title => "users" }, "decode_sereal" );
+
+    my $dec= Sereal::Decoder->new( { select_paths => '$.meta.total' } );
+    is_deeply( $dec->decode($encoded), { meta => { total => 6 } }, "decoder reused" )
+        for 1 .. 2;
+}
+
+# truncated documents and bad paths
+{
+    my $encoded= Sereal::Encoder->new->encode($data);
+    ok( !eval { select_paths( '$.title', substr( $encoded, 0, -20 ) ); 1 }, "truncated document" );
+    like( $@, qr/Unexpected termination of packet|unexpected end of input|end of packet reached/i, "... with a useful message" );
+
+    foreach my $path ( "meta", '$.', '$[', '$[0', '$["a]', '$[]', '$x', '$["a"x]' ) {
+        ok( !eval { Sereal::Decoder->new( { select_paths => $path } ); 1 }, "bad path '$path'" );
+        like( $@, qr/Bad path/, "... with a useful message" );
+    }
+    ok( !eval { Sereal::Decoder->new( { select_paths => '$..id' } ); 1 }, "recursive descent" );
+    like( $@, qr/not supported/, "... is not supported" );
+    ok( !eval { Sereal::Decoder->new( { select_paths => '$[0:5:-1]' } ); 1 }, "negative step" );
+    like( $@, qr/not supported/, "... is not supported" );
+    ok( !eval { Sereal::Decoder->new( { select_paths => { '$' => 1 } } ); 1 }, "hash of paths" );
+    like( $@, qr/expects a path or an array of paths/, "... with a useful message" );
+    ok( !eval { Sereal::Decoder->new( { select_paths => [ ('$') x 33 ] } ); 1 }, "too many paths" );
+    like( $@, qr/at most 32 paths/, "... with a useful message" );
+}
+
+done_testing();
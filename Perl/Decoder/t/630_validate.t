@@ -0,0 +1,190 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use Scalar::Util qw(weaken);
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Decoder qw(validate_sereal);
+use Sereal::Decoder::Constants qw(:all);
+
+# validate() and validate_sereal() check that a document is well formed
+# without decoding it, and return its length
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of encoder';
+}
+
+my $dec= Sereal::Decoder->new();
+
+# the error validating a document, without its prefix and where it was raised
+sub validate_error {
+    my ( $encoded, %opt )= @_;
+    return undef if eval { Sereal::Decoder->new( \%opt )->validate($encoded); 1 };
+    ( my $error= $@ ) =~ s/^Sereal: Error: //;
+    $error =~ s/ at (?:offset|\S+ line) .*//s;
+    return $error;
+}
+
+sub decode_error {
+    my ( $encoded, %opt )= @_;
+    return undef if eval { Sereal::Decoder->new( \%opt )->decode($encoded); 1 };
+    ( my $error= $@ ) =~ s/^Sereal: Error: //;
+    $error =~ s/ at (?:offset|\S+ line) .*//s;
+    return $error;
+}
+
+my $data= do {
+    my $list= [ 1, 2, 3 ];
+    my $object= bless { name => "obj" }, 'Foo';
+    my $weak= $list;
+    weaken($weak);
+    {
+        strings => [ "short", "a longer string " x 10, "caf\x{e9}", "\x{263a}" ],
+        numbers => [ 0, 15, -16, 1000, -1000, 2**40, -2**40, 1.5, 0.1 ],
+        shared  => [ $list, $list, \$list->[1], $weak ],
+        objects => [ $object, $object, bless( [], 'Foo' ), bless( {}, 'Bar' ) ],
+        regexps => [ qr/foo/, qr/b(a)r/ix ],
+        records => [ map { { id => $_, name => "row $_" } } 1 .. 5 ],
+        undefs  => [ undef, \undef ],
+    };
+};
+
+my @options= (
+    [ "plain",             {} ],
+    [ "snappy",            { compress => Sereal::Encoder::SRL_SNAPPY(), compress_threshold => 0 } ],
+    [ "zlib",              { compress => Sereal::Encoder::SRL_ZLIB(),   compress_threshold => 0 } ],
+    [ "zstd",              { compress => Sereal::Encoder::SRL_ZSTD(),   compress_threshold => 0 } ],
+    [ "dedupe_strings",    { dedupe_strings => 1 } ],
+    [ "aliased dedupe",    { aliased_dedupe_strings => 1 } ],
+    [ "record_batches",    { record_batches => 1 } ],
+    [ "protocol v1",       { protocol_version => 1 } ],
+    [ "protocol v2",       { protocol_version => 2 } ],
+    [ "no_shared_hashkeys", { no_shared_hashkeys => 1 } ],
+);
+
+# well formed documents
+foreach my $case (@options) {
+    my ( $name, $opt )= @$case;
+    my $encoded= Sereal::Encoder->new($opt)->encode($data);
+    is( $dec->validate($encoded),    length $encoded, "$name: validate returns the length" );
+    is( $dec->bytes_consumed,        length $encoded, "$name: ... and sets bytes_consumed" );
+    is( validate_sereal($encoded),   length $encoded, "$name: validate_sereal" );
+    ok( !defined validate_error( $encoded, validate_utf8 => 1 ), "$name: with validate_utf8" );
+}
+
+# header user data is skipped, and documents follow one another
+{
+    my $enc= Sereal::Encoder->new();
+    my $with_header= $enc->encode( [ 1, 2 ], { user => "data" } );
+    is( $dec->validate($with_header), length $with_header, "document with header user data" );
+
+    my $first= $enc->encode( { a => 1 } );
+    my $second= $enc->encode( [ "second" ] );
+    is( $dec->validate( $first . $second ),                 length $first,  "first of two documents" );
+    is( $dec->validate( $first . $second, length $first ), length $second, "second one at its offset" );
+}
+
+# FREEZE/THAW objects are checked as data, not thawed
+{
+    package Frozen;
+    sub new    { bless { value => $_[1] }, $_[0] }
+    sub FREEZE { return $_[0]{value} }
+    sub THAW   { die "not called" }
+}
+{
+    my $encoded= Sereal::Encoder->new( { freeze_callbacks => 1 } )->encode( [ map { Frozen->new($_) } 1 .. 3 ] );
+    is( $dec->validate($encoded), length $encoded, "frozen objects" );
+}
+
+# deep data is checked without recursing in C
+{
+    my $depth= 50_000;
+    my $nested= [];
+    $nested= [$nested] for 1 .. $depth;
+    my $encoded= Sereal::Encoder->new( { max_recursion_depth => $depth + 10 } )->encode($nested);
+    is( Sereal::Decoder->new( { max_recursion_depth => $depth + 10 } )->validate($encoded),
+        length $encoded, "deeply nested arrays" );
+    like( validate_error( $encoded, max_recursion_depth => 100 ), qr/Reached recursion limit \(100\)/,
+        "max_recursion_depth applies" );
+}
+
+# every truncated document is rejected
+foreach my $case ( @options[ 0, 4, 6 ] ) {
+    my ( $name, $opt )= @$case;
+    my $encoded= Sereal::Encoder->new($opt)->encode($data);
+    my @accepted= grep { !defined validate_error( substr( $encoded, 0, $_ ) ) } 0 .. length($encoded) - 1;
+    is( "@accepted", "", "$name: no truncated document is accepted" );
+}
+
+# malformed documents are rejected with the error decoding them gives
+{
+    my $hdr= Header();
+    my $refn= chr(SRL_HDR_REFN);
+    my $track= sub { chr( $_[0] | SRL_HDR_TRACK_FLAG ) };
+    my $arrayref= sub { chr( SRL_HDR_ARRAYREF + $_[0] ) };
+    my $hashref= sub { chr( SRL_HDR_HASHREF + $_[0] ) };
+
+    my @bad= (
+        [ "no body",                  "",                                                   qr/Not a valid Sereal document/ ],
+        [ "unknown tag",              chr(SRL_HDR_EXTEND),                                  qr/EXTEND/ ],
+        [ "reserved tag",             chr(SRL_HDR_RESERVED_LOW),                            qr/Unexpected tag/ ],
+        [ "long string",              chr(SRL_HDR_BINARY) . varint(10) . "abc",             qr/Unexpected termination/ ],
+        [ "long array",               chr(SRL_HDR_ARRAY) . varint(10) . integer(1),         qr/Unexpected termination/ ],
+        [ "long varint",              chr(SRL_HDR_VARINT) . "\x80" x 12 . "\x01",           qr/varint/ ],
+        [ "REFP to untracked item",   $arrayref->(2) . short_string("a") . chr(SRL_HDR_REFP) . varint(2),
+                                                                                            qr/REFP\(2\) references an unknown item/ ],
+        [ "REFP forward",             $arrayref->(2) . chr(SRL_HDR_REFP) . varint(5) . integer(1),
+                                                                                            qr/points past current position/ ],
+        [ "ALIAS outside container",  $refn . chr(SRL_HDR_ALIAS) . varint(1),               qr/ALIAS tag not inside container/ ],
+        [ "COPY forward",             $arrayref->(2) . chr(SRL_HDR_COPY) . varint(5) . integer(1),
+                                                                                            qr/points past current position/ ],
+        [ "COPY of a COPY",           $arrayref->(3) . short_string("a") . chr(SRL_HDR_COPY) . varint(2) . chr(SRL_HDR_COPY) . varint(4),
+                                                                                            qr/COPY\(\d+\) called during parse/ ],
+        [ "OBJECTV without class",    chr(SRL_HDR_OBJECTV) . varint(1) . $refn . integer(1),
+                                                                                            qr/without preceding OBJECT/ ],
+        [ "OBJECTV of another offset", $arrayref->(2) . chr(SRL_HDR_OBJECT) . short_string("Foo") . $refn . integer(1)
+                                           . chr(SRL_HDR_OBJECTV) . varint(4) . $refn . integer(1),
+                                                                                            qr/unknown classname offset: 4/ ],
+        [ "OBJECT of a number",       chr(SRL_HDR_OBJECT) . short_string("Foo") . integer(1), qr/Can't bless non-reference/ ],
+        [ "WEAKEN of a number",       chr(SRL_HDR_WEAKEN) . integer(1),                     qr/WEAKEN op/ ],
+        [ "bad class name",           chr(SRL_HDR_OBJECT) . integer(1) . $refn . integer(1), qr/class name/ ],
+        [ "bad hash key",             $hashref->(1) . integer(1) . integer(1),              qr/stringish/ ],
+        [ "bad key COPY",             $arrayref->(2) . integer(1) . $hashref->(1) . chr(SRL_HDR_COPY) . varint(2) . integer(1),
+                                                                                            qr/bad COPY tag/ ],
+        [ "bad regexp modifier",      chr(SRL_HDR_REGEXP) . short_string("a") . short_string("q"), qr/bad modifier/ ],
+        [ "bad regexp modifiers tag", chr(SRL_HDR_REGEXP) . short_string("a") . integer(1), qr/Expecting SRL_HDR_SHORT_BINARY/ ],
+        [ "RECORDS without keys",     chr(SRL_HDR_RECORDS) . varint(1) . varint(0) . integer(1), qr/records without keys/ ],
+        [ "bad MANY type",            chr(SRL_HDR_MANY) . varint(1) . chr(SRL_HDR_BINARY) . integer(1), qr/Unsupported item type/ ],
+    );
+    foreach my $case (@bad) {
+        my ( $name, $body, $re )= @$case;
+        my $error= validate_error( $hdr . $body );
+        like( $error, $re, "$name: rejected" );
+        is( $error, decode_error( $hdr . $body ), "$name: ... like decoding does" );
+    }
+
+    my $refs= $arrayref->(3) . $track->( SRL_HDR_ARRAYREF ) . chr(SRL_HDR_REFP) . varint(2) . chr(SRL_HDR_ALIAS) . varint(2);
+    is( $dec->validate( $hdr . $refs ), length( $hdr . $refs ), "REFP and ALIAS to a tracked item" );
+
+    my $utf8= $arrayref->(1) . chr(SRL_HDR_STR_UTF8) . varint(2) . "\xff\xfe";
+    ok( !defined validate_error( $hdr . $utf8 ), "bad UTF-8 without validate_utf8" );
+    like( validate_error( $hdr . $utf8, validate_utf8 => 1 ), qr/Invalid UTF8 byte sequence/, "... and with it" );
+
+    my $hash= $hashref->(3) . join "", map { short_string($_) . integer(1) } qw(a b c);
+    ok( !defined validate_error( $hdr . $hash, max_num_hash_entries => 3 ), "max_num_hash_entries allows as many keys" );
+    like( validate_error( $hdr . $hash, max_num_hash_entries => 2 ), qr/configured maximum is just 2/,
+        "... and refuses more" );
+
+    my $object= Sereal::Encoder->new->encode( bless [], 'Foo' );
+    like( validate_error( $object, refuse_objects => 1 ), qr/refuse_objects/, "refuse_objects applies" );
+}
+
+done_testing();
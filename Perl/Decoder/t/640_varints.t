@@ -0,0 +1,74 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Decoder::Constants qw(:all);
+
+# Runs of varints are skipped 8 bytes at a time where the machine allows it,
+# and a byte at a time near the end of the buffer and for the longest ones.
+# Check values of every length, at every distance from the end of the
+# document, read, validated and skipped in packed arrays.
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of encoder';
+}
+
+my $dec= Sereal::Decoder->new();
+my @values= ( 0, map { ( 2**$_ - 1, 2**$_ ) } 4 .. 63 );
+push @values, ~0, ~0 - 1;
+
+my %enc= (
+    plain  => Sereal::Encoder->new(),
+    packed => Sereal::Encoder->new( { pack_numeric_arrays => 1 } ),
+);
+
+foreach my $packing ( sort keys %enc ) {
+    my ( @decoded_wrong, @validated_wrong );
+    foreach my $count ( 1 .. 12 ) {
+        foreach my $i ( 0 .. $#values ) {
+            # the same value count times, then one of each length to end it
+            my $data= [ ( $values[$i] ) x $count, @values[ $i .. $#values ] ];
+            my $encoded= $enc{$packing}->encode($data);
+            my $decoded= eval { $dec->decode($encoded) };
+            push @decoded_wrong, "$count x $values[$i]"
+                if !$decoded || "@$decoded" ne "@$data";
+            push @validated_wrong, "$count x $values[$i]"
+                if ( eval { $dec->validate($encoded) } || 0 ) != length $encoded;
+        }
+    }
+    is( "@decoded_wrong",   "", "$packing: all lengths of varints decode" );
+    is( "@validated_wrong", "", "$packing: ... and validate" );
+}
+
+# negative numbers are zigzag encoded varints
+{
+    my $data= [ map { -$_ } grep { $_ && $_ < 2**62 } @values ];
+    foreach my $packing ( sort keys %enc ) {
+        my $encoded= $enc{$packing}->encode($data);
+        is_deeply( $dec->decode($encoded), $data, "$packing: negative numbers" );
+        is( $dec->validate($encoded), length $encoded, "$packing: ... validate" );
+    }
+}
+
+# a varint with too many continuation bytes among the items of a packed
+# array is refused however far into the array it is
+{
+    my @refused;
+    foreach my $before ( 0 .. 20 ) {
+        my $items= join "", ( map { varint($_) } 1 .. $before ), "\x80" x 11, "\x01", varint(1);
+        my $doc= Header() . chr(SRL_HDR_MANY) . varint( $before + 2 ) . chr(SRL_HDR_VARINT) . $items;
+        push @refused, $before if !eval { $dec->validate($doc); 1 } && $@ =~ /varint/;
+    }
+    is( "@refused", join( " ", 0 .. 20 ), "over long varints in packed arrays are refused" );
+}
+
+done_testing();
@@ -0,0 +1,87 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Decoder::Constants qw(:all);
+
+# The stats option of the decoder counts the tags of the documents it reads
+# the same way as that of the encoder counts those it writes.
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of encoder';
+}
+
+my @counters= qw(documents tags tracked bytes body_bytes copy refp alias compressed_documents compressed_bytes);
+
+my $shared= [ 1 .. 10 ];
+my $data= {
+    list   => [ map { { id => $_, name => "name $_", pi => 3.25, shared => $shared } } 1 .. 100 ],
+    shared => $shared,
+    str    => "x" x 1000,
+    strs   => [ ("some string") x 10 ],
+    obj    => bless( [ 1, 2 ], "Some::Class" ),
+    neg    => -1000,
+    nums   => [ 1 .. 100, 0.5 ],
+};
+
+{
+    my $dec= Sereal::Decoder->new();
+    is( $dec->stats, undef, "no stats without the option" );
+    $dec->reset_stats;
+    is( $dec->stats, undef, "reset_stats does nothing without it" );
+}
+
+my %enc_opts= (
+    plain  => {},
+    packed => { pack_numeric_arrays => 1 },
+    dedupe => { dedupe_strings => 1 },
+    alias  => { aliased_dedupe_strings => 1 },
+    snappy => { compress => Sereal::Encoder::SRL_SNAPPY(), compress_threshold => 0 },
+    zlib   => { compress => Sereal::Encoder::SRL_ZLIB(), compress_threshold => 0 },
+    zstd   => { compress => Sereal::Encoder::SRL_ZSTD(), compress_threshold => 0 },
+);
+foreach my $name ( sort keys %enc_opts ) {
+    my $enc= Sereal::Encoder->new( { %{ $enc_opts{$name} }, stats => 1 } );
+    my $dec= Sereal::Decoder->new( { stats => 1 } );
+    my $encoded= $enc->encode($data);
+    $encoded .= $enc->encode( [ 1, "two" ] );
+    my $decoded= $dec->decode($encoded);
+    is_deeply( $decoded, $data, "$name: roundtrip" );
+    $dec->decode_with_offset( $encoded, $dec->bytes_consumed );
+
+    my ( $enc_stats, $dec_stats )= ( $enc->stats, $dec->stats );
+    is_deeply( { map { $_ => $dec_stats->{$_} } @counters },
+        { map { $_ => $enc_stats->{$_} } @counters }, "$name: same counts as the encoder" )
+        or diag explain $dec_stats;
+    cmp_ok( $dec_stats->{decompress_time}, '>=', 0, "$name: decompress_time" );
+    ok( $dec_stats->{tables}{tracked_items}, "$name: tracked_items table" );
+}
+
+{
+    my $enc= Sereal::Encoder->new( { stats => 1 } );
+    my $encoded= $enc->encode($data);
+
+    my $dec= Sereal::Decoder->new( { stats => 1 } );
+    $dec->validate($encoded);
+    is_deeply( $dec->stats->{tags}, $enc->stats->{tags}, "validate counts the tags" );
+    is( $dec->stats->{documents}, 1, "and the document" );
+
+    $dec->reset_stats;
+    is( $dec->stats->{documents}, 0, "reset_stats starts over" );
+    is_deeply( $dec->stats->{tags}, {}, "with the tags too" );
+
+    my $sel= Sereal::Decoder->new( { stats => 1, select_paths => '$.neg' } );
+    is_deeply( $sel->decode($encoded), { neg => -1000 }, "select_paths" );
+    is( $sel->stats->{body_bytes}, $enc->stats->{body_bytes}, "select_paths counts the skipped parts too" );
+}
+
+done_testing();
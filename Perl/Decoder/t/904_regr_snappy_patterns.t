@@ -0,0 +1,37 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Decoder;
+
+# Snappy expands a short repeating pattern by copying from just behind the
+# output, so source and destination overlap. csnappy's 8 byte unaligned copy
+# did that with a plain load and store, which GCC 12 at -O3 vectorized into
+# something that got most patterns shorter than 16 bytes wrong.
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of encoder';
+}
+
+my $encoder= Sereal::Encoder->new( { compress => Sereal::Encoder::SRL_SNAPPY(), compress_threshold => 0 } );
+my $decoder= Sereal::Decoder->new();
+
+foreach my $period ( 1 .. 32 ) {
+    my $pattern= join "", map { chr( 65 + $_ ) } 1 .. $period;
+    foreach my $len ( 100, 999, 10_000 ) {
+        my $str= substr( $pattern x ( $len / $period + 1 ), 0, $len );
+        my $got= $decoder->decode( $encoder->encode( [ $str, "!" ] ) );
+        ok( $got->[0] eq $str && $got->[1] eq "!", "pattern of $period bytes, $len bytes long" );
+    }
+}
+
+done_testing();
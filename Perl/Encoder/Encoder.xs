@@ -26,67 +26,114 @@
 # define USE_CUSTOM_OPS 0
 #endif
 
-#define pp1_sereal_encode_with_object(has_hdr) THX_pp1_sereal_encode_with_object(aTHX_ has_hdr)
+#define MY_CXT_KEY "Sereal::Encoder::_stash" XS_VERSION
+
+typedef struct {
+    sv_with_hash options[SRL_ENC_OPT_COUNT];
+} my_cxt_t;
+
+START_MY_CXT
+
+#define OPOPT_FUNCTIONAL    (1<<0)  /* encode_sereal*(): no encoder object */
+#define OPOPT_HEADER        (1<<1)  /* header user data argument present */
+#define OPOPT_OPTIONS       (1<<2)  /* options hash argument present */
+
+#define pp1_sereal_encode(opopt) THX_pp1_sereal_encode(aTHX_ opopt)
 static void
-THX_pp1_sereal_encode_with_object(pTHX_ U8 has_hdr)
+THX_pp1_sereal_encode(pTHX_ U8 opopt)
 {
-  SV *encoder_ref_sv, *encoder_sv, *body_sv, *header_sv;
+  SV *encoder_ref_sv, *encoder_sv, *body_sv, *header_sv, *opt_sv;
   srl_encoder_t *enc;
   char *stash_name;
   SV *ret_sv;
   dSP;
 
-  header_sv = has_hdr ? POPs : NULL;
-  body_sv = POPs;
-  PUTBACK;
-
-  encoder_ref_sv = TOPs;
-
-  if (!expect_true(
-        encoder_ref_sv &&
-        SvROK(encoder_ref_sv) &&
-        (encoder_sv = SvRV(encoder_ref_sv)) &&
-        SvOBJECT(encoder_sv) &&
-        (stash_name= HvNAME(SvSTASH(encoder_sv))) &&
-        !strcmp(stash_name, "Sereal::Encoder")
-     ))
-  {
-    croak("handle is not a Sereal::Encoder handle");
-  }
-  /* we should never have an IV smaller than a PTR */
-  enc= INT2PTR(srl_encoder_t *,SvIV(encoder_sv));
+  opt_sv = (opopt & OPOPT_OPTIONS) ? POPs : NULL;
+  header_sv = (opopt & OPOPT_HEADER) ? POPs : NULL;
 
   if (header_sv && !SvOK(header_sv))
     header_sv = NULL;
 
-  /* We always copy the string since we might reuse the string buffer. That
-   * means we already have to do a malloc and we might as well use the
-   * opportunity to allocate only as much memory as we really need to hold
-   * the output. */
-  ret_sv= srl_dump_data_structure_mortal_sv(aTHX_ enc, body_sv, header_sv, SRL_ENC_SV_COPY_ALWAYS);
+  if (opopt & OPOPT_FUNCTIONAL) {
+    HV *opt = NULL;
+    dMY_CXT;
+
+    body_sv = TOPs;
+    PUTBACK;
+    if (opt_sv) {
+      SvGETMAGIC(opt_sv);
+      if (!SvROK(opt_sv) || SvTYPE(SvRV(opt_sv)) != SVt_PVHV)
+        croak("%s: opt is not a HASH reference", (opopt & OPOPT_HEADER)
+              ? "Sereal::Encoder::encode_sereal_with_header_data"
+              : "Sereal::Encoder::encode_sereal");
+      opt = (HV *)SvRV(opt_sv);
+    }
+    enc = srl_build_encoder_struct(aTHX_ opt, MY_CXT.options);
+    assert(enc != NULL);
+    /* Avoid copy by stealing string buffer if it is not too large.
+     * This makes sense in the functional interface since the string
+     * buffer isn't ever going to be reused. */
+    ret_sv = srl_dump_data_structure_mortal_sv(aTHX_ enc, body_sv, header_sv, SRL_ENC_SV_REUSE_MAYBE);
+  }
+  else {
+    body_sv = POPs;
+    PUTBACK;
+
+    encoder_ref_sv = TOPs;
+
+    if (!expect_true(
+          encoder_ref_sv &&
+          SvROK(encoder_ref_sv) &&
+          (encoder_sv = SvRV(encoder_ref_sv)) &&
+          SvOBJECT(encoder_sv) &&
+          (stash_name= HvNAME(SvSTASH(encoder_sv))) &&
+          !strcmp(stash_name, "Sereal::Encoder")
+       ))
+    {
+      croak("handle is not a Sereal::Encoder handle");
+    }
+    /* we should never have an IV smaller than a PTR */
+    enc= INT2PTR(srl_encoder_t *,SvIV(encoder_sv));
+
+    /* We always copy the string since we might reuse the string buffer. That
+     * means we already have to do a malloc and we might as well use the
+     * opportunity to allocate only as much memory as we really need to hold
+     * the output. */
+    ret_sv= srl_dump_data_structure_mortal_sv(aTHX_ enc, body_sv, header_sv, SRL_ENC_SV_COPY_ALWAYS);
+  }
   SPAGAIN;
   TOPs = ret_sv;
 }
 
+/* The optional last argument is the header user data for the OO interface
+ * and the options hash for the functional one. */
+#define OPOPT_WITH_OPTIONAL_ARG(opopt) \
+  ((opopt) | (((opopt) & OPOPT_FUNCTIONAL) ? OPOPT_OPTIONS : OPOPT_HEADER))
+
 #if USE_CUSTOM_OPS
 
 static OP *
-THX_pp_sereal_encode_with_object(pTHX)
+THX_pp_sereal_encode(pTHX)
 {
-  pp1_sereal_encode_with_object(PL_op->op_private);
+  pp1_sereal_encode(PL_op->op_private);
   return NORMAL;
 }
 
 static OP *
-THX_ck_entersub_args_sereal_encode_with_object(pTHX_ OP *entersubop, GV *namegv, SV *ckobj)
+THX_ck_entersub_args_sereal_encoder(pTHX_ OP *entersubop, GV *namegv, SV *ckobj)
 {
+  CV *cv = (CV*)ckobj;
+  I32 cv_private = CvXSUBANY(cv).any_i32;
+  U8 opopt = cv_private & 0xff;
+  U8 min_arity = (cv_private >> 8) & 0xff;
+  U8 max_arity = (cv_private >> 16) & 0xff;
   OP *pushop, *firstargop, *cvop, *lastargop, *argop, *newop;
   int arity;
 
   /* Walk the OP structure under the "entersub" to validate that we
    * can use the custom OP implementation. */
 
-  entersubop = ck_entersub_args_proto(entersubop, namegv, ckobj);
+  entersubop = ck_entersub_args_proto_or_list(entersubop, namegv, ckobj);
   pushop = cUNOPx(entersubop)->op_first;
   if (!OpHAS_SIBLING(pushop))
     pushop = cUNOPx(pushop)->op_first;
@@ -97,14 +144,22 @@ THX_ck_entersub_args_sereal_encode_with_object(pTHX_ OP *entersubop, GV *namegv,
   for (arity = 0, lastargop = pushop, argop = firstargop; argop != cvop;
        lastargop = argop, argop = OpSIBLING(argop))
   {
+    /* Without a prototype the arguments are in list context, so the
+     * number of values is only known if each of them yields exactly one.
+     * encode_sereal(@args) stays a normal sub call. */
+    if (!SvPOK(cv) && !(PL_opargs[argop->op_type] & OA_RETSCALAR))
+      return entersubop;
     arity++;
   }
 
-  if (expect_false(arity < 2 || arity > 3))
+  if (expect_false(arity < min_arity || arity > max_arity))
     return entersubop;
 
   /* If we get here, we can replace the entersub with a suitable
-   * sereal_encode_with_object custom OP. */
+   * custom OP. */
+
+  if (arity > min_arity)
+    opopt = OPOPT_WITH_OPTIONAL_ARG(opopt);
 
 #ifdef op_sibling_splice
   /* op_sibling_splice is new in 5.31 and we have to do things differenly */
@@ -125,8 +180,8 @@ THX_ck_entersub_args_sereal_encode_with_object(pTHX_ OP *entersubop, GV *namegv,
 #endif
 
   newop->op_type    = OP_CUSTOM;
-  newop->op_private = arity == 3;
-  newop->op_ppaddr = THX_pp_sereal_encode_with_object;
+  newop->op_private = opopt;
+  newop->op_ppaddr = THX_pp_sereal_encode;
 
 #ifdef op_sibling_splice
 
@@ -142,30 +197,38 @@ THX_ck_entersub_args_sereal_encode_with_object(pTHX_ OP *entersubop, GV *namegv,
 #endif /* USE_CUSTOM_OPS */
 
 static void
-THX_xsfunc_sereal_encode_with_object(pTHX_ CV *cv)
+THX_xsfunc_sereal_encode(pTHX_ CV *cv)
 {
   dMARK;
   dSP;
   SSize_t arity = SP - MARK;
-  PERL_UNUSED_ARG(cv);
-  if (arity < 2 || arity > 3)
+  I32 cv_private = CvXSUBANY(cv).any_i32;
+  U8 opopt = cv_private & 0xff;
+  U8 min_arity = (cv_private >> 8) & 0xff;
+  U8 max_arity = (cv_private >> 16) & 0xff;
+
+  if (arity < min_arity || arity > max_arity)
     croak("bad Sereal encoder usage");
-  pp1_sereal_encode_with_object(arity == 3);
+  if (arity > min_arity)
+    opopt = OPOPT_WITH_OPTIONAL_ARG(opopt);
+  pp1_sereal_encode(opopt);
 }
 
-#define MY_CXT_KEY "Sereal::Encoder::_stash" XS_VERSION
-
-typedef struct {
-    sv_with_hash options[SRL_ENC_OPT_COUNT];
-} my_cxt_t;
-
-START_MY_CXT
-
 MODULE = Sereal::Encoder        PACKAGE = Sereal::Encoder
 PROTOTYPES: DISABLE
 
 BOOT:
 {
+  struct {
+    char const *name;
+    char const *proto;
+    I32 cv_private;
+  } const funcs_to_install[] = {
+    { "Sereal::Encoder::sereal_encode_with_object",      "$$;$", 0x030200 },
+    { "Sereal::Encoder::encode_sereal",                  NULL,   0x020100 | OPOPT_FUNCTIONAL },
+    { "Sereal::Encoder::encode_sereal_with_header_data", NULL,   0x030200 | OPOPT_FUNCTIONAL | OPOPT_HEADER },
+  }, *fti;
+  int i;
   {
   MY_CXT_INIT;
   SRL_INIT_OPTION( SRL_ENC_OPT_IDX_ALIASED_DEDUPE_STRINGS,   SRL_ENC_OPT_STR_ALIASED_DEDUPE_STRINGS );
@@ -189,6 +252,14 @@ BOOT:
   SRL_INIT_OPTION( SRL_ENC_OPT_IDX_UNDEF_UNKNOWN,            SRL_ENC_OPT_STR_UNDEF_UNKNOWN          );
   SRL_INIT_OPTION( SRL_ENC_OPT_IDX_USE_PROTOCOL_V1,          SRL_ENC_OPT_STR_USE_PROTOCOL_V1        );
   SRL_INIT_OPTION( SRL_ENC_OPT_IDX_WARN_UNKNOWN,             SRL_ENC_OPT_STR_WARN_UNKNOWN           );
+  SRL_INIT_OPTION( SRL_ENC_OPT_IDX_ZSTD_DICTIONARY,          SRL_ENC_OPT_STR_ZSTD_DICTIONARY        );
+  SRL_INIT_OPTION( SRL_ENC_OPT_IDX_COMPRESS_THREADS,         SRL_ENC_OPT_STR_COMPRESS_THREADS       );
+  SRL_INIT_OPTION( SRL_ENC_OPT_IDX_FLUSH_THRESHOLD,          SRL_ENC_OPT_STR_FLUSH_THRESHOLD        );
+  SRL_INIT_OPTION( SRL_ENC_OPT_IDX_DEDUPE_STRINGS_BUDGET,    SRL_ENC_OPT_STR_DEDUPE_STRINGS_BUDGET  );
+  SRL_INIT_OPTION( SRL_ENC_OPT_IDX_PACK_NUMERIC_ARRAYS,      SRL_ENC_OPT_STR_PACK_NUMERIC_ARRAYS    );
+  SRL_INIT_OPTION( SRL_ENC_OPT_IDX_RECORD_BATCHES,           SRL_ENC_OPT_STR_RECORD_BATCHES         );
+  SRL_INIT_OPTION( SRL_ENC_OPT_IDX_ZERO_COPY_STRINGS_OVER,   SRL_ENC_OPT_STR_ZERO_COPY_STRINGS_OVER );
+  SRL_INIT_OPTION( SRL_ENC_OPT_IDX_STATS,                    SRL_ENC_OPT_STR_STATS                  );
   }
 #if USE_CUSTOM_OPS
   {
@@ -197,18 +268,29 @@ BOOT:
     XopENTRY_set(xop, xop_name, "sereal_encode_with_object");
     XopENTRY_set(xop, xop_desc, "sereal_encode_with_object");
     XopENTRY_set(xop, xop_class, OA_UNOP);
-    Perl_custom_op_register(aTHX_ THX_pp_sereal_encode_with_object, xop);
+    Perl_custom_op_register(aTHX_ THX_pp_sereal_encode, xop);
   }
 #endif /* USE_CUSTOM_OPS */
-  {
-    GV *gv;
-    CV *cv = newXSproto_portable("Sereal::Encoder::sereal_encode_with_object",
-                THX_xsfunc_sereal_encode_with_object, __FILE__, "$$;$");
+  for (i = sizeof(funcs_to_install)/sizeof(*fti); i--; ) {
+    CV *cv;
+
+    fti = &funcs_to_install[i];
+    /* As in the decoder, the subs share one C body function and one custom
+     * op, and are told apart by the flags and the arity limits (min_arity
+     * in the second, max_arity in the third byte) in cv_private. Only
+     * sereal_encode_with_object has a prototype, which puts its arguments
+     * into scalar context. The functional subs never had one, so the call
+     * checker only replaces calls to them whose arity it can tell from the
+     * argument ops. */
+    cv = newXSproto_portable(fti->name, THX_xsfunc_sereal_encode, __FILE__, fti->proto);
+    CvXSUBANY(cv).any_i32 = fti->cv_private;
 #if USE_CUSTOM_OPS
-    cv_set_call_checker(cv, THX_ck_entersub_args_sereal_encode_with_object, (SV*)cv);
+    cv_set_call_checker(cv, THX_ck_entersub_args_sereal_encoder, (SV*)cv);
 #endif /* USE_CUSTOM_OPS */
-    gv = gv_fetchpv("Sereal::Encoder::encode", GV_ADDMULTI, SVt_PVCV);
-    GvCV_set(gv, cv);
+  }
+  {
+    GV *gv = gv_fetchpv("Sereal::Encoder::encode", GV_ADDMULTI, SVt_PVCV);
+    GvCV_set(gv, get_cv("Sereal::Encoder::sereal_encode_with_object", 0));
   }
 }
 
@@ -237,39 +319,53 @@ flags(enc)
   OUTPUT: RETVAL
 
 void
-encode_sereal(src, opt = NULL)
+encode_to_fh(enc, fh, src, hdr_user_data_src = NULL)
+    srl_encoder_t *enc;
+    SV *fh;
     SV *src;
-    HV *opt;
+    SV *hdr_user_data_src;
   PREINIT:
-    srl_encoder_t *enc;
-    dMY_CXT;
+    PerlIO *out;
   PPCODE:
-    enc = srl_build_encoder_struct(aTHX_ opt, MY_CXT.options);
-    assert(enc != NULL);
-    /* Avoid copy by stealing string buffer if it is not too large.
-     * This makes sense in the functional interface since the string
-     * buffer isn't ever going to be reused. */
-    ST(0) = srl_dump_data_structure_mortal_sv(aTHX_ enc, src, NULL, SRL_ENC_SV_REUSE_MAYBE);
-    XSRETURN(1);
+    out = IoOFP(sv_2io(fh));
+    if (out == NULL)
+      croak("Filehandle is not open for writing");
+    if (hdr_user_data_src != NULL && !SvOK(hdr_user_data_src))
+      hdr_user_data_src = NULL;
+    srl_dump_data_structure_to_fh(aTHX_ enc, src, hdr_user_data_src, out);
+    XSRETURN_EMPTY;
 
-void
-encode_sereal_with_header_data(src, hdr_user_data_src, opt = NULL)
+UV
+encode_into(enc, dst, src, append = NULL)
+    srl_encoder_t *enc;
+    SV *dst;
     SV *src;
-    SV *hdr_user_data_src;
-    HV *opt;
+    SV *append;
+  CODE:
+    SvGETMAGIC(dst);
+    RETVAL = (UV)srl_dump_data_structure_into_sv(aTHX_ enc, src, dst, append != NULL && SvTRUE(append));
+    SvSETMAGIC(dst);
+  OUTPUT: RETVAL
+
+SV *
+stats(enc)
+    srl_encoder_t *enc;
   PREINIT:
+    HV *hv;
+  CODE:
+    if (enc->stats == NULL)
+      XSRETURN_UNDEF;
+    hv = newHV();
+    RETVAL = newRV_noinc((SV *)hv);
+    srl_encoder_stats(aTHX_ enc, hv);
+  OUTPUT: RETVAL
+
+void
+reset_stats(enc)
     srl_encoder_t *enc;
-    dMY_CXT;
-  PPCODE:
-    if (!SvOK(hdr_user_data_src))
-      hdr_user_data_src = NULL;
-    enc = srl_build_encoder_struct(aTHX_ opt, MY_CXT.options);
-    assert(enc != NULL);
-    /* Avoid copy by stealing string buffer if it is not too large.
-     * This makes sense in the functional interface since the string
-     * buffer isn't ever going to be reused. */
-    ST(0) = srl_dump_data_structure_mortal_sv(aTHX_ enc, src, hdr_user_data_src, SRL_ENC_SV_REUSE_MAYBE);
-    XSRETURN(1);
+  CODE:
+    if (enc->stats != NULL)
+      srl_encoder_reset_stats(aTHX_ enc);
 
 MODULE = Sereal::Encoder        PACKAGE = Sereal::Encoder::_ptabletest
 
@@ -279,12 +375,14 @@ test()
     PTABLE_t *tbl;
     PTABLE_ITER_t *iter;
     PTABLE_ENTRY_t *ent;
-    UV i, n = 20;
+    UV i, n = 20, big = 10000;
     char *check[20];
     char fail[5] = "not ";
     char noop[1] = "";
+    char *res_str;
   CODE:
-    tbl = PTABLE_new_size(10);
+    /* start small so that storing the items grows the table */
+    tbl = PTABLE_new_size(3);
     for (i = 0; i < (UV)n; ++i) {
       PTABLE_store(tbl, INT2PTR(void *,(1000+i)), INT2PTR(void *, (1000+i)));
       check[i] = fail;
@@ -305,6 +403,45 @@ test()
       printf("%sok %u - iter %u\n", check[i], (unsigned int)(21+i), (unsigned int)(i+1));
     }
     PTABLE_iter_free(iter);
+
+    /* delete every other item */
+    res_str = noop;
+    for (i = 0; i < (UV)n; i += 2)
+      PTABLE_delete(tbl, INT2PTR(void *, (1000+i)));
+    for (i = 0; i < (UV)n; ++i) {
+      const UV res = PTR2UV(PTABLE_fetch(tbl, INT2PTR(void *, (1000+i))));
+      if (res != ((i % 2) ? (UV)(1000+i) : 0))
+        res_str = fail;
+    }
+    printf("%sok %u - delete\n", res_str, 41);
+    printf("%sok %u - items after delete\n", tbl->tbl_items == n / 2 ? noop : fail, 42);
+
+    /* clear, then reuse the table */
+    PTABLE_clear(tbl);
+    res_str = tbl->tbl_items == 0 ? noop : fail;
+    for (i = 0; i < (UV)n; ++i) {
+      if (PTABLE_fetch(tbl, INT2PTR(void *, (1000+i))))
+        res_str = fail;
+    }
+    printf("%sok %u - clear\n", res_str, 43);
+    iter = PTABLE_iter_new(tbl);
+    printf("%sok %u - iter after clear\n", PTABLE_iter_next(iter) ? fail : noop, 44);
+    PTABLE_iter_free(iter);
+
+    /* many colliding-ish keys, deleting half of them while the rest stays findable */
+    res_str = noop;
+    for (i = 0; i < big; ++i)
+      PTABLE_store(tbl, INT2PTR(void *, (8*(i+1))), INT2PTR(void *, (i+1)));
+    for (i = 0; i < big; i += 2)
+      PTABLE_delete(tbl, INT2PTR(void *, (8*(i+1))));
+    for (i = 0; i < big; ++i) {
+      const UV res = PTR2UV(PTABLE_fetch(tbl, INT2PTR(void *, (8*(i+1)))));
+      if (res != ((i % 2) ? (UV)(i+1) : 0))
+        res_str = fail;
+    }
+    if (tbl->tbl_items != big / 2)
+      res_str = fail;
+    printf("%sok %u - store and delete %u items\n", res_str, 45, (unsigned int)big);
     PTABLE_free(tbl);
 
 
@@ -37,6 +37,8 @@ use constant #begin generated
   'SRL_F_ENCODER_COMPRESS_FLAGS_MASK' => 262592,
   'SRL_F_NOWARN_UNKNOWN_OVERLOAD' => 512,
   'SRL_F_NO_BLESS_OBJECTS' => 8192,
+  'SRL_F_PACK_NUMERIC_ARRAYS' => 524288,
+  'SRL_F_RECORD_BATCHES' => 1048576,
   'SRL_F_REUSE_ENCODER' => 2,
   'SRL_F_SHARED_HASHKEYS' => 1,
   'SRL_F_SORT_KEYS' => 1024,
@@ -68,7 +70,9 @@ use constant #begin generated
                     'CANONICAL_REFS',
                     'SORT_KEYS_PERL',
                     'SORT_KEYS_PERL_REV',
-                    'COMPRESS_ZSTD'
+                    'COMPRESS_ZSTD',
+                    'PACK_NUMERIC_ARRAYS',
+                    'RECORD_BATCHES'
                   ]
 }; #end generated
 #end-no-tidy
@@ -198,6 +202,37 @@ If Zlib or Zstd compressions are used, then this option will set a compression
 level: Zlib uses range from 1 (fastest) to 9 (best). Defaults to 6. Zstd uses
 range from 1 (fastest) to 22 (best). Default is 3.
 
+=head3 zstd_dictionary
+
+If Zstd compression is used, this option can be set to a zstd dictionary
+(a string) to compress with. This greatly improves the compression ratio for
+small documents that share a lot of content, such as hashes with the same
+keys or objects of the same classes, which on their own are often too small
+to compress well. Remember to lower C<compress_threshold> accordingly.
+
+The dictionary can either be one produced by zstd's dictionary builder (for
+example C<zstd --train>, see F<author_tools/train_zstd_dictionary.pl> in the
+Sereal repository) or any string, which is then used as raw content
+dictionary. The former carries a dictionary ID which is recorded in every
+document compressed with it.
+
+Documents compressed with a dictionary can only be decoded by a decoder which
+was given the same dictionary, see the C<zstd_dictionaries> option of
+L<Sereal::Decoder>.
+
+=head3 compress_threads
+
+If Zstd compression is used, this option can be set to the number of worker
+threads zstd should use to compress large document bodies (1MB and more).
+Compressing a body of several hundred megabytes then takes a fraction of the
+wall-clock time it takes on a single thread. Smaller bodies are compressed on
+the calling thread as usual. The worker threads are started on first use and
+kept around for the lifetime of the encoder object.
+
+The output is an ordinary zstd compressed document, any decoder that supports
+zstd can decode it. Defaults to 0, no worker threads. The option is ignored if
+the zstd library Sereal was built with has no multi-threading support.
+
 =head3 snappy
 
 See also the C<compress> option. This option is provided only for
@@ -302,17 +337,36 @@ we silently stringify without warning.
 
 =head3 max_recursion_depth
 
-C<Sereal::Encoder> is recursive. If you pass it a Perl data structure
-that is deeply nested, it will eventually exhaust the C stack. Therefore,
-there is a limit on the depth of recursion that is accepted. It defaults
-to 10000 nested calls. You may choose to override this value with the
-C<max_recursion_depth> option. Beware that setting it too high can
-cause hard crashes, so only do that if you B<KNOW> that it is safe to
-do so.
+C<Sereal::Encoder> walks nested data structures with a stack of its own
+rather than by recursing in C, so even very deeply nested structures (long
+linked lists, for example) can't exhaust the C stack. There is still a
+limit on the nesting depth that is accepted, as a safeguard against runaway
+data and because the decoder has to handle the same depth. It defaults to
+10000 nested structures. You may choose to override this value with the
+C<max_recursion_depth> option. Beware that C<Sereal::Decoder> has a limit
+of its own.
 
 Do note that the setting is somewhat approximate. Setting it to 10000 may break at
 somewhere between 9997 and 10003 nested structures depending on their types.
 
+=head3 flush_threshold
+
+Only used by C<encode_to_fh>: the encoder writes its buffer out to the file
+handle whenever it holds at least this many bytes. Defaults to 1MB. The
+buffer may still grow somewhat beyond this, since it is only written out
+between items, so a single large string is always encoded in one piece.
+
+=head3 zero_copy_strings_over
+
+Only used by C<encode_to_fh> for uncompressed documents: strings at least
+this many bytes long are written to the file handle straight from the Perl
+string, together with what the buffer holds at that point, instead of being
+copied into the encoder's buffer first. If the file handle is a plain file,
+pipe or socket without any layers but C<:perlio> or C<:unix>, this is a
+single C<writev> call. Strings that were written out this way can't be
+deduplicated against later by C<dedupe_strings>. Defaults to 0, which turns
+this off.
+
 =head3 canonical
 
 Enable all options which are related to producing canonical output, so that
@@ -387,7 +441,7 @@ Do not disable this unless you have a reason to.
 
 If this is option is enabled/true then Sereal will use a hash to encode duplicates
 of strings during serialization efficiently using (internal) backreferences. This
-has a performance and memory penalty during encoding so it defaults to off.
+has a (small) performance and memory penalty during encoding so it defaults to off.
 On the other hand, data structures with many duplicated strings will see a
 significant reduction in the size of the encoded form. Currently only strings
 longer than 3 characters will be deduped, however this may change in the future.
@@ -406,6 +460,18 @@ In other words, the output of a Sereal B<decoder> should not depend on
 whether this option was used during B<encoding>. See also below:
 I<aliased_dedupe_strings>.
 
+The hash used for this keeps about 24 bytes per distinct string, see
+I<dedupe_strings_budget> to limit that. When streaming with C<encode_to_fh>,
+strings are only deduped against those that are not written out yet.
+
+=head3 dedupe_strings_budget
+
+Limits the memory used by I<dedupe_strings> and I<aliased_dedupe_strings> to
+(roughly) this many bytes per encoder. Once the limit is reached, strings
+that were not seen before are no longer tracked, but the ones that were are
+still deduped. This keeps encoding huge documents with many distinct strings
+from using a lot of memory. Defaults to 0, which means no limit.
+
 =head3 aliased_dedupe_strings
 
 This is an advanced option that should be used only after fully understanding
@@ -425,6 +491,44 @@ but at the cost of potential action at a distance due to the aliasing.
 I<Beware:> The test suite currently does not cover this option as well as it
 probably should. Patches welcome.
 
+=head3 pack_numeric_arrays
+
+If set, arrays of at least 8 numbers of the same type are written as packed
+arrays, which store the items without a tag per item. Integers are stored
+as varints and floating point numbers as 4 or 8 byte IEEE floats. This makes
+large arrays of numbers, like time series or lists of ids, smaller and a lot
+faster to encode and decode.
+
+Only arrays whose items are all plain integers, or all plain floating point
+numbers, are packed. Strings that look like numbers, undefined values,
+references and items that are referenced from elsewhere in the data
+structure are not. Decoding a packed array gives the same result as decoding
+the unpacked one.
+
+I<Beware:> Versions of Sereal::Decoder that predate this option, and Sereal
+implementations in other languages that don't support packed arrays, refuse
+to decode documents that contain them. Disabled by default.
+
+=head3 record_batches
+
+If set, arrays of at least two hashes that all have the same keys, like rows
+fetched from a database or parsed log lines, are written as record batches.
+A record batch stores the keys once and then the values column by column,
+so a key isn't repeated for every hash, and values of the same field end up
+next to each other, which also helps compression.
+
+Only plain hashes qualify: hashes that are blessed, tied or otherwise
+magical, that are referenced from elsewhere in the data structure, or that
+are referenced weakly are not batched, and neither are arrays that contain
+such a hash or any other item. The values themselves can be anything.
+Decoding a record batch gives the same result as decoding the array of
+hashes. The keys are sorted when C<sort_keys> is 1; setting it to 2 or 3,
+to sort in Perl "cmp" order, disables batching.
+
+I<Beware:> Versions of Sereal::Decoder that predate this option, and Sereal
+implementations in other languages that don't support record batches,
+refuse to decode documents that contain them. Disabled by default.
+
 =head3 protocol_version
 
 Specifies the version of the Sereal protocol to emit. Valid are integers
@@ -443,6 +547,15 @@ If set, the encoder will emit Sereal documents following protocol version 1.
 This is strongly discouraged except for temporary
 compatibility/migration purposes.
 
+=head3 stats
+
+If set, the encoder keeps counters of what it wrote and how, see the
+C<stats> method. This is meant for finding out which of the other options
+pay off for a given workload. The counters cost next to nothing in the
+encoder itself, but the body of every document is scanned once more to
+count its tags, so don't leave it on where every cycle counts. Disabled by
+default.
+
 =head1 INSTANCE METHODS
 
 =head2 encode
@@ -466,6 +579,171 @@ If $append is true then the written data is appended to any
 existing data, otherwise any existing data will be overwritten.
 Dies if any errors occur during writing the encoded data.
 
+The document is encoded in memory first, so the file is left alone if
+encoding dies, and the output is the same as that of C<encode>. Use
+C<encode_to_fh> to write large documents without holding them in memory.
+
+=head2 encode_to_fh
+
+    $encoder->encode_to_fh($fh, $data);
+    $encoder->encode_to_fh($fh, $data, $header);
+
+Encode the data specified and write it to the file handle C<$fh>, which must
+be open for writing. The optional third parameter is header data as with
+C<encode>. Dies if any errors occur during writing.
+
+Unlike C<encode>, this does not build the whole document in memory first.
+The encoder's buffer is written out whenever it grows beyond
+C<flush_threshold> bytes (see the option of the same name), so memory use
+does not grow with the size of the document, which makes this suitable
+for dumping very large data structures. Things to keep in mind:
+
+=over 4
+
+=item *
+
+Since the encoder cannot go back and modify what it has already written out,
+the output may differ from that of C<encode> for the same data. It decodes
+to the same structure, with one exception: a weak reference whose referent
+was not referenced strongly I<before> the buffer was written out becomes a
+strong reference, because there is no way to tell at that point whether a
+strong reference to it will be seen later.
+
+=item *
+
+If encoding dies, what was written out up to that point stays written, so
+the output ends with an incomplete document. When appending to a file of
+documents, note its size before and truncate it back to that on error.
+
+=item *
+
+With zstd compression, the uncompressed body is written to a temporary file
+(as created by C<PerlIO_tmpfile>) first, since the compressed length of the
+body has to be written before the body itself. It is then compressed in
+chunks.
+
+=item *
+
+Snappy and zlib cannot compress incrementally, so with these the document
+is encoded in memory as with C<encode> and then written out.
+
+=item *
+
+Without compression, long strings can be written out without copying them
+into the encoder's buffer, see C<zero_copy_strings_over>.
+
+=back
+
+=head2 encode_into
+
+    my $len= $encoder->encode_into($buf, $data);
+    my $len= $encoder->encode_into($buf, $data, $append);
+
+Encode the data specified into the string C<$buf>, replacing what it held,
+or if C<$append> is true, appending the document to it. Returns the length
+of the document.
+
+C<encode> has to copy the document from the encoder's buffer into a new
+string on every call. C<encode_into> uses the buffer of C<$buf> as the
+encoder's output buffer instead, growing it in place, so there is no copy,
+and as long as C<$buf> is reused, no allocation either once it is large
+enough. Appending allows batching many documents back to back in one string
+without the intermediate copy of C<< $buf .= $encoder->encode($data) >>.
+Things to keep in mind:
+
+=over 4
+
+=item *
+
+Whatever C<$buf> held is turned into a byte string first when appending,
+which dies if it contains characters above 255.
+
+=item *
+
+While the document is being written, C<$buf> is undefined. So if the data
+refers to C<$buf> itself, it is encoded as undef.
+
+=item *
+
+If encoding dies, C<$buf> is left with what it held before when appending,
+and empty otherwise.
+
+=item *
+
+Compressed documents, and documents written with C<protocol_version> 1, are
+built in the encoder's buffer as with C<encode> and then copied into
+C<$buf>, since compression moves the body around and protocol version 1
+offsets are relative to the start of the buffer.
+
+=back
+
+=head2 stats
+
+    my $stats= $encoder->stats;
+
+With the C<stats> option, returns a hash reference with the counters the
+encoder kept since it was created or since C<reset_stats> was last called,
+and undef without it. Documents encoded by FREEZE methods with the same
+encoder are not counted. The counters are:
+
+=over 4
+
+=item documents
+
+The number of documents.
+
+=item tags
+
+The number of tags written by tag name, e.g. C<ARRAYREF>, C<COPY> or
+C<SHORT_BINARY>, not counting tags that are only in the header.
+The tags that hold a small number or length are counted together, as
+C<POS>, C<NEG>, C<SHORT_BINARY>, C<ARRAYREF> and C<HASHREF>. The numbers in
+packed numeric arrays (see C<pack_numeric_arrays>) don't have a tag. The
+number of tags with the flag that marks them as referred to by REFP or
+ALIAS is in C<tracked>.
+
+=item copy, refp, alias
+
+The number of C<COPY>, C<REFP> and C<ALIAS> tags, i.e. of things that were
+written as a reference to something written earlier instead of again.
+
+=item bytes, body_bytes
+
+C<body_bytes> is the size of the uncompressed bodies. C<bytes> splits these
+up by kind of tag, each with its payload but not the tags it contains:
+C<integer>, C<float>, C<string>, C<array>, C<hash>, C<reference>, C<copy>
+(COPY and ALIAS), C<object> and C<other>.
+
+=item shared_hashkeys, dedupe_strings
+
+Hashes with C<lookups>, C<hits> and their C<ratio>. For C<shared_hashkeys>,
+the lookups are those of hash keys that may have been written before (see
+C<no_shared_hashkeys>) and the hits those that had, for C<dedupe_strings>
+those of strings (see C<dedupe_strings>).
+
+=item compressed_documents, compressed_bytes, compress_time
+
+The number of documents whose body was compressed, the size of the
+compressed bodies, and the time spent compressing in seconds, including
+that of the attempts that didn't make the body smaller.
+
+=item buffer_grows
+
+The number of times the output buffer had to be enlarged.
+
+=item tables
+
+A hash with the size (in slots) and the number of times it was doubled
+(C<grows>) of the tables the encoder looks things up in: C<seen_refs>,
+C<weak_refs>, C<frozen_objects>, C<shared_hashkeys> and C<dedupe_strings>.
+The tables are created when first needed and keep their size from then on.
+
+=back
+
+=head2 reset_stats
+
+Sets the counters of the C<stats> option back to zero.
+
 =head1 EXPORTABLE FUNCTIONS
 
 =head2 sereal_encode_with_object
@@ -487,6 +765,11 @@ by a hash reference of options (see documentation for C<new()>).
 This function cannot be used for encoding a data structure with a header.
 See C<encode_sereal_with_header_data>.
 
+On sufficiently modern Perl versions, calls to it whose arguments are each
+a single scalar, as in C<encode_sereal($data, { canonical =E<gt> 1 })>, are
+compiled to a custom op without subroutine call overhead. Other calls, such
+as C<encode_sereal(@args)>, are plain subroutine calls.
+
 This functional interface is significantly slower than the OO interface since
 it cannot reuse the encoder object.
 
@@ -495,6 +778,8 @@ it cannot reuse the encoder object.
 The functional interface that is equivalent to using C<new> and C<encode>.
 Expects a data structure and a header to serialize as first and second arguments,
 optionally followed by a hash reference of options (see documentation for C<new()>).
+Calls to it are compiled to a custom op in the same cases as those to
+C<encode_sereal>.
 
 This functional interface is significantly slower than the OO interface since
 it cannot reuse the encoder object.
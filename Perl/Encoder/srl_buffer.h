@@ -73,6 +73,7 @@ srl_buf_init_buffer(pTHX_ srl_buffer_t *buf, const STRLEN init_size)
     buf->end = buf->start + init_size - 1;
     buf->pos = buf->start;
     buf->body_pos = buf->start; /* SRL_SET_BODY_POS(enc, enc->buf.start) equiv */
+    buf->grows = 0;
     return 0;
 }
 
@@ -107,7 +108,7 @@ SRL_STATIC_INLINE void
 srl_buf_grow_nocheck(pTHX_ srl_buffer_t *buf, const size_t minlen)
 {
     const size_t pos_ofs= BUF_POS_OFS(buf); /* have to store the offset of pos */
-    const size_t body_ofs= buf->body_pos - buf->start; /* have to store the offset of the body */
+    const ptrdiff_t body_ofs= buf->body_pos - buf->start; /* have to store the offset of the body */
 #ifdef MEMDEBUG
     const size_t new_size = minlen;
 #else
@@ -128,15 +129,16 @@ srl_buf_grow_nocheck(pTHX_ srl_buffer_t *buf, const size_t minlen)
     buf->end = (srl_buffer_char*) (buf->start + new_size);
     buf->pos = buf->start + pos_ofs;
     SRL_SET_BODY_POS(buf, buf->start + body_ofs);
+    buf->grows++;
 
     DEBUG_ASSERT_BUF_SANE(buf);
     assert(buf->end - buf->start > (ptrdiff_t)0);
     assert(buf->pos - buf->start >= (ptrdiff_t)0);
-    /* The following is checking against -1 because SRL_UPDATE_BODY_POS
-     * will actually set the body_pos to pos-1, where pos can be 0.
-     * This works out fine in the end, but is admittedly a bit shady.
-     * FIXME */
-    assert(buf->body_pos - buf->start >= (ptrdiff_t)-1);
+    /* No assert on body_pos: SRL_UPDATE_BODY_POS will actually set the
+     * body_pos to pos-1, where pos can be 0, and the encoder points it
+     * further before the start of the buffer after writing out part of the
+     * body when streaming. This works out fine in the end, but is admittedly
+     * a bit shady. FIXME */
 }
 
 #define BUF_SIZE_ASSERT(buf, minlen)                                    \
@@ -242,6 +244,58 @@ srl_buf_cat_varint_raw_nocheck(pTHX_ srl_buffer_t *buf, UV value) {
     DEBUG_ASSERT_BUF_SANE(buf);
 }
 
+/* On 64 bit little endian machines, varints of 2 to 8 bytes can also be
+ * appended with a single 8 byte store and no branches on their length: the
+ * 7 bit groups of the value are spread out to one per byte, and the high
+ * bits set on all the bytes below the highest one that isn't 0. Define
+ * SRL_VARINT_NO_WORDS to always write them a byte at a time. */
+#if !defined(SRL_VARINT_NO_WORDS) && defined(__GNUC__) && UVSIZE == 8 && BYTEORDER == 0x12345678
+#   define SRL_BUF_VARINT_WORDS 1
+#   ifdef __BMI2__
+#       include <immintrin.h>
+#   endif
+#endif
+
+/* Writes the varint at pos and returns the position after it, like
+ * srl_buf_cat_varint_raw_nocheck(), but may write up to 7 bytes of garbage
+ * after it. So only for appending, never for writing a varint in place in
+ * front of other data. Loops over many values keep pos in a local, which
+ * the compiler can't do with buf->pos: every byte stored might change it. */
+SRL_STATIC_INLINE srl_buffer_char *
+srl_append_varint_raw(srl_buffer_char *pos, UV value) {
+#ifdef SRL_BUF_VARINT_WORDS
+    /* runs of small values predict this well, and are cheaper without words */
+    if (value < 0x80) {
+        *pos = (U8)value;
+        return pos + 1;
+    }
+    if (expect_true( value < ((UV)1 << 56) )) {
+        U64 word= value;
+        unsigned int top;
+
+#ifdef __BMI2__
+        word= _pdep_u64(word, UINT64_C(0x7f7f7f7f7f7f7f7f));
+#else
+        /* spread the 56 bits into two 28 bit, four 14 bit, then eight 7 bit groups */
+        word= (word & UINT64_C(0x000000000fffffff)) | ((word & UINT64_C(0x00fffffff0000000)) << 4);
+        word= (word & UINT64_C(0x00003fff00003fff)) | ((word & UINT64_C(0x0fffc0000fffc000)) << 2);
+        word= (word & UINT64_C(0x007f007f007f007f)) | ((word & UINT64_C(0x3f803f803f803f80)) << 1);
+#endif
+        /* the lowest bit of the last byte */
+        top= (63 - __builtin_clzll(word)) & ~7U;
+        word |= (((U64)1 << top) - 1) & UINT64_C(0x8080808080808080);
+        Copy(&word, pos, 1, U64);
+        return pos + (top >> 3) + 1;
+    }
+#endif
+    while (value >= 0x80) {
+        *pos++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *pos++ = (U8)value;
+    return pos;
+}
+
 SRL_STATIC_INLINE UV
 srl_zigzag_iv(IV value) {
     return (UV)((value << 1) ^ (value >> (sizeof(IV) * 8 - 1)));
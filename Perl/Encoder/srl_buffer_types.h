@@ -7,6 +7,7 @@ typedef struct {
     srl_buffer_char *end;      /* ptr to end of output buffer */
     srl_buffer_char *pos;      /* ptr to current position within output buffer */
     srl_buffer_char *body_pos; /* ptr to start of body within output buffer for protocol V2 encoding */
+    UV grows;                  /* times srl_buf_grow_nocheck() reallocated the buffer, for stats */
 } srl_buffer_t;
 
 #endif
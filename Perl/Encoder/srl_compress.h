@@ -92,6 +92,74 @@ srl_destroy_snappy_workmem(pTHX_ void *workmem)
     Safefree(workmem);
 }
 
+/* Lazy zstd compression context alloc. The context is kept around for
+ * the lifetime of its owner so that consecutive documents do not pay for
+ * setting up and tearing down zstd's internal tables every time. */
+SRL_STATIC_INLINE void
+srl_init_zstd_cctx(pTHX_ void **cctx)
+{
+    if (expect_false(*cctx == NULL)) {
+        *cctx = (void *) ZSTD_createCCtx();
+        if (*cctx == NULL)
+            croak("Out of memory!");
+    }
+}
+
+/* Destroy zstd compression context */
+SRL_STATIC_INLINE void
+srl_destroy_zstd_cctx(pTHX_ void *cctx)
+{
+    if (cctx != NULL)
+        ZSTD_freeCCtx((ZSTD_CCtx *) cctx);
+}
+
+/* Lazily digest a zstd dictionary (either one produced by zstd's dictionary
+ * builder or a raw content dictionary) into a ZSTD_CDict for the given
+ * compression level. Dictionaries in zstd format carry an ID which ends up
+ * in the frame header so that the decoder can pick the matching one. */
+SRL_STATIC_INLINE void
+srl_init_zstd_cdict(pTHX_ void **cdict, SV *dictionary, const int compress_level)
+{
+    if (expect_false(*cdict == NULL)) {
+        STRLEN len;
+        const char *pv = SvPV(dictionary, len);
+        *cdict = (void *) ZSTD_createCDict(pv, len, compress_level);
+        if (*cdict == NULL)
+            croak("Invalid zstd dictionary");
+    }
+}
+
+/* Destroy digested zstd dictionary */
+SRL_STATIC_INLINE void
+srl_destroy_zstd_cdict(pTHX_ void *cdict)
+{
+    if (cdict != NULL)
+        ZSTD_freeCDict((ZSTD_CDict *) cdict);
+}
+
+/* Bodies smaller than this are always compressed on the calling thread:
+ * zstd's multi-threaded compressor does not split its input into jobs
+ * smaller than 1MB, so it could not keep more than one worker busy anyway. */
+#define SRL_ZSTD_MT_MIN_BODY_LENGTH (1024 * 1024)
+
+/* Set up the (persistent) zstd context for compressing with the given number
+ * of worker threads. Returns false if zstd was built without multi-threading
+ * support, in which case the caller has to compress on its own thread. */
+SRL_STATIC_INLINE int
+srl_setup_zstd_cctx_threads(ZSTD_CCtx *cctx, const int compress_level,
+                            const int threads, ZSTD_CDict *cdict)
+{
+    ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+    if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, threads)))
+        return 0;
+
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, compress_level);
+    if (cdict != NULL)
+        ZSTD_CCtx_refCDict(cctx, cdict);
+
+    return 1;
+}
+
 SRL_STATIC_INLINE U8
 srl_get_compression_header_flag(const U32 compress_flags)
 {
@@ -131,7 +199,10 @@ srl_reset_compression_header_flag(srl_buffer_t *buf)
                               (*flags_and_version_byte & SRL_PROTOCOL_VERSION_MASK);
 }
 
-/* Compress body with one of available compressors (zlib, snappy).
+/* Compress body with one of available compressors (zlib, snappy, zstd).
+ * zstd_cdict is an optional digested zstd dictionary (see srl_init_zstd_cdict).
+ * If zstd_threads is non-zero, large bodies are compressed by that many zstd
+ * worker threads; the output is an ordinary zstd frame either way.
  * The function sets/resets compression bits at version byte.
  * The caller has to adjust buf->body_pos by calling SRL_UPDATE_BODY_POS
  * right after exiting from srl_compress_body.
@@ -139,7 +210,8 @@ srl_reset_compression_header_flag(srl_buffer_t *buf)
 
 SRL_STATIC_INLINE void
 srl_compress_body(pTHX_ srl_buffer_t *buf, STRLEN sereal_header_length,
-                  const U32 compress_flags, const int compress_level, void **workmem)
+                  const U32 compress_flags, const int compress_level, void **workmem,
+                  void **zstd_cctx, void *zstd_cdict, const int zstd_threads)
 {
     const int is_traditional_snappy = compress_flags & SRL_F_COMPRESS_SNAPPY;
     const int is_incremental_snappy = compress_flags & SRL_F_COMPRESS_SNAPPY_INCREMENTAL;
@@ -196,9 +268,28 @@ srl_compress_body(pTHX_ srl_buffer_t *buf, STRLEN sereal_header_length,
 
         compressed_body_length = (size_t) len;
     } else if (is_zstd) {
-        size_t code = ZSTD_compress((void*) buf->pos, compressed_body_length,
-                                    (void*) (old_buf.start + sereal_header_length), uncompressed_body_length,
-                                    compress_level);
+        size_t code;
+        srl_init_zstd_cctx(aTHX_ zstd_cctx);
+
+        if (zstd_threads > 0
+            && uncompressed_body_length >= SRL_ZSTD_MT_MIN_BODY_LENGTH
+            && srl_setup_zstd_cctx_threads((ZSTD_CCtx *) *zstd_cctx, compress_level,
+                                           zstd_threads, (ZSTD_CDict *) zstd_cdict))
+        {
+            code = ZSTD_compress2((ZSTD_CCtx *) *zstd_cctx,
+                                  (void*) buf->pos, compressed_body_length,
+                                  (void*) (old_buf.start + sereal_header_length), uncompressed_body_length);
+        } else if (zstd_cdict != NULL) {
+            code = ZSTD_compress_usingCDict((ZSTD_CCtx *) *zstd_cctx,
+                                            (void*) buf->pos, compressed_body_length,
+                                            (void*) (old_buf.start + sereal_header_length), uncompressed_body_length,
+                                            (ZSTD_CDict *) zstd_cdict);
+        } else {
+            code = ZSTD_compressCCtx((ZSTD_CCtx *) *zstd_cctx,
+                                     (void*) buf->pos, compressed_body_length,
+                                     (void*) (old_buf.start + sereal_header_length), uncompressed_body_length,
+                                     compress_level);
+        }
 
         assert(ZSTD_isError(code) == 0);
         compressed_body_length = code;
@@ -0,0 +1,195 @@
+#ifndef SRL_DEDUPE_H_
+#define SRL_DEDUPE_H_
+
+/*
+ * Hash table of the strings the encoder has already written to its output
+ * buffer, for dedupe_strings. It maps a string's contents to the offset of
+ * its tag in the body, so that later occurrences can be emitted as COPY or
+ * ALIAS.
+ *
+ * No keys are stored: an entry only holds the hash, the length and the
+ * offset, and candidates are compared against the copy of the string in the
+ * output buffer, which stays put for the whole document. That also means
+ * the encoded form (STR_UTF8 or binary) has to match, so strings with the
+ * same bytes but different UTF8-ness are not deduped against each other.
+ *
+ * Like ptable.h this is an open addressing table with linear probing over a
+ * flat array, and every slot carries the generation it was stored in, so
+ * that clearing the table between documents is constant time.
+ *
+ * The memory used by the table can be limited with a budget in bytes. Once
+ * the table can't grow any further strings that are not in the table yet
+ * are no longer tracked, but the ones that are still get deduped.
+ */
+
+#include "srl_inline.h"
+#include "srl_protocol.h"
+#include "srl_buffer_types.h"
+
+typedef struct srl_dedupe_entry srl_dedupe_entry_t;
+typedef struct srl_dedupe       srl_dedupe_t;
+
+struct srl_dedupe_entry {
+    UV      ofs;    /* body offset of the tag of the string, 0 if not written yet */
+    U32     hash;
+    U32     len;
+    U32     gen;    /* slot is in use if this is the generation of the table */
+};
+
+struct srl_dedupe {
+    srl_dedupe_entry_t  *tbl_ary;
+    UV                  tbl_max;
+    UV                  tbl_items;
+    U32                 tbl_gen;    /* never 0, which marks never used slots */
+    STRLEN              budget;     /* max bytes for tbl_ary, 0 for no limit */
+    UV                  grows;      /* times the table was doubled, for stats */
+};
+
+#define SRL_DEDUPE_MAX_STR_LEN 0xFFFFFFFF
+
+/* grow once more than 3/4 of the slots are in use */
+#define SRL_DEDUPE_FULL(tbl) ((tbl)->tbl_items >= (tbl)->tbl_max - ((tbl)->tbl_max >> 2))
+
+#define SRL_DEDUPE_FITS_BUDGET(tbl, size) \
+    ((tbl)->budget == 0 || (size) * sizeof(srl_dedupe_entry_t) <= (tbl)->budget)
+
+SRL_STATIC_INLINE srl_dedupe_t *
+srl_dedupe_new(pTHX_ U8 size_base2_exponent, STRLEN budget)
+{
+    srl_dedupe_t *tbl;
+    Newxz(tbl, 1, srl_dedupe_t);
+    tbl->budget = budget;
+    /* start smaller if the budget says so, but with a few slots at least */
+    while (size_base2_exponent > 3 && !SRL_DEDUPE_FITS_BUDGET(tbl, (UV)1 << size_base2_exponent))
+        size_base2_exponent--;
+    tbl->tbl_max = ((UV)1 << size_base2_exponent) - 1;
+    tbl->tbl_gen = 1;
+    Newxz(tbl->tbl_ary, tbl->tbl_max + 1, srl_dedupe_entry_t);
+    return tbl;
+}
+
+SRL_STATIC_INLINE void
+srl_dedupe_free(pTHX_ srl_dedupe_t *tbl)
+{
+    if (!tbl)
+        return;
+    Safefree(tbl->tbl_ary);
+    Safefree(tbl);
+}
+
+/* remove all the entries, in constant time */
+SRL_STATIC_INLINE void
+srl_dedupe_clear(pTHX_ srl_dedupe_t *tbl)
+{
+    if (tbl && tbl->tbl_items) {
+        if (++tbl->tbl_gen == 0) {
+            /* wrapped around, slots from 2**32 clears ago would look used */
+            Zero(tbl->tbl_ary, tbl->tbl_max + 1, srl_dedupe_entry_t);
+            tbl->tbl_gen = 1;
+        }
+        tbl->tbl_items = 0;
+    }
+}
+
+/* double the size of the table, returns false if that would exceed the budget */
+SRL_STATIC_INLINE int
+srl_dedupe_grow(pTHX_ srl_dedupe_t *tbl)
+{
+    srl_dedupe_entry_t *oldary = tbl->tbl_ary;
+    const UV oldsize = tbl->tbl_max + 1;
+    const UV newmax = oldsize * 2 - 1;
+    srl_dedupe_entry_t *ary;
+    UV i;
+
+    if (!SRL_DEDUPE_FITS_BUDGET(tbl, newmax + 1))
+        return 0;
+
+    Newxz(ary, newmax + 1, srl_dedupe_entry_t);
+    for (i = 0; i < oldsize; i++) {
+        const srl_dedupe_entry_t *ent = &oldary[i];
+        UV j;
+        if (ent->gen != tbl->tbl_gen)
+            continue;
+        j = ent->hash & newmax;
+        while (ary[j].gen)
+            j = (j + 1) & newmax;
+        ary[j] = *ent;
+        ary[j].gen = 1;
+    }
+
+    Safefree(oldary);
+    tbl->tbl_ary = ary;
+    tbl->tbl_max = newmax;
+    tbl->tbl_gen = 1;
+    tbl->grows++;
+    return 1;
+}
+
+/* Is the string whose tag is at body offset ofs the given one? */
+SRL_STATIC_INLINE int
+srl_dedupe_is_same(const srl_buffer_t *buf, UV ofs, const char *str, STRLEN len, int is_utf8)
+{
+    const srl_buffer_char *p = buf->body_pos + ofs;
+    const U8 tag = *p++ & ~SRL_HDR_TRACK_FLAG;
+
+    if ((tag == SRL_HDR_STR_UTF8) != (is_utf8 != 0))
+        return 0;
+    if (tag < SRL_HDR_SHORT_BINARY_LOW) {
+        /* BINARY or STR_UTF8, skip the length */
+        while (*p++ & 0x80)
+            ;
+    }
+    return memcmp(p, str, len) == 0;
+}
+
+/* Look up a string that is about to be written to buf. Returns its entry if
+ * it is known, in which case ent->ofs is the offset of the earlier copy.
+ * Otherwise the string is added with ent->ofs set to 0, and the caller has
+ * to set it to the offset it writes the string at. Returns NULL if the
+ * string isn't tracked because the table is over its budget (or the string
+ * is too long).
+ *
+ * Strings that are no longer in the buffer because it was flushed by
+ * encode_to_fh() can't be compared to, their entries are reused. */
+SRL_STATIC_INLINE srl_dedupe_entry_t *
+srl_dedupe_find_or_add(pTHX_ srl_dedupe_t *tbl, const srl_buffer_t *buf,
+                       const char *str, STRLEN len, int is_utf8)
+{
+    srl_dedupe_entry_t *ent;
+    U32 hash;
+    UV i;
+
+    if (expect_false( len > SRL_DEDUPE_MAX_STR_LEN ))
+        return NULL;
+    PERL_HASH(hash, str, len);
+
+  probe:
+    for (i = hash & tbl->tbl_max;; i = (i + 1) & tbl->tbl_max) {
+        ent = &tbl->tbl_ary[i];
+        if (ent->gen != tbl->tbl_gen)
+            break;
+        if (ent->hash == hash && ent->len == (U32)len) {
+            if (expect_false( (ptrdiff_t)ent->ofs < buf->start - buf->body_pos )) {
+                ent->ofs = 0;
+                return ent;
+            }
+            if (srl_dedupe_is_same(buf, ent->ofs, str, len, is_utf8))
+                return ent;
+        }
+    }
+
+    if (expect_false( SRL_DEDUPE_FULL(tbl) )) {
+        if (!srl_dedupe_grow(aTHX_ tbl))
+            return NULL;
+        goto probe;
+    }
+
+    ent->ofs = 0;
+    ent->hash = hash;
+    ent->len = (U32)len;
+    ent->gen = tbl->tbl_gen;
+    tbl->tbl_items++;
+    return ent;
+}
+
+#endif
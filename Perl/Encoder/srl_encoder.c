@@ -46,12 +46,20 @@ extern "C" {
 #define HAS_HV_BACKREFS
 #endif
 
+#include "perliol.h"
+#ifdef I_SYSUIO
+#   include <sys/uio.h>
+#endif
+
 #include "srl_protocol.h"
 #include "srl_encoder.h"
 #include "srl_common.h"
 #include "ptable.h"
+#include "srl_dedupe.h"
+#include "srl_method_cache.h"
 #include "srl_buffer.h"
 #include "srl_compress.h"
+#include "srl_stats.h"
 #include "qsort.h"
 
 /* The ENABLE_DANGEROUS_HACKS (passed through from ENV via Makefile.PL) enables
@@ -78,18 +86,25 @@ extern "C" {
 #endif
 
 #define DEFAULT_MAX_RECUR_DEPTH 10000
+/* Initial size of the stack of arrays and hashes being written, it grows as needed */
+#define SRL_ENC_FRAMES_PREALLOCATE 64
 
 #define DEBUGHACK 0
 
 /* some static function declarations */
 SRL_STATIC_INLINE void srl_clear_seen_hashes(pTHX_ srl_encoder_t *enc);
 static void srl_dump_sv(pTHX_ srl_encoder_t *enc, SV *src);
+static void srl_dump_sv_begin(pTHX_ srl_encoder_t *enc, SV *src);
 SRL_STATIC_INLINE void srl_dump_svpv(pTHX_ srl_encoder_t *enc, SV *src);
 SRL_STATIC_INLINE void srl_dump_pv(pTHX_ srl_encoder_t *enc, const char* src, STRLEN src_len, int is_utf8);
 SRL_STATIC_INLINE void srl_fixup_weakrefs(pTHX_ srl_encoder_t *enc);
-SRL_STATIC_INLINE void srl_dump_av(pTHX_ srl_encoder_t *enc, AV *src, U32 refcnt);
-SRL_STATIC_INLINE void srl_dump_hv(pTHX_ srl_encoder_t *enc, HV *src, U32 refcnt);
+static void srl_stream_checkpoint(pTHX_ srl_encoder_t *enc);
+static void srl_stream_flush_with(pTHX_ srl_encoder_t *enc, const char *str, STRLEN str_len);
+SRL_STATIC_INLINE void srl_stream_reset(pTHX_ srl_encoder_t *enc);
+SRL_STATIC_NOINLINE void srl_dump_av(pTHX_ srl_encoder_t *enc, AV *src, U32 refcnt);
+SRL_STATIC_NOINLINE void srl_dump_hv(pTHX_ srl_encoder_t *enc, HV *src, U32 refcnt);
 SRL_STATIC_INLINE void srl_dump_hk(pTHX_ srl_encoder_t *enc, HE *src, const int share_keys);
+SRL_STATIC_INLINE int srl_dump_records(pTHX_ srl_encoder_t *enc, SV **svp, const UV n);
 SRL_STATIC_INLINE void srl_dump_nv(pTHX_ srl_encoder_t *enc, SV *src);
 SRL_STATIC_INLINE void srl_dump_ivuv(pTHX_ srl_encoder_t *enc, SV *src);
 SRL_STATIC_INLINE int srl_dump_classname(pTHX_ srl_encoder_t *enc, SV *referent, SV *replacement);
@@ -98,7 +113,7 @@ SRL_STATIC_INLINE PTABLE_t *srl_init_string_hash(srl_encoder_t *enc);
 SRL_STATIC_INLINE PTABLE_t *srl_init_ref_hash(srl_encoder_t *enc);
 SRL_STATIC_INLINE PTABLE_t *srl_init_freezeobj_svhash(srl_encoder_t *enc);
 SRL_STATIC_INLINE PTABLE_t *srl_init_weak_hash(srl_encoder_t *enc);
-SRL_STATIC_INLINE HV *srl_init_string_deduper_hv(pTHX_ srl_encoder_t *enc);
+SRL_STATIC_INLINE srl_dedupe_t *srl_init_string_deduper(pTHX_ srl_encoder_t *enc);
 
 /* Note: This returns an encoder struct pointer because it will
  *       clone the current encoder struct if it's dirty. That in
@@ -108,9 +123,9 @@ SRL_STATIC_INLINE HV *srl_init_string_deduper_hv(pTHX_ srl_encoder_t *enc);
  *       freeing it. */
 SRL_STATIC_INLINE srl_encoder_t *srl_dump_data_structure(pTHX_ srl_encoder_t *enc, SV *src, SV *user_header_src);
 
-#define SRL_GET_STR_DEDUPER_HV(enc) ( (enc)->string_deduper_hv == NULL          \
-                                    ? srl_init_string_deduper_hv(aTHX_ enc)     \
-                                   : (enc)->string_deduper_hv )
+#define SRL_GET_STR_DEDUPER(enc) ( (enc)->string_deduper == NULL             \
+                                    ? srl_init_string_deduper(aTHX_ enc)        \
+                                   : (enc)->string_deduper )
 
 #define SRL_GET_STR_PTR_SEENHASH(enc) ( (enc)->str_seenhash == NULL     \
                                     ? srl_init_string_hash(enc)         \
@@ -132,6 +147,26 @@ SRL_STATIC_INLINE srl_encoder_t *srl_dump_data_structure(pTHX_ srl_encoder_t *en
 
 #define SRL_ENC_UPDATE_BODY_POS(enc) SRL_UPDATE_BODY_POS(&(enc)->buf, (enc)->protocol_version)
 
+/* While streaming (see srl_dump_data_structure_to_fh) the start of the body
+ * may already have been written out, in which case body_pos points before
+ * the start of the buffer. Offsets into the written out part of the body are
+ * still fine for COPY/REFP/ALIAS, but the bytes there can't be modified. */
+#define SRL_ENC_BODY_OFS_IN_BUF(enc, ofs) \
+    ((ptrdiff_t)(ofs) >= (enc)->buf.start - (enc)->buf.body_pos)
+
+/* Called between items, where nothing that's already in the buffer is going
+ * to be rewritten, to flush the buffer when streaming. */
+#define SRL_ENC_STREAM_CHECKPOINT(enc) STMT_START {                 \
+    if (expect_false( (enc)->stream_out != NULL ))                  \
+        srl_stream_checkpoint(aTHX_ (enc));                         \
+} STMT_END
+
+/* Bump one of the counters of the stats option */
+#define SRL_ENC_STATS_INC(enc, counter) STMT_START {                \
+    if (expect_false( (enc)->stats != NULL ))                       \
+        (enc)->stats->counter++;                                    \
+} STMT_END
+
 #ifndef MAX_CHARSET_NAME_LENGTH
 #    define MAX_CHARSET_NAME_LENGTH 2
 #endif
@@ -286,7 +321,11 @@ SRL_STATIC_INLINE srl_encoder_t *srl_dump_data_structure(pTHX_ srl_encoder_t *en
         srl_dump_nv(aTHX_ enc, src);                                    \
     }                                                                   \
 
-#define CALL_SRL_DUMP_SV(enc, src) STMT_START {                                  \
+/* Writes src directly if it is a simple scalar, and otherwise hands it to
+ * DUMP_SV(enc, src), which is SRL_DUMP_SV_BEGIN() unless srl_dump_sv() needs
+ * to do more around it. */
+#define CALL_SRL_DUMP_SV_WITH(enc, src, DUMP_SV) STMT_START {                   \
+    SRL_ENC_STREAM_CHECKPOINT(enc);                                                 \
     if (!(src)) {                                                                   \
         srl_buf_cat_char(&(enc)->buf, SRL_HDR_CANONICAL_UNDEF); /* is this right? */\
     }                                                                               \
@@ -301,22 +340,16 @@ SRL_STATIC_INLINE srl_encoder_t *srl_dump_data_structure(pTHX_ srl_encoder_t *en
         ) {                                                                         \
             _SRL_IF_SIMPLE_DIRECT_DUMP_SV(enc, src, svt)                            \
             else {                                                                  \
-                srl_dump_sv(aTHX_ (enc), (src));                                    \
+                DUMP_SV(enc, src);                                                  \
             }                                                                       \
         } else {                                                                    \
-            srl_dump_sv(aTHX_ (enc), (src));                                        \
+            DUMP_SV(enc, src);                                                      \
         }                                                                           \
     }                                                                               \
 } STMT_END
 
-#define CALL_SRL_DUMP_SVP(enc, srcp) STMT_START {                                   \
-    if (!(srcp)) {                                                                  \
-        srl_buf_cat_char(&(enc)->buf, SRL_HDR_CANONICAL_UNDEF); /* is this right? */\
-    } else {                                                                        \
-        SV *src= *srcp;                                                             \
-        CALL_SRL_DUMP_SV(enc,src);                                                  \
-    }                                                                               \
-} STMT_END
+#define SRL_DUMP_SV_BEGIN(enc, src) srl_dump_sv_begin(aTHX_ (enc), (src))
+#define CALL_SRL_DUMP_SV(enc, src) CALL_SRL_DUMP_SV_WITH(enc, src, SRL_DUMP_SV_BEGIN)
 
 /* This is fired when we exit the Perl pseudo-block.
  * It frees our encoder and all. Put encoder-level cleanup
@@ -349,8 +382,8 @@ srl_clear_seen_hashes(pTHX_ srl_encoder_t *enc)
         PTABLE_clear(enc->str_seenhash);
     if (enc->weak_seenhash != NULL)
         PTABLE_clear(enc->weak_seenhash);
-    if (enc->string_deduper_hv != NULL)
-        hv_clear(enc->string_deduper_hv);
+    if (enc->string_deduper != NULL)
+        srl_dedupe_clear(aTHX_ enc->string_deduper);
 }
 
 void
@@ -362,7 +395,9 @@ srl_clear_encoder(pTHX_ srl_encoder_t *enc)
     }
 
     enc->recursion_depth = 0;
+    srl_stack_clear(&enc->frames); /* not empty if we croaked */
     srl_clear_seen_hashes(aTHX_ enc);
+    srl_stream_reset(aTHX_ enc);
 
     enc->buf.pos = enc->buf.start;
     /* tmp_buf.start may be NULL for an unused tmp_buf, but so what? */
@@ -376,13 +411,17 @@ srl_clear_encoder(pTHX_ srl_encoder_t *enc)
 void
 srl_destroy_encoder(pTHX_ srl_encoder_t *enc)
 {
+    srl_stream_reset(aTHX_ enc);
     srl_buf_free_buffer(aTHX_ &enc->buf);
+    srl_stack_deinit(aTHX_ &enc->frames);
 
     /* Free tmp buffer only if it was allocated at all. */
     if (enc->tmp_buf.start != NULL)
         srl_buf_free_buffer(aTHX_ &enc->tmp_buf);
 
     srl_destroy_snappy_workmem(aTHX_ enc->snappy_workmem);
+    srl_destroy_zstd_cctx(aTHX_ enc->zstd_cctx);
+    srl_destroy_zstd_cdict(aTHX_ enc->zstd_cdict);
 
     if (enc->ref_seenhash != NULL)
         PTABLE_free(enc->ref_seenhash);
@@ -392,15 +431,73 @@ srl_destroy_encoder(pTHX_ srl_encoder_t *enc)
         PTABLE_free(enc->str_seenhash);
     if (enc->weak_seenhash != NULL)
         PTABLE_free(enc->weak_seenhash);
-    if (enc->string_deduper_hv != NULL)
-        SvREFCNT_dec(enc->string_deduper_hv);
+    if (enc->string_deduper != NULL)
+        srl_dedupe_free(aTHX_ enc->string_deduper);
+    if (enc->freeze_cv_cache != NULL)
+        srl_method_cache_free(aTHX_ enc->freeze_cv_cache);
+    Safefree(enc->stats);
 
     SvREFCNT_dec(enc->sereal_string_sv);
     SvREFCNT_dec(enc->scratch_sv);
+    SvREFCNT_dec(enc->zstd_dictionary);
 
     Safefree(enc);
 }
 
+/* lookups => ..., hits => ..., ratio => hits / lookups */
+static SV *
+srl_stats_hits(pTHX_ UV lookups, UV hits)
+{
+    HV *hv = newHV();
+    hv_stores(hv, "lookups", newSVuv(lookups));
+    hv_stores(hv, "hits", newSVuv(hits));
+    hv_stores(hv, "ratio", newSVnv(srl_stats_ratio(hits, lookups)));
+    return newRV_noinc((SV *)hv);
+}
+
+void
+srl_encoder_stats(pTHX_ srl_encoder_t *enc, HV *hv)
+{
+    const srl_stats_t *stats = enc->stats;
+    HV *tables = newHV();
+
+    srl_stats_fill_hv(aTHX_ stats, hv, "compress_time");
+    hv_stores(hv, "shared_hashkeys",
+              srl_stats_hits(aTHX_ stats->shared_hashkey_lookups, stats->shared_hashkey_hits));
+    hv_stores(hv, "dedupe_strings",
+              srl_stats_hits(aTHX_ stats->dedupe_lookups, stats->dedupe_hits));
+    hv_stores(hv, "buffer_grows", newSVuv(stats->buffer_grows));
+
+    /* the tables are created when first needed and kept from then on */
+    if (enc->ref_seenhash != NULL)
+        srl_stats_table(aTHX_ tables, "seen_refs", enc->ref_seenhash->tbl_max + 1, enc->ref_seenhash->tbl_grows);
+    if (enc->str_seenhash != NULL)
+        srl_stats_table(aTHX_ tables, "shared_hashkeys", enc->str_seenhash->tbl_max + 1, enc->str_seenhash->tbl_grows);
+    if (enc->weak_seenhash != NULL)
+        srl_stats_table(aTHX_ tables, "weak_refs", enc->weak_seenhash->tbl_max + 1, enc->weak_seenhash->tbl_grows);
+    if (enc->freezeobj_svhash != NULL)
+        srl_stats_table(aTHX_ tables, "frozen_objects", enc->freezeobj_svhash->tbl_max + 1, enc->freezeobj_svhash->tbl_grows);
+    if (enc->string_deduper != NULL)
+        srl_stats_table(aTHX_ tables, "dedupe_strings", enc->string_deduper->tbl_max + 1, enc->string_deduper->grows);
+    hv_stores(hv, "tables", newRV_noinc((SV *)tables));
+}
+
+void
+srl_encoder_reset_stats(pTHX_ srl_encoder_t *enc)
+{
+    Zero(enc->stats, 1, srl_stats_t);
+    if (enc->ref_seenhash != NULL)
+        enc->ref_seenhash->tbl_grows = 0;
+    if (enc->str_seenhash != NULL)
+        enc->str_seenhash->tbl_grows = 0;
+    if (enc->weak_seenhash != NULL)
+        enc->weak_seenhash->tbl_grows = 0;
+    if (enc->freezeobj_svhash != NULL)
+        enc->freezeobj_svhash->tbl_grows = 0;
+    if (enc->string_deduper != NULL)
+        enc->string_deduper->grows = 0;
+}
+
 /* allocate an empty encoder struct - flags still to be set up */
 SRL_STATIC_INLINE srl_encoder_t *
 srl_empty_encoder_struct(pTHX)
@@ -415,9 +512,15 @@ srl_empty_encoder_struct(pTHX)
         Safefree(enc);
         croak("Out of memory");
     }
+    if (expect_false( srl_stack_init(aTHX_ &enc->frames, SRL_ENC_FRAMES_PREALLOCATE) != 0 )) {
+        srl_buf_free_buffer(aTHX_ &enc->buf);
+        Safefree(enc);
+        croak("Out of memory");
+    }
 
     enc->protocol_version = SRL_PROTOCOL_VERSION;
     enc->max_recursion_depth = DEFAULT_MAX_RECUR_DEPTH;
+    enc->flush_threshold = SRL_DEFAULT_FLUSH_THRESHOLD;
 
     return enc;
 }
@@ -525,6 +628,21 @@ srl_build_encoder_struct(pTHX_ HV *opt, sv_with_hash *options)
                         croak("'compress_level' needs to be between 1 and 22");
                     enc->compress_level = lvl;
                 }
+
+                my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_ZSTD_DICTIONARY);
+                if ( val && SvOK(val) ) {
+                    enc->zstd_dictionary = newSVsv(val);
+                    /* digest it right away to catch bad dictionaries early */
+                    srl_init_zstd_cdict(aTHX_ &enc->zstd_cdict, enc->zstd_dictionary, enc->compress_level);
+                }
+
+                my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_COMPRESS_THREADS);
+                if ( val && SvOK(val) ) {
+                    IV threads = SvIV(val);
+                    if (expect_false( threads < 0 ))
+                        croak("'compress_threads' needs to be a non-negative number");
+                    enc->compress_threads = threads;
+                }
                 break;
             default:
                 croak("Invalid Sereal compression format");
@@ -586,6 +704,18 @@ srl_build_encoder_struct(pTHX_ HV *opt, sv_with_hash *options)
                 SRL_ENC_SET_OPTION(enc, SRL_F_DEDUPE_STRINGS);
         }
 
+        my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_DEDUPE_STRINGS_BUDGET);
+        if ( val && SvTRUE(val) )
+            enc->dedupe_strings_budget = (STRLEN) SvUV(val);
+
+        my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_PACK_NUMERIC_ARRAYS);
+        if ( val && SvTRUE(val) )
+            SRL_ENC_SET_OPTION(enc, SRL_F_PACK_NUMERIC_ARRAYS);
+
+        my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_RECORD_BATCHES);
+        if ( val && SvTRUE(val) )
+            SRL_ENC_SET_OPTION(enc, SRL_F_RECORD_BATCHES);
+
         my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_STRINGIFY_UNKNOWN);
         if ( val && SvTRUE(val) ) {
             if (expect_false( undef_unknown ))
@@ -601,6 +731,15 @@ srl_build_encoder_struct(pTHX_ HV *opt, sv_with_hash *options)
                 SRL_ENC_SET_OPTION(enc, SRL_F_NOWARN_UNKNOWN_OVERLOAD);
         }
 
+        if (compression_format != 3) {
+            my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_ZSTD_DICTIONARY);
+            if ( val && SvOK(val) )
+                croak("The 'zstd_dictionary' option requires zstd compression");
+            my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_COMPRESS_THREADS);
+            if ( val && SvTRUE(val) )
+                croak("The 'compress_threads' option requires zstd compression");
+        }
+
         if (compression_format) {
             enc->compress_threshold = 1024;
             my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_COMPRESS_THRESHOLD);
@@ -617,6 +756,18 @@ srl_build_encoder_struct(pTHX_ HV *opt, sv_with_hash *options)
         my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_MAX_RECURSION_DEPTH);
         if ( val && SvTRUE(val) )
             enc->max_recursion_depth = SvUV(val);
+
+        my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_FLUSH_THRESHOLD);
+        if ( val && SvTRUE(val) )
+            enc->flush_threshold = (STRLEN) SvUV(val);
+
+        my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_ZERO_COPY_STRINGS_OVER);
+        if ( val && SvTRUE(val) )
+            enc->zero_copy_strings_over = (STRLEN) SvUV(val);
+
+        my_hv_fetchs(he, val, opt, SRL_ENC_OPT_IDX_STATS);
+        if ( val && SvTRUE(val) )
+            Newxz(enc->stats, 1, srl_stats_t);
     }
     else {
         /* SRL_F_SHARED_HASHKEYS on by default */
@@ -638,6 +789,13 @@ srl_build_encoder_struct_alike(pTHX_ srl_encoder_t *proto)
     enc->flags = proto->flags;
     enc->max_recursion_depth = proto->max_recursion_depth;
     enc->compress_threshold = proto->compress_threshold;
+    enc->compress_level = proto->compress_level;
+    enc->compress_threads = proto->compress_threads;
+    enc->flush_threshold = proto->flush_threshold;
+    enc->zero_copy_strings_over = proto->zero_copy_strings_over;
+    enc->dedupe_strings_budget = proto->dedupe_strings_budget;
+    if (proto->zstd_dictionary != NULL) /* the clone digests it on its own */
+        enc->zstd_dictionary = SvREFCNT_inc(proto->zstd_dictionary);
     if (expect_false(SRL_ENC_HAVE_OPTION(enc, SRL_F_ENABLE_FREEZE_SUPPORT))) {
         enc->sereal_string_sv = newSVpvs("Sereal");
     }
@@ -675,11 +833,11 @@ srl_init_freezeobj_svhash(srl_encoder_t *enc)
     return enc->freezeobj_svhash;
 }
 
-SRL_STATIC_INLINE HV *
-srl_init_string_deduper_hv(pTHX_ srl_encoder_t *enc)
+SRL_STATIC_INLINE srl_dedupe_t *
+srl_init_string_deduper(pTHX_ srl_encoder_t *enc)
 {
-    enc->string_deduper_hv = newHV();
-    return enc->string_deduper_hv;
+    enc->string_deduper = srl_dedupe_new(aTHX_ 6, enc->dedupe_strings_budget);
+    return enc->string_deduper;
 }
 
 
@@ -806,9 +964,6 @@ SRL_STATIC_INLINE void
 srl_dump_ivuv(pTHX_ srl_encoder_t *enc, SV *src)
 {
     char hdr;
-    /* TODO for the time being, we just won't ever use NUMLIST types because that's
-     *      a fair amount of extra implementation work. The decoders won't care and
-     *      we're just wasting some space. */
     /* TODO optimize! */
 
     /* FIXME find a way to express the condition without repeated SvIV/SvUV */
@@ -851,9 +1006,11 @@ srl_get_frozen_object(pTHX_ srl_encoder_t *enc, SV *src, SV *referent)
     /* Check for FREEZE support */
     if (expect_false( SRL_ENC_HAVE_OPTION(enc, SRL_F_ENABLE_FREEZE_SUPPORT) )) {
         HV *stash = SvSTASH(referent);
-        GV *method = NULL;
+        CV *method = NULL;
         assert(stash != NULL);
-        method = gv_fetchmethod_autoload(stash, "FREEZE", 0);
+        if (expect_false( enc->freeze_cv_cache == NULL ))
+            enc->freeze_cv_cache = PTABLE_new_size(3);
+        method = srl_method_cache_fetch(aTHX_ enc->freeze_cv_cache, stash, "FREEZE");
 
         if (expect_false( method != NULL )) {
             SV *replacement= NULL;
@@ -875,8 +1032,7 @@ srl_get_frozen_object(pTHX_ srl_encoder_t *enc, SV *src, SV *referent)
                 PTABLE_store(freezeobj_svhash, referent, replacement);
 
                 PUTBACK;
-                count = call_sv((SV *)GvCV(method), G_ARRAY);
-                /* TODO explore method lookup caching */
+                count = call_sv((SV *)method, G_ARRAY);
                 SPAGAIN;
 
                 while ( count-- > 0) {
@@ -996,6 +1152,43 @@ srl_prepare_encoder(pTHX_ srl_encoder_t *enc)
     return enc;
 }
 
+/* For the stats option: the tags of a body are counted from where the
+ * scan stopped (an offset from body_pos, which stays valid when streaming)
+ * up to the end of the buffer, see srl_stats_scan() */
+SRL_STATIC_INLINE void
+srl_stats_begin_body(srl_encoder_t *enc)
+{
+    enc->stats_scan_ofs = BODY_POS_OFS(&enc->buf);
+    enc->stats_scan_packed = 0;
+}
+
+SRL_STATIC_INLINE void
+srl_stats_scan_buf(srl_encoder_t *enc)
+{
+    const U8 *p = srl_stats_scan(enc->stats, enc->buf.body_pos + enc->stats_scan_ofs,
+                                 enc->buf.pos, &enc->stats_scan_packed);
+    enc->stats_scan_ofs = p - enc->buf.body_pos;
+}
+
+SRL_STATIC_INLINE void
+srl_stats_end_body(srl_encoder_t *enc)
+{
+    srl_stats_scan_buf(enc);
+    enc->stats->documents++;
+    enc->stats->buffer_grows += enc->buf.grows;
+    enc->buf.grows = 0;
+}
+
+#define SRL_ENC_STATS_BEGIN_BODY(enc) STMT_START {                  \
+    if (expect_false( (enc)->stats != NULL ))                       \
+        srl_stats_begin_body(enc);                                  \
+} STMT_END
+
+#define SRL_ENC_STATS_END_BODY(enc) STMT_START {                    \
+    if (expect_false( (enc)->stats != NULL ))                       \
+        srl_stats_end_body(enc);                                    \
+} STMT_END
+
 SRL_STATIC_INLINE srl_encoder_t *
 srl_dump_data_structure(pTHX_ srl_encoder_t *enc, SV *src, SV *user_header_src)
 {
@@ -1015,8 +1208,10 @@ srl_dump_data_structure(pTHX_ srl_encoder_t *enc, SV *src, SV *user_header_src)
         srl_write_header(aTHX_ enc, user_header_src, compress_flags);
         sereal_header_len = BUF_POS_OFS(&enc->buf);
         SRL_ENC_UPDATE_BODY_POS(enc);
+        SRL_ENC_STATS_BEGIN_BODY(enc);
         srl_dump_sv(aTHX_ enc, src);
         srl_fixup_weakrefs(aTHX_ enc);
+        SRL_ENC_STATS_END_BODY(enc);
         assert(BUF_POS_OFS(&enc->buf) > sereal_header_len);
         uncompressed_body_length = BUF_POS_OFS(&enc->buf) - sereal_header_len;
 
@@ -1029,10 +1224,26 @@ srl_dump_data_structure(pTHX_ srl_encoder_t *enc, SV *src, SV *user_header_src)
             /* Don't bother with compression at all if we have less than $threshold bytes of payload */
             srl_reset_compression_header_flag(&enc->buf);
         }
-        else { /* Do Snappy or zlib compression of body */
+        else { /* Do Snappy, zlib or zstd compression of body */
+            NV start_time = 0;
+
+            if (expect_false(enc->zstd_dictionary != NULL))
+                srl_init_zstd_cdict(aTHX_ &enc->zstd_cdict, enc->zstd_dictionary, enc->compress_level);
+
+            if (expect_false( enc->stats != NULL ))
+                start_time = srl_stats_now();
             srl_compress_body(aTHX_ &enc->buf, sereal_header_len,
                               compress_flags, enc->compress_level,
-                              &enc->snappy_workmem);
+                              &enc->snappy_workmem, &enc->zstd_cctx, enc->zstd_cdict,
+                              (int) enc->compress_threads);
+            if (expect_false( enc->stats != NULL )) {
+                enc->stats->compress_time += srl_stats_now() - start_time;
+                /* unless it was left uncompressed, see srl_compress_body() */
+                if (enc->buf.start[sizeof(SRL_MAGIC_STRING) - 1] & SRL_PROTOCOL_ENCODING_MASK) {
+                    enc->stats->compressed_documents++;
+                    enc->stats->compressed_bytes += BUF_POS_OFS(&enc->buf) - sereal_header_len;
+                }
+            }
 
             SRL_ENC_UPDATE_BODY_POS(enc);
             DEBUG_ASSERT_BUF_SANE(&enc->buf);
@@ -1042,8 +1253,10 @@ srl_dump_data_structure(pTHX_ srl_encoder_t *enc, SV *src, SV *user_header_src)
     {
         srl_write_header(aTHX_ enc, user_header_src, compress_flags);
         SRL_ENC_UPDATE_BODY_POS(enc);
+        SRL_ENC_STATS_BEGIN_BODY(enc);
         srl_dump_sv(aTHX_ enc, src);
         srl_fixup_weakrefs(aTHX_ enc);
+        SRL_ENC_STATS_END_BODY(enc);
     }
 
     /* NOT doing a
@@ -1104,6 +1317,452 @@ srl_fixup_weakrefs(pTHX_ srl_encoder_t *enc)
     }
 }
 
+#ifdef HAS_WRITEV
+/* The file descriptor under out if writing to it directly is the same as
+ * writing through out, -1 otherwise. That is if there is only a buffer
+ * between them, but not layers like :crlf or :encoding that would have to
+ * see the data. */
+static int
+srl_stream_writev_fd(pTHX_ PerlIO *out)
+{
+    PerlIO *f = out;
+
+    if (PerlIOValid(f) && strEQ(PerlIOBase(f)->tab->name, "perlio"))
+        f = PerlIONext(f);
+    if (!PerlIOValid(f) || !strEQ(PerlIOBase(f)->tab->name, "unix"))
+        return -1;
+    return PerlIO_fileno(out);
+}
+
+/* Write len bytes at buf and str_len bytes at str to the file descriptor
+ * with as few writev() calls as it takes. Whatever PerlIO has buffered for
+ * it is written first. */
+static void
+srl_stream_writev(pTHX_ srl_encoder_t *enc, const char *buf, STRLEN len, const char *str, STRLEN str_len)
+{
+    struct iovec iov[2];
+    int iovcnt = 0;
+    int i = 0;
+
+    if (len) {
+        iov[iovcnt].iov_base = (char *)buf;
+        iov[iovcnt++].iov_len = len;
+    }
+    iov[iovcnt].iov_base = (char *)str;
+    iov[iovcnt++].iov_len = str_len;
+
+    if (PerlIO_flush(enc->stream_out) != 0)
+        croak("Failed to write Sereal document: %s", Strerror(errno));
+    while (i < iovcnt) {
+        ssize_t written = writev(enc->stream_fd, iov + i, iovcnt - i);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            croak("Failed to write Sereal document: %s", Strerror(errno));
+        }
+        for ( ; i < iovcnt && (size_t)written >= iov[i].iov_len; i++)
+            written -= iov[i].iov_len;
+        if (i < iovcnt) {
+            iov[i].iov_base = (char *)iov[i].iov_base + written;
+            iov[i].iov_len -= written;
+        }
+    }
+}
+#endif
+
+/* Write the buffer out while streaming a document (see
+ * srl_dump_data_structure_to_fh), followed by the str_len bytes at str.
+ * These are the contents of a string whose tag is the last thing in the
+ * buffer, which is written straight from the SV, see zero_copy_strings_over.
+ * Afterwards body_pos points before the start of the buffer so that the
+ * offsets of items that were written out stay valid for COPY/REFP/ALIAS. */
+static void
+srl_stream_flush_with(pTHX_ srl_encoder_t *enc, const char *str, STRLEN str_len)
+{
+    const STRLEN len = BUF_POS_OFS(&enc->buf);
+    PTABLE_t *weak_seenhash = SRL_GET_WEAK_SEENHASH_OR_NULL(enc);
+
+    if (len == 0 && str_len == 0)
+        return;
+
+    /* srl_fixup_weakrefs() can't turn the WEAKEN tags of weakrefs whose
+     * referent we haven't seen a strong reference to into PADs once they
+     * are written out, so do it now. Such references will be strong on
+     * the decoder side, which keeps the referent alive. */
+    if (weak_seenhash) {
+        PTABLE_ITER_t *it = PTABLE_iter_new(weak_seenhash);
+        PTABLE_ENTRY_t *ent;
+
+        while ( NULL != (ent = PTABLE_iter_next(it)) ) {
+            const ptrdiff_t offset = (ptrdiff_t)ent->value;
+            if ( offset ) {
+                assert(SRL_ENC_BODY_OFS_IN_BUF(enc, offset));
+                assert(*(enc->buf.body_pos + offset) == SRL_HDR_WEAKEN);
+                *(enc->buf.body_pos + offset) = SRL_HDR_PAD;
+                ent->value = NULL;
+            }
+        }
+
+        PTABLE_iter_free(it);
+    }
+
+    if (expect_false( enc->stats != NULL ))
+        srl_stats_scan_buf(enc);
+
+#ifdef HAS_WRITEV
+    if (str_len && enc->stream_fd >= 0) {
+        srl_stream_writev(aTHX_ enc, (const char *)enc->buf.start, len, str, str_len);
+    }
+    else
+#endif
+    {
+        if (PerlIO_write(enc->stream_out, enc->buf.start, len) != (SSize_t)len)
+            croak("Failed to write Sereal document: %s", Strerror(errno));
+        if (str_len && PerlIO_write(enc->stream_out, str, str_len) != (SSize_t)str_len)
+            croak("Failed to write Sereal document: %s", Strerror(errno));
+    }
+
+    enc->buf.body_pos -= len + str_len;
+    enc->buf.pos = enc->buf.start;
+}
+
+SRL_STATIC_INLINE void
+srl_stream_flush(pTHX_ srl_encoder_t *enc)
+{
+    srl_stream_flush_with(aTHX_ enc, NULL, 0);
+}
+
+/* Write out the contents of a string whose tag was just written, see
+ * srl_dump_pv(). The tag may be that of the item waiting to be tracked. */
+static void
+srl_stream_write_string(pTHX_ srl_encoder_t *enc, const char *str, STRLEN str_len)
+{
+    if (enc->stream_track_pending) {
+        SRL_SET_TRACK_FLAG(*(enc->buf.body_pos + enc->stream_track_pending));
+        enc->stream_track_pending = 0;
+    }
+    srl_stream_flush_with(aTHX_ enc, str, str_len);
+}
+
+/* Called before an item is dumped while streaming. At this point the tag of
+ * the last item that was recorded for tracking has been written, so its
+ * track flag can be set, and nothing in the buffer will be rewritten. */
+static void
+srl_stream_checkpoint(pTHX_ srl_encoder_t *enc)
+{
+    if (enc->stream_track_pending) {
+        SRL_SET_TRACK_FLAG(*(enc->buf.body_pos + enc->stream_track_pending));
+        enc->stream_track_pending = 0;
+    }
+    if ((STRLEN)BUF_POS_OFS(&enc->buf) >= enc->flush_threshold)
+        srl_stream_flush(aTHX_ enc);
+}
+
+SRL_STATIC_INLINE void
+srl_stream_reset(pTHX_ srl_encoder_t *enc)
+{
+    if (enc->stream_tmp != NULL)
+        PerlIO_close(enc->stream_tmp);
+    enc->stream_tmp = NULL;
+    enc->stream_out = NULL;
+    enc->stream_track_pending = 0;
+    enc->stream_zero_copy_min = 0;
+    enc->stream_fd = -1;
+}
+
+/* Copy len bytes at offset ofs of a (temporary) file to out */
+static void
+srl_stream_copy(pTHX_ PerlIO *in, Off_t ofs, Off_t len, PerlIO *out, SV *chunk_sv)
+{
+    char *chunk = SvPVX(chunk_sv);
+    const STRLEN chunk_size = SvLEN(chunk_sv);
+
+    if (PerlIO_seek(in, ofs, SEEK_SET) < 0)
+        croak("Failed to seek in temporary file: %s", Strerror(errno));
+    while (len > 0) {
+        const SSize_t want = len < (Off_t)chunk_size ? (SSize_t)len : (SSize_t)chunk_size;
+        if (PerlIO_read(in, chunk, want) != want)
+            croak("Failed to read from temporary file: %s", Strerror(errno));
+        if (PerlIO_write(out, chunk, want) != want)
+            croak("Failed to write Sereal document: %s", Strerror(errno));
+        len -= want;
+    }
+}
+
+/* Compress the body_len bytes at the start of the temporary file with zstd
+ * and append the compressed frame to the same file. Returns the length of
+ * the frame. zstd writes the content size into the frame header, which is
+ * why the body has to be complete before compression starts. */
+static Off_t
+srl_stream_compress_zstd(pTHX_ srl_encoder_t *enc, PerlIO *tmp, Off_t body_len)
+{
+    SV *in_sv = sv_2mortal(newSV(ZSTD_CStreamInSize()));
+    SV *out_sv = sv_2mortal(newSV(ZSTD_CStreamOutSize()));
+    ZSTD_CCtx *cctx;
+    ZSTD_inBuffer input;
+    ZSTD_outBuffer output;
+    Off_t read_ofs = 0;
+    Off_t write_ofs = body_len;
+    size_t remaining;
+
+    srl_init_zstd_cctx(aTHX_ &enc->zstd_cctx);
+    if (expect_false(enc->zstd_dictionary != NULL))
+        srl_init_zstd_cdict(aTHX_ &enc->zstd_cdict, enc->zstd_dictionary, enc->compress_level);
+
+    cctx = (ZSTD_CCtx *) enc->zstd_cctx;
+    if (enc->compress_threads <= 0
+        || !srl_setup_zstd_cctx_threads(cctx, (int) enc->compress_level,
+                                        (int) enc->compress_threads, (ZSTD_CDict *) enc->zstd_cdict))
+    {
+        (void)srl_setup_zstd_cctx_threads(cctx, (int) enc->compress_level,
+                                          0, (ZSTD_CDict *) enc->zstd_cdict);
+    }
+    ZSTD_CCtx_setPledgedSrcSize(cctx, (unsigned long long) body_len);
+
+    do {
+        const size_t want = body_len - read_ofs < (Off_t)SvLEN(in_sv)
+                          ? (size_t)(body_len - read_ofs)
+                          : SvLEN(in_sv);
+        const ZSTD_EndDirective mode = read_ofs + (Off_t)want == body_len ? ZSTD_e_end : ZSTD_e_continue;
+
+        if (PerlIO_seek(tmp, read_ofs, SEEK_SET) < 0
+            || PerlIO_read(tmp, SvPVX(in_sv), want) != (SSize_t)want)
+        {
+            croak("Failed to read from temporary file: %s", Strerror(errno));
+        }
+        read_ofs += want;
+
+        input.src = SvPVX(in_sv);
+        input.size = want;
+        input.pos = 0;
+        do {
+            output.dst = SvPVX(out_sv);
+            output.size = SvLEN(out_sv);
+            output.pos = 0;
+            remaining = ZSTD_compressStream2(cctx, &output, &input, mode);
+            if (ZSTD_isError(remaining))
+                croak("Zstd compression failed: %s", ZSTD_getErrorName(remaining));
+            if (output.pos) {
+                if (PerlIO_seek(tmp, write_ofs, SEEK_SET) < 0
+                    || PerlIO_write(tmp, output.dst, output.pos) != (SSize_t)output.pos)
+                {
+                    croak("Failed to write to temporary file: %s", Strerror(errno));
+                }
+                write_ofs += output.pos;
+            }
+        } while (mode == ZSTD_e_end ? remaining != 0 : input.pos < input.size);
+    } while (read_ofs < body_len);
+
+    return write_ofs - body_len;
+}
+
+/* Like srl_dump_data_structure(), but writes the document to a file handle
+ * as it goes, flushing the buffer every time it grows beyond
+ * flush_threshold bytes. A zstd compressed body is written to a temporary
+ * file first since its compressed length has to be written before it. */
+void
+srl_dump_data_structure_to_fh(pTHX_ srl_encoder_t *enc, SV *src, SV *user_header_src, PerlIO *out)
+{
+    const U32 compress_flags= SRL_ENC_HAVE_OPTION(enc, SRL_F_COMPRESS_FLAGS_MASK);
+    SV *header_sv = NULL;
+
+    if (expect_false( compress_flags & ~SRL_F_COMPRESS_ZSTD )) {
+        /* Snappy and zlib can't compress incrementally, so there is no
+         * point in streaming. */
+        enc = srl_dump_data_structure(aTHX_ enc, src, user_header_src);
+        if (PerlIO_write(out, enc->buf.start, BUF_POS_OFS(&enc->buf)) != (SSize_t)BUF_POS_OFS(&enc->buf))
+            croak("Failed to write Sereal document: %s", Strerror(errno));
+        return;
+    }
+
+    enc = srl_prepare_encoder(aTHX_ enc);
+    srl_write_header(aTHX_ enc, user_header_src, compress_flags);
+    SRL_ENC_UPDATE_BODY_POS(enc);
+    if (compress_flags) {
+        /* Keep the header until we know whether the body is compressed */
+        const STRLEN header_len = BUF_POS_OFS(&enc->buf);
+        header_sv = sv_2mortal(newSVpvn((char *)enc->buf.start, header_len));
+        enc->buf.pos -= header_len;
+        enc->buf.body_pos -= header_len;
+        enc->stream_tmp = PerlIO_tmpfile();
+        if (enc->stream_tmp == NULL)
+            croak("Failed to create temporary file: %s", Strerror(errno));
+        enc->stream_out = enc->stream_tmp;
+    }
+    else {
+        enc->stream_out = out;
+        enc->stream_zero_copy_min = enc->zero_copy_strings_over;
+#ifdef HAS_WRITEV
+        enc->stream_fd = enc->stream_zero_copy_min ? srl_stream_writev_fd(aTHX_ out) : -1;
+#endif
+    }
+    SRL_ENC_STATS_BEGIN_BODY(enc);
+
+    srl_dump_sv(aTHX_ enc, src);
+    srl_fixup_weakrefs(aTHX_ enc);
+    SRL_ENC_STREAM_CHECKPOINT(enc); /* set the last pending track flag */
+    srl_stream_flush(aTHX_ enc);
+    SRL_ENC_STATS_END_BODY(enc);
+    enc->stream_out = NULL;
+#ifdef HAS_WRITEV
+    if (enc->stream_fd >= 0) {
+        /* The buffer layer doesn't know how much we wrote around it, so
+         * tell() would be off. Seeking makes it ask the file. */
+        const int saved_errno = errno;
+        (void)PerlIO_seek(out, 0, SEEK_CUR);
+        errno = saved_errno;
+    }
+#endif
+
+    if (compress_flags) {
+        PerlIO *tmp = enc->stream_tmp;
+        SV *chunk_sv = sv_2mortal(newSV(ZSTD_CStreamOutSize()));
+        const Off_t body_len = PerlIO_tell(tmp);
+        Off_t compressed_len = 0;
+
+        if (body_len < 0)
+            croak("Failed to read from temporary file: %s", Strerror(errno));
+        if (body_len >= (Off_t)enc->compress_threshold) {
+            NV start_time = 0;
+
+            if (expect_false( enc->stats != NULL ))
+                start_time = srl_stats_now();
+            compressed_len = srl_stream_compress_zstd(aTHX_ enc, tmp, body_len);
+            if (compressed_len >= body_len)
+                compressed_len = 0; /* didn't help, store it uncompressed */
+            if (expect_false( enc->stats != NULL ))
+                enc->stats->compress_time += srl_stats_now() - start_time;
+        }
+
+        if (compressed_len == 0) {
+            /* disable zstd flag in header, see srl_reset_compression_header_flag() */
+            char *flags_and_version_byte = SvPVX(header_sv) + sizeof(SRL_MAGIC_STRING) - 1;
+            *flags_and_version_byte = SRL_PROTOCOL_ENCODING_RAW |
+                                      (*flags_and_version_byte & SRL_PROTOCOL_VERSION_MASK);
+        }
+        if (PerlIO_write(out, SvPVX(header_sv), SvCUR(header_sv)) != (SSize_t)SvCUR(header_sv))
+            croak("Failed to write Sereal document: %s", Strerror(errno));
+
+        if (compressed_len) {
+            enc->buf.pos = enc->buf.start;
+            srl_buf_cat_varint_nocheck(aTHX_ &enc->buf, 0, (UV)compressed_len);
+            if (PerlIO_write(out, enc->buf.start, BUF_POS_OFS(&enc->buf)) != (SSize_t)BUF_POS_OFS(&enc->buf))
+                croak("Failed to write Sereal document: %s", Strerror(errno));
+            if (expect_false( enc->stats != NULL )) {
+                enc->stats->compressed_documents++;
+                enc->stats->compressed_bytes += BUF_POS_OFS(&enc->buf) + compressed_len;
+            }
+            enc->buf.pos = enc->buf.start;
+            srl_stream_copy(aTHX_ tmp, body_len, compressed_len, out, chunk_sv);
+        }
+        else {
+            srl_stream_copy(aTHX_ tmp, 0, body_len, out, chunk_sv);
+        }
+    }
+    srl_stream_reset(aTHX_ enc);
+}
+
+/* Hands the buffer of the encode_into() target string back to it, with
+ * len bytes in it, and puts the encoder's own buffer back. */
+static void
+srl_into_sv_release(pTHX_ srl_encoder_t *enc, const STRLEN len)
+{
+    SV *dst = enc->into_sv;
+
+    /* in case a FREEZE hook assigned something to it in the meantime */
+    SV_CHECK_THINKFIRST_COW_DROP(dst);
+    SvPV_free(dst);
+
+    SvPV_set(dst, (char *)enc->buf.start);
+    SvLEN_set(dst, BUF_SIZE(&enc->buf));
+    SvCUR_set(dst, len);
+    *SvEND(dst) = '\0';
+    SvPOK_only(dst);
+
+    srl_buf_copy_buffer(aTHX_ &enc->into_own_buf, &enc->buf);
+    enc->into_sv = NULL;
+}
+
+/* Exception cleanup for srl_dump_data_structure_into_sv(): the target
+ * string gets its buffer back with only what it held before. */
+static void
+srl_into_sv_destructor_hook(pTHX_ void *p)
+{
+    srl_encoder_t *enc = (srl_encoder_t *)p;
+    if (enc->into_sv != NULL)
+        srl_into_sv_release(aTHX_ enc, enc->into_prefix_len);
+}
+
+/* Like srl_dump_data_structure(), but writes the document into the string
+ * dst, or to the end of it if append is true. The string's own buffer is
+ * used as the output buffer meanwhile, so that it grows in place and its
+ * allocation is reused from one call to the next. Compressed and protocol
+ * V1 documents need to start at the start of the buffer, so these are
+ * written to the encoder's buffer as usual and then copied. Returns the
+ * length of the document. */
+STRLEN
+srl_dump_data_structure_into_sv(pTHX_ srl_encoder_t *enc, SV *src, SV *dst, const int append)
+{
+    STRLEN prefix_len = 0;
+    STRLEN len;
+
+    if (SvTYPE(dst) > SVt_PVMG)
+        croak("Can only encode into a plain scalar");
+    if (append && SvOK(dst)) {
+        (void)SvPV_force_nomg(dst, prefix_len);
+        if (SvUTF8(dst) && !sv_utf8_downgrade(dst, TRUE))
+            croak("Cannot append a Sereal document to a string with wide characters");
+        prefix_len = SvCUR(dst);
+    }
+    else {
+        SV_CHECK_THINKFIRST_COW_DROP(dst);
+        SvUPGRADE(dst, SVt_PV);
+    }
+    SvOOK_off(dst);
+
+    if (expect_false( SRL_ENC_HAVE_OPTION(enc, SRL_F_COMPRESS_FLAGS_MASK) || enc->protocol_version < 2 )) {
+        enc = srl_dump_data_structure(aTHX_ enc, src, NULL);
+        len = BUF_POS_OFS(&enc->buf);
+        SvGROW(dst, prefix_len + len + 1);
+        Copy(enc->buf.start, SvPVX(dst) + prefix_len, len, char);
+        SvCUR_set(dst, prefix_len + len);
+        *SvEND(dst) = '\0';
+        SvPOK_only(dst);
+        return len;
+    }
+
+    enc = srl_prepare_encoder(aTHX_ enc);
+    SvGROW(dst, prefix_len + INITIALIZATION_SIZE);
+    srl_buf_copy_buffer(aTHX_ &enc->buf, &enc->into_own_buf);
+    enc->buf.start = (srl_buffer_char *)SvPVX(dst);
+    enc->buf.end = enc->buf.start + SvLEN(dst);
+    enc->buf.pos = enc->buf.start + prefix_len;
+    SRL_SET_BODY_POS(&enc->buf, enc->buf.start);
+    enc->into_sv = dst;
+    enc->into_prefix_len = prefix_len;
+    /* Runs before srl_destructor_hook, which might free the buffer */
+    SAVEDESTRUCTOR_X(&srl_into_sv_destructor_hook, (void *)enc);
+
+    /* dst may be part of src, so it must not see its buffer growing
+     * under it. It's undef until we are done. */
+    SvPV_set(dst, NULL);
+    SvLEN_set(dst, 0);
+    SvCUR_set(dst, 0);
+    SvOK_off(dst);
+
+    srl_write_header(aTHX_ enc, NULL, 0);
+    SRL_ENC_UPDATE_BODY_POS(enc);
+    SRL_ENC_STATS_BEGIN_BODY(enc);
+    srl_dump_sv(aTHX_ enc, src);
+    srl_fixup_weakrefs(aTHX_ enc);
+    SRL_ENC_STATS_END_BODY(enc);
+
+    BUF_SIZE_ASSERT(&enc->buf, 1); /* for the trailing NUL */
+    len = BUF_POS_OFS(&enc->buf) - prefix_len;
+    srl_into_sv_release(aTHX_ enc, prefix_len + len);
+    return len;
+}
+
 
 
 static inline void
@@ -1160,14 +1819,257 @@ srl_dump_regexp(pTHX_ srl_encoder_t *enc, SV *sv)
 #define BUF_SIZE_ASSERT_HV(b, n) \
         BUF_SIZE_ASSERT((b), 2 + SRL_MAX_VARINT_LENGTH + (2 * ASSUME_BYTES_PER_TAG * (n) ) )
 
+/* Arrays of at least this many numbers of the same type are written as a
+ * packed array (MANY) if the pack_numeric_arrays option is set */
+#define SRL_PACK_MIN_ITEMS 8
+/* The items of packed arrays are written this many at a time, so the buffer
+ * is checked once per chunk, and encode_to_fh() can flush in between. */
+#define SRL_PACK_CHUNK_ITEMS 1024
+
+/* Only plain numbers that nothing else refers to can be packed, the same
+ * ones CALL_SRL_DUMP_SV() writes as an int or a float directly. */
+#define SRL_PACKABLE_SV(sv, mask, ok) (                                         \
+    (sv) && SvTYPE(sv) < SVt_PVMG && SvREFCNT(sv) == 1 &&                       \
+    (SvFLAGS(sv) & (SVf_ROK | SVp_POK | (mask))) == (ok)                        \
+)
+#define SRL_PACKABLE_IV(sv) SRL_PACKABLE_SV(sv, SVf_IOK, SVf_IOK)
+#define SRL_PACKABLE_NV(sv) SRL_PACKABLE_SV(sv, SVf_IOK | SVf_NOK, SVf_NOK)
+
+/* Returns the tag of the type the n items at svp can be packed as, or 0 if
+ * they can't be packed. Integers are VARINT, or ZIGZAG if any of them is
+ * negative. Floats are FLOAT if all of them fit one, otherwise DOUBLE. */
+SRL_STATIC_INLINE U8
+srl_packed_av_type(pTHX_ SV **svp, UV n)
+{
+    SV ** const end= svp + n;
+
+    if (SRL_PACKABLE_IV(*svp)) {
+        int has_neg= 0, has_big= 0;
+        for ( ; svp < end; svp++) {
+            SV *sv= *svp;
+            if (!SRL_PACKABLE_IV(sv))
+                return 0;
+            if (SvIsUV(sv)) {
+                if (SvUVX(sv) > (UV)IV_MAX)
+                    has_big= 1;
+            }
+            else if (SvIVX(sv) < 0) {
+                has_neg= 1;
+            }
+        }
+        if (has_neg)
+            return has_big ? 0 : SRL_HDR_ZIGZAG;
+        return SRL_HDR_VARINT;
+    }
+    else if (SRL_PACKABLE_NV(*svp)) {
+        U8 type= SRL_HDR_FLOAT;
+        for ( ; svp < end; svp++) {
+            SV *sv= *svp;
+            NV nv;
+            MS_VC6_WORKAROUND_VOLATILE float f;
+            if (!SRL_PACKABLE_NV(sv))
+                return 0;
+            nv= SvNVX(sv);
+            f= (float)nv;
+            if ( f == nv || nv != nv )
+                continue;
+            if ((NV)(double)nv != nv)
+                return 0; /* needs a LONG_DOUBLE */
+            type= SRL_HDR_DOUBLE;
+        }
+        return type;
+    }
+    return 0;
+}
+
+SRL_STATIC_INLINE void
+srl_dump_packed_av(pTHX_ srl_encoder_t *enc, SV **svp, UV n, U8 type)
+{
+    SV ** const end= svp + n;
+
+    BUF_SIZE_ASSERT(&enc->buf, 2 + SRL_MAX_VARINT_LENGTH);
+    srl_buf_cat_varint_nocheck(aTHX_ &enc->buf, SRL_HDR_MANY, n);
+    srl_buf_cat_char_nocheck(&enc->buf, type);
+
+    while (svp < end) {
+        SV ** const chunk_end= end - svp > SRL_PACK_CHUNK_ITEMS ? svp + SRL_PACK_CHUNK_ITEMS : end;
+
+        SRL_ENC_STREAM_CHECKPOINT(enc);
+        switch (type) {
+        case SRL_HDR_VARINT: {
+            srl_buffer_char *pos;
+            BUF_SIZE_ASSERT(&enc->buf, (chunk_end - svp) * SRL_MAX_VARINT_LENGTH);
+            pos= enc->buf.pos;
+            for ( ; svp < chunk_end; svp++)
+                pos= srl_append_varint_raw(pos, SvUVX(*svp));
+            enc->buf.pos= pos;
+            break;
+        }
+        case SRL_HDR_ZIGZAG: {
+            srl_buffer_char *pos;
+            BUF_SIZE_ASSERT(&enc->buf, (chunk_end - svp) * SRL_MAX_VARINT_LENGTH);
+            pos= enc->buf.pos;
+            for ( ; svp < chunk_end; svp++)
+                pos= srl_append_varint_raw(pos, srl_zigzag_iv(SvIVX(*svp)));
+            enc->buf.pos= pos;
+            break;
+        }
+        case SRL_HDR_FLOAT:
+            BUF_SIZE_ASSERT(&enc->buf, (chunk_end - svp) * sizeof(float));
+            for ( ; svp < chunk_end; svp++) {
+                const float f= (float)SvNVX(*svp);
+                Copy((char *)&f, enc->buf.pos, sizeof(f), char);
+                enc->buf.pos += sizeof(f);
+            }
+            break;
+        default: /* SRL_HDR_DOUBLE */
+            BUF_SIZE_ASSERT(&enc->buf, (chunk_end - svp) * sizeof(double));
+            for ( ; svp < chunk_end; svp++) {
+                const double d= (double)SvNVX(*svp);
+                Copy((char *)&d, enc->buf.pos, sizeof(d), char);
+                enc->buf.pos += sizeof(d);
+            }
+            break;
+        }
+    }
+}
+
+/* Arrays of at least this many hashes with the same keys are written as
+ * record batches with the record_batches option */
+#define SRL_RECORDS_MIN_ITEMS 2
+
+/* The kinds of srl_encoder_frame_t, by what the items are written from */
+#define SRL_FRAME_SVS       0   /* an array of SV pointers: plain arrays, record batch values */
+#define SRL_FRAME_AV_MG     1   /* a tied or otherwise magical array, with av_fetch() */
+#define SRL_FRAME_HV        2   /* the buckets of a plain hash, key and value */
+#define SRL_FRAME_HV_MG     3   /* a tied or otherwise magical hash, with hv_iternext() */
+#define SRL_FRAME_SORTED_HE 4   /* sorted entries of a plain hash, key and value */
+#define SRL_FRAME_SORTED_SV 5   /* sorted keys and values as SVs, each written like a value */
+
+SRL_STATIC_INLINE srl_encoder_frame_t *
+srl_push_frame(pTHX_ srl_encoder_t *enc, const U8 kind)
+{
+    srl_encoder_frame_t *frame;
+    srl_stack_push_ptr(&enc->frames, frame);
+    frame->kind= kind;
+    return frame;
+}
+
+/* Items that can't contain other items, so writing them never pushes a
+ * frame. Most arrays and hashes only contain these, and are written right
+ * away rather than through a frame. */
+#define SRL_LEAF_SV(sv) (!(sv) || (SvTYPE(sv) < SVt_PVMG && !SvROK(sv)))
+
+/* Writes an integer that SRL_PACKABLE_IV() accepts at pos, as
+ * srl_dump_ivuv() would, into room that has already been made for it.
+ * Returns the position after it. */
+SRL_STATIC_INLINE srl_buffer_char *
+srl_dump_iv_nocheck(pTHX_ srl_buffer_char *pos, SV *src)
+{
+    if (SvIsUV(src) || SvIVX(src) >= 0) {
+        const UV num= SvUVX(src);
+        if (num <= 15) {
+            *pos++= SRL_HDR_POS_LOW | (U8)num;
+        }
+        else {
+            *pos++= SRL_HDR_VARINT;
+            pos= srl_append_varint_raw(pos, num);
+        }
+    }
+    else {
+        const IV num= SvIVX(src);
+        if (num >= -16) {
+            *pos++= SRL_HDR_NEG_LOW | ((U8)num + 32);
+        }
+        else {
+            *pos++= SRL_HDR_ZIGZAG;
+            pos= srl_append_varint_raw(pos, srl_zigzag_iv(num));
+        }
+    }
+    return pos;
+}
+
+/* Writes the plain integers from svp on, of which there must be at least
+ * one, up to SRL_PACK_CHUNK_ITEMS of them. Room is made for all of them at
+ * once instead of for each one. Returns where it stopped. */
+SRL_STATIC_INLINE SV **
+srl_dump_iv_run(pTHX_ srl_encoder_t *enc, SV **svp, SV ** const end)
+{
+    SV ** const limit= end - svp > SRL_PACK_CHUNK_ITEMS ? svp + SRL_PACK_CHUNK_ITEMS : end;
+    SV **run_end= svp + 1;
+    srl_buffer_char *pos;
+
+    while (run_end < limit && SRL_PACKABLE_IV(*run_end))
+        run_end++;
+
+    SRL_ENC_STREAM_CHECKPOINT(enc);
+    BUF_SIZE_ASSERT(&enc->buf, (run_end - svp) * (1 + SRL_MAX_VARINT_LENGTH));
+    pos= enc->buf.pos;
+    for ( ; svp < run_end; svp++)
+        pos= srl_dump_iv_nocheck(aTHX_ pos, *svp);
+    enc->buf.pos= pos;
+    return svp;
+}
+
+/* Writes the items from svp on until the first one that isn't a leaf,
+ * returns where it stopped. */
+SRL_STATIC_INLINE SV **
+srl_dump_leaf_svs(pTHX_ srl_encoder_t *enc, SV **svp, SV ** const end)
+{
+    while (svp < end) {
+        SV *sv= *svp;
+        if (SRL_PACKABLE_IV(sv)) {
+            svp= srl_dump_iv_run(aTHX_ enc, svp, end);
+            continue;
+        }
+        if (!SRL_LEAF_SV(sv))
+            break;
+        CALL_SRL_DUMP_SV(enc, sv);
+        svp++;
+    }
+    return svp;
+}
+
+/* Writes the items of svp to end, or if some contain others, pushes a frame
+ * for the rest from the first of those on */
 SRL_STATIC_INLINE void
+srl_dump_svs(pTHX_ srl_encoder_t *enc, SV **svp, SV ** const end)
+{
+    svp= srl_dump_leaf_svs(aTHX_ enc, svp, end);
+    if (svp < end) {
+        srl_encoder_frame_t *frame= srl_push_frame(aTHX_ enc, SRL_FRAME_SVS);
+        frame->u.svs.ptr= svp;
+        frame->u.svs.end= end;
+    }
+}
+
+/* not inlined into srl_dump_sv_begin(), which most values go through */
+SRL_STATIC_NOINLINE void
 srl_dump_av(pTHX_ srl_encoder_t *enc, AV *src, U32 refcount)
 {
     UV n;
-    SV **svp;
 
     n = av_len(src)+1;
 
+    if ( SRL_ENC_HAVE_OPTION(enc, SRL_F_PACK_NUMERIC_ARRAYS)
+         && n >= SRL_PACK_MIN_ITEMS
+         && !SvMAGICAL(src) )
+    {
+        const U8 type= srl_packed_av_type(aTHX_ AvARRAY(src), n);
+        if (type) {
+            srl_dump_packed_av(aTHX_ enc, AvARRAY(src), n, type);
+            return;
+        }
+    }
+
+    if ( SRL_ENC_HAVE_OPTION(enc, SRL_F_RECORD_BATCHES)
+         && n >= SRL_RECORDS_MIN_ITEMS
+         && !SvMAGICAL(src)
+         && srl_dump_records(aTHX_ enc, AvARRAY(src), n) )
+    {
+        return;
+    }
+
     /* heuristic: n is virtually the min. size of any element */
     BUF_SIZE_ASSERT_AV(&enc->buf, n);
 
@@ -1182,64 +2084,62 @@ srl_dump_av(pTHX_ srl_encoder_t *enc, AV *src, U32 refcount)
         return;
     /* I can't decide if this should make me feel dirty */
     if (SvMAGICAL(src)) {
-        UV i;
-        for (i = 0; i < n; ++i) {
-            svp = av_fetch(src, i, 0);
-            CALL_SRL_DUMP_SVP(enc, svp);
-        }
+        srl_encoder_frame_t *frame= srl_push_frame(aTHX_ enc, SRL_FRAME_AV_MG);
+        frame->u.av.av= src;
+        frame->u.av.i= 0;
+        frame->u.av.n= n;
     } else {
-        SV **end;
-        svp= AvARRAY(src);
-        end= svp + n;
-        for ( ; svp < end ; svp++) {
-            /* we cannot have a null *svp so we do not use CALL_SRL_DUMP_SVP() here */
-            CALL_SRL_DUMP_SV(enc, *svp);
-        }
+        srl_dump_svs(aTHX_ enc, AvARRAY(src), AvARRAY(src) + n);
     }
 }
 
 SRL_STATIC_INLINE void
 srl_dump_hv_unsorted_nomg(pTHX_ srl_encoder_t *enc, HV *src, UV n)
 {
-    HE *he;
+    srl_encoder_frame_t *frame;
     const int do_share_keys = HvSHAREKEYS((SV *)src);
     HE **he_ptr= HvARRAY(src);
-    HE **he_end= he_ptr + HvMAX(src) + 1;
+    HE ** const he_end= he_ptr + HvMAX(src) + 1;
+    HE *he= NULL;
 
-    do {
-        for (he= *he_ptr++; he; he= HeNEXT(he) ) {
-            SV *v= HeVAL(he);
-            if (v != &PL_sv_placeholder) {
-                srl_dump_hk(aTHX_ enc, he, do_share_keys);
-                CALL_SRL_DUMP_SV(enc, v);
-                if (--n == 0) {
-                    he_ptr= he_end;
-                    break;
-                }
-            }
+    /* write the leaves right away, see srl_dump_svs() */
+    while (n) {
+        SV *v;
+        while (!he) {
+            if (expect_false( he_ptr == he_end ))
+                return;
+            he= *he_ptr++;
         }
-    } while ( he_ptr < he_end );
+        v= HeVAL(he);
+        if (v != &PL_sv_placeholder) {
+            if (!SRL_LEAF_SV(v))
+                break;
+            srl_dump_hk(aTHX_ enc, he, do_share_keys);
+            CALL_SRL_DUMP_SV(enc, v);
+            n--;
+        }
+        he= HeNEXT(he);
+    }
+    if (!n)
+        return;
+
+    frame= srl_push_frame(aTHX_ enc, SRL_FRAME_HV);
+    frame->share_keys= do_share_keys ? 1 : 0;
+    frame->u.hv.bucket= he_ptr;
+    frame->u.hv.end= he_end;
+    frame->u.hv.he= he;
+    frame->u.hv.n= n;
 }
 
 SRL_STATIC_INLINE void
 srl_dump_hv_unsorted_mg(pTHX_ srl_encoder_t *enc, HV *src, const UV n)
 {
-    HE *he;
-    UV i= 0;
-    const int do_share_keys = HvSHAREKEYS((SV *)src);
-
+    srl_encoder_frame_t *frame= srl_push_frame(aTHX_ enc, SRL_FRAME_HV_MG);
+    frame->share_keys= HvSHAREKEYS((SV *)src) ? 1 : 0;
+    frame->u.hv_mg.hv= src;
+    frame->u.hv_mg.i= 0;
+    frame->u.hv_mg.n= n;
     (void)hv_iterinit(src); /* return value not reliable according to API docs */
-    while ((he = hv_iternext(src))) {
-        SV *v;
-        if (expect_false( i == n ))
-            croak("Panic: cannot serialize a tied hash which changes its size!");
-        v= hv_iterval(src, he);
-        srl_dump_hk(aTHX_ enc, he, do_share_keys);
-        CALL_SRL_DUMP_SV(enc, v);
-        ++i;
-    }
-    if (expect_false( i != n ))
-        croak("Panic: cannot serialize a tied hash which changes its size!");
 }
 
 /* sorting hashes - nothing in perl is easy. ever.
@@ -1353,7 +2253,6 @@ srl_dump_hv_sorted_sv_slow(pTHX_ srl_encoder_t *enc, HV *src, const UV n, HE_SV
 {
     HE *he;
     UV i= 0;
-    const int do_share_keys = HvSHAREKEYS((SV *)src);
     const int is_tie= !array;
 
     /* This sub is used for ties, and for hashes with SV keys in them,
@@ -1385,10 +2284,12 @@ srl_dump_hv_sorted_sv_slow(pTHX_ srl_encoder_t *enc, HV *src, const UV n, HE_SV
 
         srl_qsort(aTHX_ enc, n, array);
 
-        while ( array < array_end ) {
-            CALL_SRL_DUMP_SV(enc, array->key.sv);
-            CALL_SRL_DUMP_SV(enc, array->val.sv);
-            array++;
+        {
+            srl_encoder_frame_t *frame= srl_push_frame(aTHX_ enc, SRL_FRAME_SORTED_SV);
+            frame->want_value= 0;
+            frame->u.sorted.hv= src;
+            frame->u.sorted.ptr= array;
+            frame->u.sorted.end= array_end;
         }
     }
 }
@@ -1408,7 +2309,7 @@ srl_dump_hv_sorted_nomg(pTHX_ srl_encoder_t *enc, HV *src, const UV n)
     {
         HE_SV *array;
         HE_SV *array_ptr;
-        HE_SV *array_end;
+        srl_encoder_frame_t *frame;
         Newx(array, n, HE_SV);
         SAVEFREEPV(array);
         array_ptr = array;
@@ -1424,18 +2325,16 @@ srl_dump_hv_sorted_nomg(pTHX_ srl_encoder_t *enc, HV *src, const UV n)
         
         srl_qsort(aTHX_ enc, n, array);
 
-        array_end = array + n;
-        for ( array_end= array + n; array < array_end; array++ ) {
-            SV *v;
-            he = array->val.he;
-            v = hv_iterval(src, he);
-            srl_dump_hk(aTHX_ enc, he, do_share_keys);
-            CALL_SRL_DUMP_SV(enc, v);
-        }
+        frame= srl_push_frame(aTHX_ enc, SRL_FRAME_SORTED_HE);
+        frame->share_keys= do_share_keys ? 1 : 0;
+        frame->u.sorted.hv= src;
+        frame->u.sorted.ptr= array;
+        frame->u.sorted.end= array + n;
     }
 }
 
-SRL_STATIC_INLINE void
+/* not inlined into srl_dump_sv_begin(), like srl_dump_av() */
+SRL_STATIC_NOINLINE void
 srl_dump_hv(pTHX_ srl_encoder_t *enc, HV *src, U32 refcount)
 {
     HE *he;
@@ -1514,8 +2413,10 @@ srl_dump_hk(pTHX_ srl_encoder_t *enc, HE *src, const int share_keys)
         {
             PTABLE_t *string_seenhash = SRL_GET_STR_PTR_SEENHASH(enc);
             const ptrdiff_t oldoffset = (ptrdiff_t)PTABLE_fetch(string_seenhash, str);
+            SRL_ENC_STATS_INC(enc, shared_hashkey_lookups);
             if (oldoffset != 0) {
                 /* Issue COPY instead of literal hash key string */
+                SRL_ENC_STATS_INC(enc, shared_hashkey_hits);
                 srl_buf_cat_varint(aTHX_ &enc->buf, SRL_HDR_COPY, (UV)oldoffset);
                 return;
             }
@@ -1543,28 +2444,23 @@ srl_dump_svpv(pTHX_ srl_encoder_t *enc, SV *src)
     STRLEN len;
     const char * const str= SvPV(src, len);
     if ( SRL_ENC_HAVE_OPTION(enc, SRL_F_DEDUPE_STRINGS) && len > 3 ) {
-        HV *string_deduper_hv= SRL_GET_STR_DEDUPER_HV(enc);
-        HE *dupe_offset_he= hv_fetch_ent(string_deduper_hv, src, 1, 0);
-        if (!dupe_offset_he) {
-            croak("out of memory (hv_fetch_ent returned NULL)");
-        } else {
-            const char out_tag= SRL_ENC_HAVE_OPTION(enc, SRL_F_ALIASED_DEDUPE_STRINGS)
-                                ? SRL_HDR_ALIAS
-                                : SRL_HDR_COPY;
-            SV *ofs_sv= HeVAL(dupe_offset_he);
-            if (SvIOK(ofs_sv)) {
-                /* emit copy or alias */
-                if (out_tag == SRL_HDR_ALIAS)
-                    SRL_SET_TRACK_FLAG(*(enc->buf.body_pos + SvUV(ofs_sv)));
-                srl_buf_cat_varint(aTHX_ &enc->buf, out_tag, SvIV(ofs_sv));
-                return;
-            } else if (SvUOK(ofs_sv)) {
-                srl_buf_cat_varint(aTHX_ &enc->buf, out_tag, SvUV(ofs_sv));
+        srl_dedupe_entry_t *ent= srl_dedupe_find_or_add(aTHX_ SRL_GET_STR_DEDUPER(enc), &enc->buf,
+                                                        str, len, SvUTF8(src));
+        if (ent) {
+            SRL_ENC_STATS_INC(enc, dedupe_lookups);
+            if (ent->ofs) {
+                /* emit copy or alias, the earlier copy is always still in the buffer */
+                SRL_ENC_STATS_INC(enc, dedupe_hits);
+                if (SRL_ENC_HAVE_OPTION(enc, SRL_F_ALIASED_DEDUPE_STRINGS)) {
+                    SRL_SET_TRACK_FLAG(*(enc->buf.body_pos + ent->ofs));
+                    srl_buf_cat_varint(aTHX_ &enc->buf, SRL_HDR_ALIAS, ent->ofs);
+                } else {
+                    srl_buf_cat_varint(aTHX_ &enc->buf, SRL_HDR_COPY, ent->ofs);
+                }
                 return;
-            } else {
-                /* start tracking this string */
-                sv_setuv(ofs_sv, (UV)BODY_POS_OFS(&enc->buf));
             }
+            /* start tracking this string */
+            ent->ofs= (UV)BODY_POS_OFS(&enc->buf);
         }
     }
     srl_dump_pv(aTHX_ enc, str, len, SvUTF8(src));
@@ -1573,7 +2469,10 @@ srl_dump_svpv(pTHX_ srl_encoder_t *enc, SV *src)
 SRL_STATIC_INLINE void
 srl_dump_pv(pTHX_ srl_encoder_t *enc, const char* src, STRLEN src_len, int is_utf8)
 {
-    BUF_SIZE_ASSERT(&enc->buf, 1 + SRL_MAX_VARINT_LENGTH + src_len); /* overallocate a bit sometimes */
+    /* when streaming, long strings are written out from where they are */
+    const int zero_copy = expect_false( enc->stream_zero_copy_min != 0 ) && src_len >= enc->stream_zero_copy_min;
+
+    BUF_SIZE_ASSERT(&enc->buf, 1 + SRL_MAX_VARINT_LENGTH + (zero_copy ? 0 : src_len)); /* overallocate a bit sometimes */
     if (is_utf8) {
         srl_buf_cat_varint_nocheck(aTHX_ &enc->buf, SRL_HDR_STR_UTF8, src_len);
     } else if (src_len <= SRL_MASK_SHORT_BINARY_LEN) {
@@ -1581,6 +2480,10 @@ srl_dump_pv(pTHX_ srl_encoder_t *enc, const char* src, STRLEN src_len, int is_ut
     } else {
         srl_buf_cat_varint_nocheck(aTHX_ &enc->buf, SRL_HDR_BINARY, src_len);
     }
+    if (zero_copy) {
+        srl_stream_write_string(aTHX_ enc, src, src_len);
+        return;
+    }
     Copy(src, enc->buf.pos, src_len, char);
     enc->buf.pos += src_len;
 }
@@ -1597,8 +2500,268 @@ srl_hv_backreferences_p_safe(pTHX_ HV *hv) {
 }
 #endif
 
+/* Only references to plain hashes that nothing else refers to, not even
+ * weakly, can be records, as neither has a tag that could be referred to. */
+#ifdef HAS_HV_BACKREFS
+#   define SRL_RECORD_HV_HAS_BACKREFS(hv) (SvOOK(hv) && srl_hv_backreferences_p_safe(aTHX_ (hv)))
+#else
+#   define SRL_RECORD_HV_HAS_BACKREFS(hv) 0
+#endif
+#define SRL_RECORD_SV(sv) (                                                     \
+    (sv) && SvTYPE(sv) < SVt_PVMG && SvROK(sv) && !SvWEAKREF(sv) &&             \
+    SvREFCNT(sv) == 1 && SvTYPE(SvRV(sv)) == SVt_PVHV &&                        \
+    SvREFCNT(SvRV(sv)) == 1 && !SvOBJECT(SvRV(sv)) && !SvMAGICAL(SvRV(sv)) &&   \
+    !SRL_RECORD_HV_HAS_BACKREFS((HV *)SvRV(sv))                                 \
+)
+
+/* Look up the entry of a key of another hash directly in the buckets, the
+ * keys of hashes with shared keys are even the same HEK. */
+SRL_STATIC_INLINE HE *
+srl_record_find_key(HV *hv, const HE *key)
+{
+    const HEK * const hek= HeKEY_hek(key);
+    HE *he= HvARRAY(hv)[HEK_HASH(hek) & HvMAX(hv)];
+
+    for ( ; he; he= HeNEXT(he)) {
+        const HEK * const he_hek= HeKEY_hek(he);
+        if ( he_hek == hek
+             || ( HEK_HASH(he_hek) == HEK_HASH(hek)
+                  && HEK_LEN(he_hek) == HEK_LEN(hek)
+                  && !((HEK_FLAGS(he_hek) ^ HEK_FLAGS(hek)) & (HVhek_UTF8|HVhek_WASUTF8))
+                  && memEQ(HEK_KEY(he_hek), HEK_KEY(hek), HEK_LEN(hek)) ) )
+        {
+            return HeVAL(he) == &PL_sv_placeholder ? NULL : he;
+        }
+    }
+    return NULL;
+}
+
+/* Writes the n items at svp as a record batch (RECORDS) if they are all
+ * references to hashes with the same keys: the keys of the first hash,
+ * followed by the values of each key for all the hashes in turn. Returns 0
+ * without writing anything if they aren't. Values that are not simple scalars
+ * are left on enc->frames for srl_dump_sv() to write. */
+SRL_STATIC_INLINE int
+srl_dump_records(pTHX_ srl_encoder_t *enc, SV **svp, const UV n)
+{
+    HV *first;
+    HE_SV *keys;
+    SV **vals;
+    UV nkeys;
+    UV i, k;
+
+    if ( !SRL_RECORD_SV(svp[0]) || SRL_ENC_HAVE_OPTION(enc, SRL_F_SORT_KEYS_PERL) )
+        return 0;
+    first= (HV *)SvRV(svp[0]);
+    nkeys= HvUSEDKEYS(first);
+    if (!nkeys)
+        return 0;
+    /* cheap checks first, before gathering anything */
+    for (i= 1; i < n; i++) {
+        if ( !SRL_RECORD_SV(svp[i]) || HvUSEDKEYS((HV *)SvRV(svp[i])) != nkeys )
+            return 0;
+    }
+
+    Newx(keys, nkeys, HE_SV);
+    SAVEFREEPV(keys);
+    {
+        HE **he_ptr= HvARRAY(first);
+        HE ** const he_end= he_ptr + HvMAX(first) + 1;
+        k= 0;
+        for ( ; he_ptr < he_end; he_ptr++) {
+            HE *he;
+            for (he= *he_ptr; he; he= HeNEXT(he)) {
+                if (HeVAL(he) == &PL_sv_placeholder)
+                    continue;
+                /* sorted hashes sort these by their SV form, see above */
+                if ( HeKWASUTF8(he) && SRL_ENC_HAVE_OPTION(enc, SRL_F_SORT_KEYS) )
+                    return 0;
+                keys[k].key.sv= HeSVKEY(he);
+                keys[k].val.he= he;
+                k++;
+            }
+        }
+    }
+    if ( SRL_ENC_HAVE_OPTION(enc, SRL_F_SORT_KEYS) )
+        QSORT(HE_SV, keys, nkeys, ISLT_HE_SV);
+
+    /* the values in the order they are written, a column at a time */
+    Newx(vals, n * nkeys, SV *);
+    SAVEFREEPV(vals);
+    for (k= 0; k < nkeys; k++)
+        vals[k * n]= HeVAL(keys[k].val.he);
+    for (i= 1; i < n; i++) {
+        HV * const hv= (HV *)SvRV(svp[i]);
+        for (k= 0; k < nkeys; k++) {
+            const HE * const he= srl_record_find_key(hv, keys[k].val.he);
+            if (!he)
+                return 0;
+            vals[k * n + i]= HeVAL(he);
+        }
+    }
+
+    BUF_SIZE_ASSERT(&enc->buf, 1 + 2 * SRL_MAX_VARINT_LENGTH);
+    srl_buf_cat_varint_nocheck(aTHX_ &enc->buf, SRL_HDR_RECORDS, n);
+    srl_buf_cat_varint_raw_nocheck(aTHX_ &enc->buf, nkeys);
+    for (k= 0; k < nkeys; k++)
+        srl_dump_hk(aTHX_ enc, keys[k].val.he, HvSHAREKEYS((SV *)first));
+    srl_dump_svs(aTHX_ enc, vals, vals + n * nkeys);
+    return 1;
+}
+
+/* Gets the next item of the array or hash at the top of the frame stack
+ * into *item, writing its key first for hashes. Returns 0 if there are no
+ * items left. SRL_FRAME_SVS and SRL_FRAME_HV frames are handled by
+ * srl_dump_sv() itself. */
+SRL_STATIC_INLINE int
+srl_frame_next_item(pTHX_ srl_encoder_t *enc, srl_encoder_frame_t *frame, SV **item)
+{
+    switch (frame->kind) {
+    case SRL_FRAME_AV_MG: {
+        SV **svp;
+        if (frame->u.av.i == frame->u.av.n)
+            return 0;
+        svp= av_fetch(frame->u.av.av, frame->u.av.i++, 0);
+        *item= svp ? *svp : NULL;
+        return 1;
+    }
+
+    case SRL_FRAME_HV_MG: {
+        HV *hv= frame->u.hv_mg.hv;
+        HE *he= hv_iternext(hv);
+        if (!he) {
+            if (expect_false( frame->u.hv_mg.i != frame->u.hv_mg.n ))
+                croak("Panic: cannot serialize a tied hash which changes its size!");
+            return 0;
+        }
+        if (expect_false( frame->u.hv_mg.i++ == frame->u.hv_mg.n ))
+            croak("Panic: cannot serialize a tied hash which changes its size!");
+        *item= hv_iterval(hv, he);
+        srl_dump_hk(aTHX_ enc, he, frame->share_keys);
+        return 1;
+    }
+
+    case SRL_FRAME_SORTED_HE: {
+        HE *he;
+        if (frame->u.sorted.ptr == frame->u.sorted.end)
+            return 0;
+        he= (frame->u.sorted.ptr++)->val.he;
+        *item= hv_iterval(frame->u.sorted.hv, he);
+        srl_dump_hk(aTHX_ enc, he, frame->share_keys);
+        return 1;
+    }
+
+    case SRL_FRAME_SORTED_SV:
+        if (frame->want_value) {
+            frame->want_value= 0;
+            *item= (frame->u.sorted.ptr++)->val.sv;
+            return 1;
+        }
+        if (frame->u.sorted.ptr == frame->u.sorted.end)
+            return 0;
+        frame->want_value= 1;
+        *item= frame->u.sorted.ptr->key.sv;
+        return 1;
+
+    default:
+        croak("Panic: unknown encoder frame kind %d", (int)frame->kind);
+    }
+    return 0; /* not reached */
+}
+
+/* An item of a SRL_FRAME_SVS or SRL_FRAME_HV frame that isn't a simple
+ * scalar: save our place, and if it pushed a frame of its own, go write
+ * that one first */
+#define SRL_DUMP_SVS_ITEM(enc, src) STMT_START {                                \
+    frame->u.svs.ptr= ptr;                                                      \
+    srl_dump_sv_begin(aTHX_ (enc), (src));                                      \
+    if (SRL_STACK_DEPTH(frames) != depth)                                       \
+        goto next_frame;                                                        \
+} STMT_END
+#define SRL_DUMP_HV_ITEM(enc, src) STMT_START {                                 \
+    frame->u.hv.bucket= bucket;                                                 \
+    frame->u.hv.he= he;                                                         \
+    frame->u.hv.n= n;                                                           \
+    srl_dump_sv_begin(aTHX_ (enc), (src));                                      \
+    if (SRL_STACK_DEPTH(frames) != depth)                                       \
+        goto next_frame;                                                        \
+} STMT_END
+
+/* Dumps src and everything it contains. Rather than recursing into arrays
+ * and hashes, srl_dump_sv_begin() writes their header and pushes a frame
+ * for their items onto enc->frames, and this loop writes the items of the
+ * frame on top until it runs out, then pops it. So the depth of the data
+ * structure is only limited by max_recursion_depth, not the C stack. The
+ * frames that were there already belong to whoever called us. */
+static void
+srl_dump_sv(pTHX_ srl_encoder_t *enc, SV *src)
+{
+    srl_stack_t *frames= &enc->frames;
+    const IV base_depth= SRL_STACK_DEPTH(frames);
+    IV depth;
+
+    srl_dump_sv_begin(aTHX_ enc, src);
+    while ((depth= SRL_STACK_DEPTH(frames)) > base_depth) {
+        srl_encoder_frame_t *frame= srl_stack_ptr(frames);
+        SV *item;
+        if (expect_true( frame->kind == SRL_FRAME_SVS )) {
+            /* arrays are by far the most common, so they get a tight loop
+             * that only goes back to the frame for items that aren't simple */
+            SV **ptr= frame->u.svs.ptr;
+            SV ** const end= frame->u.svs.end;
+            while (ptr < end) {
+                item= *ptr++;
+                CALL_SRL_DUMP_SV_WITH(enc, item, SRL_DUMP_SVS_ITEM);
+            }
+            srl_stack_pop_nocheck(frames);
+            --enc->recursion_depth;
+        }
+        else if (frame->kind == SRL_FRAME_HV) {
+            /* the same for plain hashes, walking their buckets */
+            HE **bucket= frame->u.hv.bucket;
+            HE ** const bucket_end= frame->u.hv.end;
+            HE *he= frame->u.hv.he;
+            UV n= frame->u.hv.n;
+            while (n) {
+                while (!he) {
+                    if (expect_false( bucket == bucket_end ))
+                        break;
+                    he= *bucket++;
+                }
+                if (expect_false( !he ))
+                    break;
+                item= HeVAL(he);
+                if (item != &PL_sv_placeholder) {
+                    srl_dump_hk(aTHX_ enc, he, frame->share_keys);
+                    he= HeNEXT(he);
+                    n--;
+                    CALL_SRL_DUMP_SV_WITH(enc, item, SRL_DUMP_HV_ITEM);
+                }
+                else {
+                    he= HeNEXT(he);
+                }
+            }
+            srl_stack_pop_nocheck(frames);
+            --enc->recursion_depth;
+        }
+        else if (srl_frame_next_item(aTHX_ enc, frame, &item)) {
+            CALL_SRL_DUMP_SV(enc, item);
+        }
+        else {
+            srl_stack_pop_nocheck(frames);
+            --enc->recursion_depth;
+        }
+    next_frame: ;
+    }
+}
+#undef SRL_DUMP_SVS_ITEM
+#undef SRL_DUMP_HV_ITEM
+
 /* Dumps generic SVs and delegates
- * to more specialized functions for RVs, etc. */
+ * to more specialized functions for RVs, etc.
+ * For arrays and hashes, only writes their header and leaves a frame for
+ * their items on the stack, in which case the recursion depth is only
+ * decremented once the frame is popped, see srl_dump_sv(). */
 /* TODO decide when to use the IV, when to use the PV, and when
  *      to use the NV slots of the SV.
  *      Safest simple solution seems "prefer string" (fuck dualvars).
@@ -1607,8 +2770,9 @@ srl_hv_backreferences_p_safe(pTHX_ HV *hv) {
  *      and strcmp. If same, then use int or float.
  */
 static void
-srl_dump_sv(pTHX_ srl_encoder_t *enc, SV *src)
+srl_dump_sv_begin(pTHX_ srl_encoder_t *enc, SV *src)
 {
+    const IV frames_depth= SRL_STACK_DEPTH(&enc->frames);
     UV refcount;
     svtype svt;
     MAGIC *mg;
@@ -1619,6 +2783,8 @@ srl_dump_sv(pTHX_ srl_encoder_t *enc, SV *src)
     SSize_t ref_rewrite_pos= 0;      /* preserved between loops - note SSize_t is a perl define */
     assert(src);
 
+    SRL_ENC_STREAM_CHECKPOINT(enc);
+
     if (expect_false( ++enc->recursion_depth == enc->max_recursion_depth )) {
         croak("Hit maximum recursion depth (%"UVuf"), aborting serialization",
               (UV)enc->max_recursion_depth);
@@ -1694,12 +2860,23 @@ redo_dump:
                     if (DEBUGHACK) warn("alias to %p as %"UVuf, src, (UV)oldoffset);
                     srl_buf_cat_varint(aTHX_ &enc->buf, SRL_HDR_ALIAS, (UV)oldoffset);
                 }
-                SRL_SET_TRACK_FLAG(*(enc->buf.body_pos + oldoffset));
+                /* when streaming, items that were written out are tracked already */
+                if (expect_true( SRL_ENC_BODY_OFS_IN_BUF(enc, oldoffset) ))
+                    SRL_SET_TRACK_FLAG(*(enc->buf.body_pos + oldoffset));
                 --enc->recursion_depth;
                 return;
             }
             if (DEBUGHACK) warn("storing %p as %"UVuf, src, (UV)BODY_POS_OFS(&enc->buf));
             PTABLE_store(ref_seenhash, src, INT2PTR(void *, BODY_POS_OFS(&enc->buf)));
+            if (expect_false( enc->stream_out != NULL )) {
+                /* When streaming, the item may be written out before we see
+                 * it again, so it has to be marked as tracked right away.
+                 * Its tag is written by the time we get to the next
+                 * checkpoint or the next item to track, whichever is first. */
+                if (enc->stream_track_pending)
+                    SRL_SET_TRACK_FLAG(*(enc->buf.body_pos + enc->stream_track_pending));
+                enc->stream_track_pending = BODY_POS_OFS(&enc->buf);
+            }
         }
     }
 
@@ -1805,6 +2982,8 @@ redo_dump:
                          * want to serialize around for REFP and ALIAS output */               \
                         PTABLE_t *ref_seenhash= SRL_GET_REF_SEENHASH(enc);                     \
                         PTABLE_delete(ref_seenhash, src);                                      \
+                        if ((enc)->stream_track_pending > (UV)ref_rewrite_pos)                 \
+                            (enc)->stream_track_pending = 0;                                   \
                         enc->buf.pos= enc->buf.body_pos + ref_rewrite_pos;                     \
                     }                                                                          \
                     srl_buf_cat_char(&(enc)->buf, SRL_HDR_UNDEF);                              \
@@ -1833,6 +3012,8 @@ redo_dump:
                          * want to serialize around for REFP and ALIAS output */               \
                         PTABLE_t *ref_seenhash= SRL_GET_REF_SEENHASH(enc);                     \
                         PTABLE_delete(ref_seenhash, src);                                      \
+                        if ((enc)->stream_track_pending > (UV)ref_rewrite_pos)                 \
+                            (enc)->stream_track_pending = 0;                                   \
                         enc->buf.pos= enc->buf.body_pos + ref_rewrite_pos;                     \
                         str = SvPV((refsv), len);                                              \
                     } else                                                                     \
@@ -1856,6 +3037,7 @@ redo_dump:
         SRL_HANDLE_UNSUPPORTED_SvTYPE(enc, src, svt, refsv, ref_rewrite_pos);
 #undef SRL_HANDLE_UNSUPPORTED_SvTYPE
     }
-    --enc->recursion_depth;
+    if (SRL_STACK_DEPTH(&enc->frames) == frames_depth)
+        --enc->recursion_depth;
 }
 
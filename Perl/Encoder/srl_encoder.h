@@ -11,9 +11,41 @@
 #   define INITIALIZATION_SIZE 64
 #endif
 
+/* Default for the flush_threshold option, see encode_to_fh() */
+#define SRL_DEFAULT_FLUSH_THRESHOLD (1024 * 1024)
+
 #include "srl_inline.h"
 #include "srl_buffer_types.h"
 
+typedef struct {
+    union {
+        SV *sv;
+    } key;
+    union {
+        HE *he;
+        SV *sv;
+    } val;
+} HE_SV;
+
+/* An array or hash whose items are still to be written. srl_dump_sv() keeps
+ * a stack of these instead of recursing into the items, see the SRL_FRAME_*
+ * defines in srl_encoder.c for what the kinds are. */
+typedef struct {
+    union {
+        struct { SV **ptr; SV **end; } svs;
+        struct { AV *av; UV i; UV n; } av;
+        struct { HE **bucket; HE **end; HE *he; UV n; } hv;
+        struct { HV *hv; UV i; UV n; } hv_mg;
+        struct { HV *hv; HE_SV *ptr; HE_SV *end; } sorted;
+    } u;
+    U8 kind;
+    U8 share_keys;          /* for the kinds that write hash keys */
+    U8 want_value;          /* SRL_FRAME_SORTED_SV: the key was written, the value is next */
+} srl_encoder_frame_t;
+
+#define srl_stack_type_t srl_encoder_frame_t
+#include "srl_stack.h"
+
 typedef struct PTABLE * ptable_ptr;
 typedef struct {
     srl_buffer_t buf;
@@ -25,6 +57,7 @@ typedef struct {
     UV max_recursion_depth;   /* Configurable limit on the number of recursive calls we're willing to make */
 
     UV recursion_depth;       /* current Perl-ref recursion depth */
+    srl_stack_t frames;       /* arrays and hashes being written, see srl_dump_sv() */
     ptable_ptr ref_seenhash;  /* ptr table for avoiding circular refs */
     ptable_ptr weak_seenhash; /* ptr table for avoiding dangling weakrefs */
     ptable_ptr str_seenhash;  /* ptr table for issuing COPY commands based on PTRS (used for classnames and keys)
@@ -33,15 +66,40 @@ typedef struct {
                                * Possibly this should be replaced with freezeobj_svhash, but this works fine.
                                */
     ptable_ptr freezeobj_svhash; /* ptr table for tracking objects and their frozen replacments via FREEZE */
-    HV *string_deduper_hv;    /* track strings we have seen before, by content */
+    struct srl_dedupe *string_deduper; /* track strings we have seen before, by content */
+    STRLEN dedupe_strings_budget; /* max bytes for string_deduper, 0 for no limit */
 
     void *snappy_workmem;     /* lazily allocated if and only if using Snappy */
+    void *zstd_cctx;          /* lazily allocated if and only if using zstd, reused across calls */
+    SV *zstd_dictionary;      /* optional zstd dictionary, only used with zstd compression */
+    void *zstd_cdict;         /* zstd_dictionary digested for compress_level, lazily allocated */
     IV compress_threshold;    /* do not compress things smaller than this even if compression enabled */
     IV compress_level;        /* For ZLIB and ZSTD, the compression level */
+    IV compress_threads;      /* For ZSTD, the number of worker threads for large bodies (0 for none) */
+
+                              /* only used while encode_to_fh() is streaming a document */
+    PerlIO *stream_out;       /* where srl_stream_flush() writes the buffer to, NULL if not streaming */
+    PerlIO *stream_tmp;       /* temporary file for the uncompressed body if compressing with zstd */
+    UV stream_track_pending;  /* body offset of a tracked item whose tag is not written yet */
+    STRLEN flush_threshold;   /* flush the buffer whenever it is larger than this */
+    STRLEN zero_copy_strings_over; /* write strings at least this long straight from the SV, 0 for never */
+    STRLEN stream_zero_copy_min; /* zero_copy_strings_over if the document isn't compressed, 0 otherwise */
+    int stream_fd;            /* file descriptor to writev() to, -1 to go through PerlIO */
+
+                              /* only used while encode_into() writes into a caller's string */
+    SV *into_sv;              /* the string whose buffer is in buf, NULL otherwise */
+    STRLEN into_prefix_len;   /* length of what the string held before, if appending */
+    srl_buffer_t into_own_buf; /* the encoder's own buffer in the meantime */
 
                               /* only used if SRL_F_ENABLE_FREEZE_SUPPORT is set. */
     SV *sereal_string_sv;     /* SV that says "Sereal" for FREEZE support */
+    ptable_ptr freeze_cv_cache; /* FREEZE method by class stash, lazily allocated, see srl_method_cache.h */
     SV *scratch_sv;           /* SV used by encoder for scratch operations */
+
+                              /* only used with the stats option */
+    struct srl_stats *stats;  /* counters, see srl_stats.h, NULL if not counting */
+    UV stats_scan_ofs;        /* body offset up to which the tags of the document were counted */
+    UV stats_scan_packed;     /* varints of a packed array still to count from there */
 } srl_encoder_t;
 
 typedef struct {
@@ -49,16 +107,6 @@ typedef struct {
     U32 hash;
 } sv_with_hash;
 
-typedef struct {
-    union {
-        SV *sv;
-    } key;
-    union {
-        HE *he;
-        SV *sv;
-    } val;
-} HE_SV;
-
 /* constructor from options */
 srl_encoder_t *srl_build_encoder_struct(pTHX_ HV *opt, sv_with_hash *options);
 
@@ -74,6 +122,14 @@ void srl_destroy_encoder(pTHX_ srl_encoder_t *enc);
 void srl_write_header(pTHX_ srl_encoder_t *enc, SV *user_header_src, const U32 compress_flags);
 /* Start dumping a top-level SV */
 SV *srl_dump_data_structure_mortal_sv(pTHX_ srl_encoder_t *enc, SV *src, SV *user_header_src, const U32 flags);
+/* Dump a top-level SV to a file handle, with memory use bounded by flush_threshold */
+void srl_dump_data_structure_to_fh(pTHX_ srl_encoder_t *enc, SV *src, SV *user_header_src, PerlIO *out);
+/* Dump a top-level SV into (or to the end of) a caller's string, returns the document's length */
+STRLEN srl_dump_data_structure_into_sv(pTHX_ srl_encoder_t *enc, SV *src, SV *dst, const int append);
+
+/* Put the counters of the stats option into hv, and start counting from 0 */
+void srl_encoder_stats(pTHX_ srl_encoder_t *enc, HV *hv);
+void srl_encoder_reset_stats(pTHX_ srl_encoder_t *enc);
 
 
 /* define option bits in srl_encoder_t's flags member */
@@ -141,6 +197,14 @@ SV *srl_dump_data_structure_mortal_sv(pTHX_ srl_encoder_t *enc, SV *src, SV *use
  * #define SRL_F_COMPRESS_ZSTD                  0x40000UL
  */
 
+/* If set, write arrays of numbers of the same type as packed arrays (MANY).
+ * Corresponds to the 'pack_numeric_arrays' option. */
+#define SRL_F_PACK_NUMERIC_ARRAYS               0x80000UL
+
+/* If set, write arrays of hashes with the same keys as record batches
+ * (RECORDS). Corresponds to the 'record_batches' option. */
+#define SRL_F_RECORD_BATCHES                   0x100000UL
+
 /* ====================================================================
  * oper flags
  */
@@ -242,6 +306,30 @@ SV *srl_dump_data_structure_mortal_sv(pTHX_ srl_encoder_t *enc, SV *src, SV *use
 #define SRL_ENC_OPT_STR_WARN_UNKNOWN "warn_unknown"
 #define SRL_ENC_OPT_IDX_WARN_UNKNOWN 20
 
-#define SRL_ENC_OPT_COUNT 21
+#define SRL_ENC_OPT_STR_ZSTD_DICTIONARY "zstd_dictionary"
+#define SRL_ENC_OPT_IDX_ZSTD_DICTIONARY 21
+
+#define SRL_ENC_OPT_STR_COMPRESS_THREADS "compress_threads"
+#define SRL_ENC_OPT_IDX_COMPRESS_THREADS 22
+
+#define SRL_ENC_OPT_STR_FLUSH_THRESHOLD "flush_threshold"
+#define SRL_ENC_OPT_IDX_FLUSH_THRESHOLD 23
+
+#define SRL_ENC_OPT_STR_DEDUPE_STRINGS_BUDGET "dedupe_strings_budget"
+#define SRL_ENC_OPT_IDX_DEDUPE_STRINGS_BUDGET 24
+
+#define SRL_ENC_OPT_STR_PACK_NUMERIC_ARRAYS "pack_numeric_arrays"
+#define SRL_ENC_OPT_IDX_PACK_NUMERIC_ARRAYS 25
+
+#define SRL_ENC_OPT_STR_RECORD_BATCHES "record_batches"
+#define SRL_ENC_OPT_IDX_RECORD_BATCHES 26
+
+#define SRL_ENC_OPT_STR_ZERO_COPY_STRINGS_OVER "zero_copy_strings_over"
+#define SRL_ENC_OPT_IDX_ZERO_COPY_STRINGS_OVER 27
+
+#define SRL_ENC_OPT_STR_STATS "stats"
+#define SRL_ENC_OPT_IDX_STATS 28
+
+#define SRL_ENC_OPT_COUNT 29
 
 #endif
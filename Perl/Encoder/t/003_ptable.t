@@ -11,6 +11,6 @@ BEGIN {
 use Sereal::TestSet;
 use Sereal::Encoder;
 $|= 1;
-print "1..40\n";
+print "1..45\n";
 Sereal::Encoder::_ptabletest::test();
 
@@ -134,4 +134,55 @@ is( $decoded->[0]->num, 10, 'first MyObject->num' );
 is( $decoded->[1]->num, 20, 'second MyObject->num' );
 is( $decoded->[2]->num, 30, 'third MyObject->num' );
 
+# The encoder and decoder cache the FREEZE and THAW methods of each class,
+# redefining them or changing the inheritance must still take effect
+
+{
+
+    package Cached::Base;
+
+    sub FREEZE { return "base" }
+    sub THAW   { my ( $class, undef, $data )= @_; return bless { thawed => "base:$data" }, $class }
+
+    package Cached::Child;
+    our @ISA= ('Cached::Base');
+
+    package Cached::Other;
+    sub FREEZE { return "other" }
+    sub THAW   { my ( $class, undef, $data )= @_; return bless { thawed => "other:$data" }, $class }
+}
+
+{
+    my $enc= Sereal::Encoder->new( { freeze_callbacks => 1 } );
+    my $dec= Sereal::Decoder->new;
+    my $roundtrip= sub { $dec->decode( $enc->encode( bless {}, 'Cached::Child' ) )->{thawed} };
+
+    is( $roundtrip->(), "base:base", "inherited FREEZE and THAW" );
+
+    no warnings qw(redefine once);
+    eval q{ sub Cached::Base::FREEZE { return "redefined" } 1 } or die $@;
+    is( $roundtrip->(), "base:redefined", "redefined FREEZE of the parent class" );
+
+    eval q{ sub Cached::Child::THAW { my ( $class, undef, $data )= @_; return bless { thawed => "child:$data" }, $class } 1 }
+        or die $@;
+    is( $roundtrip->(), "child:redefined", "THAW defined in the class itself" );
+
+    *Cached::Child::FREEZE= sub { return "glob" };
+    is( $roundtrip->(), "child:glob", "FREEZE assigned to the glob" );
+
+    delete $Cached::Child::{FREEZE};
+    delete $Cached::Child::{THAW};
+    @Cached::Child::ISA= ('Cached::Other');
+    is( $roundtrip->(), "other:other", "changed \@ISA" );
+
+    @Cached::Child::ISA= ();
+    my $srl= $enc->encode( bless { plain => 1 }, 'Cached::Child' );
+    is_deeply( $dec->decode($srl), bless( { plain => 1 }, 'Cached::Child' ), "no FREEZE any more" );
+
+    $srl= $enc->encode( bless {}, 'Cached::Other' );
+    delete $Cached::Other::{THAW};
+    ok( !eval { $dec->decode($srl); 1 }, "no THAW any more" );
+    like( $@, qr/No THAW method defined for class 'Cached::Other'/, "... with the usual error" );
+}
+
 done_testing();
@@ -27,6 +27,24 @@ my $no_exception= eval {
 };
 ok( !$no_exception );
 
+# the encoder doesn't recurse in C, so the limit is the only bound on depth
+{
+    my $depth= 200_000;
+    my $list;
+    $list= { value => $_, next => $list } for 1 .. $depth;
+    my $mixed= [];
+    $mixed= [ { a => $mixed, b => [ 1, 2 ] }, "x" ] for 1 .. $depth / 2;
+
+    foreach my $case ( [ "linked list", $list ], [ "arrays and hashes", $mixed ] ) {
+        my ( $name, $data )= @$case;
+        $out= eval { encode_sereal( $data, { max_recursion_depth => 3 * $depth } ) };
+        ok( defined $out && length $out > $depth, "$name $depth deep: encoded" )
+            or diag($@);
+        ok( !eval { encode_sereal($data); 1 }, "$name $depth deep: default limit applies" );
+        like( $@, qr/Hit maximum recursion depth/, "... with a useful message" );
+    }
+}
+
 done_testing();
 note("All done folks!");
 
@@ -3,11 +3,42 @@
 use strict;
 use warnings;
 
-use Sereal::Encoder qw(sereal_encode_with_object);
-use Test::More tests => 2;
+use Sereal::Encoder qw(sereal_encode_with_object encode_sereal encode_sereal_with_header_data);
+use Test::More tests => 15;
 
 my $srl_encoder= Sereal::Encoder->new();
+my $empty_array_as_sereal= "=\363rl\4\0\@";
 
 my $enc= sereal_encode_with_object($srl_encoder,[]);
-is($enc,"=\363rl\4\0\@", "check that sereal_encode_with_object works");
+is($enc,$empty_array_as_sereal, "check that sereal_encode_with_object works");
+is(encode_sereal([]), $empty_array_as_sereal, "check that encode_sereal works");
+is(encode_sereal([], { snappy_threshold => 0 }), $empty_array_as_sereal,
+    "check that encode_sereal works with options");
+is(encode_sereal_with_header_data([], undef), $empty_array_as_sereal,
+    "check that encode_sereal_with_header_data works without a header");
+is(encode_sereal_with_header_data([], "hdr", {}),
+    sereal_encode_with_object($srl_encoder, [], "hdr"),
+    "check that encode_sereal_with_header_data works with a header");
+
+# the same subs called at runtime, without the custom op
+my $func= \&encode_sereal;
+is($func->([]), $empty_array_as_sereal, "encode_sereal through a code ref");
+is(&encode_sereal_with_header_data([], "hdr"),
+    sereal_encode_with_object($srl_encoder, [], "hdr"),
+    "encode_sereal_with_header_data called with &");
+ok(!eval { $func->(); 1 }, "encode_sereal without arguments dies");
+
+# the functional subs have no prototype, so an array is flattened into
+# the argument list
+my @args= ([1, 2], { compress => 0 });
+is(encode_sereal(@args), encode_sereal([1, 2]), "encode_sereal with an array of arguments");
+my @hdr_args= ([], "hdr");
+is(encode_sereal_with_header_data(@hdr_args),
+    sereal_encode_with_object($srl_encoder, [], "hdr"),
+    "encode_sereal_with_header_data with an array of arguments");
+ok(!eval { encode_sereal(@args, 1); 1 }, "... which dies if there are too many");
+ok(!eval { $func->([], {}, 1); 1 }, "encode_sereal with too many arguments dies");
+
+ok(!eval { encode_sereal([], []); 1 }, "options that are not a hash die");
+like($@, qr/encode_sereal: opt is not a HASH reference/, "... with a useful message");
 pass("did not segfault!")
@@ -0,0 +1,53 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Encoder qw(:all);
+use Sereal::Encoder::Constants qw(:all);
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of decoder';
+}
+
+# compress_threads hands large bodies to zstd's worker threads, the output
+# has to stay a plain zstd encoded Sereal document.
+
+my $big= [ map { { id => $_, name => "name $_", list => [ $_, $_ * 2, "x" x ( $_ % 50 ) ] } } 1 .. 60_000 ];
+my $small= { foo => [ 1 .. 100 ], bar => "baz" x 100 };
+my $canon= Sereal::Encoder->new( { canonical => 1 } );
+my $big_plain= $canon->encode($big);
+cmp_ok( length($big_plain), '>', 1024 * 1024, "body is large enough for multi-threaded compression" );
+
+foreach my $threads ( 0, 1, 3 ) {
+    my $enc= Sereal::Encoder->new( { compress => SRL_ZSTD, compress_threads => $threads } );
+    my $dec= Sereal::Decoder->new;
+    foreach my $run ( 1, 2 ) {    # second run reuses the zstd context
+        my $encoded= $enc->encode($big);
+        cmp_ok( length($encoded), '>', 0, "threads=$threads run $run: encoded" );
+        is( ord( substr( $encoded, 4, 1 ) ) & SRL_PROTOCOL_ENCODING_MASK,
+            SRL_PROTOCOL_ENCODING_ZSTD, "threads=$threads run $run: zstd encoded" );
+        ok( $canon->encode( $dec->decode($encoded) ) eq $big_plain, "threads=$threads run $run: roundtrip" );
+    }
+
+    is( $enc->encode($small),
+        Sereal::Encoder->new( { compress => SRL_ZSTD } )->encode($small),
+        "threads=$threads: small bodies are compressed as before" );
+}
+
+my $ok= eval { Sereal::Encoder->new( { compress => SRL_SNAPPY, compress_threads => 2 } ); 1 };
+ok( !$ok, "compress_threads requires zstd" );
+like( $@, qr/requires zstd compression/, "... with a useful message" );
+
+$ok= eval { Sereal::Encoder->new( { compress => SRL_ZSTD, compress_threads => -1 } ); 1 };
+ok( !$ok, "negative compress_threads is refused" );
+
+done_testing();
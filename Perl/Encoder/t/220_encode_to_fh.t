@@ -0,0 +1,200 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use File::Temp qw(tempdir);
+use Scalar::Util qw(weaken isweak);
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Encoder qw(:all);
+use Sereal::Encoder::Constants qw(:all);
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of decoder';
+}
+
+# encode_to_fh() writes the buffer out every flush_threshold bytes, so items
+# referenced again later may already be written out by then.
+
+my $shared= { name => "shared", list => [ 1 .. 10 ] };
+my $cycle= { name => "cycle" };
+$cycle->{self}= $cycle;
+my $str= "a string that is long enough to be deduped";
+my $scalar= "referenced scalar";
+my $data= {
+    list   => [ map { { id => $_, name => "name $_", str => $str, shared => $shared } } 1 .. 200 ],
+    shared => $shared,
+    cycle  => $cycle,
+    obj    => bless( [ 1, 2, $shared ], "Some::Class" ),
+    scalar => \$scalar,
+    again  => \$scalar,
+};
+
+my $canon= Sereal::Encoder->new( { canonical => 1 } );
+my $expect= $canon->encode($data);
+
+# not copying the arguments, which would change the refcounts the encoder sees
+sub encode_to_string {
+    open my $fh, ">", \my $out or die "Can't open in-memory file: $!";
+    $_[0]->encode_to_fh( $fh, @_[ 1 .. $#_ ] );
+    close $fh;
+    return $out;
+}
+
+my @compress= (
+    [ raw    => {} ],
+    [ zstd   => { compress => SRL_ZSTD, compress_threshold => 0 } ],
+    [ zstd_mt => { compress => SRL_ZSTD, compress_threshold => 0, compress_threads => 2 } ],
+    [ snappy => { compress => SRL_SNAPPY } ],
+    [ zlib   => { compress => SRL_ZLIB } ],
+);
+foreach my $test (@compress) {
+    my ( $name, $opt )= @$test;
+    foreach my $threshold ( 1, 100, undef ) {
+        foreach my $dedupe ( 0, 1 ) {
+            my $enc= Sereal::Encoder->new( {
+                %$opt,
+                dedupe_strings         => $dedupe,
+                aliased_dedupe_strings => $dedupe,
+                ( defined $threshold ? ( flush_threshold => $threshold ) : () ),
+            } );
+            my $what= "$name, flush_threshold=" . ( $threshold // "default" ) . ", dedupe=$dedupe";
+            foreach my $run ( 1, 2 ) {
+                my $encoded= encode_to_string( $enc, $data );
+                my $got= Sereal::Decoder->new->decode($encoded);
+                is_deeply( $got, $data, "$what run $run: roundtrip" );
+                ok( $got->{shared} == $got->{list}[-1]{shared} && $got->{shared} == $got->{obj}[2],
+                    "$what run $run: shared references" );
+                ok( $got->{cycle}{self} == $got->{cycle}, "$what run $run: cycle" );
+                ok( $got->{scalar} == $got->{again}, "$what run $run: scalar references" );
+            }
+        }
+    }
+}
+
+# without shared references and with a large enough threshold the output is
+# identical to what encode() produces
+{
+    my $plain= { list => [ map { { id => $_, name => "name $_" } } 1 .. 100 ], str => "x" x 1000 };
+    foreach my $test ( @compress[ 0, 1, 3, 4 ] ) {
+        my ( $name, $opt )= @$test;
+        my $enc= Sereal::Encoder->new($opt);
+        is( encode_to_string( $enc, $plain ), $enc->encode($plain), "$name: same output as encode()" );
+        is( encode_to_string( $enc, $plain, { hdr => 1 } ), $enc->encode( $plain, { hdr => 1 } ),
+            "$name: same output as encode() with header data" );
+    }
+}
+
+# header data
+{
+    my $enc= Sereal::Encoder->new( { flush_threshold => 1 } );
+    my $encoded= encode_to_string( $enc, $data, [ "header", $shared ] );
+    my $dec= Sereal::Decoder->new;
+    my $header= $dec->decode_only_header($encoded);
+    is_deeply( $header, [ "header", $shared ], "header data" );
+    ok( $canon->encode( $dec->decode($encoded) ) eq $expect, "body with header data" );
+    is( encode_to_string( $enc, "x", undef ), $enc->encode("x"), "undef header data means no header" );
+}
+
+# zstd documents with bodies below compress_threshold are not compressed
+{
+    my $enc= Sereal::Encoder->new( { compress => SRL_ZSTD, compress_threshold => 1_000_000 } );
+    my $encoded= encode_to_string( $enc, $data );
+    is( ord( substr( $encoded, 4, 1 ) ) & SRL_PROTOCOL_ENCODING_MASK,
+        SRL_PROTOCOL_ENCODING_RAW, "small zstd body is stored uncompressed" );
+    ok( $canon->encode( Sereal::Decoder->new->decode($encoded) ) eq $expect, "... and decodes" );
+
+    $enc= Sereal::Encoder->new( { compress => SRL_ZSTD, compress_threshold => 0, flush_threshold => 1 } );
+    $encoded= encode_to_string( $enc, $data );
+    is( ord( substr( $encoded, 4, 1 ) ) & SRL_PROTOCOL_ENCODING_MASK,
+        SRL_PROTOCOL_ENCODING_ZSTD, "large zstd body is compressed" );
+    cmp_ok( length($encoded), '<', length($expect), "... and smaller" );
+}
+
+# weak references
+{
+    my $referent= { name => "referent" };
+    my $struct= [ $referent, $referent ];
+    weaken( $struct->[1] );
+    my $got= Sereal::Decoder->new->decode(
+        encode_to_string( Sereal::Encoder->new( { flush_threshold => 1 } ), $struct ) );
+    ok( !isweak( $got->[0] ) && isweak( $got->[1] ), "weakref after the strong reference stays weak" );
+    is( $got->[0], $got->[1], "... and points at the same item" );
+
+    $struct= [ $referent, [ ( 1 ) x 10 ], $referent ];
+    weaken( $struct->[0] );
+    $got= Sereal::Decoder->new->decode(
+        encode_to_string( Sereal::Encoder->new( { flush_threshold => 1_000_000 } ), $struct ) );
+    ok( isweak( $got->[0] ) && !isweak( $got->[2] ), "weakref before the strong reference is weak if not flushed" );
+    is( $got->[0], $got->[2], "... and points at the same item" );
+
+    $got= Sereal::Decoder->new->decode(
+        encode_to_string( Sereal::Encoder->new( { flush_threshold => 1 } ), $struct ) );
+    is( $got->[0], $got->[2], "weakref before the strong reference points at the same item if flushed" );
+
+    my $alone= [ 1, 2, 3 ];
+    $struct= [ [ ( 1 ) x 10 ], $alone ];
+    weaken( $struct->[1] );
+    $got= Sereal::Decoder->new->decode(
+        encode_to_string( Sereal::Encoder->new( { flush_threshold => 1 } ), $struct ) );
+    is_deeply( $got->[1], [ 1, 2, 3 ], "weakref without strong reference keeps its referent" );
+}
+
+# errors
+{
+    my $enc= Sereal::Encoder->new( { flush_threshold => 1 } );
+    open my $in, "<", \"foo" or die;
+    ok( !eval { $enc->encode_to_fh( $in, $data ); 1 }, "dies on a handle that isn't open for writing" );
+    like( $@, qr/not open for writing/, "... with a useful message" );
+
+    my $croak= Sereal::Encoder->new( { flush_threshold => 1, croak_on_bless => 1 } );
+    ok( !eval { encode_to_string( $croak, $data ); 1 }, "dies on an error halfway through" );
+    ok( $canon->encode( Sereal::Decoder->new->decode( encode_to_string( $croak, { a => [ 1 .. 10 ] } ) ) )
+            eq $canon->encode( { a => [ 1 .. 10 ] } ),
+        "... and the encoder can be reused afterwards" );
+}
+
+# encode_to_file encodes in memory, whatever flush_threshold is set to
+{
+    my $dir= tempdir( CLEANUP => 1 );
+    my $file= File::Spec->catfile( $dir, "out.srl" );
+    my $slurp= sub {
+        open my $fh, "<:raw", $file or die "Can't open '$file': $!";
+        my $contents= do { local $/; <$fh> };
+        close $fh;
+        return $contents;
+    };
+    my $enc= Sereal::Encoder->new( { compress => SRL_ZSTD, flush_threshold => 100 } );
+    $enc->encode_to_file( $file, $data );
+    $enc->encode_to_file( $file, [ 1, 2, 3 ], 1 );
+    my $contents= $slurp->();
+    my $dec= Sereal::Decoder->new;
+    my $got= $dec->decode($contents);
+    ok( $canon->encode($got) eq $expect, "encode_to_file" );
+    is_deeply( $dec->decode( substr( $contents, $dec->bytes_consumed ) ), [ 1, 2, 3 ], "encode_to_file in append mode" );
+
+    # a weakref whose referent comes after it stays weak
+    my $plain= Sereal::Encoder->new( { flush_threshold => 100 } );
+    my $target= [1];
+    my $weak_data= [ $target, "x" x 1000, $target ];
+    weaken( $weak_data->[0] );
+    $plain->encode_to_file( $file, $weak_data );
+    my $weak_got= $dec->decode( $slurp->() );
+    ok( isweak( $weak_got->[0] ), "encode_to_file keeps weakrefs weak" );
+
+    # and leaves the file alone if encoding dies
+    my $before= $slurp->();
+    my $croaker= Sereal::Encoder->new( { flush_threshold => 100, croak_on_bless => 1 } );
+    ok( !eval { $croaker->encode_to_file( $file, [ "x" x 1000, bless( {}, "Foo" ) ], 1 ); 1 },
+        "encode_to_file dies" );
+    is( $slurp->(), $before, "... without writing anything" );
+}
+
+done_testing();
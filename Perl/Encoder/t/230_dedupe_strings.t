@@ -0,0 +1,81 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use Scalar::Util qw(refaddr);
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Encoder;
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of decoder';
+}
+
+# dedupe_strings looks strings up by content in a table of the strings
+# already written to the output buffer
+
+my @status= map { "status_$_" } 1 .. 5;
+my $data= [
+    map { { id => $_, status => $status[ $_ % 5 ], host => "host-" . ( $_ % 3 ), uniq => "unique $_" } }
+        1 .. 200
+];
+
+my $plain= Sereal::Encoder->new->encode($data);
+foreach my $opt ( { dedupe_strings => 1 }, { aliased_dedupe_strings => 1 } ) {
+    my ($name)= keys %$opt;
+    my $enc= Sereal::Encoder->new($opt);
+    my $encoded= $enc->encode($data);
+    cmp_ok( length($encoded), '<', length($plain) - 1000, "$name: output is smaller" );
+    is_deeply( Sereal::Decoder->new->decode($encoded), $data, "$name: roundtrip" );
+    is( $enc->encode($data), $encoded, "$name: reused encoder gives the same output" );
+}
+
+# strings differing only in UTF8-ness or in the last byte
+{
+    my $latin1= "caf\xe9 au lait";
+    my $utf8= $latin1;
+    utf8::upgrade($utf8);
+    my $wide= "\x{263a} smile";
+    my $strs= [ $latin1, $utf8, $latin1, $utf8, $wide, $wide, "abcdefgh", "abcdefgi", "abcdefgh" ];
+    my $got= Sereal::Decoder->new->decode( Sereal::Encoder->new( { dedupe_strings => 1 } )->encode($strs) );
+    is_deeply( $got, $strs, "strings differing in UTF8-ness or content" );
+    is_deeply( [ map { utf8::is_utf8($_) ? 1 : 0 } @$got ], [ 0, 1, 0, 1, 1, 1, 0, 0, 0 ], "... keep their UTF8-ness" );
+
+    my $long= [ ( "x" x 100_000 ) x 3, ( "x" x 99_999 ) . "y" ];
+    my $encoded= Sereal::Encoder->new( { dedupe_strings => 1 } )->encode($long);
+    cmp_ok( length($encoded), '<', 250_000, "long strings are deduped" );
+    is_deeply( Sereal::Decoder->new->decode($encoded), $long, "... and roundtrip" );
+}
+
+# aliases point at the first occurrence
+{
+    my $got= Sereal::Decoder->new->decode(
+        Sereal::Encoder->new( { aliased_dedupe_strings => 1 } )->encode( [ "dupe me", "other", "dupe me" ] ) );
+    is( refaddr( \$got->[0] ), refaddr( \$got->[2] ), "aliased_dedupe_strings aliases the duplicate" );
+}
+
+# many distinct strings, so that the table grows, and a budget
+{
+    my $many= [ map { ( "string number $_", "string number $_" ) } 1 .. 5000 ];
+    my $full= Sereal::Encoder->new( { dedupe_strings => 1 } )->encode($many);
+    is_deeply( Sereal::Decoder->new->decode($full), $many, "many strings roundtrip" );
+
+    my $enc= Sereal::Encoder->new( { dedupe_strings => 1, dedupe_strings_budget => 4096 } );
+    my $budget= $enc->encode($many);
+    is_deeply( Sereal::Decoder->new->decode($budget), $many, "many strings with a budget roundtrip" );
+    cmp_ok( length($budget), '>', length($full), "... but fewer get deduped" );
+    cmp_ok( length($budget), '<', length( Sereal::Encoder->new->encode($many) ), "... though some still do" );
+    is( $enc->encode($many), $budget, "... also when reusing the encoder" );
+
+    my $tiny= Sereal::Encoder->new( { dedupe_strings => 1, dedupe_strings_budget => 1 } );
+    is_deeply( Sereal::Decoder->new->decode( $tiny->encode($many) ), $many, "tiny budget roundtrip" );
+}
+
+done_testing();
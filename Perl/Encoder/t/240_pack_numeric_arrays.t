@@ -0,0 +1,135 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use File::Temp qw(tempfile);
+use Scalar::Util qw(refaddr);
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Encoder qw(:all);
+use Sereal::Encoder::Constants qw(:all);
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of decoder';
+}
+
+# pack_numeric_arrays writes arrays of numbers of the same kind as MANY,
+# without a tag for each item
+
+my $packer= Sereal::Encoder->new( { pack_numeric_arrays => 1 } );
+my $many= chr(SRL_HDR_MANY);
+
+sub is_packed {
+    my ( $encoded, $type )= @_;
+    return $encoded =~ /\Q$many\E(?:[\x80-\xff]*[\x00-\x7f])\Q${\ chr $type}\E/;
+}
+
+my @cases= (
+    [ "small integers",   [ 1 .. 100 ],                         SRL_HDR_VARINT ],
+    [ "large integers",   [ map { $_ * 1_000_003 } 1 .. 100 ],  SRL_HDR_VARINT ],
+    [ "max UV",           [ ~0, 1 .. 10 ],                      SRL_HDR_VARINT ],
+    [ "negative",         [ map { $_ * 1000 } -50 .. 50 ],      SRL_HDR_ZIGZAG ],
+    [ "floats",           [ map { $_ / 4 } -50 .. 50 ],         SRL_HDR_FLOAT ],
+    [ "doubles",          [ map { $_ / 3 } 1 .. 100 ],          SRL_HDR_DOUBLE ],
+    [ "large array",      [ 1 .. 100_000 ],                     SRL_HDR_VARINT ],
+);
+foreach my $case (@cases) {
+    my ( $name, $data, $type )= @$case;
+    my $encoded= $packer->encode($data);
+    ok( is_packed( $encoded, $type ), "$name: packed" );
+    is_deeply( Sereal::Decoder->new->decode($encoded), $data, "$name: roundtrip" );
+    is_deeply(
+        Sereal::Decoder->new->decode($encoded),
+        Sereal::Decoder->new->decode( Sereal::Encoder->new->encode($data) ),
+        "$name: same as unpacked"
+    );
+}
+
+# arrays that are not packed
+{
+    my $shared= 5;
+    {
+
+        package My::TiedArray;
+        require Tie::Array;
+        our @ISA= ('Tie::StdArray');
+    }
+    tie my @tied, 'My::TiedArray';
+    @tied= 1 .. 20;
+    my @not_packed= (
+        [ "short",                [ 1 .. 7 ] ],
+        [ "mixed ints and floats", [ 1 .. 10, 0.5 ] ],
+        [ "strings",              [ map { "$_" } 1 .. 20 ] ],
+        [ "undef",                [ 1 .. 10, undef ] ],
+        [ "references",           [ ( \1 ) x 10 ] ],
+        [ "UV and negative",      [ ~0, -1, 1 .. 10 ] ],
+        [ "referenced item",      [ 1 .. 10, \$shared ] ],
+        [ "tied",                 \@tied ],
+    );
+    foreach my $case (@not_packed) {
+        my ( $name, $data )= @$case;
+        my $encoded= $packer->encode($data);
+        unlike( $encoded, qr/\Q$many\E/, "$name: not packed" );
+        is_deeply( Sereal::Decoder->new->decode($encoded), [@$data], "$name: roundtrip" );
+    }
+
+    my @items= 1 .. 20;
+    my $got= Sereal::Decoder->new->decode( $packer->encode( [ \@items, \$items[3] ] ) );
+    is_deeply( $got->[0], \@items, "array with an item referenced elsewhere" );
+    is( refaddr( \$got->[0][3] ), refaddr( $got->[1] ), "... keeps the reference" );
+}
+
+# shared and cyclic arrays keep their identity
+{
+    my $list= [ 1 .. 50 ];
+    my $got= Sereal::Decoder->new->decode( $packer->encode( { a => $list, b => $list } ) );
+    is_deeply( $got->{a}, $list, "shared array" );
+    is( refaddr( $got->{a} ), refaddr( $got->{b} ), "... is still shared" );
+
+    my $holder= { list => [ 1 .. 50 ] };
+    $holder->{self}= $holder;
+    $got= Sereal::Decoder->new->decode( $packer->encode( [ $holder, \$holder->{list} ] ) );
+    is_deeply( $got->[0]{list}, [ 1 .. 50 ], "array in a cycle" );
+    is( refaddr( $got->[0]{self} ), refaddr( $got->[0] ), "... keeps the cycle" );
+}
+
+# decoder options apply to the items
+{
+    my $encoded= $packer->encode( [ map { $_ % 4 } 1 .. 100 ] );
+    my $got= Sereal::Decoder->new( { set_readonly => 1 } )->decode($encoded);
+    ok( Internals::SvREADONLY( $got->[0] ), "set_readonly makes the items readonly" );
+
+    $got= Sereal::Decoder->new( { alias_varint_under => 4 } )->decode($encoded);
+    ok( Internals::SvREADONLY( $got->[0] ), "alias_varint_under aliases the items" );
+    is_deeply( $got, [ map { $_ % 4 } 1 .. 100 ], "... with the right values" );
+}
+
+# streaming with a tiny flush threshold
+{
+    my $data= [ [ 1 .. 10_000 ], [ map { $_ / 3 } 1 .. 10_000 ] ];
+    my ( $fh, $file )= tempfile( UNLINK => 1 );
+    binmode $fh;
+    Sereal::Encoder->new( { pack_numeric_arrays => 1, flush_threshold => 1 } )->encode_to_fh( $fh, $data );
+    close $fh;
+    is_deeply( Sereal::Decoder->new->decode_from_file($file), $data, "encode_to_fh" );
+}
+
+# truncated and corrupt documents
+{
+    my $encoded= $packer->encode( [ map { $_ / 3 } 1 .. 100 ] );
+    ok( !eval { Sereal::Decoder->new->decode( substr( $encoded, 0, -5 ) ); 1 }, "truncated MANY dies" );
+    like( $@, qr/Unexpected termination of packet/, "... with a useful message" );
+
+    ( my $bad= $encoded ) =~ s/(\Q$many\E[\x80-\xff]*[\x00-\x7f])\Q${\ chr SRL_HDR_DOUBLE}\E/$1\x28/;
+    ok( !eval { Sereal::Decoder->new->decode($bad); 1 }, "MANY of strings dies" );
+    like( $@, qr/Unsupported item type/, "... with a useful message" );
+}
+
+done_testing();
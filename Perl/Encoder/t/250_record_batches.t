@@ -0,0 +1,156 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use Scalar::Util qw(refaddr weaken);
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Encoder qw(:all);
+use Sereal::Encoder::Constants qw(:all);
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of decoder';
+}
+
+# record_batches writes arrays of hashes with the same keys as RECORDS, with
+# the keys once and the values column by column
+
+my $batcher= Sereal::Encoder->new( { record_batches => 1 } );
+my $records= chr(SRL_HDR_RECORDS);
+
+sub decode {
+    my ( $opt, $encoded )= @_;
+    return Sereal::Decoder->new($opt)->decode($encoded);
+}
+
+sub rows {
+    my ($n)= @_;
+    return [ map { { id => $_, name => "row $_", score => $_ / 4, tags => [ 1, 2 ] } } 1 .. $n ];
+}
+
+# a document with a single batch starts with REFN RECORDS
+sub is_batched {
+    my ($encoded)= @_;
+    return $encoded =~ /\Q${\ chr SRL_HDR_REFN}$records/;
+}
+
+{
+    foreach my $n ( 2, 3, 100, 10_000 ) {
+        my $data= rows($n);
+        my $encoded= $batcher->encode($data);
+        my $plain= Sereal::Encoder->new->encode($data);
+        ok( is_batched($encoded), "$n rows: batched" );
+        ok( length $encoded < length $plain, "$n rows: smaller than plain" );
+        is_deeply( decode( {}, $encoded ), $data, "$n rows: roundtrip" );
+    }
+
+    my $data= { list => rows(5), nested => [ rows(3), rows(4) ], empty => [] };
+    is_deeply( decode( {}, $batcher->encode($data) ), $data, "nested batches" );
+
+    my $utf8= [ map { { "\x{263a}" => $_, "caf\x{e9}" => "\x{263a} $_" } } 1 .. 5 ];
+    is_deeply( decode( {}, $batcher->encode($utf8) ), $utf8, "utf8 keys and values" );
+}
+
+# arrays that are not batched
+{
+    my $shared= { a => 1 };
+    my $blessed= [ map { bless { a => $_ }, 'Foo' } 1 .. 3 ];
+    my $tied= do {
+        require Tie::Hash;
+        tie my %h, 'Tie::StdHash';
+        %h= ( a => 3 );
+        [ { a => 1 }, { a => 2 }, \%h ];
+    };
+    my $weak= [ { a => 1 }, { a => 2 } ];
+    weaken( $weak->[1] );
+    my $keep= $weak->[1];
+
+    my @not_batched= (
+        [ "single hash",     [ { a => 1 } ] ],
+        [ "different keys",  [ { a => 1 }, { b => 1 } ] ],
+        [ "more keys",       [ { a => 1 }, { a => 1, b => 2 } ] ],
+        [ "empty hashes",    [ {}, {} ] ],
+        [ "non-hash item",   [ { a => 1 }, [ 1 ] ] ],
+        [ "scalar item",     [ { a => 1 }, 1 ] ],
+        [ "shared hash",     [ { a => 1 }, $shared, $shared ] ],
+        [ "blessed hashes",  $blessed ],
+        [ "tied hash",       $tied ],
+        [ "weak reference",  $weak ],
+    );
+    foreach my $case (@not_batched) {
+        my ( $name, $data )= @$case;
+        my $encoded= $batcher->encode($data);
+        ok( !is_batched($encoded), "$name: not batched" );
+        is_deeply( decode( {}, $encoded ), [@$data], "$name: roundtrip" );
+    }
+}
+
+# sort_keys gives the same output for the same data
+{
+    my @keys= map { "key$_" } 1 .. 20;
+    my ( @a, @b );
+    foreach my $i ( 1 .. 5 ) {
+        my ( %x, %y );
+        $x{$_}= $i for @keys;
+        $y{$_}= $i for reverse @keys;
+        push @a, \%x;
+        push @b, \%y;
+    }
+    foreach my $sort ( 1, 2 ) {
+        my $enc= Sereal::Encoder->new( { record_batches => 1, sort_keys => $sort } );
+        is( $enc->encode( \@a ), $enc->encode( \@b ), "sort_keys $sort: canonical" );
+        is_deeply( decode( {}, $enc->encode( \@a ) ), \@a, "sort_keys $sort: roundtrip" );
+    }
+}
+
+# references into the values and shared values keep their identity
+{
+    my $list= [ 1, 2, 3 ];
+    my $data= [ map { { id => $_, list => $list } } 1 .. 3 ];
+    my $got= decode( {}, $batcher->encode( [ $data, \$data->[1]{id} ] ) );
+    is_deeply( $got->[0], $data, "values referenced elsewhere" );
+    is( refaddr( $got->[0][0]{list} ), refaddr( $got->[0][2]{list} ), "... shared value is still shared" );
+    is( refaddr( \$got->[0][1]{id} ), refaddr( $got->[1] ), "... reference to a value is kept" );
+}
+
+# decoder options apply to the records
+{
+    my $encoded= $batcher->encode( rows(10) );
+    my $got= decode( { set_readonly => 1 }, $encoded );
+    ok( Internals::SvREADONLY( $got->[0] ),       "set_readonly makes the records readonly" );
+    ok( Internals::SvREADONLY( %{ $got->[0] } ),  "... and their hashes" );
+    ok( Internals::SvREADONLY( $got->[0]{name} ), "... and their values" );
+
+    ok( eval { decode( { max_num_hash_entries => 4 }, $encoded ); 1 }, "max_num_hash_entries allows as many keys" );
+    ok( !eval { decode( { max_num_hash_entries => 3 }, $encoded ); 1 }, "max_num_hash_entries refuses more keys" );
+    like( $@, qr/configured maximum/, "... with a useful message" );
+}
+
+# truncated and corrupt documents
+{
+    my $encoded= $batcher->encode( rows(10) );
+    ok( !eval { decode( {}, substr( $encoded, 0, -5 ) ); 1 }, "truncated RECORDS dies" );
+    like( $@, qr/unexpected (?:end of input|termination of packet)/i, "... with a useful message" );
+
+    ( my $bad= $encoded ) =~ s/$records\x0a\x04/$records\x0a\x00/;
+    ok( !eval { decode( {}, $bad ); 1 }, "RECORDS without keys dies" );
+    like( $@, qr/records without keys/, "... with a useful message" );
+
+    my $pairs= [ map { { a => $_, b => $_ } } 1 .. 3 ];
+    ( $bad= $batcher->encode($pairs) ) =~ s/\x61b/\x61a/;
+    ok( !eval { decode( {}, $bad ); 1 }, "RECORDS with duplicate keys dies" );
+    like( $@, qr/duplicate key in record batch/, "... with a useful message" );
+
+    ( $bad= $encoded ) =~ s/$records\x0a\x04/$records\x7f\x04/;
+    ok( !eval { decode( {}, $bad ); 1 }, "RECORDS with too many records dies" );
+    like( $@, qr/Unexpected termination of packet/, "... with a useful message" );
+}
+
+done_testing();
@@ -0,0 +1,92 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use File::Temp qw(tempfile);
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Encoder qw(:all);
+use Sereal::Encoder::Constants qw(:all);
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of decoder';
+}
+
+# Runs of plain integers in arrays are written together, with room made for
+# the whole run at once and their varints written a word at a time. They
+# must come out exactly as if they were written one by one.
+
+sub int_tag {
+    my $n= shift;
+    return chr( SRL_HDR_POS_LOW + $n ) if $n >= 0 && $n <= 15;
+    return chr( SRL_HDR_NEG_LOW + 16 + $n ) if $n < 0 && $n >= -16;
+    return chr(SRL_HDR_VARINT) . varint($n) if $n >= 0;
+    return chr(SRL_HDR_ZIGZAG) . varint( -( $n + 1 ) * 2 + 1 );
+}
+
+# the tagged items, one by one; looks at copies so as not to make the
+# integers strings too
+sub item_tags {
+    return map {
+        my $item= $_;
+        !defined $item         ? chr(SRL_HDR_UNDEF)
+        : $item =~ /^-?\d+\z/ ? int_tag($item)
+        :                        short_string($item)
+    } @_;
+}
+
+my $enc= Sereal::Encoder->new();
+my $dec= Sereal::Decoder->new();
+
+# every varint length, either side of each boundary, and the largest values
+my @values= ( 0, 1, 15, 16, map { ( ( 1 << $_ ) - 1, 1 << $_ ) } 5 .. 63 );
+push @values, ~0, ~0 - 1;
+my @negatives= ( -1, -16, -17, map { ( -( 1 << $_ ), -( 1 << $_ ) - 1 ) } 5 .. 62 );
+push @negatives, -9223372036854775807 - 1 if ~0 > 4294967295;
+
+my @cases= (
+    [ "positive", [@values] ],
+    [ "negative", [@negatives] ],
+    [ "interleaved", [ map { ( $values[$_], $negatives[ $_ % @negatives ] ) } 0 .. $#values ] ],
+    [ "long run", [ map { $values[ $_ % @values ] } 1 .. 2500 ] ],
+    [ "runs between strings", [ map { $_ % 7 ? $values[ $_ % @values ] : "s$_" } 1 .. 2500 ] ],
+    [ "runs between undefs", [ map { $_ % 5 ? $negatives[ $_ % @negatives ] : undef } 1 .. 100 ] ],
+);
+foreach my $case (@cases) {
+    my ( $name, $data )= @$case;
+    my $encoded= $enc->encode($data);
+    is( $encoded, Header() . array( item_tags(@$data) ), "$name: same bytes as one at a time" );
+    is_deeply( $dec->decode($encoded), $data, "$name: roundtrip" );
+}
+
+# integers that can't be written in a run stop it, and are written normally
+{
+    my $shared= 1000;
+    my $data= [ 1000, "1000", 1000.5, \$shared, 1000, [ 1000, 2000 ], 1000, $shared, 1 .. 20 ];
+    my $both= 1234;
+    my $str= "$both";    # now a string too
+    push @$data, $both, 5;
+    is_deeply( $dec->decode( $enc->encode($data) ), $data, "mixed with other scalars and references" );
+}
+
+# streaming with a tiny flush threshold writes the same bytes
+{
+    my $data= [ [ map { $values[ $_ % @values ] } 1 .. 5000 ], [ map { $_ % 3 ? -$_ : "x$_" } 1 .. 5000 ] ];
+    my ( $fh, $file )= tempfile( UNLINK => 1 );
+    binmode $fh;
+    Sereal::Encoder->new( { flush_threshold => 1 } )->encode_to_fh( $fh, $data );
+    close $fh;
+    open $fh, "<", $file or die $!;
+    binmode $fh;
+    my $streamed= do { local $/; <$fh> };
+    is( $streamed, $enc->encode($data), "encode_to_fh" );
+}
+
+done_testing();
@@ -0,0 +1,162 @@
+#!perl
+use strict;
+use warnings;
+use B ();
+use File::Spec;
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Encoder qw(:all);
+use Sereal::Encoder::Constants qw(:all);
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of decoder';
+}
+
+# encode_into() writes the document straight into the buffer of the target
+# string, so it must come out exactly as encode() would have returned it.
+
+my $shared= [ 1 .. 10 ];
+my $weak= { name => "weak" };
+my $data= {
+    list   => [ map { { id => $_, name => "name $_", shared => $shared } } 1 .. 100 ],
+    shared => $shared,
+    weak   => $weak,
+    str    => "x" x 1000,
+    obj    => bless( [ 1, 2 ], "Some::Class" ),
+};
+$data->{weak_ref}= $weak;
+Scalar::Util::weaken( $data->{weak_ref} );
+my $small= [ 1, "two", 3.5 ];
+
+my $dec= Sereal::Decoder->new();
+
+sub buf_len { return B::svref_2object( \$_[0] )->LEN }
+
+my @opts= (
+    [ raw    => {} ],
+    [ v1     => { protocol_version => 1 } ],
+    [ v2     => { protocol_version => 2 } ],
+    [ zstd   => { compress => SRL_ZSTD, compress_threshold => 0 } ],
+    [ snappy => { compress => SRL_SNAPPY, compress_threshold => 0 } ],
+    [ zlib   => { compress => SRL_ZLIB, compress_threshold => 0 } ],
+);
+foreach my $test (@opts) {
+    my ( $name, $opt )= @$test;
+    my $enc= Sereal::Encoder->new($opt);
+    my $expect= $enc->encode($data);
+    my $expect_small= $enc->encode($small);
+
+    my $buf;
+    is( $enc->encode_into( $buf, $data ), length $expect, "$name: returns the length" );
+    is( $buf, $expect, "$name: into undef" );
+    is_deeply( $dec->decode($buf), $data, "$name: roundtrip" );
+
+    $buf= "some previous content that is overwritten";
+    $enc->encode_into( $buf, $small );
+    is( $buf, $expect_small, "$name: overwrites" );
+
+    $buf= "prefix";
+    is( $enc->encode_into( $buf, $data, 1 ), length $expect, "$name: append returns the length" );
+    $enc->encode_into( $buf, $small, 1 );
+    is( $buf, "prefix" . $expect . $expect_small, "$name: appends" );
+    my $pos= length "prefix";
+    foreach my $want ( $data, $small ) {
+        is_deeply( $dec->decode_with_offset( $buf, $pos ), $want, "$name: decode appended document" );
+        $pos+= $dec->bytes_consumed;
+    }
+    is( $pos, length $buf, "$name: consumed all" );
+
+    is( $enc->encode($data), $expect, "$name: encode still works afterwards" );
+}
+
+my $enc= Sereal::Encoder->new();
+my $expect= $enc->encode($data);
+
+# the allocation is kept from one call to the next
+{
+    my $buf;
+    $enc->encode_into( $buf, $data );
+    my $len= buf_len($buf);
+    cmp_ok( $len, '>', length $expect, "string's buffer is allocated" );
+    $enc->encode_into( $buf, $small ) for 1 .. 10;
+    is( buf_len($buf), $len, "overwriting with smaller documents keeps the allocation" );
+    $enc->encode_into( $buf, $data );
+    is( buf_len($buf), $len, "and reuses it for larger ones" );
+    is( $buf, $expect, "same bytes" );
+}
+
+# whatever the target held is turned into a byte string first
+{
+    my $buf= 42;
+    $enc->encode_into( $buf, $small, 1 );
+    is( $buf, "42" . $enc->encode($small), "appended to a number" );
+
+    $buf= "caf\x{e9}";
+    utf8::upgrade($buf);
+    $enc->encode_into( $buf, $small, 1 );
+    ok( !utf8::is_utf8($buf), "appending downgrades" );
+    is( $buf, "caf\x{e9}" . $enc->encode($small), "appended to an upgraded string" );
+
+    $buf= "\x{263a}";
+    ok( !eval { $enc->encode_into( $buf, $small, 1 ); 1 }, "can't append to wide characters" );
+    like( $@, qr/wide characters/, "error message" );
+    is( $buf, "\x{263a}", "left alone" );
+
+    $buf= [ 1, 2, 3 ];
+    $enc->encode_into( $buf, $small );
+    is( $buf, $enc->encode($small), "into a scalar holding a reference" );
+
+    ok( !eval { $enc->encode_into( "constant", $small ); 1 }, "can't encode into a constant" );
+}
+
+# the target reads as undef while it is being written to
+{
+    my $buf= "old";
+    $enc->encode_into( $buf, [ \$buf, $small ] );
+    is_deeply( $dec->decode($buf), [ \undef, $small ], "target referenced by the data" );
+}
+
+# on errors the target keeps what it had when appending, and the encoder
+# keeps working
+{
+    my $croak= Sereal::Encoder->new( { croak_on_bless => 1 } );
+    my $buf= "prefix";
+    ok( !eval { $croak->encode_into( $buf, [ 1 .. 1000, bless( {}, "Foo" ) ], 1 ); 1 }, "croaks" );
+    is( $buf, "prefix", "appending: target unchanged" );
+    $croak->encode_into( $buf, $small, 1 );
+    is( $buf, "prefix" . $croak->encode($small), "then appends fine" );
+
+    $buf= "prefix";
+    ok( !eval { $croak->encode_into( $buf, bless( {}, "Foo" ) ); 1 }, "croaks" );
+    is( $buf, "", "overwriting: target emptied" );
+}
+
+# FREEZE hooks that encode with the same encoder get a fresh one
+{
+    package Freezer;
+    our $enc;
+    sub new { bless { value => $_[1] }, $_[0] }
+    sub FREEZE {
+        my $buf;
+        $enc->encode_into( $buf, $_[0]{value} );
+        return $buf;
+    }
+    sub THAW { return Freezer->new( Sereal::Decoder->new->decode( $_[2] ) ) }
+
+    package main;
+    $Freezer::enc= Sereal::Encoder->new( { freeze_callbacks => 1 } );
+    my $obj= [ Freezer->new($small), Freezer->new($data) ];
+    my $buf;
+    $Freezer::enc->encode_into( $buf, $obj );
+    is( $buf, $Freezer::enc->encode($obj), "nested encode_into" );
+    is_deeply( Sereal::Decoder->new->decode($buf), $obj, "roundtrip" );
+}
+
+done_testing();
@@ -0,0 +1,144 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use File::Temp qw(tempfile);
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Encoder qw(:all);
+use Sereal::Encoder::Constants qw(:all);
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of decoder';
+}
+
+# With zero_copy_strings_over, encode_to_fh() writes long strings to the
+# file handle straight from the Perl string, so the output must be the same
+# as that of encode(), whichever way the strings are referred to.
+
+my $blob= join "", map { chr( $_ % 256 ) } 1 .. 100_000;
+my $text= "\x{263a} smile " x 2000;
+my $key= "k" x 5000;
+
+sub make_data {
+    my ($with_refs)= @_;
+    my $data= {
+        blob   => $blob,
+        text   => $text,
+        blobs  => [ ( $blob, "short" ) x 3 ],
+        $key   => [ $key, "x" x 300 ],
+        nested => [ map { { id => $_, payload => "p" x ( 100 * $_ ) } } 1 .. 20 ],
+    };
+    if ($with_refs) {
+        $data->{refs}= [ \$blob, \$blob ];
+        $data->{again}= $data->{refs};
+    }
+    return $data;
+}
+
+my $dec= Sereal::Decoder->new();
+
+sub slurp {
+    my ($file)= @_;
+    open my $fh, "<", $file or die "Can't open $file: $!";
+    binmode $fh;
+    local $/;
+    return scalar <$fh>;
+}
+
+# not copying the arguments, which would change the refcounts the encoder sees
+sub encode_to_file {
+    my ( $fh, $file )= tempfile( UNLINK => 1 );
+    binmode $fh;
+    print $fh "before";
+    $_[0]->encode_to_fh( $fh, $_[1] );
+    my $tell= tell $fh;
+    print $fh "after";
+    close $fh or die "Can't close $file: $!";
+    my $out= slurp($file);
+    is( $tell, length($out) - length("after"), "tell() knows where we are" );
+    return substr( $out, length("before"), -length("after") );
+}
+
+sub encode_to_string {
+    open my $fh, ">", \my $out or die "Can't open in-memory file: $!";
+    $_[0]->encode_to_fh( $fh, $_[1] );
+    close $fh;
+    return $out;
+}
+
+# Strings that were written out can't be compared to for dedupe_strings any
+# more, so with it the output is only the same as that of encode() if the
+# strings that are repeated aren't written out. The decoder doesn't take an
+# ALIAS right after a REFN, so the references are left out when aliasing.
+# The documents are looked up here rather than copied around, as another
+# reference to them changes what encode_to_fh() tracks.
+my %data= ( refs => make_data(1), no_refs => make_data(0) );
+my @opts= (
+    [ plain     => {} ],
+    [ dedupe    => { dedupe_strings => 1 },         200_000 ],
+    [ aliased   => { aliased_dedupe_strings => 1 }, 200_000, 'no_refs' ],
+    [ no_shared => { no_shared_hashkeys => 1 } ],
+    [ v1        => { protocol_version => 1 } ],
+);
+foreach my $test (@opts) {
+    my ( $name, $opt, $same_over, $which )= @$test;
+    $which ||= 'refs';
+    my $expect= Sereal::Encoder->new( { %$opt, canonical => 1 } )->encode( $data{$which} );
+    foreach my $over ( 1, 200, 200_000 ) {
+        foreach my $flush ( 1_000_000, undef ) {
+            my $enc= Sereal::Encoder->new(
+                { %$opt, canonical => 1, zero_copy_strings_over => $over, flush_threshold => $flush } );
+            my $what= "$name, zero_copy_strings_over => $over, flush_threshold => " . ( $flush // "default" );
+            my $got= encode_to_file( $enc, $data{$which} );
+            is_deeply( $dec->decode($got), $data{$which}, "$what: roundtrip" );
+            is( encode_to_string( $enc, $data{$which} ), $got, "$what: in-memory file handle" );
+            is( $got, $expect, "$what: same as encode" )
+                if !$same_over || $over >= $same_over;
+        }
+    }
+}
+
+# ignored when compressing
+{
+    my $opt= { compress => SRL_ZSTD, compress_threshold => 0 };
+    my $enc= Sereal::Encoder->new( { %$opt, canonical => 1, zero_copy_strings_over => 100 } );
+    my $got= encode_to_file( $enc, $data{refs} );
+    is_deeply( $dec->decode($got), $data{refs}, "zstd roundtrip" );
+    is( $got, encode_to_string( Sereal::Encoder->new( { %$opt, canonical => 1 } ), $data{refs} ), "zstd same bytes" );
+}
+
+# and by encode
+{
+    my $enc= Sereal::Encoder->new( { canonical => 1, zero_copy_strings_over => 100 } );
+    is( $enc->encode($data{refs}), Sereal::Encoder->new( { canonical => 1 } )->encode($data{refs}), "encode unaffected" );
+}
+
+# through a pipe, with writes that may be partial
+SKIP: {
+    skip "no fork", 2 if $^O eq 'MSWin32';
+    my $enc= Sereal::Encoder->new( { canonical => 1, zero_copy_strings_over => 1000 } );
+    my $big= { list => [ ($blob) x 50 ] };
+    my $pid= open my $fh, "-|";
+    die "Can't fork: $!" if !defined $pid;
+    if ( !$pid ) {
+        binmode STDOUT;
+        $enc->encode_to_fh( \*STDOUT, $big );
+        close STDOUT;
+        exit 0;
+    }
+    binmode $fh;
+    my $got= do { local $/; <$fh> };
+    close $fh;
+    is( $got, $enc->encode($big), "pipe" );
+    is_deeply( $dec->decode($got), $big, "pipe roundtrip" );
+}
+
+done_testing();
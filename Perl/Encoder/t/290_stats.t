@@ -0,0 +1,198 @@
+#!perl
+use strict;
+use warnings;
+use File::Spec;
+use Scalar::Util ();
+use lib File::Spec->catdir(qw(t lib));
+
+BEGIN {
+    lib->import('lib')
+        if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+use Sereal::Encoder qw(:all);
+use Sereal::Encoder::Constants qw(:all);
+
+if ( not have_encoder_and_decoder() ) {
+    plan skip_all => 'Did not find right version of decoder';
+}
+
+# The stats option counts the tags of every document as they end up in the
+# output, however the document is written.
+
+my $header_len= 6;    # magic, version and an empty user header
+
+# the counters that don't depend on how the document was written
+sub counts {
+    my ($stats)= @_;
+    my %counts= %$stats;
+    delete @counts{qw(buffer_grows compress_time tables)};
+    return \%counts;
+}
+
+{
+    my $enc= Sereal::Encoder->new();
+    is( $enc->stats, undef, "no stats without the option" );
+    $enc->reset_stats;
+    is( $enc->stats, undef, "reset_stats does nothing without it" );
+}
+
+{
+    my $enc= Sereal::Encoder->new( { stats => 1 } );
+    my $stats= $enc->stats;
+    is( $stats->{documents},  0, "nothing counted yet" );
+    is( $stats->{body_bytes}, 0, "no bytes yet" );
+    is_deeply( $stats->{tags}, {}, "no tags yet" );
+
+    my $doc= $enc->encode( { list => [ 1, 2, 3 ], neg => -1, pi => 3.25 } );
+    $stats= $enc->stats;
+    is( $stats->{documents},  1,                          "one document" );
+    is( $stats->{body_bytes}, length($doc) - $header_len, "body_bytes is the length of the body" );
+    is( $stats->{tags}{$_->[0]}, $_->[1], "$_->[0] tags" )
+        for [ HASHREF => 1 ], [ SHORT_BINARY => 3 ], [ POS => 3 ], [ NEG => 1 ], [ FLOAT => 1 ];
+    is( $stats->{bytes}{integer}, 4,     "integer bytes" );
+    is( $stats->{bytes}{float},   5,     "float bytes" );
+    is( $stats->{bytes}{string},  3 + 9, "string bytes" );
+    my $sum= 0;
+    $sum += $_ for values %{ $stats->{bytes} };
+    is( $sum, $stats->{body_bytes}, "the bytes add up to body_bytes" );
+
+    $enc->encode("x");
+    is( $enc->stats->{documents},          2, "counts add up" );
+    is( $enc->stats->{tags}{POS},          3, "tags add up" );
+    is( $enc->stats->{tags}{SHORT_BINARY}, 4, "tags add up" );
+
+    $enc->reset_stats;
+    is( $enc->stats->{documents},  0, "reset_stats starts over" );
+    is( $enc->stats->{body_bytes}, 0, "with the bytes too" );
+}
+
+{
+    my $enc= Sereal::Encoder->new( { stats => 1 } );
+    my $shared= [1];
+    $enc->encode( [ { key => 1 }, { key => 2 }, $shared, $shared ] );
+    my $stats= $enc->stats;
+    is( $stats->{copy},                     1,   "COPY of a hash key" );
+    is( $stats->{refp},                     1,   "REFP" );
+    is( $stats->{tracked},                  1,   "the array REFP refers to is tracked" );
+    is( $stats->{shared_hashkeys}{lookups}, 2,   "shared hash key lookups" );
+    is( $stats->{shared_hashkeys}{hits},    1,   "shared hash key hits" );
+    is( $stats->{shared_hashkeys}{ratio},   0.5, "shared hash key ratio" );
+    ok( $stats->{tables}{seen_refs},       "seen_refs table" );
+    ok( $stats->{tables}{shared_hashkeys}, "shared_hashkeys table" );
+    ok( !$stats->{tables}{dedupe_strings}, "no dedupe_strings table" );
+}
+
+foreach my $opt ( [ dedupe_strings => 'COPY' ], [ aliased_dedupe_strings => 'ALIAS' ] ) {
+    my ( $name, $tag )= @$opt;
+    my $enc= Sereal::Encoder->new( { stats => 1, $name => 1 } );
+    $enc->encode( [ "some string", "some string", "other string" ] );
+    my $stats= $enc->stats;
+    is( $stats->{dedupe_strings}{lookups},       3, "$name: lookups" );
+    is( $stats->{dedupe_strings}{hits},          1, "$name: hits" );
+    is( $stats->{tags}{$tag},                    1, "$name: $tag" );
+    is( $stats->{tables}{dedupe_strings}{grows}, 0, "$name: dedupe_strings table" );
+}
+
+{
+    my $enc= Sereal::Encoder->new( { stats => 1, pack_numeric_arrays => 1 } );
+    my $doc= $enc->encode( [ 1 .. 100, 1000 .. 1100 ] );
+    my $stats= $enc->stats;
+    is( $stats->{tags}{MANY},  1,                          "packed array" );
+    is( $stats->{tags}{POS},   undef,                      "its items have no tag" );
+    is( $stats->{body_bytes},  length($doc) - $header_len, "but their bytes are counted" );
+    cmp_ok( $stats->{bytes}{integer}, '>', 201, "as integers" );
+}
+
+{
+    my $enc= Sereal::Encoder->new( { stats => 1 } );
+    $enc->encode( [ map { "x" x 1000 } 1 .. 100 ] );
+    cmp_ok( $enc->stats->{buffer_grows}, '>', 0, "buffer_grows" );
+}
+
+# the same counts whichever way the document is written, in canonical order
+# as a weakref that is written out before its referent becomes a PAD when
+# streaming
+my $blob= join "", map { chr( $_ % 256 ) } 1 .. 50_000;
+sub make_data {
+    my $weak= { name => "weak" };
+    my $data= {
+        list  => [ map { { id => $_, name => "name $_", pi => 3.25 } } 1 .. 200 ],
+        blobs => [ ($blob) x 3 ],
+        weak  => $weak,
+        obj   => bless( [ 1, 2 ], "Some::Class" ),
+    };
+    $data->{weak_ref}= $weak;
+    Scalar::Util::weaken( $data->{weak_ref} );
+    return $data;
+}
+my $data= make_data();
+
+my $expect= do {
+    my $enc= Sereal::Encoder->new( { stats => 1, canonical => 1 } );
+    $enc->encode($data);
+    counts( $enc->stats );
+};
+{
+    my $enc= Sereal::Encoder->new( { stats => 1, canonical => 1 } );
+    $enc->encode_into( my $buf, $data );
+    is_deeply( counts( $enc->stats ), $expect, "encode_into" );
+}
+foreach my $over ( 0, 1000 ) {
+    foreach my $flush ( 100, 1_000_000 ) {
+        my $enc= Sereal::Encoder->new(
+            { stats => 1, canonical => 1, flush_threshold => $flush, zero_copy_strings_over => $over } );
+        open my $fh, ">", \my $out or die "Can't open in-memory file: $!";
+        $enc->encode_to_fh( $fh, $data );
+        close $fh;
+        is_deeply(
+            counts( $enc->stats ),
+            $expect,
+            "encode_to_fh, flush_threshold => $flush, zero_copy_strings_over => $over"
+        ) or diag explain counts( $enc->stats );
+    }
+}
+
+# compression
+foreach my $compress ( SRL_SNAPPY, SRL_ZLIB, SRL_ZSTD ) {
+    my $enc= Sereal::Encoder->new( { stats => 1, canonical => 1, compress => $compress, compress_threshold => 0 } );
+    my $doc= $enc->encode($data);
+    my $stats= $enc->stats;
+    is( $stats->{compressed_documents}, 1, "compress => $compress: compressed_documents" );
+    is( $stats->{compressed_bytes}, length($doc) - $header_len, "compress => $compress: compressed_bytes" );
+    cmp_ok( $stats->{compress_time}, '>=', 0, "compress => $compress: compress_time" );
+    is_deeply(
+        [ @$stats{qw(documents body_bytes tags)} ],
+        [ @$expect{qw(documents body_bytes tags)} ],
+        "compress => $compress: the body is counted uncompressed"
+    );
+
+    $enc->encode("short");
+    is( $enc->stats->{compressed_documents}, 1, "compress => $compress: not if compression didn't help" );
+}
+{
+    my $enc= Sereal::Encoder->new( { stats => 1, canonical => 1, compress => SRL_ZSTD, compress_threshold => 0 } );
+    open my $fh, ">", \my $out or die "Can't open in-memory file: $!";
+    $enc->encode_to_fh( $fh, $data );
+    close $fh;
+    my $stats= $enc->stats;
+    is( $stats->{compressed_documents}, 1, "encode_to_fh with zstd: compressed_documents" );
+    is( $stats->{compressed_bytes}, length($out) - $header_len, "encode_to_fh with zstd: compressed_bytes" );
+    is( $stats->{body_bytes}, $expect->{body_bytes}, "encode_to_fh with zstd: body_bytes" );
+}
+
+# documents encoded by FREEZE with the same encoder aren't counted
+{
+    package Stats::Frozen;
+    our $enc;
+    sub FREEZE { return $enc->encode( [ 1, 2, 3 ] ) }
+}
+{
+    local $Stats::Frozen::enc= Sereal::Encoder->new( { stats => 1, freeze_callbacks => 1 } );
+    $Stats::Frozen::enc->encode( [ bless( {}, "Stats::Frozen" ) ] );
+    is( $Stats::Frozen::enc->stats->{documents}, 1, "FREEZE encodes not counted" );
+}
+
+done_testing();
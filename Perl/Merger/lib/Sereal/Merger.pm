@@ -78,12 +78,23 @@ by default.
 If this option provided and true, compression of the document body is enabled.
 As of Sereal version 3, two different compression techniques are supported
 and can be enabled by setting C<compress> to the respective named
-constants (exportable from the C<Sereal::Merger> module):
+constants (exportable from the C<Sereal::Encoder> module):
 Snappy (named constant: C<SRL_SNAPPY>),
-and Zlib (C<SRL_ZLIB>).
+and Zstd (C<SRL_ZSTD>).
 For your convenience, there is also a C<SRL_UNCOMPRESSED>
 constant.
 
+=head3 compress_level
+
+If Zstd compression is used, the compression level, between 1 and 22.
+Defaults to 3, see L<Sereal::Encoder>.
+
+=head3 compress_threads
+
+If Zstd compression is used, the number of zstd worker threads used to
+compress the merged document if its body is 1MB or larger. Defaults to 0,
+see L<Sereal::Encoder>.
+
 =head3 max_recursion_depth
 
 C<Sereal::Merger> is recursive. If you pass it a Perl data structure
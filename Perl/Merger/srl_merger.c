@@ -151,6 +151,7 @@ SRL_STATIC_INLINE void srl_merge_single_value(pTHX_ srl_merger_t *mrg);
 SRL_STATIC_INLINE void srl_merge_stringish(pTHX_ srl_merger_t *mrg);
 SRL_STATIC_INLINE void srl_merge_hash(pTHX_ srl_merger_t *mrg, const U8 tag, UV length);
 SRL_STATIC_INLINE void srl_merge_array(pTHX_ srl_merger_t *mrg, const U8 tag, UV length);
+SRL_STATIC_INLINE void srl_merge_records(pTHX_ srl_merger_t *mrg);
 SRL_STATIC_INLINE void srl_merge_binary_utf8(pTHX_ srl_merger_t *mrg, ptable_entry_ptr ptable_entry);
 SRL_STATIC_INLINE void srl_merge_short_binary(pTHX_ srl_merger_t *mrg, const U8 tag, ptable_entry_ptr ptable_entry);
 SRL_STATIC_INLINE void srl_merge_object(pTHX_ srl_merger_t *mrg, const U8 objtag);
@@ -257,11 +258,40 @@ srl_build_merger_struct(pTHX_ HV *opt)
                     SRL_MRG_SET_OPTION(mrg, SRL_F_COMPRESS_SNAPPY_INCREMENTAL);
                     break;
 
+                case 3: /* zstd */
+                    SRL_MRG_SET_OPTION(mrg, SRL_F_COMPRESS_ZSTD);
+                    if (mrg->protocol_version < 3)
+                        croak("zstd compression was introduced in protocol version 3 and you are asking for only version %i", (int) mrg->protocol_version);
+
+                    mrg->compress_level = 3; /* default compression level */
+                    svp = hv_fetchs(opt, "compress_level", 0);
+                    if (svp && SvTRUE(*svp)) {
+                        IV lvl = SvIV(*svp);
+                        if (expect_false(lvl < 1 || lvl > 22))
+                            croak("'compress_level' needs to be between 1 and 22");
+                        mrg->compress_level = (int) lvl;
+                    }
+
+                    svp = hv_fetchs(opt, "compress_threads", 0);
+                    if (svp && SvOK(*svp)) {
+                        IV threads = SvIV(*svp);
+                        if (expect_false(threads < 0))
+                            croak("'compress_threads' needs to be a non-negative number");
+                        mrg->compress_threads = (int) threads;
+                    }
+                    break;
+
                 default:
                     croak("Invalid Sereal compression format");
             }
         }
 
+        if (!SRL_MRG_HAVE_OPTION(mrg, SRL_F_COMPRESS_ZSTD)) {
+            svp = hv_fetchs(opt, "compress_threads", 0);
+            if (svp && SvTRUE(*svp))
+                croak("The 'compress_threads' option requires zstd compression");
+        }
+
         svp = hv_fetchs(opt, "max_recursion_depth", 0);
         if (svp && SvOK(*svp))
             mrg->max_recursion_depth = SvUV(*svp);
@@ -327,6 +357,7 @@ srl_destroy_merger(pTHX_ srl_merger_t *mrg)
     srl_buf_free_buffer(aTHX_ &mrg->obuf);
 
     srl_destroy_snappy_workmem(aTHX_ mrg->snappy_workmem);
+    srl_destroy_zstd_cctx(aTHX_ mrg->zstd_cctx);
 
     if (mrg->tracked_offsets) {
         srl_stack_deinit(aTHX_ mrg->tracked_offsets);
@@ -547,9 +578,22 @@ srl_merger_finish(pTHX_ srl_merger_t *mrg, SV *user_header_src)
 
     DEBUG_ASSERT_BUF_SANE(&mrg->obuf);
 
-    if (SRL_MRG_HAVE_OPTION(mrg, SRL_F_COMPRESS_SNAPPY_INCREMENTAL)) {
-        srl_compress_body(aTHX_ &mrg->obuf, body_offset, mrg->flags, 0, &mrg->snappy_workmem);
+    if (SRL_MRG_HAVE_OPTION(mrg, SRL_F_COMPRESS_SNAPPY_INCREMENTAL | SRL_F_COMPRESS_ZSTD)) {
+        /* srl_compress_body() expects the document to start at the beginning
+         * of the buffer (it flips the encoding bits in the version byte there),
+         * so move it down over the space reserved for the user header */
+        UV doc_len = BUF_POS_OFS(&mrg->obuf) - srl_start_offset - 1;
+        UV header_len = body_offset + 1 - srl_start_offset;
+
+        Move(mrg->obuf.start + srl_start_offset, mrg->obuf.start, doc_len, char);
+        mrg->obuf.pos = mrg->obuf.start + doc_len;
+
+        srl_compress_body(aTHX_ &mrg->obuf, header_len, mrg->flags, mrg->compress_level,
+                          &mrg->snappy_workmem, &mrg->zstd_cctx, NULL, mrg->compress_threads);
         SRL_UPDATE_BODY_POS(&mrg->obuf, mrg->protocol_version);
+        DEBUG_ASSERT_BUF_SANE(&mrg->obuf);
+
+        return newSVpvn((char *) mrg->obuf.start, BUF_POS_OFS(&mrg->obuf));
     }
 
     assert(srl_start_offset <= (UV) BUF_POS_OFS(&mrg->obuf));
@@ -588,6 +632,9 @@ srl_empty_merger_struct(pTHX)
     mrg->tracked_offsets_tbl = NULL;
     mrg->tracked_offsets = NULL;
     mrg->snappy_workmem = NULL;
+    mrg->zstd_cctx = NULL;
+    mrg->compress_level = 0;
+    mrg->compress_threads = 0;
     mrg->flags = 0;
     return mrg;
 }
@@ -690,6 +737,17 @@ srl_build_track_table(pTHX_ srl_merger_t *mrg)
                     srl_read_varint_uv_count(aTHX_ mrg->pibuf, " while reading ARRAY or HASH");
                     break;
 
+                case SRL_HDR_MANY: {
+                    U8 type;
+                    length = srl_read_many_header(aTHX_ mrg->pibuf, &type);
+                    srl_skip_many_items(aTHX_ mrg->pibuf, type, length);
+                    break;
+                }
+
+                case SRL_HDR_RECORDS:
+                    srl_read_records_header(aTHX_ mrg->pibuf, &length);
+                    break;
+
                 case SRL_HDR_TRUE:
                 case SRL_HDR_FALSE:
                 case SRL_HDR_UNDEF:
@@ -817,6 +875,24 @@ read_again:
                 srl_merge_array(aTHX_ mrg, tag, length);
                 break;
 
+            case SRL_HDR_MANY: {
+                /* copied verbatim, the items have no tags that could need rewriting */
+                srl_reader_char_ptr items_pos;
+                U8 type;
+                srl_buf_cat_tag_nocheck(mrg, tag);
+                items_pos = mrg->ibuf.pos;
+                length = srl_read_many_header(aTHX_ mrg->pibuf, &type);
+                srl_skip_many_items(aTHX_ mrg->pibuf, type, length);
+                length = mrg->ibuf.pos - items_pos;
+                mrg->ibuf.pos = items_pos;
+                srl_buf_copy_content_nocheck(aTHX_ mrg, length);
+                break;
+            }
+
+            case SRL_HDR_RECORDS:
+                srl_merge_records(aTHX_ mrg);
+                break;
+
             default:
                 switch (tag) {
                     case SRL_HDR_COPY:
@@ -925,6 +1001,35 @@ srl_merge_hash(pTHX_ srl_merger_t *mrg, const U8 tag, UV length)
     DEBUG_ASSERT_BUF_SANE(&mrg->obuf);
 }
 
+/* A record batch (RECORDS) is merged like an array of its keys followed by
+ * its values, the keys like hash keys */
+SRL_STATIC_INLINE void
+srl_merge_records(pTHX_ srl_merger_t *mrg)
+{
+    srl_reader_char_ptr counts_pos;
+    UV count, nkeys, i;
+    DEBUG_ASSERT_RDR_SANE(mrg->pibuf);
+    DEBUG_ASSERT_BUF_SANE(&mrg->obuf);
+
+    srl_buf_cat_tag_nocheck(mrg, SRL_HDR_RECORDS);
+    counts_pos = mrg->ibuf.pos;
+    count = srl_read_records_header(aTHX_ mrg->pibuf, &nkeys);
+    mrg->ibuf.pos = counts_pos;
+    srl_copy_varint(aTHX_ mrg);
+    srl_copy_varint(aTHX_ mrg);
+
+    for (i = 0; i < nkeys; ++i) {
+        srl_merge_stringish(aTHX_ mrg);
+    }
+
+    for (i = count * nkeys; i > 0; --i) {
+        srl_merge_single_value(aTHX_ mrg);
+    }
+
+    DEBUG_ASSERT_RDR_SANE(mrg->pibuf);
+    DEBUG_ASSERT_BUF_SANE(&mrg->obuf);
+}
+
 SRL_STATIC_INLINE void
 srl_merge_binary_utf8(pTHX_ srl_merger_t *mrg, ptable_entry_ptr ptable_entry)
 {
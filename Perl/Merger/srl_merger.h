@@ -35,8 +35,11 @@ typedef struct {
     U32 cnt_of_merged_elements;           /* total count of merged elements so far */
     U32 protocol_version;                 /* the version of the Sereal protocol to emit. */
     U32 flags;                            /* flag-like options: See SRL_F_* defines */
+    int compress_level;                   /* for zstd, the compression level */
+    int compress_threads;                 /* for zstd, the number of worker threads for large bodies */
 
     void *snappy_workmem;                 /* lazily allocated if and only if using Snappy */
+    void *zstd_cctx;                      /* lazily allocated if and only if using zstd */
 } srl_merger_t;
 
 srl_merger_t *srl_build_merger_struct(pTHX_ HV *opt);         /* constructor from options */
@@ -55,6 +58,7 @@ SV * srl_merger_finish(pTHX_ srl_merger_t *mrg, SV *user_header_src);
 /* WARNING: SRL_F_COMPRESS_SNAPPY               0x00040UL
  *          SRL_F_COMPRESS_SNAPPY_INCREMENTAL   0x00080UL
  *          SRL_F_COMPRESS_ZLIB                 0x00100UL
+ *          SRL_F_COMPRESS_ZSTD                 0x40000UL
  *          are in srl_compress.h */
 
 /* If set, use a hash to emit COPY() tags for all duplicated strings (including keys)
@@ -0,0 +1,57 @@
+#!perl
+use strict;
+use warnings;
+use Sereal::Merger;
+use Sereal::Encoder qw(encode_sereal SRL_SNAPPY SRL_ZSTD);
+use Sereal::Encoder::Constants qw(:all);
+use Sereal::Decoder qw(decode_sereal);
+use File::Spec;
+
+use lib File::Spec->catdir(qw(t lib));
+BEGIN {
+  lib->import('lib')
+    if !-d 't';
+}
+
+use Sereal::TestSet qw(:all);
+use Test::More;
+
+# Compressed merger output, with and without user header, and zstd's worker
+# threads for bodies large enough to use them.
+
+my @docs= map { [ map { { id => $_, name => "name $_" } } 1 .. 100 ] } 1 .. 3;
+my $big= [ map { { id => $_, name => "name $_", list => [ $_, "x" x ( $_ % 50 ) ] } } 1 .. 60_000 ];
+
+foreach my $test (
+    [ snappy_incr  => { compress => SRL_SNAPPY } ],
+    [ zstd         => { compress => SRL_ZSTD } ],
+    [ zstd_threads => { compress => SRL_ZSTD, compress_threads => 2 } ],
+) {
+    my ( $name, $opt )= @$test;
+    my $encoding= ( $opt->{compress} == SRL_ZSTD )
+        ? SRL_PROTOCOL_ENCODING_ZSTD : SRL_PROTOCOL_ENCODING_SNAPPY_INCREMENTAL;
+
+    foreach my $header ( undef, encode_sereal("user header") ) {
+        my $hname= $name . ( defined $header ? " with header" : "" );
+        my $merger= Sereal::Merger->new($opt);
+        $merger->append( encode_sereal($_) ) for @docs;
+        my $out= defined $header ? $merger->finish($header) : $merger->finish;
+        is( ord( substr( $out, 4, 1 ) ) & SRL_PROTOCOL_ENCODING_MASK, $encoding, "$hname: encoding bits set" );
+        is_deeply( decode_sereal($out), \@docs, "$hname: merged documents decode" );
+        is( Sereal::Decoder->new->decode_only_header($out), "user header", "$hname: user header decodes" )
+            if defined $header;
+    }
+
+    my $merger= Sereal::Merger->new($opt);
+    $merger->append( encode_sereal($big) );
+    my $out= $merger->finish;
+    cmp_ok( length($out), '<', length( encode_sereal($big) ) / 2, "$name: large document compressed" );
+    my $decoded= decode_sereal($out);
+    ok( @$decoded == 1 && @{ $decoded->[0] } == @$big && $decoded->[0][-1]{name} eq $big->[-1]{name},
+        "$name: large document decodes" );
+}
+
+my $ok= eval { Sereal::Merger->new( { compress => SRL_SNAPPY, compress_threads => 2 } ); 1 };
+ok( !$ok, "compress_threads requires zstd" );
+
+done_testing();
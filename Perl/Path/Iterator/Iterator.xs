@@ -19,7 +19,7 @@ new(CLASS, src = NULL, opt = NULL)
     HV *opt;
   CODE:
     RETVAL = srl_build_iterator_struct(aTHX_ opt);
-    if (src) srl_iterator_set(aTHX_ RETVAL, src);
+    if (src && SvOK(src)) srl_iterator_set(aTHX_ RETVAL, src);
   OUTPUT: RETVAL
 
 void
@@ -97,6 +97,14 @@ Sereal document as first argument and uses C<set> to set it.
 
   my $spi = Sereal::Path::Iterator->new(encode_sereal({}));
 
+The second optional argument is a hash reference of options. The only
+option currently supported is C<decompress_buffer_high_water>: the iterator
+decompresses compressed documents into a buffer it reuses between calls to
+C<set>, and releases that buffer on the next C<set> if it is larger than this
+many bytes (default: 16MiB).
+
+  my $spi = Sereal::Path::Iterator->new(undef, { decompress_buffer_high_water => 1 << 20 });
+
 =head2 set
 
 As alternative to passing serialized document to C<new> you can call this
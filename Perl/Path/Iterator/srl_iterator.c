@@ -76,6 +76,8 @@ extern "C" {
     (_stack_ptr)->length = (_length);                                           \
     (_stack_ptr)->first= SRL_RDR_BODY_POS_OFS_((_iter)->buf);                   \
     (_stack_ptr)->end = 0;                                                      \
+    (_stack_ptr)->records = SRL_STACK_DEPTH((_iter)->pstack) > 0                \
+                          ? ((_stack_ptr) - 1)->records : 0;                    \
     (_stack_ptr)->tag = (_tag);                                                 \
 } STMT_END
 
@@ -83,6 +85,16 @@ extern "C" {
 #define SRL_ITER_STACK_ROOT_TAG SRL_HDR_PACKET_START
 #define SRL_ITER_STACK_ON_ROOT(stack) ((stack)->ptr->tag == SRL_ITER_STACK_ROOT_TAG)
 
+/* the items of a packed array (MANY) follow its item type */
+#define SRL_ITER_MANY_ITEM_TYPE(iter) ((iter)->buf.body_pos[(iter)->stack.ptr->first - 1])
+
+/* a record of a record batch (RECORDS) is a hash right on top of the batch */
+#define SRL_ITER_STACK_ON_RECORD(stack) ((stack)->depth > 0 && ((stack)->ptr - 1)->tag == SRL_HDR_RECORDS)
+#define SRL_ITER_SEEK_RECORD(iter) STMT_START {                                     \
+    if (expect_false(SRL_ITER_STACK_ON_RECORD((iter)->pstack)))                     \
+        srl_iterator_seek_record(aTHX_ (iter));                                     \
+} STMT_END
+
 #define SRL_ITER_BASE_ERROR_FORMAT              "Sereal::Path::Iterator: Error in %s:%u "
 #define SRL_ITER_BASE_ERROR_ARGS                __FILE__, __LINE__
 
@@ -205,6 +217,12 @@ SRL_STATIC_INLINE void srl_iterator_read_object(pTHX_ srl_iterator_t *iter, int
 SRL_STATIC_INLINE void srl_iterator_read_refn(pTHX_ srl_iterator_t *iter, U8 *tag_out, UV *length_out);
 SRL_STATIC_INLINE UV   srl_iterator_read_refp(pTHX_ srl_iterator_t *iter, U8 *tag_out, UV *length_out);
 SRL_STATIC_INLINE UV   srl_iterator_read_alias(pTHX_ srl_iterator_t *iter, int *is_ref_out, U8 *tag_out, UV *length_out);
+SRL_STATIC_INLINE void srl_iterator_skip_many_items(pTHX_ srl_iterator_t *iter, UV n);
+SRL_STATIC_INLINE void srl_iterator_index_records(pTHX_ srl_iterator_t *iter);
+SRL_STATIC_INLINE const UV *srl_iterator_records_row(pTHX_ srl_iterator_t *iter, UV row, UV *nkeys_out);
+SRL_STATIC_INLINE void srl_iterator_skip_records(pTHX_ srl_iterator_t *iter, UV n);
+SRL_STATIC_INLINE void srl_iterator_step_into_record(pTHX_ srl_iterator_t *iter);
+SRL_STATIC_INLINE void srl_iterator_seek_record(pTHX_ srl_iterator_t *iter);
 
 /* wrappers */
 UV srl_iterator_eof(pTHX_ srl_iterator_t *iter)     { return SRL_RDR_DONE(iter->pbuf) ? 1 : 0; }
@@ -243,10 +261,18 @@ srl_init_iterator(pTHX_ srl_iterator_t *iter, HV *opt)
     iter->pbuf = &iter->buf;
     iter->pstack = &iter->stack;
     iter->document = NULL;
+    iter->decompress_buf = NULL;
+    iter->decompress_buffer_high_water = SRL_DEFAULT_DECOMPRESS_BUFFER_HIGH_WATER;
     iter->dec = NULL;
+    iter->records = NULL;
+    iter->records_size = 0;
 
     /* load options */
     if (opt != NULL) {
+        SV **svp = hv_fetchs(opt, "decompress_buffer_high_water", 0);
+        if (svp && SvOK(*svp))
+            iter->decompress_buffer_high_water = (STRLEN) SvUV(*svp);
+
         /* svp = hv_fetchs(opt, "dedupe_strings", 0);
         if (svp && SvTRUE(*svp))
             SRL_iter_SET_OPTION(iter, SRL_F_DEDUPE_STRINGS); */
@@ -271,8 +297,18 @@ srl_shallow_copy_iterator(pTHX_ srl_iterator_t *from, srl_iterator_t *to)
 
     to->pstack = &to->stack;
     to->pbuf = &to->buf;
+    to->decompress_buf = NULL;
+    to->decompress_buffer_high_water = from->decompress_buffer_high_water;
     to->dec = NULL;
 
+    /* the record batches on the copied stack */
+    to->records = NULL;
+    to->records_size = srl_stack_empty(from->pstack) ? 0 : from->stack.ptr->records;
+    if (to->records_size) {
+        Newx(to->records, to->records_size, UV);
+        Copy(from->records, to->records, to->records_size, UV);
+    }
+
     assert(to->buf.pos == from->buf.pos);
 }
 
@@ -287,6 +323,12 @@ srl_deinit_iterator(pTHX_ srl_iterator_t *iter)
     if (iter->document)
         SvREFCNT_dec(iter->document);
 
+    if (iter->decompress_buf)
+        SvREFCNT_dec(iter->decompress_buf);
+
+    if (iter->records)
+        Safefree(iter->records);
+
     srl_stack_deinit(aTHX_ &iter->stack);
 }
 
@@ -300,7 +342,6 @@ srl_destroy_iterator(pTHX_ srl_iterator_t *iter)
 void
 srl_iterator_set(pTHX_ srl_iterator_t *iter, SV *src)
 {
-    SV *sv;
     STRLEN len;
     UV header_len;
     U8 encoding_flags;
@@ -314,6 +355,9 @@ srl_iterator_set(pTHX_ srl_iterator_t *iter, SV *src)
         iter->document = NULL;
     }
 
+    if (iter->decompress_buf)
+        srl_release_decompress_buffer(aTHX_ &iter->decompress_buf, iter->decompress_buffer_high_water);
+
     iter->document = src;
     SvREFCNT_inc(iter->document);
 
@@ -347,20 +391,17 @@ srl_iterator_set(pTHX_ srl_iterator_t *iter, SV *src)
     } else if (   encoding_flags == SRL_PROTOCOL_ENCODING_SNAPPY
                || encoding_flags == SRL_PROTOCOL_ENCODING_SNAPPY_INCREMENTAL)
     {
-        srl_decompress_body_snappy(aTHX_ iter->pbuf, encoding_flags, &sv);
+        srl_decompress_body_snappy(aTHX_ iter->pbuf, encoding_flags, &iter->decompress_buf);
         SvREFCNT_dec(iter->document);
-        SvREFCNT_inc(sv);
-        iter->document = sv;
+        iter->document = SvREFCNT_inc(iter->decompress_buf);
     } else if (encoding_flags == SRL_PROTOCOL_ENCODING_ZLIB) {
-        srl_decompress_body_zlib(aTHX_ iter->pbuf, &sv);
+        srl_decompress_body_zlib(aTHX_ iter->pbuf, &iter->decompress_buf);
         SvREFCNT_dec(iter->document);
-        SvREFCNT_inc(sv);
-        iter->document = sv;
+        iter->document = SvREFCNT_inc(iter->decompress_buf);
     } else if (encoding_flags == SRL_PROTOCOL_ENCODING_ZSTD) {
-        srl_decompress_body_zstd(aTHX_ iter->pbuf, &sv);
+        srl_decompress_body_zstd(aTHX_ iter->pbuf, NULL, NULL, &iter->decompress_buf);
         SvREFCNT_dec(iter->document);
-        SvREFCNT_inc(sv);
-        iter->document = sv;
+        iter->document = SvREFCNT_inc(iter->decompress_buf);
     } else {
         SRL_RDR_ERROR(iter->pbuf, "Sereal document encoded in an unknown format");
     }
@@ -419,12 +460,20 @@ srl_iterator_disjoin(pTHX_ srl_iterator_t *iter)
     SRL_ITER_TRACE_WITH_POSITION("before disjoin");
     SRL_ITER_REPORT_STACK_STATE(iter);
 
+    if (expect_false(iter->stack.ptr->tag == SRL_HDR_MANY))
+        SRL_ITER_ERROR("Can't disjoin at an item of a packed array (MANY), it has no tag");
+    if (expect_false(iter->stack.ptr->tag == SRL_HDR_RECORDS))
+        SRL_ITER_ERROR("Can't disjoin at a record of a record batch (RECORDS), it has no tag");
+
+    SRL_ITER_SEEK_RECORD(iter);
+
     /* This record apart of being a boundary stores offset to idx's tag (i.e */
     /* current tag). By default stack keeps offset to tag's starting point */
     /* (i.e. continer located in the buf). */
 
     srl_stack_push_ptr(iter->pstack, stack_ptr);
     stack_ptr->first= SRL_RDR_BODY_POS_OFS(iter->pbuf); /* disjoint point */
+    stack_ptr->records = (stack_ptr - 1)->records;
     stack_ptr->tag = SRL_ITER_STACK_ROOT_TAG;
     stack_ptr->length = 1;
     stack_ptr->idx = 0;
@@ -449,6 +498,22 @@ srl_iterator_step_in(pTHX_ srl_iterator_t *iter, UV n)
         DEBUG_ASSERT_RDR_SANE(iter->pbuf);
         SRL_ITER_ASSERT_STACK(iter);
 
+        if (stack_ptr->tag == SRL_HDR_MANY) {
+            /* the items of a packed array hold nothing, so the steps left are all taken among them */
+            srl_iterator_skip_many_items(aTHX_ iter, n);
+            n = 0;
+            break;
+        }
+
+        if (stack_ptr->tag == SRL_HDR_RECORDS) {
+            /* the records of a batch have no tag, a step goes right into the next one */
+            --n;
+            srl_iterator_step_into_record(aTHX_ iter);
+            stack_ptr = iter->stack.ptr;
+            continue;
+        }
+
+        SRL_ITER_SEEK_RECORD(iter);
         --n;
 
         /* Iterator decrement idx *before* parsing an element. This's done for simplicity. */
@@ -510,6 +575,17 @@ srl_iterator_step_in(pTHX_ srl_iterator_t *iter, UV n)
                         srl_skip_varint(aTHX_ iter->pbuf);
                         break;
 
+                    case SRL_HDR_MANY: {
+                        U8 type;
+                        length = srl_read_many_header(aTHX_ iter->pbuf, &type);
+                        srl_stack_push_and_set(iter, tag, length, stack_ptr);
+                        break;
+                    }
+
+                    case SRL_HDR_RECORDS:
+                        srl_stack_push_and_set(iter, tag, 0, stack_ptr);
+                        break;
+
                     case SRL_HDR_FLOAT:         iter->buf.pos += 4;      break;
                     case SRL_HDR_DOUBLE:        iter->buf.pos += 8;      break;
                     case SRL_HDR_LONG_DOUBLE:   iter->buf.pos += 16;     break;
@@ -558,6 +634,10 @@ srl_iterator_step_in(pTHX_ srl_iterator_t *iter, UV n)
                         break;
                 }
         }
+
+        /* a record batch is read as soon as it's on the stack, whichever way it was reached */
+        if (tag == SRL_HDR_RECORDS)
+            srl_iterator_index_records(aTHX_ iter);
     }
 
     if (n == 0) SRL_ITER_TRACE_WITH_POSITION("Completed expected number of steps");
@@ -647,6 +727,7 @@ srl_iterator_next(pTHX_ srl_iterator_t *iter, UV n)
     UV length;
     IV expected_depth = iter->stack.depth;
     srl_iterator_stack_ptr stack_ptr = iter->stack.ptr;
+    const int on_record = SRL_ITER_STACK_ON_RECORD(iter->pstack);
 
     SRL_ITER_TRACE_WITH_POSITION("n=%"UVuf, n);
     if (expect_false(n == 0)) return;
@@ -654,6 +735,16 @@ srl_iterator_next(pTHX_ srl_iterator_t *iter, UV n)
     DEBUG_ASSERT_RDR_SANE(iter->pbuf);
     SRL_ITER_ASSERT_STACK(iter);
 
+    if (stack_ptr->tag == SRL_HDR_MANY) {
+        srl_iterator_skip_many_items(aTHX_ iter, n);
+        return;
+    }
+
+    if (stack_ptr->tag == SRL_HDR_RECORDS) {
+        srl_iterator_skip_records(aTHX_ iter, n);
+        return;
+    }
+
     while (1) {
         /* wrapping stack */
         srl_iterator_wrap_stack(aTHX_ iter, expected_depth);
@@ -663,6 +754,9 @@ srl_iterator_next(pTHX_ srl_iterator_t *iter, UV n)
         if (iter->stack.depth == expected_depth) {
             if (n == 0) break;
             else n--;
+
+            /* the keys and values of a record aren't next to each other */
+            if (on_record) srl_iterator_seek_record(aTHX_ iter);
         }
 
         SRL_ITER_ASSERT_STACK(iter);
@@ -716,6 +810,24 @@ srl_iterator_next(pTHX_ srl_iterator_t *iter, UV n)
                         srl_skip_varint(aTHX_ iter->pbuf);
                         break;
 
+                    case SRL_HDR_MANY: {
+                        /* the items of packed arrays hold nothing, so they are skipped as a whole */
+                        U8 type;
+                        length = srl_read_many_header(aTHX_ iter->pbuf, &type);
+                        srl_skip_many_items(aTHX_ iter->pbuf, type, length);
+                        break;
+                    }
+
+                    case SRL_HDR_RECORDS: {
+                        /* the values of record batches may be containers, so a batch
+                         * is skipped like an array of its keys and values. The frame
+                         * isn't tagged RECORDS, that's for batches stepped into. */
+                        UV nkeys;
+                        length = srl_read_records_header(aTHX_ iter->pbuf, &nkeys);
+                        srl_stack_push_and_set(iter, SRL_HDR_ARRAY, nkeys + length * nkeys, stack_ptr);
+                        break;
+                    }
+
                     case SRL_HDR_FLOAT:         iter->buf.pos += 4;      break;
                     case SRL_HDR_DOUBLE:        iter->buf.pos += 8;      break;
                     case SRL_HDR_LONG_DOUBLE:   iter->buf.pos += 16;     break;
@@ -863,8 +975,10 @@ srl_iterator_hash_key(pTHX_ srl_iterator_t *iter, const char **keyname, STRLEN *
         SRL_ITER_ERRORf1("Current stack index %d is not hash key", stack_ptr->idx);
     }
 
+    SRL_ITER_SEEK_RECORD(iter);
     srl_iterator_read_stringish(aTHX_ iter, keyname, keyname_length_out);
     stack_ptr->idx++;
+    SRL_ITER_SEEK_RECORD(iter);
 }
 
 /* Function looks for name key in current hash. If the key is found, the function stops
@@ -909,6 +1023,19 @@ srl_iterator_info(pTHX_ srl_iterator_t *iter, UV *length_out, const char **class
     if (classname_out) *classname_out = NULL;
     if (classname_lenght_out) *classname_lenght_out = 0;
 
+    /* the items of a packed array are numbers without a tag */
+    if (iter->stack.ptr->tag == SRL_HDR_MANY)
+        return SRL_ITERATOR_INFO_SCALAR;
+
+    /* the records of a batch are hashes of its keys */
+    if (iter->stack.ptr->tag == SRL_HDR_RECORDS) {
+        if (length_out) *length_out = iter->records[iter->stack.ptr->records - 1];
+        return SRL_ITERATOR_INFO_REF_TO | SRL_ITERATOR_INFO_HASH;
+    }
+
+    SRL_ITER_SEEK_RECORD(iter);
+    orig_pos = iter->buf.pos;
+
 read_again:
     SRL_ITER_ASSERT_EOF(iter, "serialized object");
     tag = *iter->buf.pos & ~SRL_HDR_TRACK_FLAG;
@@ -1069,6 +1196,22 @@ read_item:
             if (length_out) *length_out = srl_read_varint_uv_count(aTHX_ iter->pbuf, " while reading ARRAY");
             break;
 
+        case SRL_HDR_MANY: {
+            U8 item_type;
+            const UV count = srl_read_many_header(aTHX_ iter->pbuf, &item_type);
+            type |= SRL_ITERATOR_INFO_ARRAY;
+            if (length_out) *length_out = count;
+            break;
+        }
+
+        case SRL_HDR_RECORDS: {
+            UV nkeys;
+            const UV count = srl_read_records_header(aTHX_ iter->pbuf, &nkeys);
+            type |= SRL_ITERATOR_INFO_ARRAY;
+            if (length_out) *length_out = count;
+            break;
+        }
+
         CASE_SRL_HDR_POS:
         CASE_SRL_HDR_NEG:
         CASE_SRL_HDR_SHORT_BINARY:
@@ -1141,6 +1284,22 @@ read_ref:
             if (length_out) *length_out = srl_read_varint_uv_count(aTHX_ iter->pbuf, " while reading ARRAY");
             break;
 
+        case SRL_HDR_MANY: {
+            U8 item_type;
+            const UV count = srl_read_many_header(aTHX_ iter->pbuf, &item_type);
+            type |= SRL_ITERATOR_INFO_ARRAY;
+            if (length_out) *length_out = count;
+            break;
+        }
+
+        case SRL_HDR_RECORDS: {
+            UV nkeys;
+            const UV count = srl_read_records_header(aTHX_ iter->pbuf, &nkeys);
+            type |= SRL_ITERATOR_INFO_ARRAY;
+            if (length_out) *length_out = count;
+            break;
+        }
+
         CASE_SRL_HDR_POS:
         CASE_SRL_HDR_NEG:
         CASE_SRL_HDR_SHORT_BINARY:
@@ -1201,6 +1360,7 @@ srl_iterator_decode(pTHX_ srl_iterator_t *iter)
 {
     U8 tag;
     SV *into;
+    SRL_ITER_SEEK_RECORD(iter);
     SRL_ITER_TRACE_WITH_POSITION("decode object at");
     SRL_ITER_ASSERT_EOF(iter, "serialized object");
     SRL_ITER_ASSERT_STACK(iter);
@@ -1211,6 +1371,19 @@ srl_iterator_decode(pTHX_ srl_iterator_t *iter)
     Copy(&iter->buf, &iter->dec->buf, 1, srl_reader_buffer_t);
     DEBUG_ASSERT_RDR_SANE(iter->dec->pbuf);
 
+    into = sv_2mortal(newSV_type(SVt_NULL));
+    if (iter->stack.ptr->tag == SRL_HDR_MANY) {
+        srl_decode_many_item(aTHX_ iter->dec, SRL_ITER_MANY_ITEM_TYPE(iter), into);
+        return into;
+    }
+
+    if (iter->stack.ptr->tag == SRL_HDR_RECORDS) {
+        UV nkeys;
+        const UV *offsets = srl_iterator_records_row(aTHX_ iter, iter->stack.ptr->idx, &nkeys);
+        srl_decode_record(aTHX_ iter->dec, offsets, offsets + 2 * nkeys, nkeys, into);
+        return into;
+    }
+
     tag = *iter->buf.pos & ~SRL_HDR_TRACK_FLAG;
     SRL_ITER_REPORT_TAG(iter, tag);
 
@@ -1228,7 +1401,6 @@ srl_iterator_decode(pTHX_ srl_iterator_t *iter)
         }
     }
 
-    into = sv_2mortal(newSV_type(SVt_NULL));
     srl_decode_single_value(aTHX_ iter->dec, into, NULL);
     return into;
 }
@@ -1253,6 +1425,21 @@ srl_iterator_read_refn(pTHX_ srl_iterator_t *iter, U8 *tag_out, UV *length_out)
             *tag_out = SRL_HDR_ARRAY;
             break;
 
+        case SRL_HDR_MANY: {
+            U8 type;
+            iter->buf.pos++;
+            *length_out = srl_read_many_header(aTHX_ iter->pbuf, &type);
+            *tag_out = SRL_HDR_MANY;
+            break;
+        }
+
+        case SRL_HDR_RECORDS:
+            /* read by srl_iterator_index_records() once on the stack */
+            iter->buf.pos++;
+            *length_out = 0;
+            *tag_out = SRL_HDR_RECORDS;
+            break;
+
         default:
             *length_out = 1;
             *tag_out = tag;
@@ -1290,6 +1477,21 @@ srl_iterator_read_refp(pTHX_ srl_iterator_t *iter, U8 *tag_out, UV *length_out)
             *tag_out = SRL_HDR_ARRAY;
             break;
 
+        case SRL_HDR_MANY: {
+            U8 type;
+            iter->buf.pos++;
+            *length_out = srl_read_many_header(aTHX_ iter->pbuf, &type);
+            *tag_out = SRL_HDR_MANY;
+            break;
+        }
+
+        case SRL_HDR_RECORDS:
+            /* read by srl_iterator_index_records() once on the stack */
+            iter->buf.pos++;
+            *length_out = 0;
+            *tag_out = SRL_HDR_RECORDS;
+            break;
+
         default:
             *length_out = 1;
             *tag_out = tag;
@@ -1387,6 +1589,143 @@ srl_iterator_read_alias(pTHX_ srl_iterator_t *iter, int *is_ref_out, U8 *tag_out
     return alias_parsed_offset;
 }
 
+/* The items of a packed array (MANY) have no tags and hold nothing, so n of
+ * them are skipped at once, by their width or with srl_skip_varints() */
+SRL_STATIC_INLINE void
+srl_iterator_skip_many_items(pTHX_ srl_iterator_t *iter, UV n)
+{
+    srl_iterator_stack_ptr stack_ptr = iter->stack.ptr;
+    if (expect_false(n > stack_ptr->length - stack_ptr->idx)) {
+        SRL_ITER_ERRORf1("No elements at stack depth %"UVuf, (UV) iter->stack.depth);
+    }
+
+    srl_skip_many_items(aTHX_ iter->pbuf, SRL_ITER_MANY_ITEM_TYPE(iter), n);
+    stack_ptr->idx += n;
+    SRL_ITER_TRACE_WITH_POSITION("skipped %"UVuf" packed items", n);
+}
+
+/* A record batch (RECORDS) is stepped into as an array of hashes, one per
+ * record. The values of a record are one in each column rather than next to
+ * each other, so a batch is read through once it's on the stack and
+ * iter->records holds, up to stack_ptr->records:
+ *   the offsets of its nkeys keys,
+ *   the offsets of its nkeys columns,
+ *   the offsets of the values of the record `row` in every column,
+ *   row, the offset of the end of the batch and nkeys.
+ * The values of a record are found by moving on from those of `row`, so going
+ * through the records in order skips every value once. */
+SRL_STATIC_INLINE void
+srl_iterator_index_records(pTHX_ srl_iterator_t *iter)
+{
+    UV nkeys, count, size, i, r, *offsets;
+    srl_iterator_stack_ptr stack_ptr = iter->stack.ptr;
+
+    count = srl_read_records_header(aTHX_ iter->pbuf, &nkeys);
+    size = stack_ptr->records + 3 * nkeys + 3;
+    if (size > iter->records_size) {
+        iter->records_size = 2 * size;
+        Renew(iter->records, iter->records_size, UV);
+    }
+
+    offsets = iter->records + stack_ptr->records;
+    for (i = 0; i < nkeys; ++i) {
+        offsets[i] = SRL_RDR_BODY_POS_OFS(iter->pbuf);
+        srl_iterator_read_stringish(aTHX_ iter, NULL, NULL);
+    }
+
+    for (i = 0; i < nkeys; ++i) {
+        offsets[nkeys + i] = offsets[2 * nkeys + i] = SRL_RDR_BODY_POS_OFS(iter->pbuf);
+        for (r = 0; r < count; ++r) srl_skip_value(aTHX_ iter->pbuf);
+    }
+
+    offsets[3 * nkeys] = 0;
+    offsets[3 * nkeys + 1] = SRL_RDR_BODY_POS_OFS(iter->pbuf);
+    offsets[3 * nkeys + 2] = nkeys;
+
+    stack_ptr->length = count;
+    stack_ptr->records = size;
+
+    /* an empty batch is done with, otherwise stay within it */
+    if (count) iter->buf.pos = iter->buf.body_pos + offsets[0];
+    SRL_ITER_TRACE_WITH_POSITION("read record batch of %"UVuf" records of %"UVuf" keys", count, nkeys);
+}
+
+/* Returns the offsets of the batch on top of the stack, see
+ * srl_iterator_index_records(), with the values of the record row */
+SRL_STATIC_INLINE const UV *
+srl_iterator_records_row(pTHX_ srl_iterator_t *iter, UV row, UV *nkeys_out)
+{
+    srl_iterator_stack_ptr stack_ptr = iter->stack.ptr;
+    const UV nkeys = iter->records[stack_ptr->records - 1];
+    UV *offsets = iter->records + stack_ptr->records - (3 * nkeys + 3);
+    UV *values = offsets + 2 * nkeys;
+    UV i, r;
+
+    if (row < values[nkeys]) {
+        Copy(offsets + nkeys, values, nkeys, UV);
+        values[nkeys] = 0;
+    }
+
+    if (row > values[nkeys]) {
+        srl_reader_char_ptr orig_pos = iter->buf.pos;
+        for (i = 0; i < nkeys; ++i) {
+            iter->buf.pos = iter->buf.body_pos + values[i];
+            for (r = values[nkeys]; r < row; ++r) srl_skip_value(aTHX_ iter->pbuf);
+            values[i] = SRL_RDR_BODY_POS_OFS(iter->pbuf);
+        }
+
+        values[nkeys] = row;
+        iter->buf.pos = orig_pos;
+    }
+
+    *nkeys_out = nkeys;
+    return offsets;
+}
+
+/* Nothing is read to go past records, they're found when stepped into */
+SRL_STATIC_INLINE void
+srl_iterator_skip_records(pTHX_ srl_iterator_t *iter, UV n)
+{
+    srl_iterator_stack_ptr stack_ptr = iter->stack.ptr;
+    if (expect_false(n > stack_ptr->length - stack_ptr->idx)) {
+        SRL_ITER_ERRORf1("No elements at stack depth %"UVuf, (UV) iter->stack.depth);
+    }
+
+    stack_ptr->idx += n;
+    if (stack_ptr->idx == stack_ptr->length)
+        iter->buf.pos = iter->buf.body_pos + iter->records[stack_ptr->records - 2];
+
+    SRL_ITER_TRACE_WITH_POSITION("skipped %"UVuf" records", n);
+}
+
+/* Step into the current record of the batch on top of the stack, as a hash
+ * of its keys and values */
+SRL_STATIC_INLINE void
+srl_iterator_step_into_record(pTHX_ srl_iterator_t *iter)
+{
+    UV nkeys;
+    srl_iterator_stack_ptr stack_ptr = iter->stack.ptr;
+    const UV *offsets = srl_iterator_records_row(aTHX_ iter, stack_ptr->idx++, &nkeys);
+
+    iter->buf.pos = iter->buf.body_pos + offsets[0];
+    srl_stack_push_and_set(iter, SRL_HDR_HASH, 2 * nkeys, stack_ptr);
+}
+
+/* Move to the key or value of the record on top of the stack at its current
+ * index, from where its batch keeps them */
+SRL_STATIC_INLINE void
+srl_iterator_seek_record(pTHX_ srl_iterator_t *iter)
+{
+    srl_iterator_stack_ptr stack_ptr = iter->stack.ptr;
+    const UV nkeys = iter->records[stack_ptr->records - 1];
+    const UV *offsets = iter->records + stack_ptr->records - (3 * nkeys + 3);
+
+    if (stack_ptr->idx < stack_ptr->length) {
+        const UV k = stack_ptr->idx / 2;
+        iter->buf.pos = iter->buf.body_pos + (stack_ptr->idx % 2 ? offsets[2 * nkeys + k] : offsets[k]);
+    }
+}
+
 SRL_STATIC_INLINE void
 srl_iterator_read_stringish(pTHX_ srl_iterator_t *iter, const char **str_out, STRLEN *str_length_out)
 {
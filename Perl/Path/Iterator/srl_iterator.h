@@ -16,6 +16,8 @@ struct srl_iterator_stack {
     UV first;       /* offset to first element */
     UV end;         /* offset to end of this stack (i.e. offset after last */
                     /* element. Not always set. Used only in REFP/ALIAS case */
+    UV records;     /* how much of iter->records the record batches up to */
+                    /* this stack use */
     U8 tag;
 };
 
@@ -29,7 +31,11 @@ struct srl_iterator {
     srl_stack_t stack;
     srl_stack_ptr pstack;
     SV *document;
+    SV *decompress_buf;                 /* grow-only output buffer for decompression, reused across documents */
+    STRLEN decompress_buffer_high_water; /* release decompress_buf on next set() if it grew beyond this */
     struct srl_decoder *dec;
+    UV *records;                        /* offsets into the record batches on the stack, see srl_iterator_index_records() */
+    UV records_size;
 };
 
 /* constructor/destructor */
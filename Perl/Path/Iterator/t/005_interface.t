@@ -46,6 +46,17 @@ subtest "set document", sub {
     is($spi->decode(), 200, 'decode 200');
 };
 
+subtest "set compressed documents", sub {
+    foreach my $high_water (undef, 0) {
+        my $spi = Sereal::Path::Iterator->new(undef, { decompress_buffer_high_water => $high_water });
+        foreach my $len (10 * 1024, 100, 50 * 1024, 10 * 1024) {
+            my $body = 'a' x $len;
+            $spi->set(encode_sereal($body, { compress => Sereal::Encoder::SRL_ZLIB, compress_threshold => 0 }));
+            is($spi->decode(), $body, "decode compressed document of length $len");
+        }
+    }
+};
+
 subtest "reset document", sub {
     my $spi = Sereal::Path::Iterator->new(encode_sereal(100));
     lives_ok(sub { $spi->reset() }, 'expect reset() to live');
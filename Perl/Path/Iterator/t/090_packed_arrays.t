@@ -0,0 +1,61 @@
+#!perl
+use strict;
+use warnings;
+
+use Test::More;
+use Test::Exception;
+use Sereal::Path::Iterator qw/:all/;
+use Sereal::Encoder;
+
+# the items of a packed array (MANY) have no tags, the iterator steps over
+# them by their width or as varints
+my $encoder = Sereal::Encoder->new({ pack_numeric_arrays => 1 });
+
+subtest "step into packed arrays", sub {
+    my $spi = Sereal::Path::Iterator->new($encoder->encode({
+        ints    => [ map { $_ * 1000 } 1 .. 20 ],
+        neg     => [ map { -$_ } 1 .. 10 ],
+        doubles => [ map { $_ + 0.25 } 1 .. 10 ],
+    }));
+
+    $spi->step_in();
+    ok($spi->hash_exists('ints') >= 0, 'found ints');
+    is_deeply([ $spi->info() ], [ SRL_INFO_REF_TO | SRL_INFO_ARRAY, 20 ], 'info of a packed array');
+    lives_ok(sub { $spi->step_in() }, 'expect step_in() to live');
+    is($spi->stack_length(), 20, 'length of packed array');
+    is_deeply([ $spi->info() ], [ SRL_INFO_SCALAR, 1 ], 'info of an item');
+    is($spi->decode(), 1000, 'decode first item');
+    lives_ok(sub { $spi->next(5) }, 'expect next() to live');
+    is($spi->decode(), 6000, 'decode 6th item');
+    lives_ok(sub { $spi->array_goto(-1) }, 'expect array_goto() to live');
+    is($spi->decode(), 20000, 'decode last item');
+    lives_ok(sub { $spi->array_goto(2) }, 'expect array_goto() backwards to live');
+    is($spi->decode_and_next(), 3000, 'decode_and_next 3rd item');
+    is($spi->decode(), 4000, 'decode 4th item');
+    lives_ok(sub { $spi->step_out() }, 'expect step_out() to live');
+    is($spi->stack_depth(), 1, 'back in the hash');
+
+    ok($spi->hash_exists('neg') >= 0, 'found neg');
+    $spi->step_in();
+    lives_ok(sub { $spi->step_in(9) }, 'expect step_in() within the items to live');
+    is($spi->decode(), -10, 'decode last negative item');
+    dies_ok(sub { $spi->next(2) }, 'expect next() past the end to die');
+    $spi->step_out();
+
+    ok($spi->hash_exists('doubles') >= 0, 'found doubles');
+    $spi->step_in();
+    $spi->next(3);
+    is($spi->decode(), 4.25, 'decode double');
+};
+
+subtest "top level packed array", sub {
+    my $spi = Sereal::Path::Iterator->new($encoder->encode([ 1 .. 100 ]));
+    $spi->step_in();
+    is($spi->stack_length(), 100, 'length of packed array');
+    my @got;
+    push @got, $spi->decode_and_next() for 1 .. 100;
+    is_deeply(\@got, [ 1 .. 100 ], 'decode every item');
+    ok($spi->eof(), 'at the end of the document');
+};
+
+done_testing();
@@ -0,0 +1,79 @@
+#!perl
+use strict;
+use warnings;
+
+use Test::More;
+use Test::Exception;
+use Sereal::Path::Iterator qw/:all/;
+use Sereal::Encoder;
+
+# a record batch (RECORDS) is stepped into as an array of hashes, whose
+# values the iterator finds in the columns of the batch
+my $encoder = Sereal::Encoder->new({ record_batches => 1 });
+my @records = map { { id => $_, name => "n$_", tags => [ $_, $_ * 2 ] } } 1 .. 20;
+
+subtest "step into record batches", sub {
+    my $spi = Sereal::Path::Iterator->new($encoder->encode({ records => \@records, after => 'tail' }));
+
+    $spi->step_in();
+    ok($spi->hash_exists('records'), 'found records');
+    is_deeply([ $spi->info() ], [ SRL_INFO_REF_TO | SRL_INFO_ARRAY, 20 ], 'info of a record batch');
+    lives_ok(sub { $spi->step_in() }, 'expect step_in() to live');
+    is($spi->stack_length(), 20, 'length of record batch');
+    is_deeply([ $spi->info() ], [ SRL_INFO_REF_TO | SRL_INFO_HASH, 3 ], 'info of a record');
+    is_deeply($spi->decode(), $records[0], 'decode first record');
+    lives_ok(sub { $spi->next(5) }, 'expect next() to live');
+    is_deeply($spi->decode(), $records[5], 'decode 6th record');
+
+    lives_ok(sub { $spi->step_in() }, 'expect step_in() into a record to live');
+    is($spi->stack_length(), 6, 'length of record');
+    ok($spi->hash_exists('name'), 'found name');
+    is($spi->decode(), 'n6', 'decode name');
+    ok(!$spi->hash_exists('nope'), 'no such key');
+    ok($spi->hash_exists('tags'), 'found tags');
+    $spi->step_in();
+    is($spi->decode_and_next(), 6, 'decode first tag');
+    is($spi->decode(), 12, 'decode second tag');
+    $spi->step_out(2);
+    is($spi->stack_index(), 6, 'back in the batch after the record');
+
+    my %got;
+    $spi->step_in();
+    while ($spi->stack_index() < $spi->stack_length()) {
+        my $key = $spi->hash_key();
+        $got{$key} = $spi->decode();
+        $spi->next();
+    }
+    is_deeply(\%got, $records[6], 'walk over the keys and values of a record');
+    $spi->step_out();
+
+    lives_ok(sub { $spi->array_goto(2) }, 'expect array_goto() backwards to live');
+    is_deeply($spi->decode_and_next(), $records[2], 'decode_and_next 3rd record');
+    $spi->step_in();
+    ok($spi->hash_exists('id'), 'found id');
+    is($spi->decode(), 4, 'decode id of 4th record');
+    $spi->step_out(2);
+
+    ok($spi->hash_exists('after'), 'found the key after the batch');
+    is($spi->decode(), 'tail', 'decode the value after the batch');
+    $spi->reset();
+    is_deeply($spi->decode(), { records => \@records, after => 'tail' }, 'decode the document');
+};
+
+subtest "top level record batch", sub {
+    my $spi = Sereal::Path::Iterator->new($encoder->encode(\@records));
+    $spi->step_in();
+    my @got;
+    for (1 .. 20) {
+        $spi->step_in();
+        $spi->hash_exists('id');
+        push @got, $spi->decode();
+        $spi->step_out();
+    }
+    is_deeply(\@got, [ 1 .. 20 ], 'decode every id');
+    dies_ok(sub { $spi->step_in() }, 'expect step_in() past the end to die');
+    $spi->step_out();
+    ok($spi->eof(), 'at the end of the document');
+};
+
+done_testing();
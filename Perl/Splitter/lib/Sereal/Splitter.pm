@@ -27,6 +27,10 @@ this:
 
   [ $element_1, $element_2, ..., $element_n ]
 
+If the array was encoded as a packed array (C<pack_numeric_arrays>) or as a
+record batch (C<record_batches>), the chunks are packed arrays of the same
+type or record batches with the same keys.
+
 In the future, it may also work with HashRefs.
 
 
@@ -44,12 +44,13 @@ BEGIN {
         "SRL_HDR_POS"                              => 0,
         "SRL_HDR_POS_HIGH"                         => 15,
         "SRL_HDR_POS_LOW"                          => 0,
+        "SRL_HDR_RECORDS"                          => 52,
         "SRL_HDR_REFN"                             => 40,
         "SRL_HDR_REFP"                             => 41,
         "SRL_HDR_REGEXP"                           => 49,
-        "SRL_HDR_RESERVED"                         => 52,
+        "SRL_HDR_RESERVED"                         => 53,
         "SRL_HDR_RESERVED_HIGH"                    => 56,
-        "SRL_HDR_RESERVED_LOW"                     => 52,
+        "SRL_HDR_RESERVED_LOW"                     => 53,
         "SRL_HDR_SHORT_BINARY"                     => 96,
         "SRL_HDR_SHORT_BINARY_HIGH"                => 127,
         "SRL_HDR_SHORT_BINARY_LOW"                 => 96,
@@ -602,52 +603,52 @@ push @EXPORT_OK, keys %DEFINE;
 
     # autoupdated by Sereal.git:Perl/shared/author_tools/update_from_header.pl do not modify directly!
     {
-        "comment"    => "reserved",
-        "masked"     => 1,
-        "masked_val" => 0,
-        "name"       => "RESERVED_0",
-        "type_name"  => "RESERVED",
+        "comment" =>
+            "<COUNT-VARINT> <NKEYS-VARINT> [<KEY-TAG> ...] [<ITEM-TAG> ...] - array of count hashes with the same keys, values stored column by column",
+        "name"       => "RECORDS",
+        "type_name"  => "RECORDS",
         "type_value" => 52,
         "value"      => 52
     },
 
     # autoupdated by Sereal.git:Perl/shared/author_tools/update_from_header.pl do not modify directly!
     {
+        "comment"    => "reserved",
         "masked"     => 1,
-        "masked_val" => 1,
-        "name"       => "RESERVED_1",
+        "masked_val" => 0,
+        "name"       => "RESERVED_0",
         "type_name"  => "RESERVED",
-        "type_value" => 52,
+        "type_value" => 53,
         "value"      => 53
     },
 
     # autoupdated by Sereal.git:Perl/shared/author_tools/update_from_header.pl do not modify directly!
     {
         "masked"     => 1,
-        "masked_val" => 2,
-        "name"       => "RESERVED_2",
+        "masked_val" => 1,
+        "name"       => "RESERVED_1",
         "type_name"  => "RESERVED",
-        "type_value" => 52,
+        "type_value" => 53,
         "value"      => 54
     },
 
     # autoupdated by Sereal.git:Perl/shared/author_tools/update_from_header.pl do not modify directly!
     {
         "masked"     => 1,
-        "masked_val" => 3,
-        "name"       => "RESERVED_3",
+        "masked_val" => 2,
+        "name"       => "RESERVED_2",
         "type_name"  => "RESERVED",
-        "type_value" => 52,
+        "type_value" => 53,
         "value"      => 55
     },
 
     # autoupdated by Sereal.git:Perl/shared/author_tools/update_from_header.pl do not modify directly!
     {
         "masked"     => 1,
-        "masked_val" => 4,
-        "name"       => "RESERVED_4",
+        "masked_val" => 3,
+        "name"       => "RESERVED_3",
         "type_name"  => "RESERVED",
-        "type_value" => 52,
+        "type_value" => 53,
         "value"      => 56
     },
 
@@ -681,7 +682,7 @@ push @EXPORT_OK, keys %DEFINE;
     # autoupdated by Sereal.git:Perl/shared/author_tools/update_from_header.pl do not modify directly!
     {
         "comment" =>
-            "<LEN-VARINT> <TYPE-BYTE> <TAG-DATA> - repeated tag (not done yet, will be implemented in version 3)",
+            "<COUNT-VARINT> <TYPE-TAG> [<ITEM-DATA> ...] - packed array of count numbers of the same type, stored without their tags",
         "name"       => "MANY",
         "type_name"  => "MANY",
         "type_value" => 60,
@@ -50,6 +50,8 @@ extern "C" {
 #include "srl_common.h"
 #include "srl_protocol.h"
 #include "srl_inline.h"
+#include "srl_reader_varint.h"
+#include "srl_reader_misc.h"
 
 #include "snappy/csnappy_decompress.c"
 #include "miniz.h"
@@ -76,6 +78,9 @@ SRL_STATIC_INLINE srl_splitter_t * srl_empty_splitter_struct(pTHX);
 SRL_STATIC_INLINE void _parse_header(pTHX_ srl_splitter_t *splitter);
 SRL_STATIC_INLINE UV _read_varint_uv_nocheck(srl_splitter_t *splitter);
 SRL_STATIC_INLINE int _parse(pTHX_ srl_splitter_t * splitter);
+SRL_STATIC_INLINE int _parse_many(pTHX_ srl_splitter_t * splitter);
+SRL_STATIC_INLINE int _parse_records(pTHX_ srl_splitter_t * splitter);
+SRL_STATIC_INLINE char* _skip_value(pTHX_ srl_splitter_t * splitter, char* pos);
 SRL_STATIC_INLINE void _read_tag(pTHX_ srl_splitter_t * splitter, char tag);
 SRL_STATIC_INLINE void _read_varint(srl_splitter_t * splitter);
 SRL_STATIC_INLINE void _read_zigzag(srl_splitter_t * splitter);
@@ -92,6 +97,8 @@ SRL_STATIC_INLINE void _read_copy(pTHX_ srl_splitter_t * splitter);
 SRL_STATIC_INLINE void _read_alias(pTHX_ srl_splitter_t * splitter);
 SRL_STATIC_INLINE void _read_hash(srl_splitter_t * splitter);
 SRL_STATIC_INLINE void _read_array(srl_splitter_t * splitter);
+SRL_STATIC_INLINE void _read_many(srl_splitter_t * splitter);
+SRL_STATIC_INLINE void _read_records(srl_splitter_t * splitter);
 SRL_STATIC_INLINE void _read_regexp(srl_splitter_t * splitter);
 SRL_STATIC_INLINE void _update_varint_from_to(char *varint_start, char *varint_end, UV number);
 SRL_STATIC_INLINE char* _set_varint_nocheck(char* buf, UV n);
@@ -235,6 +242,12 @@ srl_splitter_t * srl_build_splitter_struct(pTHX_ HV *opt) {
 
     /* initialize */
     splitter->deepness = 0;
+    splitter->input_many_type = 0;
+    splitter->input_many_left = 0;
+    splitter->input_records_left = 0;
+    splitter->input_records_nkeys = 0;
+    splitter->input_records_keys = NULL;
+    splitter->input_records_columns = NULL;
 
     char tag = *(splitter->pos);
     splitter->pos++;
@@ -255,6 +268,42 @@ srl_splitter_t * srl_build_splitter_struct(pTHX_ HV *opt) {
             while (len-- > 0) {
                 stack_push(splitter->status_stack, ST_VALUE);
             }
+        } else if (tag == SRL_HDR_MANY) {
+            /* the chunks are packed arrays of the same type, see _parse_many() */
+            UV len = _read_varint_uv_nocheck(splitter);
+            char type = *(splitter->pos);
+            splitter->pos++;
+            if (type != SRL_HDR_VARINT && type != SRL_HDR_ZIGZAG
+                && type != SRL_HDR_FLOAT && type != SRL_HDR_DOUBLE)
+                croak("Unexpected item type in packed array (MANY)");
+            splitter->input_nb_elts = len;
+            splitter->input_many_type = type;
+            splitter->input_many_left = len;
+            SRL_SPLITTER_TRACE(" * MANY of len, %lu", len);
+        } else if (tag == SRL_HDR_RECORDS) {
+            /* the chunks are record batches with the same keys, see _parse_records() */
+            UV count = _read_varint_uv_nocheck(splitter);
+            UV nkeys = _read_varint_uv_nocheck(splitter);
+            char *pos;
+            UV i, k;
+            if (nkeys == 0)
+                croak("record batch (RECORDS) without keys");
+            splitter->input_nb_elts = count;
+            splitter->input_records_left = count;
+            splitter->input_records_nkeys = nkeys;
+            splitter->input_records_keys = splitter->pos;
+            SRL_SPLITTER_TRACE(" * RECORDS of len, %lu", count);
+
+            /* find where each column starts, the values come column by column */
+            Newx(splitter->input_records_columns, 2 * nkeys, char *);
+            pos = splitter->pos;
+            for (k = 0; k < nkeys; k++)
+                pos = _skip_value(aTHX_ splitter, pos);
+            for (k = 0; k < nkeys; k++) {
+                splitter->input_records_columns[k] = pos;
+                for (i = 0; i < count; i++)
+                    pos = _skip_value(aTHX_ splitter, pos);
+            }
         } else {
             croak("first tag is REFN but next tag is not ARRAY");
         }
@@ -279,6 +328,9 @@ void srl_destroy_splitter(pTHX_ srl_splitter_t *splitter) {
         Safefree(splitter->status_stack);
     }
 
+    if (splitter->input_records_columns)
+        Safefree(splitter->input_records_columns);
+
     Safefree(splitter);
 }
 
@@ -412,6 +464,7 @@ void _parse_header(pTHX_ srl_splitter_t *splitter) {
 
         splitter->pos = splitter->input_str;;
         splitter->input_len = uncompressed_len;
+        splitter->input_str_end = splitter->input_str + uncompressed_len;
         splitter->input_body_pos = splitter->pos;
 
     } else if (is_zlib_encoded) {
@@ -448,6 +501,7 @@ void _parse_header(pTHX_ srl_splitter_t *splitter) {
 
         splitter->pos = splitter->input_str;
         splitter->input_len = (STRLEN)tmp;
+        splitter->input_str_end = splitter->input_str + splitter->input_len;
         splitter->input_body_pos = splitter->pos;
 
     }
@@ -555,6 +609,102 @@ SRL_STATIC_INLINE int _parse(pTHX_ srl_splitter_t * splitter) {
     return 0;
 }
 
+/* The items of a top level packed array (MANY) have no tags, so they are
+ * copied as they are, as many as it takes to reach the chunk size, and the
+ * chunk is a packed array of the same type. */
+SRL_STATIC_INLINE int _parse_many(pTHX_ srl_splitter_t * splitter) {
+    UV n;
+
+    if (splitter->input_many_left == 0)
+        return 0;
+
+    if (splitter->input_many_type == SRL_HDR_FLOAT || splitter->input_many_type == SRL_HDR_DOUBLE) {
+        UV width = splitter->input_many_type == SRL_HDR_FLOAT ? 4 : 8;
+        n = splitter->size_limit / width;
+        if (n * width < splitter->size_limit || n == 0)
+            n++;
+        if (n > splitter->input_many_left)
+            n = splitter->input_many_left;
+        if ( (UV)(splitter->input_str_end - splitter->pos) / width < n )
+            croak("Unexpected end of input in packed array (MANY)");
+        splitter->pos += n * width;
+    } else {
+        n = 0;
+        do {
+            _read_varint_uv_nocheck(splitter);
+            n++;
+        } while ( n < splitter->input_many_left
+                  && (UV)(splitter->pos - splitter->chunk_iter_start) < splitter->size_limit );
+    }
+
+    SRL_SPLITTER_TRACE(" * MANY chunk of %lu items", n);
+    splitter->input_many_left -= n;
+    splitter->chunk_nb_elts = n;
+    _maybe_flush_chunk(aTHX_ splitter, NULL, NULL);
+    return 1;
+}
+
+/* A top level record batch (RECORDS) is split into record batches with the
+ * same keys and a slice of each column. The number of records of a chunk
+ * has to be known before its first column is copied, so the values of the
+ * next records are skipped first, until they add up to the chunk size. Then
+ * the keys and each column slice are parsed as usual, jumping from one to
+ * the next, which takes care of COPY, REFP and ALIAS tags. */
+SRL_STATIC_INLINE int _parse_records(pTHX_ srl_splitter_t * splitter) {
+    UV nkeys = splitter->input_records_nkeys;
+    char **columns = splitter->input_records_columns;
+    char **ends = columns + nkeys;
+    UV size = 0;
+    UV n = 0;
+    UV i, k;
+    int found;
+
+    if (splitter->input_records_left == 0)
+        return 0;
+
+    Copy(columns, ends, nkeys, char *);
+    do {
+        for (k = 0; k < nkeys; k++) {
+            char *end = _skip_value(aTHX_ splitter, ends[k]);
+            size += end - ends[k];
+            ends[k] = end;
+        }
+        n++;
+    } while ( n < splitter->input_records_left && size < splitter->size_limit );
+
+    /* the keys, then n values from each column, in reverse as it's a stack */
+    splitter->deepness++;
+    stack_push(splitter->status_stack, ST_DEEPNESS_UP);
+    for (k = nkeys; k-- > 0; ) {
+        for (i = 0; i < n; i++)
+            stack_push(splitter->status_stack, ST_VALUE);
+        stack_push(splitter->status_stack, (UV)columns[k]);
+        stack_push(splitter->status_stack, ST_ABSOLUTE_JUMP);
+    }
+    for (k = 0; k < nkeys; k++)
+        stack_push(splitter->status_stack, ST_VALUE);
+    stack_push(splitter->status_stack, (UV)splitter->input_records_keys);
+    stack_push(splitter->status_stack, ST_ABSOLUTE_JUMP);
+
+    SRL_SPLITTER_TRACE(" * RECORDS chunk of %lu records", n);
+    found = _parse(aTHX_ splitter);
+    Copy(ends, columns, nkeys, char *);
+    splitter->input_records_left -= n;
+    splitter->chunk_nb_elts = n;
+    return found;
+}
+
+/* Returns where the value at pos ends, without parsing it */
+SRL_STATIC_INLINE char* _skip_value(pTHX_ srl_splitter_t * splitter, char* pos) {
+    srl_reader_buffer_t buf;
+    buf.start = (srl_reader_char_ptr)splitter->input_str;
+    buf.end = (srl_reader_char_ptr)splitter->input_str_end;
+    buf.pos = (srl_reader_char_ptr)pos;
+    buf.body_pos = (srl_reader_char_ptr)splitter->input_body_pos;
+    srl_skip_value(aTHX_ &buf);
+    return (char *)buf.pos;
+}
+
 void _check_for_duplicates(pTHX_ srl_splitter_t * splitter, char* binary_start_pos, UV len, bool is_utf8) {
     dedupe_el_t *element = NULL;
     if (splitter->dont_check_for_duplicate) {
@@ -643,6 +793,8 @@ _read_tag(pTHX_ srl_splitter_t * splitter, char tag)
             case SRL_HDR_REFP:           _read_refp(aTHX_ splitter);         break;
             case SRL_HDR_HASH:           _read_hash(splitter);         break;
             case SRL_HDR_ARRAY:          _read_array(splitter);        break;
+            case SRL_HDR_MANY:           _read_many(splitter);         break;
+            case SRL_HDR_RECORDS:        _read_records(splitter);      break;
             case SRL_HDR_OBJECT:         _read_object(splitter, 0);    break;
             case SRL_HDR_OBJECT_FREEZE:  _read_object(splitter, 1);    break;
             case SRL_HDR_OBJECTV:        _read_objectv(aTHX_ splitter, 0);   break;
@@ -935,6 +1087,41 @@ SRL_STATIC_INLINE void _read_array(srl_splitter_t * splitter) {
     return;
 }
 
+SRL_STATIC_INLINE void _read_many(srl_splitter_t * splitter) {
+    UV len = _read_varint_uv_nocheck(splitter);
+    char type = *(splitter->pos++);
+    SRL_SPLITTER_TRACE(" * MANY of len, %lu", len);
+    /* the items of a packed array have no tags, they are just skipped */
+    switch (type) {
+        case SRL_HDR_VARINT:
+        case SRL_HDR_ZIGZAG:
+#ifdef SRL_VARINT_WORDS
+            splitter->pos = (char *)srl_skip_varint_words((U8 *)splitter->pos, (U8 *)splitter->input_str_end, &len);
+#endif
+            while (len-- > 0)
+                _read_varint_uv_nocheck(splitter);
+            break;
+        case SRL_HDR_FLOAT:  splitter->pos += len * 4; break;
+        case SRL_HDR_DOUBLE: splitter->pos += len * 8; break;
+        default:             croak("Unexpected item type in packed array (MANY)"); break;
+    }
+    return;
+}
+
+SRL_STATIC_INLINE void _read_records(srl_splitter_t * splitter) {
+    UV count = _read_varint_uv_nocheck(splitter);
+    UV nkeys = _read_varint_uv_nocheck(splitter);
+    UV len = nkeys + count * nkeys;
+    SRL_SPLITTER_TRACE(" * RECORDS of len, %lu", count);
+    /* the keys then the values, column by column, all of them tagged */
+    splitter->deepness++;
+    stack_push(splitter->status_stack, ST_DEEPNESS_UP);
+    while (len-- > 0) {
+        stack_push(splitter->status_stack, ST_VALUE);
+    }
+    return;
+}
+
 SRL_STATIC_INLINE void _read_regexp(srl_splitter_t * splitter) {
     splitter->deepness++;
     stack_push(splitter->status_stack, ST_DEEPNESS_UP);
@@ -1010,7 +1197,8 @@ SV* srl_splitter_next_chunk(pTHX_ srl_splitter_t * splitter) {
     sv_catpvn(splitter->chunk, tmp_str, 1);
     splitter->chunk_current_offset += 1;
 
-    tmp_str[0] = SRL_HDR_ARRAY;
+    tmp_str[0] = splitter->input_records_nkeys ? SRL_HDR_RECORDS
+               : splitter->input_many_type ? SRL_HDR_MANY : SRL_HDR_ARRAY;
     sv_catpvn(splitter->chunk, tmp_str, 1);
     splitter->chunk_current_offset += 1;
 
@@ -1021,7 +1209,20 @@ SV* srl_splitter_next_chunk(pTHX_ srl_splitter_t * splitter) {
     sv_catpvn(splitter->chunk, tmp_str, varint_len);
     splitter->chunk_current_offset += varint_len;
 
-    int found = _parse(aTHX_ splitter);
+    if (splitter->input_many_type) {
+        /* the item type follows the count of a packed array */
+        sv_catpvn(splitter->chunk, &splitter->input_many_type, 1);
+        splitter->chunk_current_offset += 1;
+    } else if (splitter->input_records_nkeys) {
+        /* and the number of keys the count of a record batch */
+        UV nkeys_len = (UV) (_set_varint_nocheck(tmp_str, splitter->input_records_nkeys) - tmp_str);
+        sv_catpvn(splitter->chunk, tmp_str, nkeys_len);
+        splitter->chunk_current_offset += nkeys_len;
+    }
+
+    int found = splitter->input_many_type ? _parse_many(aTHX_ splitter)
+              : splitter->input_records_nkeys ? _parse_records(aTHX_ splitter)
+              : _parse(aTHX_ splitter);
     if (found) {
         char * varint_start = SvPVX(splitter->chunk) + varint_pos;
         char * varint_end = varint_start + varint_len - 1;
@@ -19,6 +19,20 @@ typedef struct {
     char * input_body_pos;
     UV input_nb_elts;
 
+    /* the item type of a top level packed array (MANY), or 0, and how
+     * many of its items are left to split */
+    char input_many_type;
+    UV input_many_left;
+
+    /* for a top level record batch (RECORDS): the records left to split,
+     * the number of keys and where they start, and where the next value of
+     * each column starts, followed by where the values of the current chunk
+     * end, see _parse_records() */
+    UV input_records_left;
+    UV input_records_nkeys;
+    char * input_records_keys;
+    char ** input_records_columns;
+
     int deepness;
 
     STRLEN input_len;
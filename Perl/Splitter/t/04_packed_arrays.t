@@ -0,0 +1,53 @@
+#!perl
+use strict;
+use warnings;
+use Test::More;
+
+use Sereal::Splitter qw(SRL_ZLIB create_header_data_template);
+
+use Sereal::Encoder;
+use Sereal::Decoder qw(decode_sereal decode_sereal_with_header_data);
+
+# A top level packed array (MANY) is split into packed arrays of the same
+# type. The generators make fresh numbers every time, as a number that has
+# been used as a string isn't packed anymore.
+my %arrays = (
+    varint => sub { [ map { $_ * 1000 } 1 .. 1000 ] },
+    zigzag => sub { [ map { -$_ * 1000 } 1 .. 1000 ] },
+    double => sub { [ map { $_ + 0.5 } 1 .. 1000 ] },
+);
+
+foreach my $name (sort keys %arrays) {
+    foreach my $compress (0, SRL_ZLIB) {
+        my $data = Sereal::Encoder->new({ pack_numeric_arrays => 1, compress => $compress })
+                                  ->encode($arrays{$name}->());
+        my $o = Sereal::Splitter->new({ chunk_size => 100, input => $data });
+
+        my @acc;
+        my $nb_chunks = 0;
+        while (defined( my $chunk = $o->next_chunk())) {
+            $nb_chunks++;
+            is(substr($chunk, 6, 2), "\x28\x3c", "$name chunk $nb_chunks is a packed array")
+              if $nb_chunks == 1;
+            push @acc, @{decode_sereal($chunk)};
+        }
+        cmp_ok($nb_chunks, '>', 5, "$name array split in $nb_chunks chunks");
+        is_deeply(\@acc, $arrays{$name}->(), "$name chunks hold all the items, in order");
+    }
+}
+
+{
+    my $data = Sereal::Encoder->new({ pack_numeric_arrays => 1 })->encode([ 1 .. 20 ]);
+    my $o = Sereal::Splitter->new({ chunk_size => 1, input => $data,
+                                    header_data_template => create_header_data_template({count => '__$CNT__'}),
+                                  });
+    my @acc;
+    while (defined( my $chunk = $o->next_chunk())) {
+        my ($header, $struct) = @{decode_sereal_with_header_data($chunk)};
+        is($header->{count}, 1, "one item per chunk");
+        push @acc, @$struct;
+    }
+    is_deeply(\@acc, [ 1 .. 20 ], "all items, one at a time");
+}
+
+done_testing;
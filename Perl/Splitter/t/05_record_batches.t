@@ -0,0 +1,53 @@
+#!perl
+use strict;
+use warnings;
+use Test::More;
+
+use Sereal::Splitter qw(SRL_ZLIB create_header_data_template);
+
+use Sereal::Encoder;
+use Sereal::Decoder qw(decode_sereal decode_sereal_with_header_data);
+
+# A top level record batch (RECORDS) is split into record batches with the
+# same keys, each holding a slice of every column.
+my %arrays = (
+    scalars    => sub { [ map { { id => $_, name => "name $_", score => $_ / 4 } } 1 .. 500 ] },
+    containers => sub { [ map { { id => $_, tags => [ $_, "t$_" ], meta => { n => $_ } } } 1 .. 500 ] },
+    one_key    => sub { [ map { { id => $_ } } 1 .. 500 ] },
+);
+
+foreach my $name (sort keys %arrays) {
+    foreach my $options ({}, { compress => SRL_ZLIB }, { dedupe_strings => 1 }) {
+        my $data = Sereal::Encoder->new({ record_batches => 1, %$options })
+                                  ->encode($arrays{$name}->());
+        my $o = Sereal::Splitter->new({ chunk_size => 200, input => $data });
+
+        my @acc;
+        my $nb_chunks = 0;
+        while (defined( my $chunk = $o->next_chunk())) {
+            $nb_chunks++;
+            is(substr($chunk, 6, 2), "\x28\x34", "$name chunk $nb_chunks is a record batch")
+              if $nb_chunks == 1;
+            push @acc, @{decode_sereal($chunk)};
+        }
+        cmp_ok($nb_chunks, '>', 5, "$name batch split in $nb_chunks chunks");
+        is_deeply(\@acc, $arrays{$name}->(), "$name chunks hold all the records, in order");
+    }
+}
+
+{
+    my $records = [ map { { id => $_, name => "n$_" } } 1 .. 20 ];
+    my $data = Sereal::Encoder->new({ record_batches => 1 })->encode($records);
+    my $o = Sereal::Splitter->new({ chunk_size => 1, input => $data,
+                                    header_data_template => create_header_data_template({count => '__$CNT__'}),
+                                  });
+    my @acc;
+    while (defined( my $chunk = $o->next_chunk())) {
+        my ($header, $struct) = @{decode_sereal_with_header_data($chunk)};
+        is($header->{count}, 1, "one record per chunk");
+        push @acc, @$struct;
+    }
+    is_deeply(\@acc, $records, "all records, one at a time");
+}
+
+done_testing;
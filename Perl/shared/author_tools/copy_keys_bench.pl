@@ -0,0 +1,27 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(timethis :hireswallclock);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Sereal::Encoder;
+use Getopt::Long qw(GetOptions);
+
+# Decodes an array of records that share their keys, which the encoder
+# writes out once and refers back to with COPY tags afterwards, as most
+# row-like data does. This is dominated by storing the hash keys, so
+# compare the rate across builds.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'records=i'       => \( my $nrecords= 100_000 ),
+    'keys=i'          => \( my $nkeys= 20 ),
+    'key-length=i'    => \( my $key_length= 12 ),
+) or die "Bad option";
+
+my @keys= map { sprintf "%-*s", $key_length, "field_$_" } 1 .. $nkeys;
+my $data= [ map { my $n= $_; +{ map { $_ => $n } @keys } } 1 .. $nrecords ];
+my $doc= Sereal::Encoder->new->encode($data);
+printf "%d records of %d keys of %d bytes, %d bytes\n", $nrecords, $nkeys, $key_length, length $doc;
+
+my $dec= Sereal::Decoder->new;
+timethis( $duration, sub { sereal_decode_with_object( $dec, $doc ) }, "decode" );
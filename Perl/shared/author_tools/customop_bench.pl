@@ -0,0 +1,44 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Encoder qw(sereal_encode_with_object encode_sereal encode_sereal_with_header_data);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Getopt::Long qw(GetOptions);
+
+# Measures the per call overhead of the encoding and decoding functions on
+# tiny payloads, where it matters most. Plain calls compile to custom ops,
+# calls with & bypass the prototype and go through a regular sub call.
+
+GetOptions( 'secs|duration=f' => \( my $duration= -3 ), ) or die "Bad option";
+
+my $data= { id => 42, ok => 1 };
+my $enc= Sereal::Encoder->new();
+my $dec= Sereal::Decoder->new();
+my $doc= $enc->encode($data);
+
+my %benchmarks= (
+    sereal_encode_with_object => {
+        custom_op => sub { sereal_encode_with_object( $enc, $data ) },
+        sub_call  => sub { &sereal_encode_with_object( $enc, $data ) },
+        method    => sub { $enc->encode($data) },
+    },
+    encode_sereal => {
+        custom_op => sub { encode_sereal($data) },
+        sub_call  => sub { &encode_sereal($data) },
+    },
+    encode_sereal_with_header_data => {
+        custom_op => sub { encode_sereal_with_header_data( $data, 1 ) },
+        sub_call  => sub { &encode_sereal_with_header_data( $data, 1 ) },
+    },
+    sereal_decode_with_object => {
+        custom_op => sub { sereal_decode_with_object( $dec, $doc ) },
+        sub_call  => sub { &sereal_decode_with_object( $dec, $doc ) },
+        method    => sub { $dec->decode($doc) },
+    },
+);
+
+foreach my $name ( sort keys %benchmarks ) {
+    print "\n$name:\n";
+    cmpthese( $duration, $benchmarks{$name} );
+}
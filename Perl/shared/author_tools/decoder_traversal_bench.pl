@@ -0,0 +1,50 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(timethese :hireswallclock);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Sereal::Encoder qw(encode_sereal);
+use Getopt::Long qw(GetOptions);
+
+# Measures how fast the decoder reads deep and wide data structures: linked
+# lists and nested arrays that are many levels deep, large flat arrays and
+# hashes, arrays of small records and a tree of hashes. Run it against two
+# builds to compare changes to the traversal.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'depth=i'         => \( my $depth= 5000 ),
+    'items=i'         => \( my $nitems= 100_000 ),
+) or die "Bad option";
+
+my %datasets;
+{
+    my $list;
+    $list= { value => $_, next => $list } for 1 .. $depth;
+    $datasets{deep_list}= $list;
+
+    my $nested= [];
+    $nested= [ $_, $nested ] for 1 .. $depth;
+    $datasets{deep_arrays}= $nested;
+}
+$datasets{wide_array}= [ map { "item $_" } 1 .. $nitems ];
+$datasets{wide_hash}= { map { ( "key $_" => $_ ) } 1 .. $nitems };
+$datasets{records}= [ map { { id => $_, name => "row $_", tags => [ 1, 2, 3 ] } } 1 .. $nitems / 10 ];
+$datasets{tree}= do {
+    my $build;
+    $build= sub {
+        my ($level)= @_;
+        return $level ? { left => $build->( $level - 1 ), right => $build->( $level - 1 ), level => $level } : "leaf";
+    };
+    $build->(14);
+};
+
+my $dec= Sereal::Decoder->new( { max_recursion_depth => 10 * $depth } );
+timethese(
+    $duration,
+    {
+        map {
+            my $doc= encode_sereal( $datasets{$_}, { max_recursion_depth => 10 * $depth } );
+            $_ => sub { sereal_decode_with_object( $dec, $doc ) }
+        } sort keys %datasets
+    } );
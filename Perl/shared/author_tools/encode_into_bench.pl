@@ -0,0 +1,47 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Encoder;
+use Getopt::Long qw(GetOptions);
+
+# Compares encode, which copies the encoder's buffer into a new string on
+# every call, with encode_into, which writes into the caller's string and
+# keeps its allocation from one call to the next. Both for replacing the
+# string with each document and for batching documents back to back in one
+# string, as a message bus would, flushing it every --batch documents.
+# Both are called as methods, so that the call overhead is the same.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'batch=i'         => \( my $batch= 100 ),
+) or die "Bad option";
+
+my %datasets= (
+    tiny   => { id => 42, ok => 1 },
+    small  => { map { ( "key$_" => "value $_" ) } 1 .. 20 },
+    medium => [ map { { id => $_, name => "name $_", tags => [ 1 .. 5 ] } } 1 .. 200 ],
+    large  => [ map { "x" x 1000 } 1 .. 1000 ],
+);
+
+my $enc= Sereal::Encoder->new();
+
+foreach my $name (qw(tiny small medium large)) {
+    my $data= $datasets{$name};
+    printf "\n%s (%d bytes):\n", $name, length $enc->encode($data);
+    my ( $str, $buf, $cat, $into, $n_cat, $n_into );
+    cmpthese(
+        $duration,
+        {
+            encode      => sub { $str= $enc->encode($data) },
+            encode_into => sub { $enc->encode_into( $buf, $data ) },
+            append_cat  => sub {
+                $cat= "" if ++$n_cat % $batch == 0;
+                $cat .= $enc->encode($data);
+            },
+            append_into => sub {
+                $into= "" if ++$n_into % $batch == 0;
+                $enc->encode_into( $into, $data, 1 );
+            },
+        } );
+}
@@ -3,9 +3,16 @@ use strict;
 use warnings;
 use Sereal::Encoder;
 use Sereal::Decoder;
+use Getopt::Long qw(GetOptions);
 
 use Benchmark::Dumb qw(cmpthese);
 
+GetOptions(
+    'timing=s'  => \( my $timing= "1000.01" ),
+    'objects=i' => \( my $nobjects= 100 ),
+    'depth=i'   => \( my $depth= 5 ),
+) or die "Bad option";
+
 my $enc_nocb= Sereal::Encoder->new();
 my $enc_cb= Sereal::Encoder->new( { freeze_callbacks => 1 } );
 my $dec= Sereal::Decoder->new();
@@ -29,23 +36,35 @@ sub THAW {
 
 package main;
 
+# FREEZE and THAW inherited through a chain of $depth classes, where looking
+# them up for every object is most expensive
+my $deep_class= "Foo";
+for my $level ( 1 .. $depth ) {
+    no strict 'refs';
+    @{"Deep${level}::ISA"}= ($deep_class);
+    $deep_class= "Deep${level}";
+}
+
 my $data= Foo->new( name => "blargh" );
 my $data_big= [];
-for ( 1 .. 100 ) {
+for ( 1 .. $nobjects ) {
     push @$data_big, Foo->new( name => "blargh" );
 }
 my $data_big_nocb= [];
-for ( 1 .. 100 ) {
+for ( 1 .. $nobjects ) {
     push @$data_big_nocb, bless( { name => "blargh" } => "Bar" );
 }
+my $data_big_deep= [];
+for ( 1 .. $nobjects ) {
+    push @$data_big_deep, bless( { name => "blargh" } => $deep_class );
+}
 
 my $frozen_nocb= $enc_nocb->encode($data);
 my $frozen_cb= $enc_cb->encode($data);
 
 my $frozen_big_nocb= $enc_nocb->encode($data_big);
 my $frozen_big_cb= $enc_cb->encode($data_big);
-
-my $timing= "1000.01";
+my $frozen_big_deep= $enc_cb->encode($data_big_deep);
 
 print "Comparing small serialization with/out callbacks...\n";
 cmpthese(
@@ -61,6 +80,7 @@ cmpthese(
     {
         cb             => sub { $enc_cb->encode($data_big) },
         no_cb          => sub { $enc_nocb->encode($data_big) },
+        cb_deep        => sub { $enc_cb->encode($data_big_deep) },
         cb_nocbdata    => sub { $enc_cb->encode($data_big_nocb) },
         no_cb_nocbdata => sub { $enc_nocb->encode($data_big_nocb) },
     } );
@@ -77,6 +97,7 @@ print "Comparing big deserialization with/out callbacks...\n";
 cmpthese(
     $timing,
     {
-        cb    => sub { $dec->decode($frozen_big_cb) },
-        no_cb => sub { $dec->decode($frozen_big_nocb) },
+        cb      => sub { $dec->decode($frozen_big_cb) },
+        cb_deep => sub { $dec->decode($frozen_big_deep) },
+        no_cb   => sub { $dec->decode($frozen_big_nocb) },
     } );
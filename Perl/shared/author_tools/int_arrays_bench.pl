@@ -0,0 +1,50 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(timethese :hireswallclock);
+use Sereal::Encoder qw(sereal_encode_with_object);
+use Getopt::Long qw(GetOptions);
+
+# Measures encoding int-heavy payloads: large arrays of integers of a few
+# typical sizes, plain and packed (the pack_numeric_arrays option), arrays
+# where integers alternate with strings, and many small arrays of integers.
+# Build the encoder with OPTIMIZE='-O2 -DSRL_VARINT_NO_WORDS' to compare with
+# writing varints a byte at a time.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'items=i'         => \( my $nitems= 100_000 ),
+) or die "Bad option";
+
+# a cheap deterministic sequence, so runs compare
+my $seed= 42;
+sub next_rand { $seed= ( $seed * 1103515245 + 12345 ) % 2**31; return $seed / 2**31 }
+
+my %datasets= (
+    small      => [ map { int( next_rand() * 16 ) } 1 .. $nitems ],
+    bytes      => [ map { int( next_rand() * 256 ) } 1 .. $nitems ],
+    ids        => [ map { 1 + int( next_rand() * 1_000_000 ) } 1 .. $nitems ],
+    timestamps => [ map { 1_600_000_000 + int( next_rand() * 100_000_000 ) } 1 .. $nitems ],
+    skewed     => [ map { int( 2**( next_rand()**2 * 40 ) ) } 1 .. $nitems ],
+    signed     => [ map { int( ( next_rand() - 0.5 ) * 2**( 4 + next_rand() * 28 ) ) } 1 .. $nitems ],
+    mixed      => [ map { $_ % 4 ? int( next_rand() * 100_000 ) : "str$_" } 1 .. $nitems ],
+    rows       => [ map { [ map { int( next_rand() * 100_000 ) } 1 .. 10 ] } 1 .. $nitems / 10 ],
+);
+
+my %enc= (
+    plain  => Sereal::Encoder->new(),
+    packed => Sereal::Encoder->new( { pack_numeric_arrays => 1 } ),
+);
+
+foreach my $name ( sort keys %datasets ) {
+    my $data= $datasets{$name};
+    print "\n$name:\n";
+    timethese(
+        $duration,
+        {
+            map {
+                my $enc= $enc{$_};
+                $_ => sub { sereal_encode_with_object( $enc, $data ) }
+            } sort keys %enc
+        } );
+}
@@ -0,0 +1,58 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Sereal::Encoder qw(sereal_encode_with_object);
+use Getopt::Long qw(GetOptions);
+
+# Compares encoding numeric arrays as plain ARRAY and as packed MANY (the
+# pack_numeric_arrays option). Prints the encoded size and the encode/decode
+# rate for arrays of small and large integers, negative integers, floats and
+# doubles.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'items=i'         => \( my $nitems= 1_000_000 ),
+) or die "Bad option";
+
+my %datasets= (
+    small_ints    => [ map { $_ % 100 } 1 .. $nitems ],
+    large_ints    => [ map { $_ * 1009 } 1 .. $nitems ],
+    negative_ints => [ map { $_ * 1009 - $nitems * 500 } 1 .. $nitems ],
+    floats        => [ map { $_ / 4 } 1 .. $nitems ],
+    doubles       => [ map { $_ / 3 + 0.1 } 1 .. $nitems ],
+);
+
+my %enc= (
+    plain  => Sereal::Encoder->new(),
+    packed => Sereal::Encoder->new( { pack_numeric_arrays => 1 } ),
+);
+my $dec= Sereal::Decoder->new();
+
+foreach my $name ( sort keys %datasets ) {
+    my $data= $datasets{$name};
+    my %encoded= map { $_ => sereal_encode_with_object( $enc{$_}, $data ) } keys %enc;
+    print "\n$name ($nitems items)\n";
+    printf "%-8s %10d bytes\n", $_, length $encoded{$_} for sort keys %encoded;
+
+    print "encode:\n";
+    cmpthese(
+        $duration,
+        {
+            map {
+                my $enc= $enc{$_};
+                $_ => sub { sereal_encode_with_object( $enc, $data ) }
+            } keys %enc
+        } );
+
+    print "decode:\n";
+    cmpthese(
+        $duration,
+        {
+            map {
+                my $doc= $encoded{$_};
+                $_ => sub { sereal_decode_with_object( $dec, $doc ) }
+            } keys %encoded
+        } );
+}
@@ -0,0 +1,81 @@
+/* Microbenchmark for the pointer table in ptable.h, see ptable_bench.pl
+ * which builds this against the current and an older ptable.h and compares
+ * the results.
+ *
+ * The access pattern is the one of the encoder's ref_seenhash: for every
+ * "document" the table is cleared, then every item is looked up and stored
+ * if it wasn't seen before, and a fraction of the items is seen again.
+ * The keys are laid out like SV heads in a Perl arena.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "EXTERN.h"
+#include "perl.h"
+
+#include "srl_inline.h"
+#ifndef PTABLE_HEADER
+#   define PTABLE_HEADER "ptable.h"
+#endif
+#include PTABLE_HEADER
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char **argv)
+{
+    const UV items = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+    const double duration = argc > 2 ? atof(argv[2]) : 1;
+    const UV repeat_every = 4; /* every 4th item is referenced twice */
+    char *arena;
+    void **keys;
+    PTABLE_t *tbl;
+    UV i, docs = 0, found = 0;
+    double start, elapsed;
+
+    /* SV heads are 24 bytes on 64-bit perls; visit them in a shuffled order
+     * like a graph of objects created at different times would. */
+    arena = (char *)malloc(items * 24 + 24);
+    keys = (void **)malloc(items * sizeof(void *));
+    for (i = 0; i < items; i++)
+        keys[i] = arena + i * 24;
+    srand(42);
+    for (i = items - 1; i > 0; i--) {
+        UV j = (UV)rand() % (i + 1);
+        void *tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    tbl = PTABLE_new();
+    start = now();
+    do {
+        UV n;
+        for (n = 0; n < 16; n++) {
+            PTABLE_clear(tbl);
+            for (i = 0; i < items; i++) {
+                if (!PTABLE_fetch(tbl, keys[i]))
+                    PTABLE_store(tbl, keys[i], INT2PTR(void *, i + 1));
+                if (i % repeat_every == 0 && PTABLE_fetch(tbl, keys[i / 2]))
+                    found++;
+            }
+            docs++;
+        }
+        elapsed = now() - start;
+    } while (elapsed < duration);
+    PTABLE_free(tbl);
+
+    /* documents/s and nanoseconds per item */
+    printf("%"UVuf" %.1f %.2f %"UVuf"\n", items, docs / elapsed, elapsed * 1e9 / (docs * items), found);
+    free(keys);
+    free(arena);
+    return 0;
+}
@@ -0,0 +1,58 @@
+use strict;
+use warnings;
+use Cwd qw(abs_path);
+use File::Basename qw(dirname);
+use File::Spec;
+use File::Temp qw(tempdir);
+use Getopt::Long qw(GetOptions);
+
+# Compares the pointer table in shared/ptable.h with the one from an older
+# revision (by default the one before the last change to ptable.h) by
+# building author_tools/ptable_bench.c against both of them.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= 1 ),
+    'size=i@'         => \( my $sizes= undef ),
+    'old=s'           => \( my $old_rev= undef ),
+    'cc=s'            => \( my $cc= "cc" ),
+) or die "Bad option";
+
+$sizes ||= [ 100, 1_000, 10_000, 100_000, 1_000_000 ];
+
+my $tools= dirname( abs_path(__FILE__) );
+my $shared= dirname($tools);
+my $dir= tempdir( CLEANUP => 1 );
+
+if ( !defined $old_rev ) {
+    chomp( $old_rev= `git -C "$shared" log -1 --format=%H -- ptable.h` );
+    die "Can't find the last change to ptable.h\n" if !$old_rev;
+    $old_rev .= "^";
+}
+my $old_header= File::Spec->catfile( $dir, "ptable_old.h" );
+system("git -C \"$shared\" show \"$old_rev:./ptable.h\" > \"$old_header\"") == 0
+    or die "Can't get ptable.h from '$old_rev'\n";
+
+chomp( my $ccopts= `$^X -MExtUtils::Embed -e ccopts` );
+chomp( my $ldopts= `$^X -MExtUtils::Embed -e ldopts` );
+
+my %bin;
+foreach my $which ( [ old => $old_header ], [ new => File::Spec->catfile( $shared, "ptable.h" ) ] ) {
+    my ( $name, $header )= @$which;
+    $bin{$name}= File::Spec->catfile( $dir, "ptable_bench_$name" );
+    my $cmd= qq{$cc -O2 $ccopts -I"$shared" -DPTABLE_HEADER='"$header"' }
+        . qq{-o "$bin{$name}" "$tools/ptable_bench.c" $ldopts};
+    system($cmd) == 0 or die "Failed to build: $cmd\n";
+}
+
+printf "Comparing ptable.h with the one from %s\n\n", $old_rev;
+printf "%10s %14s %14s %10s %10s %8s\n", "items", "old docs/s", "new docs/s", "old ns/key", "new ns/key", "speedup";
+foreach my $size (@$sizes) {
+    my %res;
+    foreach my $name (qw(old new)) {
+        my ( $items, $rate, $ns, $found )= split " ", `"$bin{$name}" $size $duration`;
+        die "Benchmark failed\n" if !defined $found;
+        $res{$name}= { rate => $rate, ns => $ns };
+    }
+    printf "%10d %14.1f %14.1f %10.2f %10.2f %7.0f%%\n", $size, $res{old}{rate}, $res{new}{rate},
+        $res{old}{ns}, $res{new}{ns}, 100 * ( $res{new}{rate} / $res{old}{rate} - 1 );
+}
@@ -0,0 +1,81 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Sereal::Encoder qw(sereal_encode_with_object SRL_ZSTD);
+use Getopt::Long qw(GetOptions);
+
+# Compares encoding arrays of hashes with the same keys as plain hashes and
+# as record batches (the record_batches option), with and without zstd.
+# Prints the encoded size and the encode/decode rate for rows as they come
+# out of a database and for parsed log lines.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'rows=i'          => \( my $nrows= 10_000 ),
+) or die "Bad option";
+
+my @status= qw(active inactive banned);
+my %datasets= (
+    db_rows => [
+        map {
+            {
+                id         => $_,
+                name       => "user $_",
+                email      => "user$_\@example.com",
+                status     => $status[ $_ % 3 ],
+                created_at => 1_600_000_000 + $_ * 17,
+                score      => $_ / 7,
+            }
+        } 1 .. $nrows
+    ],
+    log_lines => [
+        map {
+            {
+                ts      => 1_700_000_000 + $_,
+                level   => ( $_ % 10 ? "info" : "warn" ),
+                host    => "web" . ( $_ % 8 ),
+                path    => "/api/v1/items/" . ( $_ % 500 ),
+                status  => ( $_ % 50 ? 200 : 500 ),
+                elapsed => ( $_ % 97 ) / 1000,
+                agent   => "Mozilla/5.0",
+            }
+        } 1 .. $nrows
+    ],
+);
+
+my %enc= (
+    plain        => Sereal::Encoder->new(),
+    batched      => Sereal::Encoder->new( { record_batches => 1 } ),
+    plain_zstd   => Sereal::Encoder->new( { compress => SRL_ZSTD } ),
+    batched_zstd => Sereal::Encoder->new( { compress => SRL_ZSTD, record_batches => 1 } ),
+);
+my $dec= Sereal::Decoder->new();
+
+foreach my $name ( sort keys %datasets ) {
+    my $data= $datasets{$name};
+    my %encoded= map { $_ => sereal_encode_with_object( $enc{$_}, $data ) } keys %enc;
+    print "\n$name ($nrows rows)\n";
+    printf "%-12s %10d bytes\n", $_, length $encoded{$_} for sort keys %encoded;
+
+    print "encode:\n";
+    cmpthese(
+        $duration,
+        {
+            map {
+                my $enc= $enc{$_};
+                $_ => sub { sereal_encode_with_object( $enc, $data ) }
+            } keys %enc
+        } );
+
+    print "decode:\n";
+    cmpthese(
+        $duration,
+        {
+            map {
+                my $doc= $encoded{$_};
+                $_ => sub { sereal_decode_with_object( $dec, $doc ) }
+            } keys %encoded
+        } );
+}
@@ -0,0 +1,47 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Sereal::Encoder;
+use Getopt::Long qw(GetOptions);
+
+# Compares decoding documents full of regexps, drawn from a small set of
+# distinct patterns as with validation rules or routing tables, with and
+# without the regexp_cache_size option. Prints the cache stats after the
+# run.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'regexps=i'       => \( my $nregexps= 1000 ),
+    'patterns=i'      => \( my $npatterns= 50 ),
+    'cache-size=i'    => \( my $cache_size= 100 ),
+) or die "Bad option";
+
+# a new qr// object for every item, the encoder would refer back to the first
+# occurrence of the same object
+my $data= [
+    map {
+        my $n= $_ % $npatterns;
+        { id => $_, rule => qr/^(?:item|entry)[-_]$n(\d+)\s*=\s*(\w+)$/i }
+    } 1 .. $nregexps
+];
+my $doc= Sereal::Encoder->new->encode($data);
+printf "%d regexps of %d distinct patterns, %d bytes\n", $nregexps, $npatterns, length $doc;
+
+my %dec= (
+    compile => Sereal::Decoder->new(),
+    cache   => Sereal::Decoder->new( { regexp_cache_size => $cache_size } ),
+);
+
+cmpthese(
+    $duration,
+    {
+        map {
+            my $dec= $dec{$_};
+            $_ => sub { sereal_decode_with_object( $dec, $doc ) }
+        } keys %dec
+    } );
+
+my $stats= $dec{cache}->regexp_cache_stats;
+print join( ", ", map { "$_: $stats->{$_}" } sort keys %$stats ), "\n";
@@ -0,0 +1,56 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Sereal::Encoder qw(sereal_encode_with_object);
+use Getopt::Long qw(GetOptions);
+
+# Compares decoding a whole document with decoding only a few values of it
+# with the select_paths option, for a large API response with a small header
+# and many records, plain and as record batches.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'rows=i'          => \( my $nrows= 500 ),
+) or die "Bad option";
+
+my $data= {
+    status  => "ok",
+    request => { id => "abc123", elapsed => 0.25, host => "web3" },
+    items   => [
+        map {
+            {
+                id      => $_,
+                name    => "item $_",
+                price   => $_ * 1.5,
+                tags    => [ "tag" . ( $_ % 7 ), "tag" . ( $_ % 11 ) ],
+                details => { color => "red", size => $_ % 5, text => "lorem ipsum " x 4 },
+            }
+        } 1 .. $nrows
+    ],
+};
+
+my %paths= (
+    header => [ '$.status', '$.request.id' ],
+    ids    => '$.items[*].id',
+    first  => '$.items[0:3]',
+);
+my %dec= (
+    whole => Sereal::Decoder->new(),
+    map { $_ => Sereal::Decoder->new( { select_paths => $paths{$_} } ) } keys %paths,
+);
+
+foreach my $batched ( 0, 1 ) {
+    my $enc= Sereal::Encoder->new( { record_batches => $batched } );
+    my $doc= sereal_encode_with_object( $enc, $data );
+    printf "\n%s, %d bytes\n", ( $batched ? "record batches" : "plain" ), length $doc;
+    cmpthese(
+        $duration,
+        {
+            map {
+                my $dec= $dec{$_};
+                $_ => sub { sereal_decode_with_object( $dec, $doc ) }
+            } keys %dec
+        } );
+}
@@ -0,0 +1,46 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Decoder;
+use Sereal::Encoder;
+use Getopt::Long qw(GetOptions);
+use Data::Dumper qw(Dumper);
+
+# Shows what the stats option costs, encoding and decoding with and without
+# it, and with --dump what it reports for each dataset.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'dump'            => \( my $dump ),
+) or die "Bad option";
+
+my %datasets= (
+    small   => { map { ( "key$_" => "value $_" ) } 1 .. 20 },
+    records => [ map { { id => $_, name => "name $_", price => $_ * 1.5, tags => [ 1 .. 5 ] } } 1 .. 500 ],
+    strings => [ map { "x" x 1000 } 1 .. 1000 ],
+);
+
+my %enc= map { $_ => Sereal::Encoder->new( { stats => $_ eq "stats" } ) } qw(plain stats);
+my %dec= map { $_ => Sereal::Decoder->new( { stats => $_ eq "stats" } ) } qw(plain stats);
+
+foreach my $name (qw(small records strings)) {
+    my $data= $datasets{$name};
+    my $encoded= $enc{plain}->encode($data);
+    printf "\n%s (%d bytes):\n", $name, length $encoded;
+    cmpthese(
+        $duration,
+        {
+            map {
+                my $kind= $_;
+                ( "encode_$kind" => sub { $enc{$kind}->encode($data) },
+                  "decode_$kind" => sub { $dec{$kind}->decode($encoded) } )
+            } qw(plain stats)
+        } );
+    if ($dump) {
+        local $Data::Dumper::Sortkeys= 1;
+        local $Data::Dumper::Indent= 1;
+        print Dumper( $enc{stats}->stats, $dec{stats}->stats );
+    }
+    $_->reset_stats for values(%enc), values(%dec);
+}
@@ -0,0 +1,107 @@
+use strict;
+use warnings;
+use Sereal::Decoder qw(decode_sereal);
+use Sereal::Encoder;
+use File::Find qw(find);
+use File::Temp qw(tempdir);
+use File::Spec;
+use Getopt::Long qw(GetOptions);
+
+# Builds a zstd dictionary for use with the zstd_dictionary option of
+# Sereal::Encoder (and zstd_dictionaries of Sereal::Decoder) from a set of
+# sample Sereal documents (*.srl files).
+#
+# Every sample is decoded and re-encoded without compression, and the document
+# bodies are what the dictionary is trained on, since that is what gets
+# compressed. Training is done by zstd's dictionary builder via the zstd
+# command line tool. Without it (or with --raw) a raw content dictionary is
+# built by concatenating sample bodies instead, which is much less effective
+# but needs no external tools.
+#
+#   perl train_zstd_dictionary.pl --out my.dict --size 16384 samples_dir/
+
+GetOptions(
+    'out|o=s'  => \( my $out= undef ),
+    'size=i'   => \( my $size= 16 * 1024 ),
+    'id=i'     => \( my $dict_id= undef ),
+    'zstd=s'   => \( my $zstd= "zstd" ),
+    'raw'      => \( my $raw= 0 ),
+    'verbose'  => \( my $verbose= 0 ),
+) or die "Bad option";
+
+defined $out or die "Need --out FILE";
+@ARGV or die "Need at least one directory (or file) with sample .srl documents";
+
+my @files;
+find(
+    {
+        no_chdir => 1,
+        wanted   => sub { push @files, $_ if -f $_ && /\.srl\z/ },
+    },
+    @ARGV
+);
+@files or die "Found no .srl files in @ARGV";
+
+my $enc= Sereal::Encoder->new();
+my @bodies;
+foreach my $file ( sort @files ) {
+    open my $fh, "<:raw", $file or die "Can't open '$file': $!";
+    my $doc= do { local $/; <$fh> };
+    close $fh;
+
+    my $data= eval { decode_sereal($doc) };
+    if ( !defined $data && $@ ) {
+        warn "Skipping '$file': $@";
+        next;
+    }
+
+    # magic, version/encoding byte and an empty header suffix
+    my $body= $enc->encode($data);
+    substr( $body, 0, 6, "" );
+    push @bodies, $body;
+}
+printf "Read %d samples, %d bytes of uncompressed document bodies\n",
+    scalar(@bodies), length( join "", @bodies );
+
+if ( !$raw && system("$zstd --version >/dev/null 2>&1") == 0 ) {
+    my $dir= tempdir( CLEANUP => 1 );
+    my @sample_files;
+    foreach my $i ( 0 .. $#bodies ) {
+        my $fname= File::Spec->catfile( $dir, "sample_$i" );
+        open my $fh, ">:raw", $fname or die "Can't write '$fname': $!";
+        print $fh $bodies[$i];
+        close $fh;
+        push @sample_files, $fname;
+    }
+    my @cmd= ( $zstd, "--train", "-q", "-f", "-o", $out, "--maxdict=$size" );
+    push @cmd, "--dictID=$dict_id" if defined $dict_id;
+    print "Running: @cmd <samples>\n" if $verbose;
+    system( @cmd, @sample_files ) == 0
+        or die "zstd dictionary training failed, try --raw\n";
+}
+else {
+    warn "zstd command line tool not found, building raw content dictionary\n" if !$raw;
+    warn "--id is ignored for raw content dictionaries\n" if defined $dict_id;
+
+    # zstd prefers the most useful content at the end of the dictionary
+    my $dict= "";
+    foreach my $body (@bodies) {
+        last if length($dict) + length($body) > $size;
+        $dict= $body . $dict;
+    }
+    open my $fh, ">:raw", $out or die "Can't write '$out': $!";
+    print $fh $dict;
+    close $fh;
+}
+
+open my $fh, "<:raw", $out or die "Can't open '$out': $!";
+my $dict= do { local $/; <$fh> };
+close $fh;
+
+my ( $magic, $id )= unpack( "VV", $dict );
+if ( defined $magic && $magic == 0xEC30A437 ) {
+    printf "Wrote %d byte zstd dictionary with ID %u to '%s'\n", length($dict), $id, $out;
+}
+else {
+    printf "Wrote %d byte raw content dictionary to '%s'\n", length($dict), $out;
+}
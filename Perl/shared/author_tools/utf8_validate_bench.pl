@@ -0,0 +1,49 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Encoder qw(sereal_encode_with_object);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Getopt::Long qw(GetOptions);
+
+# Measures what the validate_utf8 option costs when decoding documents of
+# long UTF-8 strings in ASCII, accented Latin, CJK, emoji and a mix of them.
+# Build the decoder with OPTIMIZE='-O2 -DSRL_UTF8_NO_SIMD' to compare with
+# checking the strings with Perl's is_utf8_string() alone.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -2 ),
+    'strings=i'       => \( my $nstrings= 1000 ),
+    'length=i'        => \( my $length= 200 ),
+) or die "Bad option";
+
+my %alphabets= (
+    ascii => [ 'a' .. 'z', ' ' ],
+    latin => [ "\x{e9}", "\x{e8}", "\x{fc}", "\x{e7}", 'a' .. 'z', ' ' ],
+    cjk   => [ map { chr } 0x4e00 .. 0x4e80 ],
+    emoji => [ map { chr } 0x1f600 .. 0x1f640 ],
+);
+$alphabets{mixed}= [ map { @$_ } @alphabets{qw(ascii cjk emoji)} ];
+
+my $enc= Sereal::Encoder->new();
+my $dec= Sereal::Decoder->new();
+my $validating_dec= Sereal::Decoder->new( { validate_utf8 => 1 } );
+
+foreach my $corpus ( sort keys %alphabets ) {
+    my $chars= $alphabets{$corpus};
+    my @strings= map {
+        my $i= $_;
+        join "", map { $chars->[ ( $i * 7 + $_ * 13 ) % @$chars ] } 1 .. $length
+    } 1 .. $nstrings;
+    utf8::upgrade($_) for @strings;
+    my $encoded= sereal_encode_with_object( $enc, \@strings );
+
+    printf "%s: %d strings of %d characters, %d bytes\n", $corpus, $nstrings, $length, length $encoded;
+    cmpthese(
+        $duration,
+        {
+            decode        => sub { sereal_decode_with_object( $dec,            $encoded ) },
+            validate_utf8 => sub { sereal_decode_with_object( $validating_dec, $encoded ) },
+        } );
+    print "\n";
+}
@@ -0,0 +1,54 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Sereal::Encoder qw(sereal_encode_with_object);
+use Getopt::Long qw(GetOptions);
+
+# Compares checking documents with validate() to decoding them and throwing
+# the result away, which is what one had to do before, for documents with
+# many records, short strings, nested structures and shared values.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'rows=i'          => \( my $nrows= 500 ),
+) or die "Bad option";
+
+my $shared= { currency => "EUR", region => "eu-west" };
+my %datasets= (
+    records => [
+        map {
+            {
+                id      => $_,
+                name    => "item $_",
+                price   => $_ * 1.5,
+                tags    => [ "tag" . ( $_ % 7 ), "tag" . ( $_ % 11 ) ],
+                details => { color => "red", size => $_ % 5, text => "lorem ipsum " x 4 },
+                market  => $shared,
+            }
+        } 1 .. $nrows
+    ],
+    strings => [ map { "string number $_" } 1 .. 20 * $nrows ],
+    numbers => [ map { $_ * 7919 } 1 .. 20 * $nrows ],
+    nested  => do {
+        my $tree= "leaf";
+        $tree= { level => $_, left => $tree, right => [ $_, "x" ] } for 1 .. $nrows;
+        $tree;
+    },
+);
+
+my $dec= Sereal::Decoder->new( { max_recursion_depth => 10 * $nrows } );
+foreach my $opt ( { dedupe_strings => 1 }, { record_batches => 1, compress => Sereal::Encoder::SRL_ZSTD() } ) {
+    my $enc= Sereal::Encoder->new( { %$opt, max_recursion_depth => 10 * $nrows } );
+    foreach my $name ( sort keys %datasets ) {
+        my $doc= sereal_encode_with_object( $enc, $datasets{$name} );
+        printf "\n%s (%s), %d bytes\n", $name, join( ", ", map { "$_ => $opt->{$_}" } sort keys %$opt ), length $doc;
+        cmpthese(
+            $duration,
+            {
+                decode   => sub { sereal_decode_with_object( $dec, $doc ) },
+                validate => sub { $dec->validate($doc) },
+            } );
+    }
+}
@@ -0,0 +1,65 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(timethese :hireswallclock);
+use Sereal::Encoder qw(sereal_encode_with_object);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Getopt::Long qw(GetOptions);
+
+# Measures reading varints: decoding, validating and skipping over arrays of
+# integers whose encoded lengths follow a few realistic distributions, plain
+# and packed (MANY), and strings whose lengths are varints too. Build the
+# readers with OPTIMIZE='-O3 -DSRL_VARINT_NO_WORDS' to compare with skipping
+# runs of varints a byte at a time.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -2 ),
+    'items=i'         => \( my $nitems= 100_000 ),
+) or die "Bad option";
+
+my $have_iterator= eval { require Sereal::Path::Iterator; 1 };
+
+# a cheap deterministic sequence, so runs compare
+my $seed= 42;
+sub next_rand { $seed= ( $seed * 1103515245 + 12345 ) % 2**31; return $seed / 2**31 }
+
+my %datasets= (
+    # counters and flags: 1 byte
+    small => [ map { int( next_rand() * 128 ) } 1 .. $nitems ],
+    # database ids: mostly 3 bytes
+    ids => [ map { 1 + int( next_rand() * 1_000_000 ) } 1 .. $nitems ],
+    # unix timestamps: 5 bytes
+    timestamps => [ map { 1_600_000_000 + int( next_rand() * 100_000_000 ) } 1 .. $nitems ],
+    # mostly small, with a long tail: 1 to 4 bytes
+    skewed => [ map { int( 2**( next_rand()**2 * 28 ) ) } 1 .. $nitems ],
+    # large signed deltas, zigzag encoded: 2 to 5 bytes
+    deltas => [ map { int( ( next_rand() - 0.5 ) * 2**( 8 + next_rand() * 24 ) ) } 1 .. $nitems ],
+    # 62 bit hashes: 9 bytes, longer than a word
+    hashes => [ map { int( next_rand() * 2**31 ) * 2**31 + int( next_rand() * 2**31 ) } 1 .. $nitems ],
+    # strings of varied length, each with a length varint
+    strings => [ map { "x" x int( 2**( next_rand() * 9 ) ) } 1 .. $nitems / 10 ],
+);
+
+my %enc= (
+    plain  => Sereal::Encoder->new(),
+    packed => Sereal::Encoder->new( { pack_numeric_arrays => 1 } ),
+);
+my $dec= Sereal::Decoder->new();
+my $iter= $have_iterator ? Sereal::Path::Iterator->new() : undef;
+
+foreach my $name ( sort keys %datasets ) {
+    foreach my $packing ( sort keys %enc ) {
+        next if $packing eq 'packed' && $name eq 'strings';
+        # the array and a value after it, for the iterator to skip to
+        my $doc= sereal_encode_with_object( $enc{$packing}, [ $datasets{$name}, 1 ] );
+        my %tests= (
+            decode   => sub { sereal_decode_with_object( $dec, $doc ) },
+            validate => sub { $dec->validate($doc) },
+        );
+        $tests{skip}= sub { $iter->set($doc); $iter->step_in; $iter->next }
+            if $iter;
+
+        printf "\n%s, %s: %d bytes\n", $name, $packing, length $doc;
+        timethese( $duration, \%tests );
+    }
+}
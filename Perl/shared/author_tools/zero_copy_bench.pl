@@ -0,0 +1,55 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Sereal::Encoder;
+use Getopt::Long qw(GetOptions);
+
+# Compares decoding documents holding large strings (HTML fragments, images)
+# with and without the zero_copy_strings_over option, for uncompressed and
+# zstd compressed documents. Prints how many bytes of strings each decode
+# copies and the decode rate.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'blobs=i'         => \( my $nblobs= 50 ),
+    'min-size=i'      => \( my $min_size= 10_000 ),
+    'max-size=i'      => \( my $max_size= 200_000 ),
+    'threshold=i'     => \( my $threshold= 4096 ),
+) or die "Bad option";
+
+srand(42);
+my @blobs= map {
+    my $len= $min_size + int( rand( $max_size - $min_size ) );
+    join "", map { chr( 97 + int rand 26 ) } 1 .. $len;
+} 1 .. $nblobs;
+my $data= [ map { { id => $_, html => $blobs[$_], title => "page $_" } } 0 .. $#blobs ];
+
+my $blob_bytes= 0;
+$blob_bytes+= length for @blobs;
+printf "%d strings of %d to %d bytes, %d bytes in total\n", $nblobs, $min_size, $max_size, $blob_bytes;
+
+my %dec= (
+    copy      => Sereal::Decoder->new(),
+    zero_copy => Sereal::Decoder->new( { zero_copy_strings_over => $threshold } ),
+);
+
+foreach my $compress ( 0, Sereal::Encoder::SRL_ZSTD() ) {
+    my $doc= Sereal::Encoder->new( { compress => $compress } )->encode($data);
+    printf "\n%s (%d bytes):\n", $compress ? "zstd" : "uncompressed", length $doc;
+    foreach my $name ( sort keys %dec ) {
+        my $got= sereal_decode_with_object( $dec{$name}, $doc );
+        my $copied= 0;
+        $copied+= Internals::SvREADONLY( $_->{html} ) ? 0 : length $_->{html} for @$got;
+        printf "%-10s copies %d bytes of strings\n", $name, $copied;
+    }
+    cmpthese(
+        $duration,
+        {
+            map {
+                my $dec= $dec{$_};
+                $_ => sub { sereal_decode_with_object( $dec, $doc ) }
+            } keys %dec
+        } );
+}
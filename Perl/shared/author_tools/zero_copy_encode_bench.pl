@@ -0,0 +1,55 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use File::Spec;
+use Sereal::Encoder;
+use Getopt::Long qw(GetOptions);
+
+# Compares encode_to_fh of documents holding large strings with and without
+# the zero_copy_strings_over option, writing to a file (truncated before
+# each run) and to /dev/null, which is cheap enough for the copies into the
+# encoder's buffer to show.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'blobs=i'         => \( my $nblobs= 50 ),
+    'min-size=i'      => \( my $min_size= 10_000 ),
+    'max-size=i'      => \( my $max_size= 200_000 ),
+    'threshold=i'     => \( my $threshold= 4096 ),
+    'file=s'          => \( my $file= "zero_copy_encode_bench.out" ),
+) or die "Bad option";
+
+srand(42);
+my @blobs= map {
+    my $len= $min_size + int( rand( $max_size - $min_size ) );
+    join "", map { chr( 97 + int rand 26 ) } 1 .. $len;
+} 1 .. $nblobs;
+my $data= [ map { { id => $_, html => $blobs[$_], title => "page $_" } } 0 .. $#blobs ];
+
+my $blob_bytes= 0;
+$blob_bytes+= length for @blobs;
+printf "%d strings, %d bytes in total\n", $nblobs, $blob_bytes;
+
+my $copy= Sereal::Encoder->new();
+my $zero= Sereal::Encoder->new( { zero_copy_strings_over => $threshold } );
+
+foreach my $target ( $file, File::Spec->devnull ) {
+    open my $fh, ">", $target or die "Can't open $target: $!";
+    binmode $fh;
+    print "\n$target:\n";
+    cmpthese(
+        $duration,
+        {
+            copy => sub {
+                seek $fh, 0, 0;
+                $copy->encode_to_fh( $fh, $data );
+            },
+            zero_copy => sub {
+                seek $fh, 0, 0;
+                $zero->encode_to_fh( $fh, $data );
+            },
+        } );
+    close $fh or die "Can't close $target: $!";
+}
+unlink $file;
@@ -0,0 +1,53 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Decoder qw(decode_sereal sereal_decode_with_object);
+use Sereal::Encoder qw(encode_sereal sereal_encode_with_object);
+use Getopt::Long qw(GetOptions);
+
+# Compares zstd compression/decompression through a long-lived encoder/decoder
+# object (which keeps its ZSTD_CCtx/ZSTD_DCtx around between calls) with the
+# functional interface (which builds a fresh encoder/decoder, and therefore a
+# fresh zstd context, for every document).
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'size=i@'         => \( my $sizes= undef ),
+    'level=i'         => \( my $level= 3 ),
+) or die "Bad option";
+
+$sizes ||= [ 2_000, 8_000, 20_000 ];
+
+my %enc_opt= ( compress => Sereal::Encoder::SRL_ZSTD, compress_level => $level );
+my $enc= Sereal::Encoder->new( \%enc_opt );
+my $dec= Sereal::Decoder->new();
+
+foreach my $size (@$sizes) {
+    # a document of roughly $size bytes that compresses reasonably well
+    my $data= {};
+    my $i= 0;
+    while ( length( encode_sereal($data) ) < $size ) {
+        $data->{ "key_" . $i }= [ $i, "value number $i", { id => $i, name => "name_" . ( $i % 17 ) } ];
+        $i++;
+    }
+    my $encoded= $enc->encode($data);
+    printf "\n%d byte document, %d bytes compressed (zstd level %d)\n",
+        length( encode_sereal($data) ), length($encoded), $level;
+
+    print "Encoding:\n";
+    cmpthese(
+        $duration,
+        {
+            fresh_ctx  => sub { encode_sereal( $data, \%enc_opt ) },
+            reused_ctx => sub { sereal_encode_with_object( $enc, $data ) },
+        } );
+
+    print "Decoding:\n";
+    cmpthese(
+        $duration,
+        {
+            fresh_ctx  => sub { decode_sereal($encoded) },
+            reused_ctx => sub { sereal_decode_with_object( $dec, $encoded ) },
+        } );
+}
@@ -0,0 +1,110 @@
+use strict;
+use warnings;
+use blib;
+use Benchmark qw(cmpthese :hireswallclock);
+use Sereal::Decoder qw(sereal_decode_with_object);
+use Sereal::Encoder qw(sereal_encode_with_object);
+use File::Temp qw(tempdir);
+use File::Spec;
+use File::Basename qw(dirname);
+use Getopt::Long qw(GetOptions);
+
+# Compares zstd compression with and without a dictionary on the small
+# documents from bench.pl, where plain zstd has little to work with. Prints
+# the average compressed size and the encode/decode rate for plain zstd, a
+# raw content dictionary and (if the zstd command line tool is available) a
+# dictionary trained by train_zstd_dictionary.pl.
+
+GetOptions(
+    'secs|duration=f' => \( my $duration= -3 ),
+    'level=i'         => \( my $level= 3 ),
+    'samples=i'       => \( my $nsamples= 1000 ),
+    'dict-size=i'     => \( my $dict_size= 8 * 1024 ),
+    'zstd=s'          => \( my $zstd= "zstd" ),
+) or die "Bad option";
+
+my %datasets= (
+    small_hash => sub {
+        my $i= shift;
+        return {
+            foo => $i,
+            bar => [ 100 + $i, 101, 102 + $i % 7 ],
+            str => "this is a \x{df} string which has to be serialized $i",
+        };
+    },
+    array_of_small_hashes => sub {
+        my $i= shift;
+        return [ map { { foo => $i + $_, bar => [ 100, 101, 102 ], str => "string $_" } } 1 .. 1 + $i % 5 ];
+    },
+);
+
+my $tool= File::Spec->catfile( dirname(__FILE__), "train_zstd_dictionary.pl" );
+my $plain_enc= Sereal::Encoder->new();
+
+foreach my $name ( sort keys %datasets ) {
+    my @data= map { $datasets{$name}->($_) } 1 .. $nsamples;
+    my $dir= tempdir( CLEANUP => 1 );
+    foreach my $i ( 0 .. $#data ) {
+        my $file= File::Spec->catfile( $dir, "sample_$i.srl" );
+        open my $fh, ">:raw", $file or die "Can't write '$file': $!";
+        print $fh $plain_enc->encode( $data[$i] );
+        close $fh;
+    }
+
+    my %dicts= ( none => undef );
+    foreach my $kind (qw(raw trained)) {
+        my $out= File::Spec->catfile( $dir, "$kind.dict" );
+        my @args= ( "--out", $out, "--size", $dict_size, "--zstd", $zstd );
+        push @args, "--raw" if $kind eq 'raw';
+        if ( system( $^X, "-Mblib", $tool, @args, $dir ) != 0 ) {
+            warn "Could not build $kind dictionary, skipping it\n";
+            next;
+        }
+        open my $fh, "<:raw", $out or die "Can't open '$out': $!";
+        $dicts{$kind}= do { local $/; <$fh> };
+        close $fh;
+    }
+
+    my ( %enc, %dec, %encoded );
+    foreach my $kind ( sort keys %dicts ) {
+        $enc{$kind}= Sereal::Encoder->new( {
+            compress           => Sereal::Encoder::SRL_ZSTD,
+            compress_level     => $level,
+            compress_threshold => 0,
+            ( defined $dicts{$kind} ? ( zstd_dictionary => $dicts{$kind} ) : () ),
+        } );
+        $dec{$kind}= Sereal::Decoder->new(
+            { ( defined $dicts{$kind} ? ( zstd_dictionaries => $dicts{$kind} ) : () ) } );
+        $encoded{$kind}= [ map { $enc{$kind}->encode($_) } @data ];
+    }
+
+    my $uncompressed= 0;
+    $uncompressed += length( $plain_enc->encode($_) ) for @data;
+    printf "\n%s: %d documents, %.1f bytes on average uncompressed (zstd level %d)\n",
+        $name, scalar(@data), $uncompressed / @data, $level;
+    foreach my $kind ( sort keys %dicts ) {
+        my $total= 0;
+        $total += length($_) for @{ $encoded{$kind} };
+        printf "  %-8s %7.1f bytes on average, ratio %.2f\n", $kind, $total / @data, $uncompressed / $total;
+    }
+
+    print "Encoding:\n";
+    cmpthese(
+        $duration,
+        {
+            map {
+                my $enc= $enc{$_};
+                ( $_ => sub { sereal_encode_with_object( $enc, $_ ) for @data } )
+            } keys %dicts
+        } );
+
+    print "Decoding:\n";
+    cmpthese(
+        $duration,
+        {
+            map {
+                my ( $dec, $docs )= ( $dec{$_}, $encoded{$_} );
+                ( $_ => sub { sereal_decode_with_object( $dec, $_ ) for @$docs } )
+            } keys %dicts
+        } );
+}
@@ -134,6 +134,9 @@ sub check_external_libraries {
         print "Using bundled zstd code\n";
         push @{$subdirs}, 'zstd';
         $$objects .= ' zstd/libzstd$(OBJ_EXT)';
+
+        # see zstd/Makefile.PL, the multi-threaded compressor needs pthreads
+        $$libs .= ' -lpthread' if $Config{i_pthread} && $^O ne 'MSWin32';
     }
 }
 
@@ -3,7 +3,22 @@
  */
 
 /*
- * This is a customized version of the pointer table implementation in sv.c
+ * This started out as a customized version of the pointer table
+ * implementation in sv.c. It is now an open addressing table: all entries
+ * live in one flat array which is probed linearly, so there is no malloc
+ * per entry and a lookup usually touches a single cache line.
+ *
+ * Every slot carries the generation of the table it was stored in. A slot
+ * is only in use if its generation matches the table's, which lets
+ * PTABLE_clear() empty the table in constant time by bumping the table's
+ * generation. This matters for encoders/decoders that are reused for many
+ * documents.
+ *
+ * Note that unlike with the chained implementation, the entry returned by
+ * PTABLE_find()/PTABLE_store() (and by the iterators) only stays valid until
+ * the next PTABLE_store() or PTABLE_delete(), since those may move entries
+ * around. Storing or deleting while iterating is not supported, setting the
+ * value of an existing entry is fine.
  */
 
 #ifndef PTABLE_H_
@@ -47,20 +62,28 @@
 
 #define PTABLE_FLAG_AUTOCLEAN 1
 
+/* a slot is in use if its generation is the one of the table */
+#define PTABLE_SLOT_USED(tbl, ent) ((ent)->gen == (tbl)->tbl_gen)
+
+/* grow once more than 3/4 of the slots are in use */
+#define PTABLE_FULL(tbl) ((tbl)->tbl_items >= (tbl)->tbl_max - ((tbl)->tbl_max >> 2))
+
 typedef struct PTABLE_entry PTABLE_ENTRY_t;
 typedef struct PTABLE       PTABLE_t;
 typedef struct PTABLE_iter  PTABLE_ITER_t;
 
 struct PTABLE_entry {
-    struct PTABLE_entry     *next;
     void                    *key;
     void                    *value;
+    U32                     gen;
 };
 
 struct PTABLE {
-    struct PTABLE_entry     **tbl_ary;
+    struct PTABLE_entry     *tbl_ary;
     UV                      tbl_max;
     UV                      tbl_items;
+    U32                     tbl_gen;  /* never 0, which marks never used slots */
+    UV                      tbl_grows; /* times the table was doubled, for stats */
     PTABLE_ITER_t           *cur_iter; /* one iterator at a time can be auto-freed */
 };
 
@@ -94,10 +117,12 @@ PTABLE_new_size(const U8 size_base2_exponent)
 {
     PTABLE_t *tbl;
     Newxz(tbl, 1, PTABLE_t);
-    tbl->tbl_max = (1 << size_base2_exponent) - 1;
+    /* need at least a few slots for the load factor to make sense */
+    tbl->tbl_max = (1 << (size_base2_exponent < 3 ? 3 : size_base2_exponent)) - 1;
     tbl->tbl_items = 0;
+    tbl->tbl_gen = 1;
     tbl->cur_iter = NULL;
-    Newxz(tbl->tbl_ary, tbl->tbl_max + 1, PTABLE_ENTRY_t*);
+    Newxz(tbl->tbl_ary, tbl->tbl_max + 1, PTABLE_ENTRY_t);
     return tbl;
 }
 
@@ -110,14 +135,17 @@ PTABLE_new(void)
 /* map an existing pointer using a table */
 SRL_STATIC_INLINE PTABLE_ENTRY_t *
 PTABLE_find(PTABLE_t *tbl, const void *key) {
-    PTABLE_ENTRY_t *tblent;
-    const UV hash = PTABLE_HASH(key);
-    tblent = tbl->tbl_ary[hash & tbl->tbl_max];
-    for (; tblent; tblent = tblent->next) {
+    PTABLE_ENTRY_t * const ary = tbl->tbl_ary;
+    const UV max = tbl->tbl_max;
+    UV i = PTABLE_HASH(key) & max;
+
+    for (;; i = (i + 1) & max) {
+        PTABLE_ENTRY_t *tblent = &ary[i];
+        if (!PTABLE_SLOT_USED(tbl, tblent))
+            return NULL;
         if (tblent->key == key)
             return tblent;
     }
-    return NULL;
 }
 
 SRL_STATIC_INLINE void *
@@ -127,37 +155,38 @@ PTABLE_fetch(PTABLE_t *tbl, const void *key)
     return tblent ? tblent->value : NULL;
 }
 
-/* double the hash bucket size of an existing ptr table */
+/* double the size of an existing ptr table */
 
 SRL_STATIC_INLINE void
 PTABLE_grow(PTABLE_t *tbl)
 {
-    PTABLE_ENTRY_t **ary = tbl->tbl_ary;
+    PTABLE_ENTRY_t *oldary = tbl->tbl_ary;
     const UV oldsize = tbl->tbl_max + 1;
-    UV newsize = oldsize * 2;
+    const U32 oldgen = tbl->tbl_gen;
+    const UV newmax = oldsize * 2 - 1;
+    PTABLE_ENTRY_t *ary;
     UV i;
 
-    Renew(ary, newsize, PTABLE_ENTRY_t*);
-    Zero(&ary[oldsize], newsize - oldsize, PTABLE_ENTRY_t*);
-    tbl->tbl_max = --newsize;
-    tbl->tbl_ary = ary;
+    Newxz(ary, newmax + 1, PTABLE_ENTRY_t);
 
-    for (i = 0; i < oldsize; i++, ary++) {
-        PTABLE_ENTRY_t **curentp, **entp, *ent;
-        if (!*ary)
+    for (i = 0; i < oldsize; i++) {
+        PTABLE_ENTRY_t *ent = &oldary[i];
+        UV j;
+        if (ent->gen != oldgen)
             continue;
-        curentp = ary + oldsize;
-        for (entp = ary, ent = *ary; ent; ent = *entp) {
-            if ((newsize & PTABLE_HASH(ent->key)) != i) {
-                *entp = ent->next;
-                ent->next = *curentp;
-                *curentp = ent;
-                continue;
-            } else {
-                entp = &ent->next;
-            }
-        }
+        j = PTABLE_HASH(ent->key) & newmax;
+        while (ary[j].gen)
+            j = (j + 1) & newmax;
+        ary[j].key = ent->key;
+        ary[j].value = ent->value;
+        ary[j].gen = 1;
     }
+
+    Safefree(oldary);
+    tbl->tbl_ary = ary;
+    tbl->tbl_max = newmax;
+    tbl->tbl_gen = 1;
+    tbl->tbl_grows++;
 }
 
 /* add a new entry to a pointer => pointer table */
@@ -165,22 +194,27 @@ PTABLE_grow(PTABLE_t *tbl)
 SRL_STATIC_INLINE PTABLE_ENTRY_t *
 PTABLE_store(PTABLE_t *tbl, void *key, void *value)
 {
-    PTABLE_ENTRY_t *tblent = PTABLE_find(tbl, key);
-
-    if (tblent) {
-        tblent->value = value;
-    } else {
-        const UV entry = PTABLE_HASH(key) & tbl->tbl_max;
-        Newx(tblent, 1, PTABLE_ENTRY_t);
-
-        tblent->key = key;
-        tblent->value = value;
-        tblent->next = tbl->tbl_ary[entry];
-        tbl->tbl_ary[entry] = tblent;
-        tbl->tbl_items++;
-        if (tblent->next && (tbl->tbl_items > tbl->tbl_max))
-            PTABLE_grow(tbl);
+    PTABLE_ENTRY_t *tblent;
+    UV max;
+    UV i;
+
+    /* grow first so that the entry we return stays where it is */
+    if (PTABLE_FULL(tbl) && !PTABLE_find(tbl, key))
+        PTABLE_grow(tbl);
+
+    max = tbl->tbl_max;
+    for (i = PTABLE_HASH(key) & max;; i = (i + 1) & max) {
+        tblent = &tbl->tbl_ary[i];
+        if (!PTABLE_SLOT_USED(tbl, tblent)) {
+            tblent->key = key;
+            tblent->gen = tbl->tbl_gen;
+            tbl->tbl_items++;
+            break;
+        }
+        if (tblent->key == key)
+            break;
     }
+    tblent->value = value;
 
     return tblent;
 }
@@ -192,26 +226,11 @@ SRL_STATIC_INLINE void
 PTABLE_clear(PTABLE_t *tbl)
 {
     if (tbl && tbl->tbl_items) {
-        register PTABLE_ENTRY_t * * const array = tbl->tbl_ary;
-        UV riter = tbl->tbl_max;
-
-        do {
-            PTABLE_ENTRY_t *entry = array[riter];
-
-            while (entry) {
-                PTABLE_ENTRY_t * const oentry = entry;
-                entry = entry->next;
-                Safefree(oentry);
-            }
-
-            /* chocolateboy 2008-01-08
-             *
-             * make sure we clear the array entry, so that subsequent probes fail
-             */
-
-            array[riter] = NULL;
-        } while (riter--);
-
+        if (++tbl->tbl_gen == 0) {
+            /* wrapped around, slots from 2**32 clears ago would look used */
+            Zero(tbl->tbl_ary, tbl->tbl_max + 1, PTABLE_ENTRY_t);
+            tbl->tbl_gen = 1;
+        }
         tbl->tbl_items = 0;
     }
 }
@@ -220,29 +239,16 @@ SRL_STATIC_INLINE void
 PTABLE_clear_dec(pTHX_ PTABLE_t *tbl)
 {
     if (tbl && tbl->tbl_items) {
-        register PTABLE_ENTRY_t * * const array = tbl->tbl_ary;
+        PTABLE_ENTRY_t * const array = tbl->tbl_ary;
         UV riter = tbl->tbl_max;
 
         do {
-            PTABLE_ENTRY_t *entry = array[riter];
-
-            while (entry) {
-                PTABLE_ENTRY_t * const oentry = entry;
-                entry = entry->next;
-                if (oentry->value)
-                    SvREFCNT_dec((SV*)(oentry->value));
-                Safefree(oentry);
-            }
-
-            /* chocolateboy 2008-01-08
-             *
-             * make sure we clear the array entry, so that subsequent probes fail
-             */
-
-            array[riter] = NULL;
+            PTABLE_ENTRY_t *entry = &array[riter];
+            if (PTABLE_SLOT_USED(tbl, entry) && entry->value)
+                SvREFCNT_dec((SV*)(entry->value));
         } while (riter--);
 
-        tbl->tbl_items = 0;
+        PTABLE_clear(tbl);
     }
 }
 
@@ -251,47 +257,47 @@ PTABLE_clear_dec(pTHX_ PTABLE_t *tbl)
 SRL_STATIC_INLINE void
 PTABLE_delete(PTABLE_t *tbl, void *key)
 {
-    PTABLE_ENTRY_t *tblent;
-    PTABLE_ENTRY_t *tblent_prev;
+    PTABLE_ENTRY_t *ary;
+    UV max;
+    UV i, j;
 
-    if (!tbl || !tbl->tbl_items) {
+    if (!tbl || !tbl->tbl_items)
         return;
-    } else {
-        const UV hash = PTABLE_HASH(key);
-        tblent_prev = NULL;
-        tblent = tbl->tbl_ary[hash & tbl->tbl_max];
-
-        for (; tblent; tblent_prev = tblent, tblent = tblent->next) {
-            if (tblent->key == key) {
-                if (tblent_prev != NULL) {
-                    tblent_prev->next = tblent->next;
-                }
-                else {
-                    /* First entry in chain */
-                    tbl->tbl_ary[hash & tbl->tbl_max] = tblent->next;
-                }
-                Safefree(tblent);
-                break;
-            }
+
+    ary = tbl->tbl_ary;
+    max = tbl->tbl_max;
+    for (i = PTABLE_HASH(key) & max;; i = (i + 1) & max) {
+        if (!PTABLE_SLOT_USED(tbl, &ary[i]))
+            return;
+        if (ary[i].key == key)
+            break;
+    }
+
+    /* Shift back the entries after the deleted one that would no longer be
+     * found because their probe sequence runs through the hole at i. */
+    for (j = (i + 1) & max; PTABLE_SLOT_USED(tbl, &ary[j]); j = (j + 1) & max) {
+        const UV home = PTABLE_HASH(ary[j].key) & max;
+        /* is home cyclically outside of (i, j]? */
+        if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+            ary[i] = ary[j];
+            i = j;
         }
     }
+    ary[i].gen = 0;
+    tbl->tbl_items--;
 }
 
 
 
 #define PTABLE_ITER_NEXT_ELEM(iter, tbl)                                    \
     STMT_START {                                                            \
-        if ((iter)->cur_entry && (iter)->cur_entry->next) {                 \
-            (iter)->cur_entry = (iter)->cur_entry->next;                    \
-        }                                                                   \
-        else {                                                              \
-            do {                                                            \
-                if ((iter)->bucket_num > (tbl)->tbl_max) {                  \
-                    (iter)->cur_entry = NULL;                               \
-                    break;                                                  \
-                }                                                           \
-                (iter)->cur_entry = (tbl)->tbl_ary[(iter)->bucket_num++];   \
-            } while ((iter)->cur_entry == NULL);                            \
+        (iter)->cur_entry = NULL;                                           \
+        while ((iter)->bucket_num <= (tbl)->tbl_max) {                      \
+            PTABLE_ENTRY_t *ent_ = &(tbl)->tbl_ary[(iter)->bucket_num++];   \
+            if (PTABLE_SLOT_USED(tbl, ent_)) {                              \
+                (iter)->cur_entry = ent_;                                   \
+                break;                                                      \
+            }                                                               \
         }                                                                   \
     } STMT_END
 
@@ -366,7 +372,6 @@ PTABLE_free(PTABLE_t *tbl)
     if (!tbl)
         return;
 
-    PTABLE_clear(tbl);
     if (tbl->cur_iter) {
         PTABLE_ITER_t *it = tbl->cur_iter;
         tbl->cur_iter = NULL; /* avoid circular checks */
@@ -95,7 +95,13 @@ Steffen Mueller <smueller@cpan.org>
 static INLINE void UnalignedCopy64(const void *src, void *dst) {
 #if defined(__i386__) || defined(__x86_64__) || defined(__powerpc__) || defined(ARCH_ARM_HAVE_UNALIGNED) || defined(__aarch64__)
   if ((sizeof(void *) == 8) || (sizeof(long) == 8)) {
-    UNALIGNED_STORE64(dst, UNALIGNED_LOAD64(src));
+    /* memmove() rather than UNALIGNED_STORE64(dst, UNALIGNED_LOAD64(src)):
+       src and dst overlap when IncrementalCopyFastPath() expands a pattern
+       shorter than 16 bytes, and memmove() is the one that allows that. For
+       8 bytes it compiles to the same single load and store, but stops
+       GCC 12 at -O3 from vectorizing the copy loop, which breaks the
+       expansion. */
+    memmove(dst, src, 8);
   } else {
    /* This can be more efficient than UNALIGNED_LOAD64 + UNALIGNED_STORE64
       on some platforms, in particular ARM. */
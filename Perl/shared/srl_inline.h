@@ -13,5 +13,26 @@
 #   define SRL_STATIC_INLINE STATIC inline
 #endif
 
+/* For functions that would otherwise be inlined into a hot caller and make
+ * its prologue more expensive for all the calls that don't need them. */
+#if defined(__GNUC__)
+#   define SRL_STATIC_NOINLINE STATIC __attribute__((noinline))
+#elif defined(_MSC_VER)
+#   define SRL_STATIC_NOINLINE STATIC __declspec(noinline)
+#else
+#   define SRL_STATIC_NOINLINE STATIC
+#endif
+
+
+/* For small functions on hot paths that compilers leave out of line once
+ * their caller grows past their inlining limits. */
+#if defined(__GNUC__)
+#   define SRL_STATIC_ALWAYS_INLINE STATIC inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#   define SRL_STATIC_ALWAYS_INLINE STATIC __forceinline
+#else
+#   define SRL_STATIC_ALWAYS_INLINE SRL_STATIC_INLINE
+#endif
+
 
 #endif
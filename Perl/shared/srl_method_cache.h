@@ -0,0 +1,76 @@
+#ifndef SRL_METHOD_CACHE_H_
+#define SRL_METHOD_CACHE_H_
+
+/* Caches the CV a method name resolves to per class, so encoding or
+ * decoding many objects of the same class with FREEZE/THAW callbacks does
+ * one method lookup per class rather than one per object. Negative lookups
+ * are cached as well.
+ *
+ * An entry stays valid as long as the method generations of its stash are
+ * unchanged: perl bumps the stash's mro pkg_gen when a method of the class
+ * itself is (re)defined, its cache_gen when one of a parent class is or
+ * their @ISA changes, and PL_sub_generation for changes that affect every
+ * class. As they only ever go up, their sum changes whenever one does.
+ *
+ * The table maps stashes to srl_method_cache_entry_t and holds a reference
+ * to both the stash, so its address can't be reused for another one, and
+ * the CV. */
+
+#include "ptable.h"
+
+typedef struct {
+    CV *cv;     /* resolved method, NULL if the class doesn't have one */
+    U32 gen;    /* method generation of the stash at lookup time */
+} srl_method_cache_entry_t;
+
+#if PERL_VERSION >= 10
+#   define SRL_METHOD_CACHE_GEN(stash) \
+        ((U32)(HvMROMETA(stash)->pkg_gen + HvMROMETA(stash)->cache_gen + PL_sub_generation))
+#else
+#   define SRL_METHOD_CACHE_GEN(stash) ((U32)PL_sub_generation)
+#endif
+
+SRL_STATIC_INLINE CV *
+srl_method_cache_fetch(pTHX_ PTABLE_t *cache, HV *stash, const char *name)
+{
+    srl_method_cache_entry_t *entry = (srl_method_cache_entry_t *)PTABLE_fetch(cache, stash);
+    const U32 gen = SRL_METHOD_CACHE_GEN(stash);
+    GV *method;
+
+    if (expect_true( entry != NULL )) {
+        if (expect_true( entry->gen == gen ))
+            return entry->cv;
+        /* stale, look it up again */
+        if (entry->cv)
+            SvREFCNT_dec(entry->cv);
+    }
+    else {
+        Newx(entry, 1, srl_method_cache_entry_t);
+        SvREFCNT_inc_simple_void_NN((SV *)stash);
+        PTABLE_store(cache, stash, entry);
+    }
+
+    method = gv_fetchmethod_autoload(stash, name, 0);
+    entry->cv = method ? (CV *)SvREFCNT_inc((SV *)GvCV(method)) : NULL;
+    entry->gen = gen;
+    return entry->cv;
+}
+
+SRL_STATIC_INLINE void
+srl_method_cache_free(pTHX_ PTABLE_t *cache)
+{
+    PTABLE_ITER_t *it = PTABLE_iter_new(cache);
+    PTABLE_ENTRY_t *ent;
+
+    while ( NULL != (ent = PTABLE_iter_next(it)) ) {
+        srl_method_cache_entry_t *entry = (srl_method_cache_entry_t *)ent->value;
+        if (entry->cv)
+            SvREFCNT_dec(entry->cv);
+        SvREFCNT_dec((SV *)ent->key);
+        Safefree(entry);
+    }
+    PTABLE_iter_free(it);
+    PTABLE_free(cache);
+}
+
+#endif
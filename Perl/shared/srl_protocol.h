@@ -59,15 +59,15 @@
     REGEXP            | "1"  |  49 | 0x31 | 0b00110001 | <PATTERN-STR-TAG> <MODIFIERS-STR-TAG>
     OBJECT_FREEZE     | "2"  |  50 | 0x32 | 0b00110010 | <STR-TAG> <ITEM-TAG> - class, object-item. Need to call "THAW" method on class after decoding
     OBJECTV_FREEZE    | "3"  |  51 | 0x33 | 0b00110011 | <OFFSET-VARINT> <ITEM-TAG> - (OBJECTV_FREEZE is to OBJECT_FREEZE as OBJECTV is to OBJECT)
-    RESERVED_0        | "4"  |  52 | 0x34 | 0b00110100 | reserved
-    RESERVED_1        | "5"  |  53 | 0x35 | 0b00110101 |
-    RESERVED_2        | "6"  |  54 | 0x36 | 0b00110110 |
-    RESERVED_3        | "7"  |  55 | 0x37 | 0b00110111 |
-    RESERVED_4        | "8"  |  56 | 0x38 | 0b00111000 | reserved
+    RECORDS           | "4"  |  52 | 0x34 | 0b00110100 | <COUNT-VARINT> <NKEYS-VARINT> [<KEY-TAG> ...] [<ITEM-TAG> ...] - array of count hashes with the same keys, values stored column by column
+    RESERVED_0        | "5"  |  53 | 0x35 | 0b00110101 | reserved
+    RESERVED_1        | "6"  |  54 | 0x36 | 0b00110110 |
+    RESERVED_2        | "7"  |  55 | 0x37 | 0b00110111 |
+    RESERVED_3        | "8"  |  56 | 0x38 | 0b00111000 | reserved
     CANONICAL_UNDEF   | "9"  |  57 | 0x39 | 0b00111001 | undef (PL_sv_undef) - "the" Perl undef (see notes)
     FALSE             | ":"  |  58 | 0x3a | 0b00111010 | false (PL_sv_no)
     TRUE              | ";"  |  59 | 0x3b | 0b00111011 | true  (PL_sv_yes)
-    MANY              | "<"  |  60 | 0x3c | 0b00111100 | <LEN-VARINT> <TYPE-BYTE> <TAG-DATA> - repeated tag (not done yet, will be implemented in version 3)
+    MANY              | "<"  |  60 | 0x3c | 0b00111100 | <COUNT-VARINT> <TYPE-TAG> [<ITEM-DATA> ...] - packed array of count numbers of the same type, stored without their tags
     PACKET_START      | "="  |  61 | 0x3d | 0b00111101 | (first byte of magic string in header)
     EXTEND            | ">"  |  62 | 0x3e | 0b00111110 | <BYTE> - for additional tags
     PAD               | "?"  |  63 | 0x3f | 0b00111111 | (ignored tag, skip to next byte)
@@ -213,15 +213,17 @@
 
 /* Note: Can do reserved check with a range now, but as we start using
  *       them, might have to explicit == check later. */
-#define SRL_HDR_RESERVED        ((U8)52)      /* reserved */
-#define SRL_HDR_RESERVED_LOW    ((U8)52)
+#define SRL_HDR_RECORDS         ((U8)52)      /* <COUNT-VARINT> <NKEYS-VARINT> [<KEY-TAG> ...] [<ITEM-TAG> ...] - array of count hashes with the same keys, values stored column by column */
+
+#define SRL_HDR_RESERVED        ((U8)53)      /* reserved */
+#define SRL_HDR_RESERVED_LOW    ((U8)53)
 #define SRL_HDR_RESERVED_HIGH   ((U8)56)
 
 #define SRL_HDR_CANONICAL_UNDEF ((U8)57)      /* undef (PL_sv_undef) - "the" Perl undef (see notes) */
 #define SRL_HDR_FALSE           ((U8)58)      /* false (PL_sv_no)  */
 #define SRL_HDR_TRUE            ((U8)59)      /* true  (PL_sv_yes) */
 
-#define SRL_HDR_MANY            ((U8)60)      /* <LEN-VARINT> <TYPE-BYTE> <TAG-DATA> - repeated tag (not done yet, will be implemented in version 3) */
+#define SRL_HDR_MANY            ((U8)60)      /* <COUNT-VARINT> <TYPE-TAG> [<ITEM-DATA> ...] - packed array of count numbers of the same type, stored without their tags */
 #define SRL_HDR_PACKET_START    ((U8)61)      /* (first byte of magic string in header) */
 
 
@@ -7,6 +7,7 @@
 #include "srl_reader_error.h"
 #include "srl_reader_varint.h"
 #include "srl_protocol.h"
+#include "ptable.h"
 
 #if defined(HAVE_CSNAPPY)
     #include <csnappy.h>
@@ -39,24 +40,43 @@
     #include "miniz.h"
 #endif
 
-/* Creates a new buffer of size header_len + body_len + 1 and swaps it into place
+/* Reusable decompression buffers bigger than this are released once the
+ * document they hold is done with (see srl_release_decompress_buffer). */
+#define SRL_DEFAULT_DECOMPRESS_BUFFER_HIGH_WATER (16 * 1024 * 1024)
+
+/* Provides a buffer of size header_len + body_len + 1 and swaps it into place
  * of the current reader's buffer. Sets reader position to right after the
- * header and makes the reader state internally consistent. The buffer is
- * owned by a mortal SV which is returned. */
-/* TODO reuse the buffer */
+ * header and makes the reader state internally consistent.
+ *
+ * If reuse_sv is NULL, the buffer is owned by a new mortal SV. Otherwise
+ * *reuse_sv is a grow-only buffer owned by the caller: it is recycled if it
+ * is large enough and nobody else holds a reference to it, else it is
+ * replaced by a fresh SV (and the caller's reference to the old one is
+ * dropped). Either way, the SV owning the buffer is returned. */
 
 SRL_STATIC_INLINE SV *
 srl_realloc_empty_buffer(pTHX_ srl_reader_buffer_t *buf,
                          const STRLEN header_len,
-                         const STRLEN body_len)
+                         const STRLEN body_len,
+                         SV **reuse_sv)
 {
     SV *b_sv;
     srl_reader_char_ptr b;
-
-    /* Let perl clean this up. Yes, it's not the most efficient thing
-     * ever, but it's just one mortal per full decompression, so not
-     * a bottle-neck. */
-    b_sv = sv_2mortal( newSV(header_len + body_len + 1 ));
+    const STRLEN size = header_len + body_len + 1;
+
+    if (reuse_sv == NULL) {
+        /* Let perl clean this up. */
+        b_sv = sv_2mortal( newSV(size) );
+    } else {
+        b_sv = *reuse_sv;
+        /* Growing in place would copy the stale contents, so we rather
+         * throw a buffer that is too small away and start over. */
+        if (b_sv == NULL || SvREFCNT(b_sv) > 1 || SvLEN(b_sv) < size) {
+            if (b_sv != NULL)
+                SvREFCNT_dec(b_sv);
+            b_sv = *reuse_sv = newSV(size);
+        }
+    }
     b = (srl_reader_char_ptr) SvPVX(b_sv);
 
     buf->start = b;
@@ -67,17 +87,116 @@ srl_realloc_empty_buffer(pTHX_ srl_reader_buffer_t *buf,
     return b_sv;
 }
 
+/* Releases a reusable decompression buffer that grew beyond high_water bytes
+ * so that a single unusually large document does not pin its memory for the
+ * lifetime of the reader. */
+
+SRL_STATIC_INLINE void
+srl_release_decompress_buffer(pTHX_ SV **reuse_sv, const STRLEN high_water)
+{
+    if (*reuse_sv != NULL && SvLEN(*reuse_sv) > high_water) {
+        SvREFCNT_dec(*reuse_sv);
+        *reuse_sv = NULL;
+    }
+}
+
+/* Lazy zstd decompression context alloc. Long-lived readers (e.g. a
+ * reusable decoder object) pass a pointer to their own slot so that the
+ * context survives between documents. */
+
+SRL_STATIC_INLINE void
+srl_init_zstd_dctx(pTHX_ void **dctx)
+{
+    if (expect_false(*dctx == NULL)) {
+        *dctx = (void *) ZSTD_createDCtx();
+        if (*dctx == NULL)
+            croak("Out of memory!");
+    }
+}
+
+/* Destroy zstd decompression context */
+
+SRL_STATIC_INLINE void
+srl_destroy_zstd_dctx(pTHX_ void *dctx)
+{
+    if (dctx != NULL)
+        ZSTD_freeDCtx((ZSTD_DCtx *) dctx);
+}
+
+/* Find the digested dictionary with the given ID, digesting it on first use.
+ * Dictionaries without an ID (raw content dictionaries) have ID 0.
+ * Returns NULL if there is no such dictionary. */
+
+SRL_STATIC_INLINE ZSTD_DDict *
+srl_zstd_dicts_lookup(pTHX_ srl_zstd_dicts_t *dicts, const unsigned dict_id)
+{
+    ZSTD_DDict *ddict;
+    SSize_t i, top;
+
+    if (dicts->dicts == NULL)
+        return NULL;
+
+    if (dicts->ddicts == NULL)
+        dicts->ddicts = PTABLE_new_size(2);
+
+    ddict = (ZSTD_DDict *) PTABLE_fetch(dicts->ddicts, INT2PTR(void *, (UV) dict_id));
+    if (ddict != NULL)
+        return ddict;
+
+    top = av_len(dicts->dicts);
+    for (i = 0; i <= top; i++) {
+        STRLEN len;
+        const char *pv;
+        SV **svp = av_fetch(dicts->dicts, i, 0);
+        if (svp == NULL)
+            continue;
+
+        pv = SvPV(*svp, len);
+        if (ZSTD_getDictID_fromDict(pv, len) != dict_id)
+            continue;
+
+        ddict = ZSTD_createDDict(pv, len);
+        if (ddict == NULL)
+            croak("Invalid zstd dictionary");
+
+        PTABLE_store(dicts->ddicts, INT2PTR(void *, (UV) dict_id), ddict);
+        return ddict;
+    }
+
+    return NULL;
+}
+
+/* Free the digested dictionaries and drop the reference to the raw ones */
+
+SRL_STATIC_INLINE void
+srl_zstd_dicts_destroy(pTHX_ srl_zstd_dicts_t *dicts)
+{
+    if (dicts->ddicts != NULL) {
+        PTABLE_ENTRY_t *e;
+        PTABLE_ITER_t *it = PTABLE_iter_new(dicts->ddicts);
+        while (NULL != (e = PTABLE_iter_next(it)))
+            ZSTD_freeDDict((ZSTD_DDict *) e->value);
+        PTABLE_iter_free(it);
+        PTABLE_free(dicts->ddicts);
+        dicts->ddicts = NULL;
+    }
+
+    if (dicts->dicts != NULL) {
+        SvREFCNT_dec(dicts->dicts);
+        dicts->dicts = NULL;
+    }
+}
+
 /* Decompress a Snappy-compressed document body and put the resulting document
- * body back in the place of the old compressed blob. The function internaly
- * creates temporary buffer which is owned by mortal SV. If the caller is
- * interested in keeping the buffer around for longer time, it should pass
- * buf_owner parameter and unmortalize it.
+ * body back in the place of the old compressed blob. The output buffer is
+ * provided by srl_realloc_empty_buffer: pass a pointer to a caller-owned
+ * buf_owner slot to have it reused between documents, or NULL to get a
+ * temporary buffer owned by a mortal SV.
  * The caller *MUST* call SRL_RDR_UPDATE_BODY_POS right after existing from this function. */
 
 SRL_STATIC_INLINE UV
 srl_decompress_body_snappy(pTHX_ srl_reader_buffer_t *buf, U8 encoding_flags, SV** buf_owner)
 {
-    SV *buf_sv;
     int header_len;
     int decompress_ok;
     uint32_t dest_len;
@@ -101,8 +220,7 @@ srl_decompress_body_snappy(pTHX_ srl_reader_buffer_t *buf, U8 encoding_flags, SV
         SRL_RDR_ERROR(buf, "Invalid Snappy header in Snappy-compressed Sereal packet");
 
     /* Allocate output buffer and swap it into place within the bufoder. */
-    buf_sv = srl_realloc_empty_buffer(aTHX_ buf, sereal_header_len, dest_len);
-    if (buf_owner) *buf_owner = buf_sv;
+    srl_realloc_empty_buffer(aTHX_ buf, sereal_header_len, dest_len, buf_owner);
 
     decompress_ok = csnappy_decompress_noheader((char *)(old_pos + header_len),
                                                 compressed_packet_len - header_len,
@@ -118,16 +236,13 @@ srl_decompress_body_snappy(pTHX_ srl_reader_buffer_t *buf, U8 encoding_flags, SV
 }
 
 /* Decompress a zlib-compressed document body and put the resulting
- * document body back in the place of the old compressed blob. The function
- * internaly creates temporary buffer which is owned by mortal SV. If the
- * caller is interested in keeping the buffer around for longer time, it should
- * pass buf_owner parameter and unmortalize it.
+ * document body back in the place of the old compressed blob. The output
+ * buffer is handled as in srl_decompress_body_snappy.
  * The caller *MUST* call SRL_RDR_UPDATE_BODY_POS right after existing from this function. */
 
 SRL_STATIC_INLINE UV
 srl_decompress_body_zlib(pTHX_ srl_reader_buffer_t *buf, SV** buf_owner)
 {
-    SV *buf_sv;
     mz_ulong tmp;
     int decompress_ok;
     UV bytes_consumed;
@@ -144,8 +259,7 @@ srl_decompress_body_zlib(pTHX_ srl_reader_buffer_t *buf, SV** buf_owner)
     bytes_consumed = compressed_packet_len + SRL_RDR_POS_OFS(buf);
 
     /* Allocate output buffer and swap it into place within the decoder. */
-    buf_sv = srl_realloc_empty_buffer(aTHX_ buf, sereal_header_len, uncompressed_packet_len);
-    if (buf_owner) *buf_owner = buf_sv;
+    srl_realloc_empty_buffer(aTHX_ buf, sereal_header_len, uncompressed_packet_len, buf_owner);
 
     tmp = uncompressed_packet_len;
     decompress_ok = mz_uncompress((unsigned char *)buf->pos,
@@ -159,16 +273,21 @@ srl_decompress_body_zlib(pTHX_ srl_reader_buffer_t *buf, SV** buf_owner)
 }
 
 /* Decompress a zstd-compressed document body and put the resulting document
- * body back in the place of the old compressed blob. The function internaly
- * creates temporary buffer which is owned by mortal SV. If the caller is
- * interested in keeping the buffer around for longer time, it should pass
- * buf_owner parameter and unmortalize it.  The caller *MUST* call
- * SRL_RDR_UPDATE_BODY_POS right after existing from this function. */
+ * body back in the place of the old compressed blob. The output buffer is
+ * handled as in srl_decompress_body_snappy. If zstd_dctx is not NULL, the
+ * decompression context it points to is (lazily created and) reused,
+ * otherwise a one-shot context is used. Documents compressed with a
+ * dictionary require the matching one in dicts, which may be NULL if the
+ * caller does not support dictionaries (it then also may not pass a NULL
+ * zstd_dctx). The caller *MUST* call SRL_RDR_UPDATE_BODY_POS right after
+ * existing from this function. */
 
 SRL_STATIC_INLINE UV
-srl_decompress_body_zstd(pTHX_ srl_reader_buffer_t *buf, SV** buf_owner)
+srl_decompress_body_zstd(pTHX_ srl_reader_buffer_t *buf, void **zstd_dctx,
+                         srl_zstd_dicts_t *dicts, SV** buf_owner)
 {
-    SV *buf_sv;
+    ZSTD_DDict *ddict = NULL;
+    unsigned dict_id;
     UV bytes_consumed;
     size_t decompress_code;
 
@@ -186,12 +305,33 @@ srl_decompress_body_zstd(pTHX_ srl_reader_buffer_t *buf, SV** buf_owner)
     if (expect_false(uncompressed_packet_len == 0))
         SRL_RDR_ERROR(buf, "Invalid zstd packet with unknown uncompressed size");
 
-    /* Allocate output buffer and swap it into place within the decoder. */
-    buf_sv = srl_realloc_empty_buffer(aTHX_ buf, sereal_header_len, (STRLEN) uncompressed_packet_len);
-    if (buf_owner) *buf_owner = buf_sv;
+    dict_id = ZSTD_getDictID_fromFrame((const void *)buf->pos, (size_t) compressed_packet_len);
+    if (dicts != NULL)
+        ddict = srl_zstd_dicts_lookup(aTHX_ dicts, dict_id);
+    if (expect_false(ddict == NULL && dict_id != 0)) {
+        SRL_RDR_ERRORf1(buf, "Sereal document was compressed with zstd dictionary %u which is not known to this decoder",
+                        dict_id);
+    }
 
-    decompress_code = ZSTD_decompress((void *)buf->pos, (size_t) uncompressed_packet_len,
-                                      (void *)old_pos,  (size_t) compressed_packet_len);
+    /* Allocate output buffer and swap it into place within the decoder. */
+    srl_realloc_empty_buffer(aTHX_ buf, sereal_header_len, (STRLEN) uncompressed_packet_len, buf_owner);
+
+    if (ddict) {
+        assert(zstd_dctx != NULL);
+        srl_init_zstd_dctx(aTHX_ zstd_dctx);
+        decompress_code = ZSTD_decompress_usingDDict((ZSTD_DCtx *) *zstd_dctx,
+                                                     (void *)buf->pos, (size_t) uncompressed_packet_len,
+                                                     (void *)old_pos,  (size_t) compressed_packet_len,
+                                                     ddict);
+    } else if (zstd_dctx) {
+        srl_init_zstd_dctx(aTHX_ zstd_dctx);
+        decompress_code = ZSTD_decompressDCtx((ZSTD_DCtx *) *zstd_dctx,
+                                              (void *)buf->pos, (size_t) uncompressed_packet_len,
+                                              (void *)old_pos,  (size_t) compressed_packet_len);
+    } else {
+        decompress_code = ZSTD_decompress((void *)buf->pos, (size_t) uncompressed_packet_len,
+                                          (void *)old_pos,  (size_t) compressed_packet_len);
+    }
 
     if (expect_false( ZSTD_isError(decompress_code) )) {
         SRL_RDR_ERRORf1(buf, "Zstd decompression of Sereal packet payload failed with error %s!",
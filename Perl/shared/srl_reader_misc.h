@@ -5,6 +5,8 @@
 #include "srl_common.h"
 #include "srl_reader.h"
 #include "srl_protocol.h"
+#include "srl_reader_error.h"
+#include "srl_reader_varint.h"
 
 /* not sure that this's the best location for this function */
 SRL_STATIC_INLINE IV
@@ -47,4 +49,201 @@ srl_validate_header_version(pTHX_ srl_reader_char_ptr strdata, STRLEN len)
     return -1;
 }
 
+/* Read the count and the type tag of a packed array (MANY) whose tag has
+ * been read already, and check that there is room for that many items of
+ * the type. Returns the count. */
+SRL_STATIC_INLINE UV
+srl_read_many_header(pTHX_ srl_reader_buffer_t *buf, U8 *type_out)
+{
+    const UV count= srl_read_varint_uv_count(aTHX_ buf, " while reading MANY");
+    UV min_size= 0;
+    U8 type;
+
+    SRL_RDR_ASSERT_SPACE(buf, 1, " while reading MANY");
+    type= *buf->pos++;
+    switch (type) {
+        case SRL_HDR_VARINT:
+        case SRL_HDR_ZIGZAG: min_size= 1; break;
+        case SRL_HDR_FLOAT:  min_size= 4; break;
+        case SRL_HDR_DOUBLE: min_size= 8; break;
+        default:
+            SRL_RDR_ERRORf1(buf, "Unsupported item type %u in packed array (MANY)", (unsigned int)type);
+    }
+    if (expect_false( count > (UV)SRL_RDR_SPACE_LEFT(buf) / min_size )) {
+        SRL_RDR_ERRORf2(buf, "Unexpected termination of packet while reading MANY, "
+                        "want %"UVuf" items, only have %"IVdf" bytes available",
+                        count, (IV)SRL_RDR_SPACE_LEFT(buf));
+    }
+
+    *type_out= type;
+    return count;
+}
+
+/* Skip the count items of a packed array (MANY) following its header */
+SRL_STATIC_INLINE void
+srl_skip_many_items(pTHX_ srl_reader_buffer_t *buf, U8 type, UV count)
+{
+    if (type == SRL_HDR_FLOAT) {
+        buf->pos += count * 4;
+    } else if (type == SRL_HDR_DOUBLE) {
+        buf->pos += count * 8;
+    } else {
+        srl_skip_varints(aTHX_ buf, count);
+    }
+}
+
+/* Read the record and key counts of a record batch (RECORDS) whose tag has
+ * been read already, and check that there are keys and that there is room
+ * for them and the values, every one of which takes at least a byte.
+ * Returns the number of records, the number of keys is stored in
+ * nkeys_out. */
+SRL_STATIC_INLINE UV
+srl_read_records_header(pTHX_ srl_reader_buffer_t *buf, UV *nkeys_out)
+{
+    const UV count= srl_read_varint_uv_count(aTHX_ buf, " while reading RECORDS");
+    const UV nkeys= srl_read_varint_uv_count(aTHX_ buf, " while reading RECORDS");
+    const UV space= (UV)SRL_RDR_SPACE_LEFT(buf);
+
+    if (expect_false( nkeys == 0 ))
+        SRL_RDR_ERROR(buf, "Corrupted packet while reading RECORDS, records without keys");
+    if (expect_false( nkeys > space || count > (space - nkeys) / nkeys )) {
+        SRL_RDR_ERRORf3(buf, "Unexpected termination of packet while reading RECORDS, "
+                        "want %"UVuf" records of %"UVuf" keys, only have %"IVdf" bytes available",
+                        count, nkeys, (IV)space);
+    }
+
+    *nkeys_out= nkeys;
+    return count;
+}
+
+/* Add n items to the number of items left to skip by srl_skip_value(). Each
+ * of them takes at least a byte, which also keeps the count from overflowing. */
+#define SRL_SKIP_ITEMS(buf, items, n) STMT_START {                                  \
+    (items) += (n);                                                                 \
+    if (expect_false( (items) > (UV)SRL_RDR_SPACE_LEFT(buf) ))                      \
+        SRL_RDR_ERROR((buf), "Unexpected termination of packet while skipping a value"); \
+} STMT_END
+
+/* Skip the value whose tag is next in the buffer, with everything it
+ * contains, without decoding any of it. Rather than recursing into
+ * containers this counts the items still to be skipped, so it copes with
+ * data of any depth. */
+SRL_STATIC_INLINE void
+srl_skip_value(pTHX_ srl_reader_buffer_t *buf)
+{
+    UV items= 1;
+    UV n;
+
+    while (items) {
+        U8 tag;
+        SRL_RDR_ASSERT_SPACE(buf, 1, " while skipping a value");
+        tag= *buf->pos++ & ~SRL_HDR_TRACK_FLAG;
+        --items;
+
+        switch (tag & 0xE0) {
+            case 0x0: /* POS_0 .. NEG_1 */
+                break;
+
+            case 0x40: /* ARRAYREF_0 .. HASHREF_15 */
+                /* for HASHREF_0 .. HASHREF_15 multiply the length by two */
+                SRL_SKIP_ITEMS(buf, items, (UV)(tag & 0xF) << ((tag & 0x10) ? 1 : 0));
+                break;
+
+            case 0x60: /* SHORT_BINARY_0 .. SHORT_BINARY_31 */
+                n= SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(tag);
+                SRL_RDR_ASSERT_SPACE(buf, n, " while skipping a string");
+                buf->pos += n;
+                break;
+
+            default:
+                switch (tag) {
+                    case SRL_HDR_HASH:
+                        n= srl_read_varint_uv_count(aTHX_ buf, " while reading HASH");
+                        SRL_SKIP_ITEMS(buf, items, 2 * n);
+                        break;
+
+                    case SRL_HDR_ARRAY:
+                        n= srl_read_varint_uv_count(aTHX_ buf, " while reading ARRAY");
+                        SRL_SKIP_ITEMS(buf, items, n);
+                        break;
+
+                    case SRL_HDR_VARINT:
+                    case SRL_HDR_ZIGZAG:
+                    case SRL_HDR_COPY:
+                    case SRL_HDR_REFP:
+                    case SRL_HDR_ALIAS:
+                        srl_skip_varint(aTHX_ buf);
+                        break;
+
+                    case SRL_HDR_MANY: {
+                        U8 type;
+                        n= srl_read_many_header(aTHX_ buf, &type);
+                        srl_skip_many_items(aTHX_ buf, type, n);
+                        break;
+                    }
+
+                    case SRL_HDR_RECORDS: {
+                        /* the keys, then the values of all the records */
+                        UV nkeys;
+                        n= srl_read_records_header(aTHX_ buf, &nkeys);
+                        SRL_SKIP_ITEMS(buf, items, nkeys + n * nkeys);
+                        break;
+                    }
+
+                    case SRL_HDR_FLOAT:
+                        SRL_RDR_ASSERT_SPACE(buf, 4, " while skipping a FLOAT");
+                        buf->pos += 4;
+                        break;
+                    case SRL_HDR_DOUBLE:
+                        SRL_RDR_ASSERT_SPACE(buf, 8, " while skipping a DOUBLE");
+                        buf->pos += 8;
+                        break;
+                    case SRL_HDR_LONG_DOUBLE:
+                        SRL_RDR_ASSERT_SPACE(buf, 16, " while skipping a LONG_DOUBLE");
+                        buf->pos += 16;
+                        break;
+
+                    case SRL_HDR_TRUE:
+                    case SRL_HDR_FALSE:
+                    case SRL_HDR_UNDEF:
+                    case SRL_HDR_CANONICAL_UNDEF:
+                        break;
+
+                    case SRL_HDR_PAD:
+                        ++items; /* not an item */
+                        break;
+
+                    case SRL_HDR_REFN:
+                    case SRL_HDR_WEAKEN:
+                        SRL_SKIP_ITEMS(buf, items, 1);
+                        break;
+
+                    case SRL_HDR_BINARY:
+                    case SRL_HDR_STR_UTF8:
+                        n= srl_read_varint_uv_length(aTHX_ buf, " while skipping BINARY or STR_UTF8");
+                        SRL_RDR_ASSERT_SPACE(buf, n, " while skipping a string");
+                        buf->pos += n;
+                        break;
+
+                    case SRL_HDR_OBJECT:
+                    case SRL_HDR_OBJECT_FREEZE:
+                    case SRL_HDR_REGEXP:
+                        /* the class name or pattern, and the object or modifiers */
+                        SRL_SKIP_ITEMS(buf, items, 2);
+                        break;
+
+                    case SRL_HDR_OBJECTV:
+                    case SRL_HDR_OBJECTV_FREEZE:
+                        srl_skip_varint(aTHX_ buf);
+                        SRL_SKIP_ITEMS(buf, items, 1);
+                        break;
+
+                    default:
+                        SRL_RDR_ERROR_UNIMPLEMENTED(buf, tag, "");
+                        break;
+                }
+        }
+    }
+}
+
 #endif
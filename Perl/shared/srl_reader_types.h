@@ -14,4 +14,14 @@ struct srl_reader_buffer {
 typedef struct srl_reader_buffer srl_reader_buffer_t;
 typedef srl_reader_buffer_t * srl_reader_buffer_ptr;
 
+/* zstd dictionaries known to a reader: the raw dictionaries (an AV of
+ * strings, possibly shared between readers) and the ZSTD_DDicts digested
+ * from them on first use, keyed by dictionary ID. */
+struct srl_zstd_dicts {
+    AV *dicts;
+    struct PTABLE *ddicts;
+};
+
+typedef struct srl_zstd_dicts srl_zstd_dicts_t;
+
 #endif
@@ -0,0 +1,265 @@
+#ifndef SRL_READER_UTF8_H_
+#define SRL_READER_UTF8_H_
+
+#include "srl_inline.h"
+#include "srl_common.h"
+
+/* Checking that the strings of a document are well formed UTF-8, for the
+ * validate_utf8 option.
+ *
+ * srl_is_utf8_string() gives the same answer as Perl's is_utf8_string().
+ * On x86 it first checks the string for strict UTF-8 16 or 32 bytes at a
+ * time with SSE4.1 or AVX2, using the "lookup" algorithm from Keiser and
+ * Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte" (2021).
+ * Which of them is used is decided the first time we are called, for the
+ * CPU we are running on. Perl accepts more than strict UTF-8 does
+ * (surrogates, and code points above 0x10FFFF), so a string the vectorized
+ * check rejects is passed on to is_utf8_string() to decide. That only
+ * happens for invalid strings or those unusual code points. Short strings,
+ * other CPUs and compilers go straight to is_utf8_string().
+ *
+ * Define SRL_UTF8_NO_SIMD to build without the vectorized check. */
+
+#if !defined(SRL_UTF8_NO_SIMD) && (defined(__x86_64__) || defined(__i386__))    \
+    && (defined(__clang__)                                                      \
+        || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#   define SRL_UTF8_SIMD 1
+#   include <immintrin.h>
+#endif
+
+/* strings shorter than this aren't worth the setup of the vectorized check */
+#define SRL_UTF8_SIMD_MIN_LEN 16
+
+#ifdef SRL_UTF8_SIMD
+
+/* The errors a byte can have given the one before it. Each of the three
+ * tables below is indexed by one nibble of the pair of bytes and gives the
+ * errors that nibble allows for; only those all three agree on are real. */
+#define SRL_UTF8_TOO_SHORT      (1 << 0) /* 11______ 0_______ or 11______ 11______ */
+#define SRL_UTF8_TOO_LONG       (1 << 1) /* 0_______ 10______ */
+#define SRL_UTF8_OVERLONG_3     (1 << 2) /* 11100000 100_____ */
+#define SRL_UTF8_TOO_LARGE      (1 << 3) /* 11110100 1001____ and above */
+#define SRL_UTF8_SURROGATE      (1 << 4) /* 11101101 101_____ */
+#define SRL_UTF8_OVERLONG_2     (1 << 5) /* 1100000_ 10______ */
+#define SRL_UTF8_TOO_LARGE_1000 (1 << 6) /* 11110101 1000____ and above */
+#define SRL_UTF8_OVERLONG_4     (1 << 6) /* 11110000 1000____ */
+#define SRL_UTF8_TWO_CONTS      (1 << 7) /* 10______ 10______ */
+#define SRL_UTF8_CARRY          (SRL_UTF8_TOO_SHORT | SRL_UTF8_TOO_LONG | SRL_UTF8_TWO_CONTS)
+
+/* indexed by the high nibble of the first byte */
+#define SRL_UTF8_BYTE_1_HIGH                                                    \
+    SRL_UTF8_TOO_LONG, SRL_UTF8_TOO_LONG, SRL_UTF8_TOO_LONG, SRL_UTF8_TOO_LONG, \
+    SRL_UTF8_TOO_LONG, SRL_UTF8_TOO_LONG, SRL_UTF8_TOO_LONG, SRL_UTF8_TOO_LONG, \
+    (char)SRL_UTF8_TWO_CONTS, (char)SRL_UTF8_TWO_CONTS, (char)SRL_UTF8_TWO_CONTS, (char)SRL_UTF8_TWO_CONTS, \
+    SRL_UTF8_TOO_SHORT | SRL_UTF8_OVERLONG_2,                                   \
+    SRL_UTF8_TOO_SHORT,                                                         \
+    SRL_UTF8_TOO_SHORT | SRL_UTF8_OVERLONG_3 | SRL_UTF8_SURROGATE,              \
+    (char)(SRL_UTF8_TOO_SHORT | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000 | SRL_UTF8_OVERLONG_4)
+
+/* indexed by the low nibble of the first byte */
+#define SRL_UTF8_BYTE_1_LOW                                                     \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_OVERLONG_3 | SRL_UTF8_OVERLONG_2 | SRL_UTF8_OVERLONG_4), \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_OVERLONG_2),                               \
+    (char)SRL_UTF8_CARRY,                                                       \
+    (char)SRL_UTF8_CARRY,                                                       \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE),                                \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000),      \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000),      \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000),      \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000),      \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000),      \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000),      \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000),      \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000),      \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000 | SRL_UTF8_SURROGATE), \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000),      \
+    (char)(SRL_UTF8_CARRY | SRL_UTF8_TOO_LARGE | SRL_UTF8_TOO_LARGE_1000)
+
+/* indexed by the high nibble of the second byte */
+#define SRL_UTF8_BYTE_2_HIGH                                                    \
+    SRL_UTF8_TOO_SHORT, SRL_UTF8_TOO_SHORT, SRL_UTF8_TOO_SHORT, SRL_UTF8_TOO_SHORT, \
+    SRL_UTF8_TOO_SHORT, SRL_UTF8_TOO_SHORT, SRL_UTF8_TOO_SHORT, SRL_UTF8_TOO_SHORT, \
+    (char)(SRL_UTF8_TOO_LONG | SRL_UTF8_OVERLONG_2 | SRL_UTF8_TWO_CONTS         \
+           | SRL_UTF8_OVERLONG_3 | SRL_UTF8_TOO_LARGE_1000 | SRL_UTF8_OVERLONG_4), \
+    (char)(SRL_UTF8_TOO_LONG | SRL_UTF8_OVERLONG_2 | SRL_UTF8_TWO_CONTS         \
+           | SRL_UTF8_OVERLONG_3 | SRL_UTF8_TOO_LARGE),                         \
+    (char)(SRL_UTF8_TOO_LONG | SRL_UTF8_OVERLONG_2 | SRL_UTF8_TWO_CONTS         \
+           | SRL_UTF8_SURROGATE | SRL_UTF8_TOO_LARGE),                          \
+    (char)(SRL_UTF8_TOO_LONG | SRL_UTF8_OVERLONG_2 | SRL_UTF8_TWO_CONTS         \
+           | SRL_UTF8_SURROGATE | SRL_UTF8_TOO_LARGE),                          \
+    SRL_UTF8_TOO_SHORT, SRL_UTF8_TOO_SHORT, SRL_UTF8_TOO_SHORT, SRL_UTF8_TOO_SHORT
+
+/* a block ending with any of these in its last three bytes continues into
+ * the next one: 1111____ 111_____ 11______ */
+#define SRL_UTF8_MAX_COMPLETE_END (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1)
+
+typedef int (*srl_utf8_check_t)(const U8 *s, STRLEN len);
+
+/* Each of the checks returns true if s is strict UTF-8. Each block of input
+ * is checked together with the end of the one before it, so that characters
+ * that span blocks are seen whole; a block that is all ASCII only needs the
+ * one before it to not end in the middle of a character. The last partial
+ * block is padded with NULs, which makes a character cut short by the end of
+ * the string an error. */
+
+__attribute__((target("sse4.1")))
+SRL_STATIC_INLINE int
+srl_utf8_check_sse41(const U8 *s, STRLEN len)
+{
+    const __m128i byte_1_high= _mm_setr_epi8(SRL_UTF8_BYTE_1_HIGH);
+    const __m128i byte_1_low= _mm_setr_epi8(SRL_UTF8_BYTE_1_LOW);
+    const __m128i byte_2_high= _mm_setr_epi8(SRL_UTF8_BYTE_2_HIGH);
+    const __m128i max_complete_end= _mm_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        SRL_UTF8_MAX_COMPLETE_END);
+    const __m128i low_nibble= _mm_set1_epi8(0x0F);
+    const __m128i third_byte_lead= _mm_set1_epi8(0xE0 - 0x80);
+    const __m128i fourth_byte_lead= _mm_set1_epi8(0xF0 - 0x80);
+    const __m128i high_bit= _mm_set1_epi8((char)0x80);
+    const U8 *end= s + len;
+    __m128i error= _mm_setzero_si128();
+    __m128i prev_input= _mm_setzero_si128();
+    __m128i prev_incomplete= _mm_setzero_si128();
+    __m128i input, prev1, special, must_continue;
+    U8 tail[16];
+
+    while (s < end) {
+        if (end - s >= 16) {
+            input= _mm_loadu_si128((const __m128i *)s);
+            s += 16;
+        }
+        else {
+            Zero(tail, 16, U8);
+            Copy(s, tail, end - s, U8);
+            input= _mm_loadu_si128((const __m128i *)tail);
+            s= end;
+        }
+
+        if (_mm_movemask_epi8(input) == 0) {
+            error= _mm_or_si128(error, prev_incomplete);
+            prev_incomplete= _mm_setzero_si128();
+        }
+        else {
+            prev1= _mm_alignr_epi8(input, prev_input, 15);
+            special= _mm_and_si128(
+                _mm_and_si128(
+                    _mm_shuffle_epi8(byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble)),
+                    _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, low_nibble))),
+                _mm_shuffle_epi8(byte_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble)));
+            /* the high bit is set where the byte must be the third or fourth
+             * of a character, as the continuations the tables call errors */
+            must_continue= _mm_or_si128(
+                _mm_subs_epu8(_mm_alignr_epi8(input, prev_input, 14), third_byte_lead),
+                _mm_subs_epu8(_mm_alignr_epi8(input, prev_input, 13), fourth_byte_lead));
+            error= _mm_or_si128(error,
+                _mm_xor_si128(_mm_and_si128(must_continue, high_bit), special));
+            prev_incomplete= _mm_subs_epu8(input, max_complete_end);
+        }
+        prev_input= input;
+    }
+    error= _mm_or_si128(error, prev_incomplete);
+    return _mm_testz_si128(error, error);
+}
+
+__attribute__((target("avx2")))
+SRL_STATIC_INLINE int
+srl_utf8_check_avx2(const U8 *s, STRLEN len)
+{
+    const __m256i byte_1_high= _mm256_setr_epi8(SRL_UTF8_BYTE_1_HIGH, SRL_UTF8_BYTE_1_HIGH);
+    const __m256i byte_1_low= _mm256_setr_epi8(SRL_UTF8_BYTE_1_LOW, SRL_UTF8_BYTE_1_LOW);
+    const __m256i byte_2_high= _mm256_setr_epi8(SRL_UTF8_BYTE_2_HIGH, SRL_UTF8_BYTE_2_HIGH);
+    const __m256i max_complete_end= _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        SRL_UTF8_MAX_COMPLETE_END);
+    const __m256i low_nibble= _mm256_set1_epi8(0x0F);
+    const __m256i third_byte_lead= _mm256_set1_epi8(0xE0 - 0x80);
+    const __m256i fourth_byte_lead= _mm256_set1_epi8(0xF0 - 0x80);
+    const __m256i high_bit= _mm256_set1_epi8((char)0x80);
+    const U8 *end= s + len;
+    __m256i error= _mm256_setzero_si256();
+    __m256i prev_input= _mm256_setzero_si256();
+    __m256i prev_incomplete= _mm256_setzero_si256();
+    __m256i input, shifted, prev1, special, must_continue;
+    U8 tail[32];
+
+    while (s < end) {
+        if (end - s >= 32) {
+            input= _mm256_loadu_si256((const __m256i *)s);
+            s += 32;
+        }
+        else {
+            Zero(tail, 32, U8);
+            Copy(s, tail, end - s, U8);
+            input= _mm256_loadu_si256((const __m256i *)tail);
+            s= end;
+        }
+
+        if (_mm256_movemask_epi8(input) == 0) {
+            error= _mm256_or_si256(error, prev_incomplete);
+            prev_incomplete= _mm256_setzero_si256();
+        }
+        else {
+            /* alignr works within each 128 bit lane, so give it the end of
+             * the previous block for the low lane and our own low lane for
+             * the high one */
+            shifted= _mm256_permute2x128_si256(prev_input, input, 0x21);
+            prev1= _mm256_alignr_epi8(input, shifted, 15);
+            special= _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble)),
+                    _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, low_nibble))),
+                _mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble)));
+            must_continue= _mm256_or_si256(
+                _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 14), third_byte_lead),
+                _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 13), fourth_byte_lead));
+            error= _mm256_or_si256(error,
+                _mm256_xor_si256(_mm256_and_si256(must_continue, high_bit), special));
+            prev_incomplete= _mm256_subs_epu8(input, max_complete_end);
+        }
+        prev_input= input;
+    }
+    error= _mm256_or_si256(error, prev_incomplete);
+    return _mm256_testz_si256(error, error);
+}
+
+/* for CPUs with neither, so that everything is left to is_utf8_string() */
+SRL_STATIC_INLINE int
+srl_utf8_check_none(const U8 *s, STRLEN len)
+{
+    PERL_UNUSED_ARG(s);
+    PERL_UNUSED_ARG(len);
+    return 0;
+}
+
+SRL_STATIC_INLINE srl_utf8_check_t
+srl_utf8_select_check(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return srl_utf8_check_avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return srl_utf8_check_sse41;
+    return srl_utf8_check_none;
+}
+
+#endif /* SRL_UTF8_SIMD */
+
+SRL_STATIC_INLINE int
+srl_is_utf8_string(const U8 *s, STRLEN len)
+{
+#ifdef SRL_UTF8_SIMD
+    /* picked on first use; racing threads all store the same value */
+    static srl_utf8_check_t check= NULL;
+
+    if (len >= SRL_UTF8_SIMD_MIN_LEN) {
+        if (expect_false( check == NULL ))
+            check= srl_utf8_select_check();
+        if (expect_true( check(s, len) ))
+            return 1;
+    }
+#endif
+    return is_utf8_string((U8 *)s, len);
+}
+
+#endif
@@ -6,6 +6,78 @@
 #include "srl_reader.h"
 #include "srl_reader_error.h"
 
+/* On 64 bit little endian machines runs of varints are skipped 8 bytes at a
+ * time. The high bit of each byte of such a word is clear on the last byte
+ * of a varint, so the "ends" of a word (its clear high bits, as set bits)
+ * tell how many varints end in it. Single varints are still read and skipped
+ * a byte at a time: that is faster, as each load has to wait for the length
+ * of the varint before it, while the CPU runs ahead in the byte loop. Define
+ * SRL_VARINT_NO_WORDS to skip runs a byte at a time too. */
+#if !defined(SRL_VARINT_NO_WORDS) && defined(__GNUC__) && UVSIZE == 8 && BYTEORDER == 0x12345678
+#   define SRL_VARINT_WORDS 1
+#endif
+
+#ifdef SRL_VARINT_WORDS
+
+#define SRL_VARINT_WORD_ENDS(word) (~(word) & UINT64_C(0x8080808080808080))
+
+/* the 8 bytes at ptr, the first of them in the low byte */
+SRL_STATIC_INLINE U64
+srl_varint_load_word(const U8 *ptr)
+{
+    U64 word;
+    Copy(ptr, &word, 1, U64);
+    return word;
+}
+
+/* Skip up to *count varints between pos and end, 8 bytes at a time, and
+ * return the position of the first one not skipped. *count is decreased by
+ * the number that were. Stops at the last few bytes of the buffer and before
+ * a varint longer than SRL_MAX_VARINT_LENGTH, for the caller to skip or
+ * report byte by byte. Not inlined, as the loop would slow down the readers'
+ * main loops that it would end up in, for the odd packed array. */
+SRL_STATIC_NOINLINE const U8 *
+srl_skip_varint_words(const U8 *pos, const U8 *end, UV *count)
+{
+    UV left= *count;
+    /* the bytes of the varint the last word ended in the middle of */
+    unsigned int run= 0;
+
+    while (left && end - pos >= 8) {
+        U64 ends= SRL_VARINT_WORD_ENDS(srl_varint_load_word(pos));
+        UV n;
+
+        if (expect_false( ends == 0 )) {
+            if (run + 8 >= SRL_MAX_VARINT_LENGTH)
+                break;
+            run += 8;
+            pos += 8;
+            continue;
+        }
+        if (expect_false( run + (__builtin_ctzll(ends) >> 3) >= SRL_MAX_VARINT_LENGTH ))
+            break;
+
+        /* add up the ends, one per byte */
+        n= (UV)((((ends >> 7) * UINT64_C(0x0101010101010101))) >> 56);
+        if (n >= left) {
+            /* drop the ends of the varints before the last one we want */
+            while (--left)
+                ends &= ends - 1;
+            pos += (__builtin_ctzll(ends) >> 3) + 1;
+            run= 0;
+            break;
+        }
+        left -= n;
+        run= __builtin_clzll(ends) >> 3;
+        pos += 8;
+    }
+
+    *count= left;
+    return pos - run;
+}
+
+#endif /* SRL_VARINT_WORDS */
+
 SRL_STATIC_INLINE void
 srl_skip_varint(pTHX_ srl_reader_buffer_t *buf)
 {
@@ -182,6 +254,17 @@ srl_read_varint_uv(pTHX_ srl_reader_buffer_t *buf)
     }
 }
 
+/* Skip count varints, such as the items of a packed array (MANY) */
+SRL_STATIC_INLINE void
+srl_skip_varints(pTHX_ srl_reader_buffer_t *buf, UV count)
+{
+#ifdef SRL_VARINT_WORDS
+    buf->pos= (srl_reader_char_ptr)srl_skip_varint_words(buf->pos, buf->end, &count);
+#endif
+    while (count--)
+        srl_skip_varint(aTHX_ buf);
+}
+
 SRL_STATIC_INLINE UV
 srl_read_varint_uv_offset(pTHX_ srl_reader_buffer_t *buf, const char * const errstr)
 {
@@ -0,0 +1,300 @@
+#ifndef SRL_STATS_H_
+#define SRL_STATS_H_
+
+/* Counters for the stats option of the encoder and the decoder, to find
+ * out what the documents of a workload are made of and where the time
+ * goes, so that the options can be tuned for it.
+ *
+ * The tags are not counted as they are written or read, that would cost a
+ * branch per item even with stats off. Instead the body of every document
+ * is scanned once it is complete (or, when the encoder is streaming, every
+ * part of it before it is written out), which costs nothing with stats
+ * off and is about as cheap as the alternative with stats on. Both sides
+ * scan the same way, so a document counts the same on either.
+ *
+ * The rest of the counters are updated where the thing happens, behind a
+ * check for the stats struct, in places that are not hot. */
+
+#include "srl_inline.h"
+#include "srl_protocol.h"
+#include "srl_taginfo.h"
+
+/* what the bytes of the tags are attributed to, the tag with its payload
+ * but not the items it contains */
+#define SRL_STATS_INTEGER   0   /* POS, NEG, VARINT, ZIGZAG, the items of packed integer arrays */
+#define SRL_STATS_FLOAT     1   /* FLOAT, DOUBLE, LONG_DOUBLE, the items of packed float arrays */
+#define SRL_STATS_STRING    2   /* BINARY, STR_UTF8, SHORT_BINARY */
+#define SRL_STATS_ARRAY     3   /* ARRAY, ARRAYREF, MANY */
+#define SRL_STATS_HASH      4   /* HASH, HASHREF, RECORDS */
+#define SRL_STATS_REFERENCE 5   /* REFN, REFP, WEAKEN */
+#define SRL_STATS_COPY      6   /* COPY, ALIAS */
+#define SRL_STATS_OBJECT    7   /* OBJECT, OBJECTV and their FREEZE variants, REGEXP */
+#define SRL_STATS_OTHER     8   /* UNDEF, TRUE, FALSE, PAD, EXTEND, ... */
+#define SRL_STATS_FAMILIES  9
+
+static const char * const srl_stats_family_name[SRL_STATS_FAMILIES] = {
+    "integer", "float", "string", "array", "hash", "reference", "copy", "object", "other"
+};
+
+typedef struct srl_stats {
+    UV documents;
+    UV tags[128];                           /* by tag, without the track flag */
+    UV tracked;                             /* tags with the track flag */
+    UV bytes[SRL_STATS_FAMILIES];           /* body bytes, see SRL_STATS_INTEGER etc. */
+    UV compressed_documents;
+    UV compressed_bytes;                    /* of the compressed bodies, with their length prefix */
+    NV compress_time;                       /* seconds spent (de)compressing */
+
+                                            /* encoder only */
+    UV shared_hashkey_lookups;              /* hash keys looked up to be shared, see no_shared_hashkeys */
+    UV shared_hashkey_hits;                 /* of these, written as COPY */
+    UV dedupe_lookups;                      /* strings looked up for dedupe_strings */
+    UV dedupe_hits;                         /* of these, written as COPY or ALIAS */
+    UV buffer_grows;                        /* times the output buffer was reallocated */
+} srl_stats_t;
+
+/* seconds since some point in the past */
+SRL_STATIC_INLINE NV
+srl_stats_now(void)
+{
+#if defined(CLOCK_MONOTONIC) && !defined(WIN32)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (NV)ts.tv_sec + (NV)ts.tv_nsec / 1e9;
+#elif defined(HAS_GETTIMEOFDAY)
+    struct timeval tv;
+    PerlProc_gettimeofday(&tv, NULL);
+    return (NV)tv.tv_sec + (NV)tv.tv_usec / 1e6;
+#else
+    return (NV)time(NULL);
+#endif
+}
+
+/* Count the varints at p, up to *n of them but not past end. Returns where
+ * the first one that was not counted starts, *n is how many are left. */
+SRL_STATIC_INLINE const U8 *
+srl_stats_skip_varints(const U8 *p, const U8 * const end, UV *n)
+{
+    UV left = *n;
+    while (left && p < end) {
+        if (!(*p++ & 0x80))
+            left--;
+    }
+    *n = left;
+    return p;
+}
+
+SRL_STATIC_INLINE const U8 *
+srl_stats_read_varint(const U8 *p, const U8 * const end, UV *value)
+{
+    UV uv = 0;
+    unsigned int shift = 0;
+    while (p < end && shift < sizeof(UV) * 8) {
+        const U8 c = *p++;
+        uv |= (UV)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            break;
+        shift += 7;
+    }
+    *value = uv;
+    return p;
+}
+
+/* Count the tags of a document body from p to end into stats. p has to be
+ * at the start of a tag, or of the items of a packed array if *packed is
+ * the number of these that are left. Returns where the tag after the last
+ * one counted starts, which is past end if the payload of that one (a
+ * string or packed floats) isn't all there, and sets *packed for the next
+ * part of the body. */
+SRL_STATIC_INLINE const U8 *
+srl_stats_scan(srl_stats_t *stats, const U8 *p, const U8 * const end, UV *packed)
+{
+    UV * const bytes = stats->bytes;
+
+    if (*packed) {
+        const U8 * const from = p;
+        p = srl_stats_skip_varints(p, end, packed);
+        bytes[SRL_STATS_INTEGER] += p - from;
+    }
+
+    while (p < end) {
+        const U8 * const tag_pos = p;
+        const U8 tag = *p++ & ~SRL_HDR_TRACK_FLAG;
+        U8 family;
+        UV n;
+
+        stats->tags[tag]++;
+        if (*tag_pos & SRL_HDR_TRACK_FLAG)
+            stats->tracked++;
+
+        if (tag <= SRL_HDR_NEG_HIGH) {
+            family = SRL_STATS_INTEGER;
+        }
+        else if (tag >= SRL_HDR_SHORT_BINARY_LOW) {
+            p += SRL_HDR_SHORT_BINARY_LEN_FROM_TAG(tag);
+            family = SRL_STATS_STRING;
+        }
+        else if (tag >= SRL_HDR_HASHREF_LOW) {
+            family = SRL_STATS_HASH;
+        }
+        else if (tag >= SRL_HDR_ARRAYREF_LOW) {
+            family = SRL_STATS_ARRAY;
+        }
+        else {
+            switch (tag) {
+            case SRL_HDR_VARINT:
+            case SRL_HDR_ZIGZAG:
+                p = srl_stats_read_varint(p, end, &n);
+                family = SRL_STATS_INTEGER;
+                break;
+            case SRL_HDR_FLOAT:       p += 4;  family = SRL_STATS_FLOAT; break;
+            case SRL_HDR_DOUBLE:      p += 8;  family = SRL_STATS_FLOAT; break;
+            case SRL_HDR_LONG_DOUBLE: p += 16; family = SRL_STATS_FLOAT; break;
+            case SRL_HDR_BINARY:
+            case SRL_HDR_STR_UTF8:
+                p = srl_stats_read_varint(p, end, &n);
+                p += n;
+                family = SRL_STATS_STRING;
+                break;
+            case SRL_HDR_REFN:
+            case SRL_HDR_WEAKEN:
+                family = SRL_STATS_REFERENCE;
+                break;
+            case SRL_HDR_REFP:
+                p = srl_stats_read_varint(p, end, &n);
+                family = SRL_STATS_REFERENCE;
+                break;
+            case SRL_HDR_COPY:
+            case SRL_HDR_ALIAS:
+                p = srl_stats_read_varint(p, end, &n);
+                family = SRL_STATS_COPY;
+                break;
+            case SRL_HDR_ARRAY:
+                p = srl_stats_read_varint(p, end, &n);
+                family = SRL_STATS_ARRAY;
+                break;
+            case SRL_HDR_HASH:
+                p = srl_stats_read_varint(p, end, &n);
+                family = SRL_STATS_HASH;
+                break;
+            case SRL_HDR_RECORDS:
+                p = srl_stats_read_varint(p, end, &n);
+                p = srl_stats_read_varint(p, end, &n);
+                family = SRL_STATS_HASH;
+                break;
+            case SRL_HDR_OBJECTV:
+            case SRL_HDR_OBJECTV_FREEZE:
+                p = srl_stats_read_varint(p, end, &n);
+                /* FALLTHROUGH */
+            case SRL_HDR_OBJECT:
+            case SRL_HDR_OBJECT_FREEZE:
+            case SRL_HDR_REGEXP:
+                family = SRL_STATS_OBJECT;
+                break;
+            case SRL_HDR_MANY: {
+                U8 type = 0;
+                p = srl_stats_read_varint(p, end, &n);
+                if (p < end)
+                    type = *p++;
+                bytes[SRL_STATS_ARRAY] += p - tag_pos;
+                if (type == SRL_HDR_FLOAT || type == SRL_HDR_DOUBLE) {
+                    const UV size = type == SRL_HDR_FLOAT ? 4 : 8;
+                    p += n * size;
+                    bytes[SRL_STATS_FLOAT] += n * size;
+                }
+                else {
+                    const U8 * const from = p;
+                    *packed = n;
+                    p = srl_stats_skip_varints(p, end, packed);
+                    bytes[SRL_STATS_INTEGER] += p - from;
+                }
+                continue;
+            }
+            case SRL_HDR_EXTEND:
+                p++;
+                /* FALLTHROUGH */
+            default:
+                family = SRL_STATS_OTHER;
+                break;
+            }
+        }
+        bytes[family] += p - tag_pos;
+    }
+
+    return p;
+}
+
+/* The name tags are reported under, the ones that hold a small number in
+ * the tag itself are counted together */
+SRL_STATIC_INLINE const char *
+srl_stats_tag_name(U8 tag)
+{
+    if (tag <= SRL_HDR_POS_HIGH)
+        return "POS";
+    if (tag <= SRL_HDR_NEG_HIGH)
+        return "NEG";
+    if (tag >= SRL_HDR_SHORT_BINARY_LOW)
+        return "SHORT_BINARY";
+    if (tag >= SRL_HDR_HASHREF_LOW)
+        return "HASHREF";
+    if (tag >= SRL_HDR_ARRAYREF_LOW)
+        return "ARRAYREF";
+    return SRL_TAG_NAME(tag);
+}
+
+SRL_STATIC_INLINE void
+srl_stats_add(pTHX_ HV *hv, const char *name, UV n)
+{
+    SV **svp = hv_fetch(hv, name, strlen(name), 1);
+    sv_setuv(*svp, (SvOK(*svp) ? SvUV(*svp) : 0) + n);
+}
+
+SRL_STATIC_INLINE NV
+srl_stats_ratio(UV part, UV whole)
+{
+    return whole ? (NV)part / (NV)whole : 0.0;
+}
+
+/* Fill in the counters both the encoder and the decoder have, the name of
+ * compress_time is the one it is reported under. */
+SRL_STATIC_INLINE void
+srl_stats_fill_hv(pTHX_ const srl_stats_t *stats, HV *hv, const char *compress_time)
+{
+    HV *tags = newHV();
+    HV *bytes = newHV();
+    UV body_bytes = 0;
+    int i;
+
+    hv_stores(hv, "documents", newSVuv(stats->documents));
+    for (i = 0; i < 128; i++) {
+        if (stats->tags[i])
+            srl_stats_add(aTHX_ tags, srl_stats_tag_name((U8)i), stats->tags[i]);
+    }
+    hv_stores(hv, "tags", newRV_noinc((SV *)tags));
+    hv_stores(hv, "tracked", newSVuv(stats->tracked));
+    for (i = 0; i < SRL_STATS_FAMILIES; i++) {
+        hv_store(bytes, srl_stats_family_name[i], strlen(srl_stats_family_name[i]),
+                 newSVuv(stats->bytes[i]), 0);
+        body_bytes += stats->bytes[i];
+    }
+    hv_stores(hv, "bytes", newRV_noinc((SV *)bytes));
+    hv_stores(hv, "body_bytes", newSVuv(body_bytes));
+    hv_stores(hv, "copy", newSVuv(stats->tags[SRL_HDR_COPY]));
+    hv_stores(hv, "refp", newSVuv(stats->tags[SRL_HDR_REFP]));
+    hv_stores(hv, "alias", newSVuv(stats->tags[SRL_HDR_ALIAS]));
+    hv_stores(hv, "compressed_documents", newSVuv(stats->compressed_documents));
+    hv_stores(hv, "compressed_bytes", newSVuv(stats->compressed_bytes));
+    hv_store(hv, compress_time, strlen(compress_time), newSVnv(stats->compress_time), 0);
+}
+
+/* tables->{name} = { size => ..., grows => ... } */
+SRL_STATIC_INLINE void
+srl_stats_table(pTHX_ HV *tables, const char *name, UV size, UV grows)
+{
+    HV *hv = newHV();
+    hv_stores(hv, "size", newSVuv(size));
+    hv_stores(hv, "grows", newSVuv(grows));
+    hv_store(tables, name, strlen(name), newRV_noinc((SV *)hv), 0);
+}
+
+#endif
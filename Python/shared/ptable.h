@@ -15,7 +15,11 @@
  */
 
 /*
- * This is a customized version of the pointer table implementation in sv.c
+ * This started out as a customized version of the pointer table
+ * implementation in sv.c. It is now an open addressing table with a flat
+ * entry array and linear probing, see Perl/shared/ptable.h for the details.
+ * Entries returned by PTABLE_find() and the iterator are only valid until
+ * the next PTABLE_store() or PTABLE_delete().
  */
 
 #ifndef PTABLE_H_
@@ -74,16 +78,23 @@
 
 #define PTABLE_HASH(ptr) ptr_hash(PTR2nat(ptr))
 
+/* a slot is in use if its generation is the one of the table */
+#define PTABLE_SLOT_USED(tbl, ent) ((ent)->gen == (tbl)->tbl_gen)
+
+/* grow once more than 3/4 of the slots are in use */
+#define PTABLE_FULL(tbl) ((tbl)->tbl_items >= (tbl)->tbl_max - ((tbl)->tbl_max >> 2))
+
 struct PTABLE_entry {
-    struct PTABLE_entry     *next;
     void                    *key;
     void                    *value;
+    U32                     gen;
 };
 
 struct PTABLE {
-    struct PTABLE_entry     **tbl_ary;
+    struct PTABLE_entry     *tbl_ary;
     UV                      tbl_max;
     UV                      tbl_items;
+    U32                     tbl_gen;  /* never 0, which marks never used slots */
 };
 
 struct PTABLE_iter {
@@ -122,25 +133,33 @@ STATIC PTABLE_t *
 PTABLE_new_size(const U8 size_base2_exponent)
 {
     PTABLE_t *tbl;
-    tbl = PyMem_Malloc(sizeof(*tbl));
-    tbl->tbl_max = (1 << size_base2_exponent) - 1;
+    if (!Newx(tbl, 1, PTABLE_t))
+        return NULL;
+    /* need at least a few slots for the load factor to make sense */
+    tbl->tbl_max = (1 << (size_base2_exponent < 3 ? 3 : size_base2_exponent)) - 1;
     tbl->tbl_items = 0;
-    if (!Newxz(tbl->tbl_ary, tbl->tbl_max + 1, PTABLE_ENTRY_t*))
+    tbl->tbl_gen = 1;
+    if (!Newxz(tbl->tbl_ary, tbl->tbl_max + 1, PTABLE_ENTRY_t)) {
+        Safefree(tbl);
         return NULL;
+    }
     return tbl;
 }
 
 /* map an existing pointer using a table */
 STATIC PTABLE_ENTRY_t *
 PTABLE_find(PTABLE_t *tbl, const void *key) {
-    PTABLE_ENTRY_t *tblent;
-    const UV hash = PTABLE_HASH(key);
-    tblent = tbl->tbl_ary[hash & tbl->tbl_max];
-    for (; tblent; tblent = tblent->next) {
+    PTABLE_ENTRY_t * const ary = tbl->tbl_ary;
+    const UV max = tbl->tbl_max;
+    UV i = PTABLE_HASH(key) & max;
+
+    for (;; i = (i + 1) & max) {
+        PTABLE_ENTRY_t *tblent = &ary[i];
+        if (!PTABLE_SLOT_USED(tbl, tblent))
+            return NULL;
         if (tblent->key == key)
             return tblent;
     }
-    return NULL;
 }
 
 SRL_STATIC_INLINE void *
@@ -155,88 +174,76 @@ PTABLE_fetch(PTABLE_t *tbl, const void *key)
 STATIC int
 PTABLE_store(PTABLE_t *tbl, void *key, void *value)
 {
-    PTABLE_ENTRY_t *tblent = PTABLE_find(tbl, key);
+    PTABLE_ENTRY_t *tblent;
+    UV max;
+    UV i;
 
-    if (tblent) {
-        tblent->value = value;
-    } else {
-        const UV entry = PTABLE_HASH(key) & tbl->tbl_max;
-        if (!Newx(tblent, 1, PTABLE_ENTRY_t))
+    if (PTABLE_FULL(tbl) && !PTABLE_find(tbl, key))
+        if (-1 == PTABLE_grow(tbl))
             return -1;
 
-        tblent->key = key;
-        tblent->value = value;
-        tblent->next = tbl->tbl_ary[entry];
-        tbl->tbl_ary[entry] = tblent;
-        tbl->tbl_items++;
-        if (tblent->next && (tbl->tbl_items > tbl->tbl_max))
-            if (-1 == PTABLE_grow(tbl))
-                return -1;
+    max = tbl->tbl_max;
+    for (i = PTABLE_HASH(key) & max;; i = (i + 1) & max) {
+        tblent = &tbl->tbl_ary[i];
+        if (!PTABLE_SLOT_USED(tbl, tblent)) {
+            tblent->key = key;
+            tblent->gen = tbl->tbl_gen;
+            tbl->tbl_items++;
+            break;
+        }
+        if (tblent->key == key)
+            break;
     }
+    tblent->value = value;
     return 0;
 }
 
-/* double the hash bucket size of an existing ptr table */
+/* double the size of an existing ptr table */
 
 STATIC int
 PTABLE_grow(PTABLE_t *tbl)
 {
-    PTABLE_ENTRY_t **ary = tbl->tbl_ary;
+    PTABLE_ENTRY_t *oldary = tbl->tbl_ary;
     const UV oldsize = tbl->tbl_max + 1;
-    UV newsize = oldsize * 2;
+    const U32 oldgen = tbl->tbl_gen;
+    const UV newmax = oldsize * 2 - 1;
+    PTABLE_ENTRY_t *ary;
     UV i;
 
-    if (!Renew(ary, newsize, PTABLE_ENTRY_t*))
+    if (!Newxz(ary, newmax + 1, PTABLE_ENTRY_t))
         return -1;
-    Zero(&ary[oldsize], newsize - oldsize, PTABLE_ENTRY_t*);
-    tbl->tbl_max = --newsize;
-    tbl->tbl_ary = ary;
 
-    for (i = 0; i < oldsize; i++, ary++) {
-        PTABLE_ENTRY_t **curentp, **entp, *ent;
-        if (!*ary)
+    for (i = 0; i < oldsize; i++) {
+        PTABLE_ENTRY_t *ent = &oldary[i];
+        UV j;
+        if (ent->gen != oldgen)
             continue;
-        curentp = ary + oldsize;
-        for (entp = ary, ent = *ary; ent; ent = *entp) {
-            if ((newsize & PTABLE_HASH(ent->key)) != i) {
-                *entp = ent->next;
-                ent->next = *curentp;
-                *curentp = ent;
-                continue;
-            } else {
-                entp = &ent->next;
-            }
-        }
+        j = PTABLE_HASH(ent->key) & newmax;
+        while (ary[j].gen)
+            j = (j + 1) & newmax;
+        ary[j].key = ent->key;
+        ary[j].value = ent->value;
+        ary[j].gen = 1;
     }
+
+    Safefree(oldary);
+    tbl->tbl_ary = ary;
+    tbl->tbl_max = newmax;
+    tbl->tbl_gen = 1;
     return 0;
 }
 
-/* remove all the entries from a ptr table */
+/* remove all the entries from a ptr table, in constant time */
 
 STATIC void
 PTABLE_clear(PTABLE_t *tbl)
 {
     if (tbl && tbl->tbl_items) {
-        register PTABLE_ENTRY_t * * const array = tbl->tbl_ary;
-        UV riter = tbl->tbl_max;
-
-        do {
-            PTABLE_ENTRY_t *entry = array[riter];
-
-            while (entry) {
-                PTABLE_ENTRY_t * const oentry = entry;
-                entry = entry->next;
-                Safefree(oentry);
-            }
-
-            /* chocolateboy 2008-01-08
-             *
-             * make sure we clear the array entry, so that subsequent probes fail
-             */
-
-            array[riter] = NULL;
-        } while (riter--);
-
+        if (++tbl->tbl_gen == 0) {
+            /* wrapped around, slots from 2**32 clears ago would look used */
+            Zero(tbl->tbl_ary, tbl->tbl_max + 1, PTABLE_ENTRY_t);
+            tbl->tbl_gen = 1;
+        }
         tbl->tbl_items = 0;
     }
 }
@@ -246,30 +253,32 @@ PTABLE_clear(PTABLE_t *tbl)
 STATIC void
 PTABLE_delete(PTABLE_t *tbl, void *key)
 {
-    PTABLE_ENTRY_t *tblent;
-    PTABLE_ENTRY_t *tblent_prev;
+    PTABLE_ENTRY_t *ary;
+    UV max;
+    UV i, j;
 
-    if (!tbl || !tbl->tbl_items) {
+    if (!tbl || !tbl->tbl_items)
         return;
-    } else {
-        const UV hash = PTABLE_HASH(key);
-        tblent_prev = NULL;
-        tblent = tbl->tbl_ary[hash & tbl->tbl_max];
-
-        for (; tblent; tblent_prev = tblent, tblent = tblent->next) {
-            if (tblent->key == key) {
-                if (tblent_prev != NULL) {
-                    tblent_prev->next = tblent->next;
-                }
-                else {
-                    /* First entry in chain */
-                    tbl->tbl_ary[hash & tbl->tbl_max] = tblent->next;
-                }
-                Safefree(tblent);
-                break;
-            }
+
+    ary = tbl->tbl_ary;
+    max = tbl->tbl_max;
+    for (i = PTABLE_HASH(key) & max;; i = (i + 1) & max) {
+        if (!PTABLE_SLOT_USED(tbl, &ary[i]))
+            return;
+        if (ary[i].key == key)
+            break;
+    }
+
+    /* shift back the following entries whose probe sequence runs through the hole */
+    for (j = (i + 1) & max; PTABLE_SLOT_USED(tbl, &ary[j]); j = (j + 1) & max) {
+        const UV home = PTABLE_HASH(ary[j].key) & max;
+        if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+            ary[i] = ary[j];
+            i = j;
         }
     }
+    ary[i].gen = 0;
+    tbl->tbl_items--;
 }
 
 /* clear and free a ptr table */
@@ -280,7 +289,6 @@ PTABLE_free(PTABLE_t *tbl)
     if (!tbl) {
         return;
     }
-    PTABLE_clear(tbl);
     Safefree(tbl->tbl_ary);
     Safefree(tbl);
 }
@@ -288,17 +296,13 @@ PTABLE_free(PTABLE_t *tbl)
 
 #define PTABLE_ITER_NEXT_ELEM(iter, tbl)                                    \
     STMT_START {                                                            \
-        if ((iter)->cur_entry && (iter)->cur_entry->next) {                 \
-            (iter)->cur_entry = (iter)->cur_entry->next;                    \
-        }                                                                   \
-        else {                                                              \
-            do {                                                            \
-                if ((iter)->bucket_num > (tbl)->tbl_max) {                  \
-                    (iter)->cur_entry = NULL;                               \
-                    break;                                                  \
-                }                                                           \
-                (iter)->cur_entry = (tbl)->tbl_ary[(iter)->bucket_num++];   \
-            } while ((iter)->cur_entry == NULL);                            \
+        (iter)->cur_entry = NULL;                                           \
+        while ((iter)->bucket_num <= (tbl)->tbl_max) {                      \
+            PTABLE_ENTRY_t *ent_ = &(tbl)->tbl_ary[(iter)->bucket_num++];   \
+            if (PTABLE_SLOT_USED(tbl, ent_)) {                              \
+                (iter)->cur_entry = ent_;                                   \
+                break;                                                      \
+            }                                                               \
         }                                                                   \
     } STMT_END
 